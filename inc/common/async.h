@@ -18,23 +18,24 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 
-#if USE_CLIENT
-
-typedef struct asyncwork_s {
-    void (*work_cb)(void *);
-    void (*done_cb)(void *);
+typedef enum {
+    ASYNC_PRIO_LOW = -1,
+    ASYNC_PRIO_NORMAL,      // zero, so that it's default
+    ASYNC_PRIO_HIGH
+} asyncprio_t;
+
+typedef struct {
+    void (*work_cb)(void *);    // called from worker thread
+    void (*done_cb)(void *);    // called from main thread
     void *cb_arg;
-    struct asyncwork_s *next;
+    asyncprio_t priority;
 } asyncwork_t;
 
-void Com_QueueAsyncWork(asyncwork_t *work);
+// zero is never returned for valid work
+typedef uint64_t asynchandle_t;
+
+void Com_InitAsyncWork(void);
+asynchandle_t Com_QueueAsyncWork(const asyncwork_t *work);
+void Com_WaitAsyncWork(asynchandle_t handle);
 void Com_CompleteAsyncWork(void);
 void Com_ShutdownAsyncWork(void);
-
-#else
-
-#define Com_QueueAsyncWork(work)    (void)0
-#define Com_CompleteAsyncWork()     (void)0
-#define Com_ShutdownAsyncWork()     (void)0
-
-#endif
@@ -161,7 +161,6 @@ typedef struct {
     int                 contents;
     int                 numsides;
     mbrushside_t        *firstbrushside;
-    unsigned            checkcount;         // to avoid repeated testings
 } mbrush_t;
 
 typedef struct {
@@ -331,6 +330,8 @@ mmodel_t *BSP_InlineModel(bsp_t *bsp, const char *name);
 
 byte* BSP_GetPvs(bsp_t *bsp, int cluster);
 byte* BSP_GetPvs2(bsp_t *bsp, int cluster);
+void BSP_BuildPvs2Matrix(bsp_t *bsp);
+void BSP_RebuildPvsMatrix(bsp_t *bsp);
 
 bool BSP_SavePatchedPVS(bsp_t *bsp);
 
@@ -34,6 +34,40 @@ typedef struct {
     char        *entitystring;
 } cm_t;
 
+// box clipping hull, can be private to a trace context
+typedef struct {
+    cplane_t        planes[12];
+    mnode_t         nodes[6];
+    mbrush_t        brush;
+    mbrush_t        *leafbrush;
+    mbrushside_t    brushsides[6];
+    mleaf_t         leaf;
+    mleaf_t         emptyleaf;
+} cm_boxhull_t;
+
+#define CM_TRACE_CHECKED    128     // must be power of two
+
+// per-caller box trace state. CM_BoxTraceEx and friends touch no global
+// state, so different threads may trace concurrently as long as each one
+// uses its own context. Must be initialized with CM_InitTraceContext.
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      offsets[8];
+    vec3_t      extents;
+    trace_t     *trace;
+    int         contents;
+    bool        ispoint;        // optimized case
+
+    // to avoid repeated testings of brushes shared by several leafs
+    unsigned    checkcount;
+    struct {
+        const mbrush_t  *brush;
+        unsigned        checkcount;
+    } checked[CM_TRACE_CHECKED];
+
+    cm_boxhull_t    box;
+} cm_trace_t;
+
 void        CM_Init(void);
 
 void        CM_FreeMap(cm_t *cm);
@@ -52,6 +86,7 @@ mleaf_t     *CM_LeafNum(cm_t *cm, int number);
 
 // creates a clipping hull for an arbitrary box
 mnode_t     *CM_HeadnodeForBox(const vec3_t mins, const vec3_t maxs);
+mnode_t     *CM_HeadnodeForBoxEx(cm_trace_t *ctx, const vec3_t mins, const vec3_t maxs);
 
 // returns an ORed contents mask
 int         CM_PointContents(const vec3_t p, mnode_t *headnode);
@@ -69,12 +104,27 @@ void        CM_TransformedBoxTrace(trace_t *trace,
                                    const vec3_t origin, const vec3_t angles);
 void        CM_ClipEntity(trace_t *dst, const trace_t *src, struct edict_s *ent);
 
+// reentrant versions of the above
+void        CM_InitTraceContext(cm_trace_t *ctx);
+void        CM_BoxTraceEx(cm_trace_t *ctx, trace_t *trace,
+                          const vec3_t start, const vec3_t end,
+                          const vec3_t mins, const vec3_t maxs,
+                          mnode_t *headnode, int brushmask);
+void        CM_TransformedBoxTraceEx(cm_trace_t *ctx, trace_t *trace,
+                                     const vec3_t start, const vec3_t end,
+                                     const vec3_t mins, const vec3_t maxs,
+                                     mnode_t *headnode, int brushmask,
+                                     const vec3_t origin, const vec3_t angles);
+
 // call with topnode set to the headnode, returns with topnode
 // set to the first node that splits the box
 int         CM_BoxLeafs(cm_t *cm, const vec3_t mins, const vec3_t maxs,
                         mleaf_t **list, int listsize, mnode_t **topnode);
 mleaf_t     *CM_PointLeaf(cm_t *cm, const vec3_t p);
 
+#define CM_MAX_FATCLUSTERS  64
+
+int         CM_FatClusters(cm_t *cm, const vec3_t org, int *clusters);
 byte        *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org, int vis);
 
 void        CM_SetAreaPortalState(cm_t *cm, int portalnum, bool open);
@@ -83,7 +133,7 @@ bool        CM_AreasConnected(cm_t *cm, int area1, int area2);
 int         CM_WriteAreaBits(cm_t *cm, byte *buffer, int area);
 int         CM_WritePortalBits(cm_t *cm, byte *buffer);
 void        CM_SetPortalStates(cm_t *cm, byte *buffer, int bytes);
-bool        CM_HeadnodeVisible(mnode_t *headnode, byte *visbits);
+bool        CM_HeadnodeVisible(mnode_t *headnode, const byte *visbits);
 
 void        CM_WritePortalState(cm_t *cm, qhandle_t f);
 void        CM_ReadPortalState(cm_t *cm, qhandle_t f);
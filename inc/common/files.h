@@ -42,7 +42,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define FS_LoadFile(path, buf)  FS_LoadFileEx(path, buf, 0, TAG_FILESYSTEM)
 #define FS_LoadFileFlags(path, buf, flags)  \
                                 FS_LoadFileEx(path, buf, (flags), TAG_FILESYSTEM)
-#define FS_FreeFile(buf)        Z_Free(buf)
 
 // just regular malloc for now
 #define FS_AllocTempMem(size)   FS_Malloc(size)
@@ -65,6 +64,7 @@ int FS_RenameFile(const char *from, const char *to);
 #endif
 
 int FS_CreatePath(char *path);
+void FS_IndexFile(const char *fullpath);
 
 char    *FS_CopyExtraInfo(const char *name, const file_info_t *info);
 
@@ -81,6 +81,17 @@ qhandle_t FS_EasyOpenFile(char *buf, size_t size, unsigned mode,
 int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag);
 // a NULL buffer will just return the file length without loading
 // length < 0 indicates error
+void FS_FreeFile(void *buf);
+
+#if USE_ZLIB
+bool FS_BeginPrefetch(const char *name);
+int64_t FS_PrefetchFile(const char *path);
+void FS_EndPrefetch(void);
+#else
+#define FS_BeginPrefetch(name)  false
+#define FS_PrefetchFile(path)   Q_ERR(ENOSYS)
+#define FS_EndPrefetch()        (void)0
+#endif
 
 int FS_WriteFile(const char *path, const void *data, size_t len);
 
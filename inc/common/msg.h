@@ -87,7 +87,7 @@ typedef enum {
     MSG_ES_REMOVE       = BIT(8),   // entity is removed (MVD stream only)
 } msgEsFlags_t;
 
-extern sizebuf_t    msg_write;
+extern q_thread_local sizebuf_t msg_write;
 extern byte         msg_write_buffer[MAX_MSGLEN];
 
 extern sizebuf_t    msg_read;
@@ -117,6 +117,9 @@ int     MSG_WriteDeltaUsercmd_Enhanced(const usercmd_t *from, const usercmd_t *c
 void    MSG_WriteDir(const vec3_t vector);
 void    MSG_PackEntity(entity_packed_t *out, const entity_state_t *in, const entity_state_extension_t *ext);
 void    MSG_WriteDeltaEntity(const entity_packed_t *from, const entity_packed_t *to, msgEsFlags_t flags);
+#if USE_TESTS
+void    MSG_WriteDeltaEntityScalar(const entity_packed_t *from, const entity_packed_t *to, msgEsFlags_t flags);
+#endif
 void    MSG_PackPlayer(player_packed_t *out, const player_state_t *in);
 void    MSG_WriteDeltaPlayerstate_Default(const player_packed_t *from, const player_packed_t *to, msgPsFlags_t flags);
 int     MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t *from, player_packed_t *to, msgPsFlags_t flags);
@@ -97,6 +97,7 @@ typedef struct netstream_s {
     netstate_t state;
     fifo_t recv;
     fifo_t send;
+    size_t sent;    // by NET_SendStream, not yet in statistics
 } netstream_t;
 
 static inline bool NET_IsEqualAdr(const netadr_t *a, const netadr_t *b)
@@ -195,6 +196,8 @@ bool        NET_GetAddress(netsrc_t sock, netadr_t *adr);
 void        NET_GetPackets(netsrc_t sock, void (*packet_cb)(void));
 bool        NET_SendPacket(netsrc_t sock, const void *data,
                            size_t len, const netadr_t *to);
+void        NET_BeginSendBatch(netsrc_t sock);
+void        NET_FlushSendBatch(netsrc_t sock);
 
 char        *NET_AdrToString(const netadr_t *a);
 bool        NET_StringToAdr(const char *s, netadr_t *a, int default_port);
@@ -211,6 +214,7 @@ neterr_t    NET_Accept(netstream_t *s);
 neterr_t    NET_Connect(const netadr_t *peer, netstream_t *s);
 neterr_t    NET_RunConnect(netstream_t *s);
 neterr_t    NET_RunStream(netstream_t *s);
+neterr_t    NET_SendStream(netstream_t *s);
 void        NET_UpdateStream(netstream_t *s);
 
 struct pollfd   *NET_AllocPollFd(void);
@@ -0,0 +1,50 @@
+/*
+Copyright (C) 2026 Q2RTX contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+//
+// Frame profiler. Time spent between Prof_Begin() and Prof_End() is summed
+// per zone, and Prof_EndFrame() pushes the sums into a ring of per-frame
+// samples. Does nothing unless com_profile is set. Main thread only.
+//
+
+typedef enum {
+    PROF_SV_FRAME,      // whole server frame
+    PROF_SV_PACKETS,    // reading UDP packets
+    PROF_SV_GTV,        // GTV client connections
+    PROF_SV_GAME,       // game library RunFrame()
+    PROF_SV_MVD,        // MVD frame encoding
+    PROF_SV_SEND,       // sending frames to clients
+    PROF_SV_BUILD,      // building client frames
+    PROF_SV_WRITE,      // writing client datagrams
+    PROF_SV_WAIT,       // waiting for frames built by send threads
+
+    PROF_NUM_STATIC     // more zones can be registered by name
+} profzone_t;
+
+#define PROF_MAX_ZONES      32
+#define PROF_SAMPLES        1024
+
+void        Prof_Init(void);
+int         Prof_Register(const char *name);
+uint64_t    Prof_Begin(void);
+void        Prof_End(int zone, uint64_t start);
+void        Prof_EndFrame(void);
+void        Prof_Reset(void);
+void        Prof_PrintStats(void);
@@ -54,6 +54,28 @@ char    *Z_TagCopyString(const char *in, memtag_t tag) q_malloc;
 void    Z_FreeTags(memtag_t tag);
 void    Z_LeakTest(memtag_t tag);
 void    Z_Stats_f(void);
+void    Z_SlabStats_f(void);
+
+#if USE_TESTS
+typedef enum {
+    ZTRACE_ALLOC,
+    ZTRACE_FREE,
+    ZTRACE_REALLOC
+} ztraceop_t;
+
+// one recorded allocator call, pointers are only used as identifiers
+typedef struct {
+    uint8_t     op;
+    uint16_t    tag;
+    uint32_t    size;
+    uint64_t    ptr;
+    uint64_t    old;
+} ztrace_t;
+
+void    Z_SetSlabsEnabled(bool enable);
+void    Z_StartTrace(void);
+const ztrace_t *Z_StopTrace(size_t *count);
+#endif
 
 // may return pointer to static memory
 char    *Z_CvarCopyString(const char *in);
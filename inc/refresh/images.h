@@ -110,6 +110,8 @@ extern uint32_t d_8to24table[256];
 void IMG_ReloadAll(void);
 image_t *IMG_Find(const char *name, imagetype_t type, imageflags_t flags);
 image_t *IMG_FindExisting(const char *name, imagetype_t type);
+void IMG_Prefetch(const char *name, imagetype_t type, imageflags_t flags);
+void IMG_EndPrefetch(void);
 image_t *IMG_Clone(image_t *image, const char* new_name);
 void IMG_FreeUnused(void);
 void IMG_FreeAll(void);
@@ -122,8 +124,8 @@ image_t *IMG_ForHandle(qhandle_t h);
 int IMG_GetDimensions(const char* name, int16_t* width, int16_t* height);
 
 void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
-                         byte *out, int outwidth, int outheight);
-void IMG_MipMap(byte *out, byte *in, int width, int height);
+                         byte *out, int outwidth, int outheight, bool linear);
+void IMG_MipMap(byte *out, byte *in, int width, int height, bool linear);
 
 // these are implemented in src/refresh/[gl,sw]/images.c
 extern void (*IMG_Unload)(image_t *image);
@@ -277,7 +277,15 @@ typedef game_export_t *(*game_entry_t)(game_import_t *);
  * game_export_ex_t structures, provided GAME_API_VERSION_EX is also bumped.
  */
 
-#define GAME_API_VERSION_EX     1
+#define GAME_API_VERSION_EX     5
+
+// single request for TraceBatch()
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      mins, maxs;
+    edict_t     *passent;
+    int         contentmask;
+} tracereq_t;
 
 typedef struct {
     int     apiversion;
@@ -298,12 +306,29 @@ typedef struct {
 
     const char *(*ErrorString)(int error);
     void    *(*TagRealloc)(void *ptr, size_t size);
+
+    // equivalent to calling trace() for each request in order, but
+    // shares entity area queries between requests with overlapping bounds
+    void    (*TraceBatch)(const tracereq_t *reqs, trace_t *results, int count);
+
+    // copies data and writes it to path later from a background thread,
+    // gzip compressed if requested. intended for WriteGame() and WriteLevel()
+    void    (*WriteFileAsync)(const char *path, const void *data, size_t len, bool compress);
+
+    // server frame profiler zones, shown by prof_stats. ProfBegin() returns
+    // 0 when profiling is off, making ProfEnd() a no-op
+    int         (*ProfRegister)(const char *name);
+    uint64_t    (*ProfBegin)(void);
+    void        (*ProfEnd)(int zone, uint64_t start);
 } game_import_ex_t;
 
 typedef struct {
     int     apiversion;
 
     void    (*RestartFilesystem)(void); // called when fs_restart is issued
+
+    // reseeds game random number generator, makes benchmarks repeatable
+    void    (*SeedRandom)(uint32_t seed);
 } game_export_ex_t;
 
 typedef const game_export_ex_t *(*game_entry_ex_t)(const game_import_ex_t *);
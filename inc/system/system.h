@@ -34,6 +34,7 @@ void    Sys_FreeLibrary(void *handle);
 void    *Sys_GetProcAddress(void *handle, const char *sym);
 
 unsigned Sys_Milliseconds(void);
+uint64_t Sys_Microseconds(void);
 void     Sys_Sleep(int msec);
 
 void    Sys_Init(void);
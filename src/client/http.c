@@ -861,6 +861,8 @@ fail2:
             if (rename(dl->path, temp))
                 Com_EPrintf("[HTTP] Failed to rename '%s' to '%s': %s\n",
                             dl->path, dl->queue->path, strerror(errno));
+            else
+                FS_IndexFile(temp);
             dl->path[0] = 0;
 
             //a pak file is very special...
@@ -334,6 +334,108 @@ static qhandle_t CL_RegisterImage(const char *s)
     return R_RegisterPic2(s);
 }
 
+/*
+=================
+CL_PrefetchImage
+
+Follows renderer image search order and prefetches the first file found.
+=================
+*/
+static void CL_PrefetchImage(const char *base, const char *ext)
+{
+    char buffer[MAX_QPATH];
+    cvar_t *var;
+    const char *s;
+    bool native_first;
+
+    var = Cvar_FindVar("r_override_textures");
+    native_first = var && var->integer < 1;
+
+    if (native_first && Q_concat(buffer, sizeof(buffer), base, ext) < sizeof(buffer))
+        if (FS_PrefetchFile(buffer) >= 0)
+            return;
+
+    var = Cvar_FindVar("r_texture_formats");
+    for (s = var ? var->string : "pjt"; *s; s++) {
+        switch (Q_tolower(*s)) {
+            case 'p': ext = ".png"; break;
+            case 'j': ext = ".jpg"; break;
+            case 't': ext = ".tga"; break;
+            default: continue;
+        }
+        if (Q_concat(buffer, sizeof(buffer), base, ext) >= sizeof(buffer))
+            return;
+        if (FS_PrefetchFile(buffer) >= 0)
+            return;
+    }
+
+    if (!native_first && Q_concat(buffer, sizeof(buffer), base, ext) < sizeof(buffer))
+        FS_PrefetchFile(buffer);
+}
+
+/*
+=================
+CL_PrefetchFiles
+
+Lets deflated map textures, models and pics be decompressed in background
+while registration is in progress.
+=================
+*/
+static void CL_PrefetchFiles(void)
+{
+    char buffer[MAX_QPATH];
+    const char *name;
+    int i;
+
+    if (!cl.bsp || !FS_BeginPrefetch(cl.mapname))
+        return;
+
+    for (i = 0; i < cl.bsp->numtexinfo; i++) {
+        name = cl.bsp->texinfo[i].name;
+        if (Q_concat(buffer, sizeof(buffer), "textures/", name) >= sizeof(buffer) - 8)
+            continue;
+        CL_PrefetchImage(buffer, ".wal");
+        if (cls.ref_type == REF_TYPE_VKPT) {
+            // material normal and emissive maps
+            Q_strlcat(buffer, "_n", sizeof(buffer));
+            CL_PrefetchImage(buffer, ".tga");
+            buffer[strlen(buffer) - 2] = 0;
+            Q_strlcat(buffer, "_light", sizeof(buffer));
+            CL_PrefetchImage(buffer, ".tga");
+        }
+    }
+
+    for (i = 2; i < cl.csr.max_models; i++) {
+        name = cl.configstrings[cl.csr.models + i];
+        if (!name[0]) {
+            break;
+        }
+        if (name[0] == '#' || name[0] == '*') {
+            continue;
+        }
+        // vkpt prefers MD3 replacements of MD2 models
+        if (cls.ref_type == REF_TYPE_VKPT && !COM_CompareExtension(name, ".md2") &&
+            COM_StripExtension(buffer, name, sizeof(buffer)) < sizeof(buffer) - 4) {
+            Q_strlcat(buffer, ".md3", sizeof(buffer));
+            if (FS_PrefetchFile(buffer) >= 0)
+                continue;
+        }
+        FS_PrefetchFile(name);
+    }
+
+    for (i = 1; i < cl.csr.max_images; i++) {
+        name = cl.configstrings[cl.csr.images + i];
+        if (!name[0]) {
+            break;
+        }
+        if (name[0] == '/' || name[0] == '\\' || *COM_FileExtension(name)) {
+            continue;
+        }
+        if (Q_concat(buffer, sizeof(buffer), "pics/", name) < sizeof(buffer))
+            CL_PrefetchImage(buffer, ".pcx");
+    }
+}
+
 /*
 =================
 CL_PrepRefresh
@@ -351,6 +453,8 @@ void CL_PrepRefresh(void)
     if (!cl.mapname[0])
         return;     // no map loaded
 
+    CL_PrefetchFiles();
+
     // register models, pics, and skins
     R_BeginRegistration(cl.mapname);
 
@@ -406,6 +510,8 @@ void CL_PrepRefresh(void)
     // the renderer can now free unneeded stuff
     R_EndRegistration();
 
+    FS_EndPrefetch();
+
     // clear any lines of console text
     Con_ClearNotify_f();
 
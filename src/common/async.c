@@ -17,89 +17,342 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "shared/shared.h"
+#include "shared/list.h"
 #include "common/async.h"
+#include "common/cmd.h"
+#include "common/common.h"
+#include "common/cvar.h"
 #include "common/zone.h"
 #include "system/pthread.h"
+#include "system/system.h"
 
-static bool work_initialized;
-static bool work_terminate;
-static pthread_mutex_t work_lock;
-static pthread_cond_t work_cond;
-static pthread_t work_thread;
-static asyncwork_t *pend_head;
-static asyncwork_t *done_head;
+#define MAX_ASYNC_THREADS   16
 
-static void append_work(asyncwork_t **head, asyncwork_t *work)
+#define ASYNC_PRIO_COUNT    (ASYNC_PRIO_HIGH - ASYNC_PRIO_LOW + 1)
+
+// jobs are allocated in chunks and recycled, never freed until shutdown
+#define JOB_CHUNK           64
+
+typedef enum {
+    JOB_FREE,
+    JOB_PENDING,    // in one of pend_lists
+    JOB_RUNNING,    // work_cb is executing
+    JOB_DONE,       // in done_list
+    JOB_RETIRING    // done_cb is executing
+} jobstate_t;
+
+typedef struct {
+    list_t          entry;
+    asyncwork_t     work;
+    jobstate_t      state;
+    unsigned        index;      // in job_table
+    unsigned        serial;     // unique for each queued work
+    unsigned        queued;     // time work was queued
+} asyncjob_t;
+
+typedef struct {
+    uint64_t    queued;
+    uint64_t    completed;
+    uint64_t    wait_msec;
+    uint64_t    run_msec;
+    unsigned    max_wait;
+    unsigned    max_run;
+    int         depth;
+    int         max_depth;
+} asyncstats_t;
+
+static cvar_t           *com_async_threads;
+
+static bool             work_initialized;
+static bool             work_terminate;
+static pthread_mutex_t  work_lock;
+static pthread_cond_t   work_cond;
+static pthread_cond_t   done_cond;
+static pthread_t        work_threads[MAX_ASYNC_THREADS];
+static int              num_work_threads;
+
+static list_t           pend_lists[ASYNC_PRIO_COUNT];
+static list_t           done_list;
+static list_t           free_list;
+
+static asyncjob_t       **job_table;
+static unsigned         num_jobs;
+static unsigned         job_serial;
+
+static asyncstats_t     work_stats[ASYNC_PRIO_COUNT];
+
+static asyncjob_t *alloc_job(void)
 {
-    asyncwork_t *c, **p;
-    for (p = head, c = *head; c; p = &c->next, c = c->next)
-        ;
-    work->next = NULL;
-    *p = work;
+    asyncjob_t *job;
+    int i;
+
+    if (LIST_EMPTY(&free_list)) {
+        job = Z_Mallocz(sizeof(*job) * JOB_CHUNK);
+        job_table = Z_Realloc(job_table, sizeof(job_table[0]) * (num_jobs + JOB_CHUNK));
+        for (i = 0; i < JOB_CHUNK; i++, job++) {
+            job->index = num_jobs;
+            job_table[num_jobs++] = job;
+            List_Append(&free_list, &job->entry);
+        }
+    }
+
+    job = LIST_FIRST(asyncjob_t, &free_list, entry);
+    List_Remove(&job->entry);
+
+    // invalidates any stale handles
+    if (!++job_serial)
+        job_serial++;
+    job->serial = job_serial;
+
+    return job;
+}
+
+static void free_job(asyncjob_t *job)
+{
+    job->state = JOB_FREE;
+    List_Insert(&free_list, &job->entry);
+}
+
+static asyncjob_t *pop_job(void)
+{
+    asyncjob_t *job;
+    int i;
+
+    for (i = ASYNC_PRIO_COUNT - 1; i >= 0; i--) {
+        if (!LIST_EMPTY(&pend_lists[i])) {
+            job = LIST_FIRST(asyncjob_t, &pend_lists[i], entry);
+            List_Remove(&job->entry);
+            work_stats[i].depth--;
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+// called and returns with work_lock held
+static void run_job(asyncjob_t *job)
+{
+    asyncstats_t *s = &work_stats[job->work.priority - ASYNC_PRIO_LOW];
+    unsigned start, wait, run;
+
+    job->state = JOB_RUNNING;
+    start = Sys_Milliseconds();
+
+    pthread_mutex_unlock(&work_lock);
+    job->work.work_cb(job->work.cb_arg);
+    pthread_mutex_lock(&work_lock);
+
+    run = Sys_Milliseconds() - start;
+    wait = start - job->queued;
+
+    s->completed++;
+    s->wait_msec += wait;
+    s->run_msec += run;
+    s->max_wait = max(s->max_wait, wait);
+    s->max_run = max(s->max_run, run);
+
+    job->state = JOB_DONE;
+    List_Append(&done_list, &job->entry);
+    pthread_cond_broadcast(&done_cond);
 }
 
 static void *work_func(void *arg)
 {
+    asyncjob_t *job;
+
     pthread_mutex_lock(&work_lock);
     while (1) {
-        while (!pend_head && !work_terminate)
+        while (!(job = pop_job()) && !work_terminate)
             pthread_cond_wait(&work_cond, &work_lock);
 
-        asyncwork_t *work = pend_head;
-        if (!work)
+        // pending work is drained before exiting
+        if (!job)
             break;
-        pend_head = work->next;
-
-        pthread_mutex_unlock(&work_lock);
-        work->work_cb(work->cb_arg);
-        pthread_mutex_lock(&work_lock);
 
-        append_work(&done_head, work);
+        run_job(job);
     }
     pthread_mutex_unlock(&work_lock);
 
     return NULL;
 }
 
-void Com_QueueAsyncWork(asyncwork_t *work)
+static void start_work_threads(void)
 {
-    if (!work_initialized) {
-        pthread_mutex_init(&work_lock, NULL);
-        pthread_cond_init(&work_cond, NULL);
-        if (pthread_create(&work_thread, NULL, work_func, NULL))
-            Com_Error(ERR_FATAL, "Couldn't create async work thread");
-        work_initialized = true;
-    }
+    int i, count;
+
+    for (i = 0; i < ASYNC_PRIO_COUNT; i++)
+        List_Init(&pend_lists[i]);
+    List_Init(&done_list);
+    List_Init(&free_list);
+
+    pthread_mutex_init(&work_lock, NULL);
+    pthread_cond_init(&work_cond, NULL);
+    pthread_cond_init(&done_cond, NULL);
+
+    count = Q_clip(com_async_threads->integer, 1, MAX_ASYNC_THREADS);
+    for (i = 0; i < count; i++)
+        if (pthread_create(&work_threads[i], NULL, work_func, NULL))
+            break;
+
+    if (!i)
+        Com_Error(ERR_FATAL, "Couldn't create async work thread");
+    if (i < count)
+        Com_WPrintf("Created only %d of %d async work threads\n", i, count);
+
+    num_work_threads = i;
+    work_initialized = true;
+}
+
+/*
+=================
+Com_QueueAsyncWork
+
+Copies work description and schedules it for execution on the worker pool.
+Work of higher priority is started first, work of equal priority is started
+in the order it was queued. Returned handle can be passed to
+Com_WaitAsyncWork.
+=================
+*/
+asynchandle_t Com_QueueAsyncWork(const asyncwork_t *work)
+{
+    asyncjob_t *job;
+    asyncstats_t *s;
+    asynchandle_t handle;
+    int prio;
+
+    if (!work_initialized)
+        start_work_threads();
+
+    prio = Q_clip(work->priority, ASYNC_PRIO_LOW, ASYNC_PRIO_HIGH);
+    s = &work_stats[prio - ASYNC_PRIO_LOW];
 
     pthread_mutex_lock(&work_lock);
-    append_work(&pend_head, Z_CopyStruct(work));
+
+    job = alloc_job();
+    job->work = *work;
+    job->work.priority = prio;
+    job->state = JOB_PENDING;
+    job->queued = Sys_Milliseconds();
+    List_Append(&pend_lists[prio - ASYNC_PRIO_LOW], &job->entry);
+
+    s->queued++;
+    s->depth++;
+    s->max_depth = max(s->max_depth, s->depth);
+
+    handle = (uint64_t)job->serial << 32 | job->index;
+
     pthread_mutex_unlock(&work_lock);
 
     pthread_cond_signal(&work_cond);
+
+    return handle;
+}
+
+/*
+=================
+Com_WaitAsyncWork
+
+Blocks until the given work is finished and runs its completion callback.
+Work not yet picked up by the pool is executed on the calling thread.
+Returns immediately if work has already been completed.
+=================
+*/
+void Com_WaitAsyncWork(asynchandle_t handle)
+{
+    unsigned index = handle & UINT32_MAX;
+    unsigned serial = handle >> 32;
+    asyncjob_t *job;
+
+    if (!work_initialized || !serial)
+        return;
+
+    pthread_mutex_lock(&work_lock);
+
+    if (index >= num_jobs)
+        goto unlock;
+
+    job = job_table[index];
+    if (job->serial != serial)
+        goto unlock;
+
+    if (job->state == JOB_PENDING) {
+        List_Remove(&job->entry);
+        work_stats[job->work.priority - ASYNC_PRIO_LOW].depth--;
+        run_job(job);
+    }
+
+    while (job->serial == serial && job->state == JOB_RUNNING)
+        pthread_cond_wait(&done_cond, &work_lock);
+
+    if (job->serial == serial && job->state == JOB_DONE) {
+        List_Remove(&job->entry);
+        job->state = JOB_RETIRING;
+        pthread_mutex_unlock(&work_lock);
+
+        if (job->work.done_cb)
+            job->work.done_cb(job->work.cb_arg);
+
+        pthread_mutex_lock(&work_lock);
+        free_job(job);
+    }
+
+unlock:
+    pthread_mutex_unlock(&work_lock);
 }
 
+/*
+=================
+Com_CompleteAsyncWork
+
+Runs completion callbacks for finished work. Called once per frame.
+=================
+*/
 void Com_CompleteAsyncWork(void)
 {
-    asyncwork_t *work, *next;
+    asyncjob_t *job, *next;
+    list_t retiring;
 
     if (!work_initialized)
         return;
     if (pthread_mutex_trylock(&work_lock))
         return;
-    if (q_unlikely(done_head)) {
-        for (work = done_head; work; work = next) {
-            next = work->next;
-            if (work->done_cb)
-                work->done_cb(work->cb_arg);
-            Z_Free(work);
-        }
-        done_head = NULL;
+    if (q_likely(LIST_EMPTY(&done_list))) {
+        pthread_mutex_unlock(&work_lock);
+        return;
     }
+
+    // take over the whole list so that callbacks run unlocked
+    retiring = done_list;
+    List_Relink(&retiring);
+    List_Init(&done_list);
+
+    LIST_FOR_EACH(asyncjob_t, job, &retiring, entry)
+        job->state = JOB_RETIRING;
+
+    pthread_mutex_unlock(&work_lock);
+
+    LIST_FOR_EACH(asyncjob_t, job, &retiring, entry)
+        if (job->work.done_cb)
+            job->work.done_cb(job->work.cb_arg);
+
+    pthread_mutex_lock(&work_lock);
+    LIST_FOR_EACH_SAFE(asyncjob_t, job, next, &retiring, entry)
+        free_job(job);
     pthread_mutex_unlock(&work_lock);
 }
 
+/*
+=================
+Com_ShutdownAsyncWork
+
+Finishes all queued work and stops the worker threads.
+=================
+*/
 void Com_ShutdownAsyncWork(void)
 {
+    int i;
+
     if (!work_initialized)
         return;
 
@@ -107,12 +360,76 @@ void Com_ShutdownAsyncWork(void)
     work_terminate = true;
     pthread_mutex_unlock(&work_lock);
 
-    pthread_cond_signal(&work_cond);
+    pthread_cond_broadcast(&work_cond);
+
+    for (i = 0; i < num_work_threads; i++)
+        Q_assert(!pthread_join(work_threads[i], NULL));
+    num_work_threads = 0;
 
-    Q_assert(!pthread_join(work_thread, NULL));
     Com_CompleteAsyncWork();
 
+    for (i = 0; i < num_jobs; i += JOB_CHUNK)
+        Z_Free(job_table[i]);
+    Z_Freep((void**)&job_table);
+    num_jobs = 0;
+
     pthread_mutex_destroy(&work_lock);
     pthread_cond_destroy(&work_cond);
+    pthread_cond_destroy(&done_cond);
+    work_terminate = false;
     work_initialized = false;
 }
+
+static void Com_AsyncStats_f(void)
+{
+    static const char names[ASYNC_PRIO_COUNT][8] = { "low", "normal", "high" };
+    const asyncstats_t *s;
+    int i;
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        if (work_initialized)
+            pthread_mutex_lock(&work_lock);
+        for (i = 0; i < ASYNC_PRIO_COUNT; i++) {
+            s = &work_stats[i];
+            work_stats[i] = (asyncstats_t){ .depth = s->depth, .max_depth = s->depth };
+        }
+        if (work_initialized)
+            pthread_mutex_unlock(&work_lock);
+        return;
+    }
+
+    if (!work_initialized) {
+        Com_Printf("Async work pool not started.\n");
+        return;
+    }
+
+    pthread_mutex_lock(&work_lock);
+
+    Com_Printf("%d threads, %u jobs allocated, %d free\n",
+               num_work_threads, num_jobs, List_Count(&free_list));
+    Com_Printf("prio    queued completed depth  peak  avg wait max wait  avg run  max run\n"
+               "------ ------- --------- ----- ----- --------- -------- -------- --------\n");
+    for (i = ASYNC_PRIO_COUNT - 1; i >= 0; i--) {
+        s = &work_stats[i];
+        Com_Printf("%-6s %7"PRIu64" %9"PRIu64" %5d %5d %7.1fms %6ums %6.1fms %6ums\n",
+                   names[i], s->queued, s->completed, s->depth, s->max_depth,
+                   s->completed ? (double)s->wait_msec / s->completed : 0.0, s->max_wait,
+                   s->completed ? (double)s->run_msec / s->completed : 0.0, s->max_run);
+    }
+
+    pthread_mutex_unlock(&work_lock);
+}
+
+static void com_async_threads_changed(cvar_t *self)
+{
+    // new pool is started on demand
+    Com_ShutdownAsyncWork();
+}
+
+void Com_InitAsyncWork(void)
+{
+    com_async_threads = Cvar_Get("com_async_threads", "2", 0);
+    com_async_threads->changed = com_async_threads_changed;
+
+    Cmd_AddCommand("async_stats", Com_AsyncStats_f);
+}
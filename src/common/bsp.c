@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "shared/shared.h"
 #include "shared/list.h"
+#include "common/async.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/common.h"
@@ -36,6 +37,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 extern mtexinfo_t nulltexinfo;
 
 static cvar_t *map_visibility_patch;
+static cvar_t *map_pvs_threads;
 
 /*
 ===============================================================================
@@ -251,7 +253,6 @@ LOAD(Brushes)
         out->firstbrushside = bsp->brushsides + firstside;
         out->numsides = numsides;
         out->contents = BSP_Long();
-        out->checkcount = 0;
     }
 
     return Q_ERR_SUCCESS;
@@ -1002,12 +1003,11 @@ void BSP_Free(bsp_t *bsp)
     }
     Q_assert(bsp->refcount > 0);
     if (--bsp->refcount == 0) {
-		if (bsp->pvs2_matrix)
-		{
-			// free the PVS2 matrix separately - it's not part of the hunk
-			Z_Free(bsp->pvs2_matrix);
-			bsp->pvs2_matrix = NULL;
-		}
+		// free the PVS matrices separately - they are not part of the hunk
+		Z_Free(bsp->pvs_matrix);
+		bsp->pvs_matrix = NULL;
+		Z_Free(bsp->pvs2_matrix);
+		bsp->pvs2_matrix = NULL;
 
         Hunk_Free(&bsp->hunk);
         List_Remove(&bsp->entry);
@@ -1015,6 +1015,128 @@ void BSP_Free(bsp_t *bsp)
     }
 }
 
+// rows of a large matrix are split into bands that are built on the async
+// work pool, each band writes only its own rows of the destination matrix
+#define PVS_BAND_CLUSTERS	64
+#define PVS_MAX_BANDS		16
+
+typedef struct pvsband_s {
+	bsp_t* bsp;
+	byte* matrix;
+	int start, end;
+	void (*rows)(struct pvsband_s* band);
+} pvsband_t;
+
+static void pvs_band_work_cb(void* arg)
+{
+	pvsband_t* band = arg;
+
+	band->rows(band);
+}
+
+// runs first band on calling thread, the rest on async work pool
+static void run_pvs_bands(bsp_t* bsp, byte* matrix, void (*rows)(pvsband_t*))
+{
+	pvsband_t bands[PVS_MAX_BANDS];
+	asynchandle_t handles[PVS_MAX_BANDS];
+	int numclusters = bsp->vis->numclusters;
+	int count = 1;
+
+	if (map_pvs_threads->integer)
+		count = Q_clip(numclusters / PVS_BAND_CLUSTERS, 1, PVS_MAX_BANDS);
+
+	for (int i = 0; i < count; i++)
+	{
+		bands[i].bsp = bsp;
+		bands[i].matrix = matrix;
+		bands[i].start = numclusters * i / count;
+		bands[i].end = numclusters * (i + 1) / count;
+		bands[i].rows = rows;
+	}
+
+	for (int i = 1; i < count; i++)
+	{
+		asyncwork_t work = {
+			.work_cb = pvs_band_work_cb,
+			.cb_arg = &bands[i],
+			.priority = ASYNC_PRIO_HIGH,
+		};
+		handles[i] = Com_QueueAsyncWork(&work);
+	}
+
+	pvs_band_work_cb(&bands[0]);
+
+	// bands not yet picked up by the pool are run here
+	for (int i = 1; i < count; i++)
+		Com_WaitAsyncWork(handles[i]);
+}
+
+static void decompress_pvs_rows(pvsband_t* band)
+{
+	bsp_t* bsp = band->bsp;
+
+	for (int cluster = band->start; cluster < band->end; cluster++)
+	{
+		BSP_ClusterVis(bsp, band->matrix + bsp->visrowsize * cluster, cluster, DVIS_PVS);
+	}
+}
+
+// ORs one row into another a machine word at a time
+static void merge_pvs_rows(byte* dst, const byte* src, size_t size)
+{
+	size_t i, a, b;
+
+	for (i = 0; i + sizeof(a) <= size; i += sizeof(a))
+	{
+		memcpy(&a, dst + i, sizeof(a));
+		memcpy(&b, src + i, sizeof(b));
+		a |= b;
+		memcpy(dst + i, &a, sizeof(a));
+	}
+
+	for (; i < size; i++)
+		dst[i] |= src[i];
+}
+
+static void build_pvs2_rows(pvsband_t* band)
+{
+	bsp_t* bsp = band->bsp;
+	size_t rowsize = bsp->visrowsize;
+	int numclusters = bsp->vis->numclusters;
+
+	for (int cluster = band->start; cluster < band->end; cluster++)
+	{
+		const byte* pvs = bsp->pvs_matrix + rowsize * cluster;
+		byte* dest_pvs = band->matrix + rowsize * cluster;
+		memcpy(dest_pvs, pvs, rowsize);
+
+		for (size_t i = 0; i < rowsize; i += sizeof(size_t))
+		{
+			size_t end = min(i + sizeof(size_t), rowsize);
+			size_t word;
+
+			// most of a large row is empty, skip it a word at a time
+			if (end - i == sizeof(word))
+			{
+				memcpy(&word, pvs + i, sizeof(word));
+				if (!word)
+					continue;
+			}
+
+			for (size_t j = i; j < end; j++)
+			{
+				for (int bit = 0; bit < 8; bit++)
+				{
+					int vis_cluster = (int)(j << 3) | bit;
+
+					if ((pvs[j] & BIT(bit)) && vis_cluster < numclusters)
+						merge_pvs_rows(dest_pvs, bsp->pvs_matrix + rowsize * vis_cluster, rowsize);
+				}
+			}
+		}
+	}
+}
+
 static void BSP_BuildPvsMatrix(bsp_t *bsp)
 {
 	if (!bsp->vis)
@@ -1027,14 +1149,40 @@ static void BSP_BuildPvsMatrix(bsp_t *bsp)
 	// we want BSP_CluterVis to use the old PVS data here, and not the new empty matrix
 	byte* pvs_matrix = Z_Mallocz(matrix_size);
 	
-	for (int cluster = 0; cluster < bsp->vis->numclusters; cluster++)
-	{
-		BSP_ClusterVis(bsp, pvs_matrix + bsp->visrowsize * cluster, cluster, DVIS_PVS);
-	}
+	run_pvs_bands(bsp, pvs_matrix, decompress_pvs_rows);
 
 	bsp->pvs_matrix = pvs_matrix;
 }
 
+// Builds the second-order PVS: each row is the union of first-order PVS rows
+// of all clusters visible from that cluster.
+void BSP_BuildPvs2Matrix(bsp_t *bsp)
+{
+	if (!bsp->vis || !bsp->pvs_matrix)
+		return;
+
+	size_t matrix_size = bsp->visrowsize * bsp->vis->numclusters;
+	byte* pvs2_matrix = Z_Malloc(matrix_size);
+
+	run_pvs_bands(bsp, pvs2_matrix, build_pvs2_rows);
+
+	Z_Free(bsp->pvs2_matrix);
+	bsp->pvs2_matrix = pvs2_matrix;
+}
+
+// Rebuilds the first-order PVS matrix from the visibility lump, dropping any
+// patched matrices loaded or built before.
+void BSP_RebuildPvsMatrix(bsp_t *bsp)
+{
+	Z_Free(bsp->pvs_matrix);
+	bsp->pvs_matrix = NULL;
+	Z_Free(bsp->pvs2_matrix);
+	bsp->pvs2_matrix = NULL;
+	bsp->pvs_patched = false;
+
+	BSP_BuildPvsMatrix(bsp);
+}
+
 byte* BSP_GetPvs(bsp_t *bsp, int cluster)
 {
 	if (!bsp->vis || !bsp->pvs_matrix)
@@ -1057,6 +1205,13 @@ byte* BSP_GetPvs2(bsp_t *bsp, int cluster)
 	return bsp->pvs2_matrix + bsp->visrowsize * cluster;
 }
 
+// Patched PVS files start with this header, followed by both matrices. Files
+// written before the header was added hold just the matrices and can't be
+// checked against the map, these are still accepted if the size matches.
+#define PVS_IDENT		MakeLittleLong('P','V','S','M')
+#define PVS_VERSION		1
+#define PVS_HEADER_SIZE	16	// ident, version, map checksum, numclusters
+
 // Converts `maps/<name>.bsp` into `maps/pvs/<name>.bin`
 static bool BSP_GetPatchedPVSFileName(const char* map_path, char pvs_path[MAX_QPATH])
 {
@@ -1084,28 +1239,45 @@ static bool BSP_LoadPatchedPVS(bsp_t *bsp)
 {
 	char pvs_path[MAX_QPATH];
 
+	if (!bsp->vis)
+		return false;
+
 	if (!BSP_GetPatchedPVSFileName(bsp->name, pvs_path))
 		return false;
 
 	unsigned char* filebuf = 0;
 	int filelen = 0;
-	filelen = FS_LoadFile(pvs_path, (void**)&filebuf);
+	filelen = FS_LoadFileFlags(pvs_path, (void**)&filebuf, FS_FLAG_MAPPED);
 
 	if (filebuf == 0)
 		return false;
 
 	size_t matrix_size = bsp->visrowsize * bsp->vis->numclusters;
-	if (filelen != matrix_size * 2)
+	const unsigned char* data = filebuf;
+
+	if (filelen == PVS_HEADER_SIZE + matrix_size * 2)
+	{
+		// written for a different version of this map?
+		if (RL32(filebuf) != PVS_IDENT || RL32(filebuf + 4) != PVS_VERSION ||
+			RL32(filebuf + 8) != bsp->checksum || RL32(filebuf + 12) != bsp->vis->numclusters)
+		{
+			Com_DPrintf("Ignoring stale %s\n", pvs_path);
+			FS_FreeFile(filebuf);
+			return false;
+		}
+		data += PVS_HEADER_SIZE;
+	}
+	else if (filelen != matrix_size * 2)
 	{
 		FS_FreeFile(filebuf);
 		return false;
 	}
 
 	bsp->pvs_matrix = Z_Malloc(matrix_size);
-	memcpy(bsp->pvs_matrix, filebuf, matrix_size);
+	memcpy(bsp->pvs_matrix, data, matrix_size);
 
 	bsp->pvs2_matrix = Z_Malloc(matrix_size);
-	memcpy(bsp->pvs2_matrix, filebuf + matrix_size, matrix_size);
+	memcpy(bsp->pvs2_matrix, data + matrix_size, matrix_size);
 
 	FS_FreeFile(filebuf);
 	return true;
@@ -1126,12 +1298,16 @@ bool BSP_SavePatchedPVS(bsp_t *bsp)
 		return false;
 
 	size_t matrix_size = bsp->visrowsize * bsp->vis->numclusters;
-	unsigned char* filebuf = Z_Malloc(matrix_size * 2);
+	unsigned char* filebuf = Z_Malloc(PVS_HEADER_SIZE + matrix_size * 2);
 
-	memcpy(filebuf, bsp->pvs_matrix, matrix_size);
-	memcpy(filebuf + matrix_size, bsp->pvs2_matrix, matrix_size);
+	WL32(filebuf, PVS_IDENT);
+	WL32(filebuf + 4, PVS_VERSION);
+	WL32(filebuf + 8, bsp->checksum);
+	WL32(filebuf + 12, bsp->vis->numclusters);
+	memcpy(filebuf + PVS_HEADER_SIZE, bsp->pvs_matrix, matrix_size);
+	memcpy(filebuf + PVS_HEADER_SIZE + matrix_size, bsp->pvs2_matrix, matrix_size);
 
-	int err = FS_WriteFile(pvs_path, filebuf, matrix_size * 2);
+	int err = FS_WriteFile(pvs_path, filebuf, PVS_HEADER_SIZE + matrix_size * 2);
 
 	Z_Free(filebuf);
 
@@ -1381,7 +1557,7 @@ int BSP_Load(const char *name, bsp_t **bsp_p)
     //
     // load the file
     //
-    filelen = FS_LoadFile(name, (void **)&buf);
+    filelen = FS_LoadFileFlags(name, (void **)&buf, FS_FLAG_MAPPED);
     if (!buf) {
         return filelen;
     }
@@ -1775,6 +1951,7 @@ mmodel_t *BSP_InlineModel(bsp_t *bsp, const char *name)
 void BSP_Init(void)
 {
     map_visibility_patch = Cvar_Get("map_visibility_patch", "1", 0);
+    map_pvs_threads = Cvar_Get("map_pvs_threads", "1", 0);
 
     Cmd_AddCommand("bsplist", BSP_List_f);
 
@@ -34,7 +34,6 @@ mtexinfo_t nulltexinfo;
 static mleaf_t      nullleaf;
 
 static unsigned     floodvalid;
-static unsigned     checkcount;
 
 static cvar_t       *map_noareas;
 static cvar_t       *map_allsolid_bug;
@@ -240,14 +239,7 @@ mleaf_t *CM_LeafNum(cm_t *cm, int number)
 
 //=======================================================================
 
-static cplane_t box_planes[12];
-static mnode_t  box_nodes[6];
-static mnode_t  *box_headnode;
-static mbrush_t box_brush;
-static mbrush_t *box_leafbrush;
-static mbrushside_t box_brushsides[6];
-static mleaf_t  box_leaf;
-static mleaf_t  box_emptyleaf;
+static cm_boxhull_t box_hull;
 
 /*
 ===================
@@ -257,7 +249,7 @@ Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
 ===================
 */
-static void CM_InitBoxHull(void)
+static void CM_InitBoxHull(cm_boxhull_t *box)
 {
     int         i;
     int         side;
@@ -265,47 +257,65 @@ static void CM_InitBoxHull(void)
     cplane_t    *p;
     mbrushside_t    *s;
 
-    box_headnode = &box_nodes[0];
+    memset(box, 0, sizeof(*box));
 
-    box_brush.numsides = 6;
-    box_brush.firstbrushside = &box_brushsides[0];
-    box_brush.contents = CONTENTS_MONSTER;
+    box->brush.numsides = 6;
+    box->brush.firstbrushside = &box->brushsides[0];
+    box->brush.contents = CONTENTS_MONSTER;
 
-    box_leaf.contents = CONTENTS_MONSTER;
-    box_leaf.firstleafbrush = &box_leafbrush;
-    box_leaf.numleafbrushes = 1;
+    box->leaf.contents = CONTENTS_MONSTER;
+    box->leaf.firstleafbrush = &box->leafbrush;
+    box->leaf.numleafbrushes = 1;
 
-    box_leafbrush = &box_brush;
+    box->leafbrush = &box->brush;
 
     for (i = 0; i < 6; i++) {
         side = i & 1;
 
         // brush sides
-        s = &box_brushsides[i];
-        s->plane = &box_planes[i * 2 + side];
+        s = &box->brushsides[i];
+        s->plane = &box->planes[i * 2 + side];
         s->texinfo = &nulltexinfo;
 
         // nodes
-        c = &box_nodes[i];
-        c->plane = &box_planes[i * 2];
-        c->children[side] = (mnode_t *)&box_emptyleaf;
+        c = &box->nodes[i];
+        c->plane = &box->planes[i * 2];
+        c->children[side] = (mnode_t *)&box->emptyleaf;
         if (i != 5)
-            c->children[side ^ 1] = &box_nodes[i + 1];
+            c->children[side ^ 1] = &box->nodes[i + 1];
         else
-            c->children[side ^ 1] = (mnode_t *)&box_leaf;
+            c->children[side ^ 1] = (mnode_t *)&box->leaf;
 
         // planes
-        p = &box_planes[i * 2];
+        p = &box->planes[i * 2];
         p->type = i >> 1;
         p->normal[i >> 1] = 1;
 
-        p = &box_planes[i * 2 + 1];
+        p = &box->planes[i * 2 + 1];
         p->type = 3 + (i >> 1);
         p->signbits = 1 << (i >> 1);
         p->normal[i >> 1] = -1;
     }
 }
 
+static mnode_t *CM_SetBoxHull(cm_boxhull_t *box, const vec3_t mins, const vec3_t maxs)
+{
+    box->planes[0].dist = maxs[0];
+    box->planes[1].dist = -maxs[0];
+    box->planes[2].dist = mins[0];
+    box->planes[3].dist = -mins[0];
+    box->planes[4].dist = maxs[1];
+    box->planes[5].dist = -maxs[1];
+    box->planes[6].dist = mins[1];
+    box->planes[7].dist = -mins[1];
+    box->planes[8].dist = maxs[2];
+    box->planes[9].dist = -maxs[2];
+    box->planes[10].dist = mins[2];
+    box->planes[11].dist = -mins[2];
+
+    return &box->nodes[0];
+}
+
 /*
 ===================
 CM_HeadnodeForBox
@@ -316,20 +326,25 @@ BSP trees instead of being compared directly.
 */
 mnode_t *CM_HeadnodeForBox(const vec3_t mins, const vec3_t maxs)
 {
-    box_planes[0].dist = maxs[0];
-    box_planes[1].dist = -maxs[0];
-    box_planes[2].dist = mins[0];
-    box_planes[3].dist = -mins[0];
-    box_planes[4].dist = maxs[1];
-    box_planes[5].dist = -maxs[1];
-    box_planes[6].dist = mins[1];
-    box_planes[7].dist = -mins[1];
-    box_planes[8].dist = maxs[2];
-    box_planes[9].dist = -maxs[2];
-    box_planes[10].dist = mins[2];
-    box_planes[11].dist = -mins[2];
-
-    return box_headnode;
+    return CM_SetBoxHull(&box_hull, mins, maxs);
+}
+
+/*
+===================
+CM_HeadnodeForBoxEx
+
+Same as above, but uses the private hull of trace context. Returned node
+is valid until the next call with the same context.
+===================
+*/
+mnode_t *CM_HeadnodeForBoxEx(cm_trace_t *ctx, const vec3_t mins, const vec3_t maxs)
+{
+    return CM_SetBoxHull(&ctx->box, mins, maxs);
+}
+
+static inline bool CM_IsBoxHull(const cm_trace_t *ctx, const mnode_t *headnode)
+{
+    return headnode == box_hull.nodes || (ctx && headnode == ctx->box.nodes);
 }
 
 mleaf_t *CM_PointLeaf(cm_t *cm, const vec3_t p)
@@ -347,33 +362,35 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-static int          leaf_count, leaf_maxcount;
-static mleaf_t      **leaf_list;
-static const vec_t  *leaf_mins, *leaf_maxs;
-static mnode_t      *leaf_topnode;
-
-static void CM_BoxLeafs_r(mnode_t *node)
+typedef struct {
+    int         count, maxcount;
+    mleaf_t     **list;
+    const vec_t *mins, *maxs;
+    mnode_t     *topnode;
+} boxleafs_t;
+
+static void CM_BoxLeafs_r(boxleafs_t *bl, mnode_t *node)
 {
     int     s;
 
     while (node->plane) {
-        s = BoxOnPlaneSideFast(leaf_mins, leaf_maxs, node->plane);
+        s = BoxOnPlaneSideFast(bl->mins, bl->maxs, node->plane);
         if (s == BOX_INFRONT) {
             node = node->children[0];
         } else if (s == BOX_BEHIND) {
             node = node->children[1];
         } else {
             // go down both
-            if (!leaf_topnode) {
-                leaf_topnode = node;
+            if (!bl->topnode) {
+                bl->topnode = node;
             }
-            CM_BoxLeafs_r(node->children[0]);
+            CM_BoxLeafs_r(bl, node->children[0]);
             node = node->children[1];
         }
     }
 
-    if (leaf_count < leaf_maxcount) {
-        leaf_list[leaf_count++] = (mleaf_t *)node;
+    if (bl->count < bl->maxcount) {
+        bl->list[bl->count++] = (mleaf_t *)node;
     }
 }
 
@@ -381,20 +398,21 @@ static int CM_BoxLeafs_headnode(const vec3_t mins, const vec3_t maxs,
                                 mleaf_t **list, int listsize,
                                 mnode_t *headnode, mnode_t **topnode)
 {
-    leaf_list = list;
-    leaf_count = 0;
-    leaf_maxcount = listsize;
-    leaf_mins = mins;
-    leaf_maxs = maxs;
+    boxleafs_t  bl;
 
-    leaf_topnode = NULL;
+    bl.list = list;
+    bl.count = 0;
+    bl.maxcount = listsize;
+    bl.mins = mins;
+    bl.maxs = maxs;
+    bl.topnode = NULL;
 
-    CM_BoxLeafs_r(headnode);
+    CM_BoxLeafs_r(&bl, headnode);
 
     if (topnode)
-        *topnode = leaf_topnode;
+        *topnode = bl.topnode;
 
-    return leaf_count;
+    return bl.count;
 }
 
 int CM_BoxLeafs(cm_t *cm, const vec3_t mins, const vec3_t maxs,
@@ -438,7 +456,7 @@ int CM_TransformedPointContents(const vec3_t p, mnode_t *headnode, const vec3_t
     VectorSubtract(p, origin, p_l);
 
     // rotate start and end into the models frame of reference
-    if (headnode != box_headnode && !VectorEmpty(angles)) {
+    if (!CM_IsBoxHull(NULL, headnode) && !VectorEmpty(angles)) {
         AnglesToAxis(angles, axis);
         RotatePoint(p_l, axis);
     }
@@ -457,20 +475,37 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define DIST_EPSILON    0.03125f
 
-static vec3_t   trace_start, trace_end;
-static vec3_t   trace_offsets[8];
-static vec3_t   trace_extents;
+// context used by non-reentrant API
+static cm_trace_t   cm_trace;
+
+/*
+================
+CM_CheckBrush
 
-static trace_t  *trace_trace;
-static int      trace_contents;
-static bool     trace_ispoint;      // optimized case
+Returns true if brush was already checked during this trace.
+Lookup table is lossy, so worst case is testing the same brush twice,
+which doesn't change the result.
+================
+*/
+static inline bool CM_CheckBrush(cm_trace_t *ctx, const mbrush_t *brush)
+{
+    uint32_t hash = (uint32_t)((uintptr_t)brush / sizeof(*brush)) * 0x9e3779b1U;
+    unsigned i = hash >> 25 & (CM_TRACE_CHECKED - 1);
+
+    if (ctx->checked[i].brush == brush && ctx->checked[i].checkcount == ctx->checkcount)
+        return true;
+
+    ctx->checked[i].brush = brush;
+    ctx->checked[i].checkcount = ctx->checkcount;
+    return false;
+}
 
 /*
 ================
 CM_ClipBoxToBrush
 ================
 */
-static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace, mbrush_t *brush)
+static void CM_ClipBoxToBrush(const cm_trace_t *ctx, const vec3_t p1, const vec3_t p2, trace_t *trace, mbrush_t *brush)
 {
     int         i;
     cplane_t    *plane, *clipplane;
@@ -497,10 +532,10 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
         plane = side->plane;
 
         // FIXME: special case for axial
-        if (!trace_ispoint) {
+        if (!ctx->ispoint) {
             // general box case
             // push the plane out apropriately for mins/maxs
-            dist = DotProduct(trace_offsets[plane->signbits], plane->normal);
+            dist = DotProduct(ctx->offsets[plane->signbits], plane->normal);
             dist = plane->dist - dist;
         } else {
             // special point case
@@ -569,7 +604,7 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
 CM_TestBoxInBrush
 ================
 */
-static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, mbrush_t *brush)
+static void CM_TestBoxInBrush(const cm_trace_t *ctx, const vec3_t p1, trace_t *trace, mbrush_t *brush)
 {
     int         i;
     cplane_t    *plane;
@@ -587,7 +622,7 @@ static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, mbrush_t *brush)
         // FIXME: special case for axial
         // general box case
         // push the plane out apropriately for mins/maxs
-        dist = DotProduct(trace_offsets[plane->signbits], plane->normal);
+        dist = DotProduct(ctx->offsets[plane->signbits], plane->normal);
         dist = plane->dist - dist;
 
         d1 = DotProduct(p1, plane->normal) - dist;
@@ -608,25 +643,24 @@ static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, mbrush_t *brush)
 CM_TraceToLeaf
 ================
 */
-static void CM_TraceToLeaf(mleaf_t *leaf)
+static void CM_TraceToLeaf(cm_trace_t *ctx, mleaf_t *leaf)
 {
     int         k;
     mbrush_t    *b, **leafbrush;
 
-    if (!(leaf->contents & trace_contents))
+    if (!(leaf->contents & ctx->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
+        if (CM_CheckBrush(ctx, b))
             continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
 
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & ctx->contents))
             continue;
-        CM_ClipBoxToBrush(trace_start, trace_end, trace_trace, b);
-        if (!trace_trace->fraction)
+        CM_ClipBoxToBrush(ctx, ctx->start, ctx->end, ctx->trace, b);
+        if (!ctx->trace->fraction)
             return;
     }
 }
@@ -636,25 +670,24 @@ static void CM_TraceToLeaf(mleaf_t *leaf)
 CM_TestInLeaf
 ================
 */
-static void CM_TestInLeaf(mleaf_t *leaf)
+static void CM_TestInLeaf(cm_trace_t *ctx, mleaf_t *leaf)
 {
     int         k;
     mbrush_t    *b, **leafbrush;
 
-    if (!(leaf->contents & trace_contents))
+    if (!(leaf->contents & ctx->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
+        if (CM_CheckBrush(ctx, b))
             continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
 
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & ctx->contents))
             continue;
-        CM_TestBoxInBrush(trace_start, trace_trace, b);
-        if (!trace_trace->fraction)
+        CM_TestBoxInBrush(ctx, ctx->start, ctx->trace, b);
+        if (!ctx->trace->fraction)
             return;
     }
 }
@@ -665,7 +698,7 @@ CM_RecursiveHullCheck
 
 ==================
 */
-static void CM_RecursiveHullCheck(mnode_t *node, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
+static void CM_RecursiveHullCheck(cm_trace_t *ctx, mnode_t *node, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
 {
     cplane_t    *plane;
     float       t1, t2, offset;
@@ -675,14 +708,14 @@ static void CM_RecursiveHullCheck(mnode_t *node, float p1f, float p2f, const vec
     int         side;
     float       midf;
 
-    if (trace_trace->fraction <= p1f)
+    if (ctx->trace->fraction <= p1f)
         return;     // already hit something nearer
 
 recheck:
     // if plane is NULL, we are in a leaf node
     plane = node->plane;
     if (!plane) {
-        CM_TraceToLeaf((mleaf_t *)node);
+        CM_TraceToLeaf(ctx, (mleaf_t *)node);
         return;
     }
 
@@ -693,16 +726,16 @@ recheck:
     if (plane->type < 3) {
         t1 = p1[plane->type] - plane->dist;
         t2 = p2[plane->type] - plane->dist;
-        offset = trace_extents[plane->type];
+        offset = ctx->extents[plane->type];
     } else {
         t1 = PlaneDiff(p1, plane);
         t2 = PlaneDiff(p2, plane);
-        if (trace_ispoint)
+        if (ctx->ispoint)
             offset = 0;
         else
-            offset = fabsf(trace_extents[0] * plane->normal[0]) +
-                     fabsf(trace_extents[1] * plane->normal[1]) +
-                     fabsf(trace_extents[2] * plane->normal[2]);
+            offset = fabsf(ctx->extents[0] * plane->normal[0]) +
+                     fabsf(ctx->extents[1] * plane->normal[1]) +
+                     fabsf(ctx->extents[2] * plane->normal[2]);
     }
 
     // see which sides we need to consider
@@ -739,48 +772,63 @@ recheck:
     midf = p1f + (p2f - p1f) * frac;
     LerpVector(p1, p2, frac, mid);
 
-    CM_RecursiveHullCheck(node->children[side], p1f, midf, p1, mid);
+    CM_RecursiveHullCheck(ctx, node->children[side], p1f, midf, p1, mid);
 
     // go past the node
     midf = p1f + (p2f - p1f) * frac2;
     LerpVector(p1, p2, frac2, mid);
 
-    CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
+    CM_RecursiveHullCheck(ctx, node->children[side ^ 1], midf, p2f, mid, p2);
 }
 
 //======================================================================
 
 /*
 ==================
-CM_BoxTrace
+CM_InitTraceContext
 ==================
 */
-void CM_BoxTrace(trace_t *trace,
-                 const vec3_t start, const vec3_t end,
-                 const vec3_t mins, const vec3_t maxs,
-                 mnode_t *headnode, int brushmask)
+void CM_InitTraceContext(cm_trace_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    CM_InitBoxHull(&ctx->box);
+}
+
+/*
+==================
+CM_BoxTraceEx
+==================
+*/
+void CM_BoxTraceEx(cm_trace_t *ctx, trace_t *trace,
+                   const vec3_t start, const vec3_t end,
+                   const vec3_t mins, const vec3_t maxs,
+                   mnode_t *headnode, int brushmask)
 {
     const vec_t *bounds[2] = { mins, maxs };
     int i, j;
 
-    checkcount++;       // for multi-check avoidance
+    // for multi-check avoidance
+    if (!++ctx->checkcount) {
+        memset(ctx->checked, 0, sizeof(ctx->checked));
+        ctx->checkcount = 1;
+    }
 
     // fill in a default trace
-    trace_trace = trace;
-    memset(trace_trace, 0, sizeof(*trace_trace));
-    trace_trace->fraction = 1;
-    trace_trace->surface = &(nulltexinfo.c);
+    ctx->trace = trace;
+    memset(trace, 0, sizeof(*trace));
+    trace->fraction = 1;
+    trace->surface = &(nulltexinfo.c);
 
     if (!headnode) {
         return;
     }
 
-    trace_contents = brushmask;
-    VectorCopy(start, trace_start);
-    VectorCopy(end, trace_end);
+    ctx->contents = brushmask;
+    VectorCopy(start, ctx->start);
+    VectorCopy(end, ctx->end);
     for (i = 0; i < 8; i++)
         for (j = 0; j < 3; j++)
-            trace_offsets[i][j] = bounds[(i >> j) & 1][j];
+            ctx->offsets[i][j] = bounds[(i >> j) & 1][j];
 
     //
     // check for position test special case
@@ -799,11 +847,11 @@ void CM_BoxTrace(trace_t *trace,
 
         numleafs = CM_BoxLeafs_headnode(c1, c2, leafs, q_countof(leafs), headnode, NULL);
         for (i = 0; i < numleafs; i++) {
-            CM_TestInLeaf(leafs[i]);
-            if (trace_trace->allsolid)
+            CM_TestInLeaf(ctx, leafs[i]);
+            if (trace->allsolid)
                 break;
         }
-        VectorCopy(start, trace_trace->endpos);
+        VectorCopy(start, trace->endpos);
         return;
     }
 
@@ -811,39 +859,39 @@ void CM_BoxTrace(trace_t *trace,
     // check for point special case
     //
     if (VectorEmpty(mins) && VectorEmpty(maxs)) {
-        trace_ispoint = true;
-        VectorClear(trace_extents);
+        ctx->ispoint = true;
+        VectorClear(ctx->extents);
     } else {
-        trace_ispoint = false;
-        trace_extents[0] = max(-mins[0], maxs[0]);
-        trace_extents[1] = max(-mins[1], maxs[1]);
-        trace_extents[2] = max(-mins[2], maxs[2]);
+        ctx->ispoint = false;
+        ctx->extents[0] = max(-mins[0], maxs[0]);
+        ctx->extents[1] = max(-mins[1], maxs[1]);
+        ctx->extents[2] = max(-mins[2], maxs[2]);
     }
 
     //
     // general sweeping through world
     //
-    CM_RecursiveHullCheck(headnode, 0, 1, start, end);
+    CM_RecursiveHullCheck(ctx, headnode, 0, 1, start, end);
 
-    if (trace_trace->fraction == 1)
-        VectorCopy(end, trace_trace->endpos);
+    if (trace->fraction == 1)
+        VectorCopy(end, trace->endpos);
     else
-        LerpVector(start, end, trace_trace->fraction, trace_trace->endpos);
+        LerpVector(start, end, trace->fraction, trace->endpos);
 }
 
 /*
 ==================
-CM_TransformedBoxTrace
+CM_TransformedBoxTraceEx
 
 Handles offseting and rotation of the end points for moving and
 rotating entities
 ==================
 */
-void CM_TransformedBoxTrace(trace_t *trace,
-                            const vec3_t start, const vec3_t end,
-                            const vec3_t mins, const vec3_t maxs,
-                            mnode_t *headnode, int brushmask,
-                            const vec3_t origin, const vec3_t angles)
+void CM_TransformedBoxTraceEx(cm_trace_t *ctx, trace_t *trace,
+                              const vec3_t start, const vec3_t end,
+                              const vec3_t mins, const vec3_t maxs,
+                              mnode_t *headnode, int brushmask,
+                              const vec3_t origin, const vec3_t angles)
 {
     vec3_t      start_l, end_l;
     vec3_t      axis[3];
@@ -854,7 +902,7 @@ void CM_TransformedBoxTrace(trace_t *trace,
     VectorSubtract(end, origin, end_l);
 
     // rotate start and end into the models frame of reference
-    rotated = headnode != box_headnode && !VectorEmpty(angles);
+    rotated = !CM_IsBoxHull(ctx, headnode) && !VectorEmpty(angles);
     if (rotated) {
         AnglesToAxis(angles, axis);
         RotatePoint(start_l, axis);
@@ -862,7 +910,7 @@ void CM_TransformedBoxTrace(trace_t *trace,
     }
 
     // sweep the box through the model
-    CM_BoxTrace(trace, start_l, end_l, mins, maxs, headnode, brushmask);
+    CM_BoxTraceEx(ctx, trace, start_l, end_l, mins, maxs, headnode, brushmask);
 
     // rotate plane normal into the worlds frame of reference
     if (rotated && trace->fraction != 1.0f) {
@@ -875,6 +923,34 @@ void CM_TransformedBoxTrace(trace_t *trace,
     LerpVector(start, end, trace->fraction, trace->endpos);
 }
 
+/*
+==================
+CM_BoxTrace
+==================
+*/
+void CM_BoxTrace(trace_t *trace,
+                 const vec3_t start, const vec3_t end,
+                 const vec3_t mins, const vec3_t maxs,
+                 mnode_t *headnode, int brushmask)
+{
+    CM_BoxTraceEx(&cm_trace, trace, start, end, mins, maxs, headnode, brushmask);
+}
+
+/*
+==================
+CM_TransformedBoxTrace
+==================
+*/
+void CM_TransformedBoxTrace(trace_t *trace,
+                            const vec3_t start, const vec3_t end,
+                            const vec3_t mins, const vec3_t maxs,
+                            mnode_t *headnode, int brushmask,
+                            const vec3_t origin, const vec3_t angles)
+{
+    CM_TransformedBoxTraceEx(&cm_trace, trace, start, end, mins, maxs,
+                             headnode, brushmask, origin, angles);
+}
+
 void CM_ClipEntity(trace_t *dst, const trace_t *src, struct edict_s *ent)
 {
     dst->allsolid |= src->allsolid;
@@ -1067,7 +1143,7 @@ Returns true if any leaf under headnode has a cluster that
 is potentially visible
 =============
 */
-bool CM_HeadnodeVisible(mnode_t *node, byte *visbits)
+bool CM_HeadnodeVisible(mnode_t *node, const byte *visbits)
 {
     mleaf_t *leaf;
     int     cluster;
@@ -1087,6 +1163,45 @@ bool CM_HeadnodeVisible(mnode_t *node, byte *visbits)
     return false;
 }
 
+/*
+============
+CM_FatClusters
+
+Returns the number of distinct clusters touched by a small box around the
+view origin, sorted in ascending order. The fat PVS is the union of PVS rows
+of these clusters. Clusters array must hold CM_MAX_FATCLUSTERS entries.
+============
+*/
+int CM_FatClusters(cm_t *cm, const vec3_t org, int *clusters)
+{
+    mleaf_t *leafs[CM_MAX_FATCLUSTERS];
+    int     i, j, count, numclusters, cluster;
+    vec3_t  mins, maxs;
+
+    for (i = 0; i < 3; i++) {
+        mins[i] = org[i] - 8;
+        maxs[i] = org[i] + 8;
+    }
+
+    count = CM_BoxLeafs(cm, mins, maxs, leafs, q_countof(leafs), NULL);
+    Q_assert(count > 0);
+
+    // convert leafs to clusters, insertion sort and drop duplicates
+    numclusters = 0;
+    for (i = 0; i < count; i++) {
+        cluster = leafs[i]->cluster;
+        for (j = numclusters; j > 0 && clusters[j - 1] > cluster; j--)
+            ;
+        if (j > 0 && clusters[j - 1] == cluster)
+            continue;   // already have the cluster we want
+        memmove(clusters + j + 1, clusters + j, sizeof(clusters[0]) * (numclusters - j));
+        clusters[j] = cluster;
+        numclusters++;
+    }
+
+    return numclusters;
+}
+
 /*
 ============
 CM_FatPVS
@@ -1098,11 +1213,9 @@ so we can't use a single PVS point
 byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org, int vis)
 {
     byte    temp[VIS_MAX_BYTES];
-    mleaf_t *leafs[64];
-    int     clusters[64];
+    int     clusters[CM_MAX_FATCLUSTERS];
     int     i, j, count, longs;
     size_t  *src, *dst;
-    vec3_t  mins, maxs;
 
     if (!cm->cache) {   // map not loaded
         return memset(mask, 0, VIS_MAX_BYTES);
@@ -1111,36 +1224,18 @@ byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org, int vis)
         return memset(mask, 0xff, VIS_MAX_BYTES);
     }
 
-    for (i = 0; i < 3; i++) {
-        mins[i] = org[i] - 8;
-        maxs[i] = org[i] + 8;
-    }
-
-    count = CM_BoxLeafs(cm, mins, maxs, leafs, q_countof(leafs), NULL);
-    Q_assert(count > 0);
-
-    // convert leafs to clusters
-    for (i = 0; i < count; i++) {
-        clusters[i] = leafs[i]->cluster;
-    }
+    count = CM_FatClusters(cm, org, clusters);
 
     BSP_ClusterVis(cm->cache, mask, clusters[0], vis);
     longs = VIS_FAST_LONGS(cm->cache);
 
     // or in all the other leaf bits
     for (i = 1; i < count; i++) {
-        for (j = 0; j < i; j++) {
-            if (clusters[i] == clusters[j]) {
-                goto nextleaf; // already have the cluster we want
-            }
-        }
         src = (size_t *)BSP_ClusterVis(cm->cache, temp, clusters[i], vis);
         dst = (size_t *)mask;
         for (j = 0; j < longs; j++) {
             *dst++ |= *src++;
         }
-
-nextleaf:;
     }
 
     return mask;
@@ -1153,7 +1248,8 @@ CM_Init
 */
 void CM_Init(void)
 {
-    CM_InitBoxHull();
+    CM_InitBoxHull(&box_hull);
+    CM_InitTraceContext(&cm_trace);
 
     nullleaf.cluster = -1;
 
@@ -39,6 +39,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/net/chan.h"
 #include "common/net/net.h"
 #include "common/pmove.h"
+#include "common/prof.h"
 #include "common/prompt.h"
 #include "common/protocol.h"
 #include "common/tests.h"
@@ -928,6 +929,10 @@ void Qcommon_Init(int argc, char **argv)
     rcon_password = Cvar_Get("rcon_password", "", CVAR_PRIVATE);
 
     Cmd_AddCommand("z_stats", Z_Stats_f);
+    Cmd_AddCommand("z_slab_stats", Z_SlabStats_f);
+
+    Com_InitAsyncWork();
+    Prof_Init();
 
     //Cmd_AddCommand("setenv", Com_Setenv_f);
 
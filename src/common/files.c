@@ -18,7 +18,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "shared/shared.h"
+#include "shared/atomic.h"
 #include "shared/list.h"
+#include "common/async.h"
 #include "common/common.h"
 #include "common/cvar.h"
 #include "common/error.h"
@@ -36,7 +38,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sys/stat.h>
 #ifndef _WIN32
     #include <unistd.h>
+    #include <sys/mman.h>
 #else
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+    #include <io.h>
     #define stat _stat
 #endif
 
@@ -137,8 +143,12 @@ typedef struct packfile_s {
 
 typedef struct {
     filetype_t  type;       // FS_PAK or FS_ZIP
-    unsigned    refcount;   // for tracking pack users
+    unsigned    refcount;   // for tracking pack users, including mapped views
     FILE        *fp;
+    const byte  *map;       // read-only mapping of the whole file
+    int64_t     map_size;
+    bool        map_failed;
+    list_t      map_entry;  // in fs_mapped_packs
     unsigned    num_files;
     unsigned    hash_size;
     packfile_t  *files;
@@ -147,9 +157,17 @@ typedef struct {
     char        filename[1];
 } pack_t;
 
+typedef struct {
+    unsigned    gen;        // fs_index_gen at the time of building
+    unsigned    count;      // number of names
+    unsigned    mask;       // hash table size - 1
+    char        *names[1];  // open addressing, NULL means free slot
+} dirindex_t;
+
 typedef struct searchpath_s {
     struct searchpath_s *next;
     pack_t      *pack;        // only one of filename / pack will be used
+    dirindex_t  *index;       // built on demand for directories
     unsigned    mode;
     char        filename[1];
 } searchpath_t;
@@ -186,28 +204,47 @@ static searchpath_t *fs_base_searchpaths;
 static list_t       fs_hard_links;
 static list_t       fs_soft_links;
 
+static LIST_DECL(fs_mapped_packs);
+
 static file_t       fs_files[MAX_FILE_HANDLES];
 static int          fs_num_files;
 
 static bool         fs_non_uniq_open;
 
+static unsigned     fs_index_gen = 1;   // bumped to invalidate directory indexes
+
 #if USE_DEBUG
 static int          fs_count_read;
 static int          fs_count_open;
 static int          fs_count_strcmp;
 static int          fs_count_strlwr;
+static int          fs_count_mapped;
+static int          fs_count_copied;
+static int          fs_count_indexed;
 #define FS_COUNT_READ       fs_count_read++
 #define FS_COUNT_OPEN       fs_count_open++
 #define FS_COUNT_STRCMP     fs_count_strcmp++
 #define FS_COUNT_STRLWR     fs_count_strlwr++
+#define FS_COUNT_MAPPED     fs_count_mapped++
+#define FS_COUNT_COPIED     fs_count_copied++
+#define FS_COUNT_INDEXED    fs_count_indexed++
 #else
 #define FS_COUNT_READ       (void)0
 #define FS_COUNT_OPEN       (void)0
 #define FS_COUNT_STRCMP     (void)0
 #define FS_COUNT_STRLWR     (void)0
+#define FS_COUNT_MAPPED     (void)0
+#define FS_COUNT_COPIED     (void)0
+#define FS_COUNT_INDEXED    (void)0
 #endif
 
 static cvar_t       *fs_autoexec;
+static cvar_t       *fs_mmap;
+static cvar_t       *fs_index;
+#if USE_ZLIB
+static cvar_t       *fs_prefetch;
+static cvar_t       *fs_prefetch_size;
+#endif
 
 #if USE_DEBUG
 static cvar_t       *fs_debug;
@@ -231,6 +268,7 @@ static int seek_zip_file(file_t *file, int64_t offset, int whence);
 // allows FS to be restarted while reading something from pack
 static pack_t *pack_get(pack_t *pack);
 static void pack_put(pack_t *pack);
+static bool pack_map(pack_t *pack);
 
 /*
 
@@ -593,6 +631,7 @@ FS_CreatePath
 
 Creates any directories needed to store the given filename.
 Expects a fully qualified, normalized system path (i.e. with / separators).
+Doesn't touch directory indexes, so it is safe to call from worker threads.
 ============
 */
 int FS_CreatePath(char *path)
@@ -917,6 +956,8 @@ static int64_t open_file_write(file_t *file, const char *name)
         goto fail;
     }
 
+    FS_IndexFile(fullpath);
+
     FS_DPrintf("%s: %s: %"PRId64" bytes\n", __func__, fullpath, pos);
     return pos;
 
@@ -1315,6 +1356,149 @@ fail:
     return ret;
 }
 
+/*
+=============================================================================
+
+DIRECTORY INDEX
+
+Probing for alternative file names (texture formats, overrides, model formats)
+mostly misses, and each miss costs one or two failed open() calls per
+directory in the search path. For opens with FS_FLAG_INDEXED, directories are
+first checked against a set of all file names built by scanning the directory
+once. Index only answers `definitely missing' (names are compared without
+regard to case), everything else goes to disk as usual. Files written or
+renamed through filesystem are added to existing indexes, files created by
+other means are only found after FS_Restart unless passed to FS_IndexFile.
+Indexes are rebuilt on demand after FS_Restart.
+
+=============================================================================
+*/
+
+static void free_index(dirindex_t *index)
+{
+    unsigned i;
+
+    if (!index)
+        return;
+
+    for (i = 0; i <= index->mask; i++)
+        Z_Free(index->names[i]);
+
+    Z_Free(index);
+}
+
+static dirindex_t *build_index(const char *path)
+{
+    listfiles_t list = {
+        .flags = FS_SEARCH_SAVEPATH | FS_SEARCH_RECURSIVE,
+        .baselen = strlen(path) + 1,
+    };
+    dirindex_t *index;
+    unsigned i, j, size;
+
+    Sys_ListFiles_r(&list, path, 0);
+
+    // keep load factor under 1/2
+    size = Q_npot32(list.count * 2 + 1);
+    index = FS_Mallocz(sizeof(*index) + sizeof(index->names[0]) * (size - 1));
+    index->gen = fs_index_gen;
+    index->count = list.count;
+    index->mask = size - 1;
+
+    for (i = 0; i < list.count; i++) {
+#ifdef _WIN32
+        FS_ReplaceSeparators(list.files[i], '/');
+#endif
+        j = FS_HashPath(list.files[i], 0) & index->mask;
+        while (index->names[j])
+            j = (j + 1) & index->mask;
+        index->names[j] = list.files[i];
+    }
+
+    Z_Free(list.files);
+
+    FS_DPrintf("%s: %s: %d files\n", __func__, path, list.count);
+    return index;
+}
+
+// returns false if file is known to be missing from directory search path
+static bool index_lookup(searchpath_t *search, const char *normalized, size_t namelen)
+{
+    dirindex_t *index = search->index;
+    const char *s;
+    unsigned i, depth = 0;
+
+    if (!fs_index->integer)
+        return true;
+
+    // files deeper than listing limit are not indexed
+    for (s = normalized; *s; s++)
+        depth += *s == '/';
+    if (depth > MAX_LISTED_DEPTH)
+        return true;
+
+    if (!index || index->gen != fs_index_gen) {
+        free_index(index);
+        index = search->index = build_index(search->filename);
+    }
+
+    i = FS_HashPathLen(normalized, namelen, 0) & index->mask;
+    for (; index->names[i]; i = (i + 1) & index->mask)
+        if (!FS_pathcmp(index->names[i], normalized))
+            return true;
+
+    FS_COUNT_INDEXED;
+    return false;
+}
+
+/*
+================
+FS_IndexFile
+
+Adds a newly created file, given by full system path, to existing directory
+indexes instead of invalidating them all and rescanning directories on the
+next lookup. Called for files written through filesystem, and should be
+called for files created by other means that indexed lookups need to find.
+Main thread only.
+================
+*/
+void FS_IndexFile(const char *fullpath)
+{
+    searchpath_t *search;
+    dirindex_t *index;
+    const char *name;
+    size_t len;
+    unsigned i;
+
+    for (search = fs_searchpaths; search; search = search->next) {
+        index = search->index;
+        if (!index || index->gen != fs_index_gen)
+            continue;
+
+        len = strlen(search->filename);
+        if (strncmp(fullpath, search->filename, len) || fullpath[len] != '/')
+            continue;
+
+        name = fullpath + len + 1;
+        i = FS_HashPath(name, 0) & index->mask;
+        for (; index->names[i]; i = (i + 1) & index->mask)
+            if (!FS_pathcmp(index->names[i], name))
+                break;
+        if (index->names[i])
+            continue;   // overwriting existing file
+
+        // drop index that became too dense, it will be rebuilt if needed
+        if ((index->count + 1) * 2 > index->mask + 1) {
+            free_index(index);
+            search->index = NULL;
+            continue;
+        }
+
+        index->names[i] = FS_CopyString(name);
+        index->count++;
+    }
+}
+
 int FS_LastModified(char const * file, uint64_t * last_modified)
 {
 #ifndef NO_TEXTURE_RELOADS
@@ -1341,6 +1525,11 @@ int FS_LastModified(char const * file, uint64_t * last_modified)
             continue;
         }
 
+        // callers probe for files that mostly don't exist
+        if (!index_lookup(search, file, strlen(file))) {
+            continue;
+        }
+
         // check a file in the directory tree
         len = Q_concat(fullpath, sizeof(fullpath), search->filename, "/", file);
         if (len >= sizeof(fullpath)) {
@@ -1426,6 +1615,10 @@ static int64_t open_file_read(file_t *file, const char *normalized, size_t namel
             if (valid == PATH_INVALID) {
                 continue;
             }
+            // skip directory if index says the file is not there
+            if ((file->mode & FS_FLAG_INDEXED) && !index_lookup(search, normalized, namelen)) {
+                continue;
+            }
             // check a file in the directory tree
             if (Q_concat(fullpath, sizeof(fullpath), search->filename,
                          "/", normalized) >= sizeof(fullpath)) {
@@ -1844,12 +2037,354 @@ qhandle_t FS_EasyOpenFile(char *buf, size_t size, unsigned mode,
     return easy_open_write(buf, size, mode, dir, name, ext);
 }
 
+#if USE_ZLIB
+
+/*
+=============================================================================
+
+PREFETCH
+
+Deflated pack entries known to be needed soon are inflated ahead of time on
+async worker threads. Output buffers are allocated on the main thread when
+work is queued, so the zone allocator is never entered from workers, and
+total size of buffers in flight is bounded by fs_prefetch_size. Entries are
+looked up by pack entry, so path resolution rules are not duplicated.
+
+=============================================================================
+*/
+
+#define PREFETCH_HASH   256
+
+typedef struct prefetch_s {
+    list_t          entry;      // in fs_prefetch_wait or fs_prefetch_busy
+    struct prefetch_s *hash_next;
+    pack_t          *pack;
+    packfile_t      *file;
+    const byte      *in;        // compressed data if pack is mapped
+    byte            *data;      // allocated when queued
+    asynchandle_t   handle;
+    atomic_int      cancel;
+    int             error;      // set by worker
+    unsigned        msec;       // set by worker
+} prefetch_t;
+
+static LIST_DECL(fs_prefetch_wait);     // not yet queued, in request order
+static LIST_DECL(fs_prefetch_busy);     // queued or finished, not consumed
+static prefetch_t   *fs_prefetch_hash[PREFETCH_HASH];
+static size_t       fs_prefetch_bytes;  // size of buffers in flight
+
+static struct {
+    char        name[MAX_QPATH];
+    unsigned    start;
+    int         files;
+    int         hits;
+    int         wasted;
+    int         failed;
+    size_t      bytes;
+    unsigned    inflate_msec;
+    unsigned    wait_msec;
+} fs_prefetch_stats;
+
+#define PREFETCH_HASH_INDEX(file) \
+    (((uintptr_t)(file) >> 4) & (PREFETCH_HASH - 1))
+
+// runs on worker thread, must not touch anything but the item itself
+static void prefetch_work(void *arg)
+{
+    prefetch_t *p = arg;
+    packfile_t *entry = p->file;
+    unsigned start = Sys_Milliseconds();
+    const byte *in;
+    byte *temp = NULL;
+    FILE *fp;
+    z_stream z;
+    int ret;
+
+    if (atomic_load(&p->cancel)) {
+        p->error = Q_ERR(ECANCELED);
+        return;
+    }
+
+    if (p->in) {
+        in = p->in;
+    } else {
+        // shared pack handle belongs to main thread
+        fp = fopen(p->pack->filename, "rb");
+        if (!fp) {
+            p->error = Q_ERRNO;
+            return;
+        }
+        temp = malloc(entry->complen);
+        if (!temp) {
+            p->error = Q_ERR(ENOMEM);
+        } else if (os_fseek(fp, entry->filepos, SEEK_SET)) {
+            p->error = Q_ERRNO;
+        } else if (!fread(temp, entry->complen, 1, fp)) {
+            p->error = FS_ERR_READ(fp);
+        }
+        fclose(fp);
+        if (p->error) {
+            free(temp);
+            return;
+        }
+        in = temp;
+    }
+
+    // default zlib allocator is thread safe, FS_zalloc is not
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, -MAX_WBITS) != Z_OK) {
+        p->error = Q_ERR_INFLATE_FAILED;
+    } else {
+        z.next_in = (Bytef *)in;
+        z.avail_in = (uInt)entry->complen;
+        z.next_out = p->data;
+        z.avail_out = (uInt)entry->filelen;
+
+        ret = inflate(&z, Z_FINISH);
+        if (ret != Z_STREAM_END || z.avail_out)
+            p->error = Q_ERR_INFLATE_FAILED;
+
+        inflateEnd(&z);
+    }
+
+    free(temp);
+    p->msec = Sys_Milliseconds() - start;
+}
+
+// queues waiting items in request order while they fit into the budget
+static void prefetch_queue(void)
+{
+    size_t limit = (size_t)Cvar_ClampInteger(fs_prefetch_size, 1, 1024) << 20;
+    asyncwork_t work = { .work_cb = prefetch_work };
+    prefetch_t *p, *next;
+    size_t len;
+
+    LIST_FOR_EACH_SAFE(prefetch_t, p, next, &fs_prefetch_wait, entry) {
+        len = p->file->filelen;
+        if (fs_prefetch_bytes && fs_prefetch_bytes + len > limit)
+            break;
+
+        p->data = FS_Malloc(len + 1);
+        p->data[len] = 0;
+        fs_prefetch_bytes += len;
+
+        work.cb_arg = p;
+        p->handle = Com_QueueAsyncWork(&work);
+
+        List_Remove(&p->entry);
+        List_Append(&fs_prefetch_busy, &p->entry);
+    }
+}
+
+static prefetch_t *prefetch_find(const packfile_t *file)
+{
+    prefetch_t *p;
+
+    for (p = fs_prefetch_hash[PREFETCH_HASH_INDEX(file)]; p; p = p->hash_next)
+        if (p->file == file)
+            return p;
+
+    return NULL;
+}
+
+// waits for queued work and unlinks the item, returns inflated data if any
+static byte *prefetch_release(prefetch_t *p)
+{
+    prefetch_t **back;
+    byte *data = p->data;
+
+    if (p->handle) {
+        Com_WaitAsyncWork(p->handle);
+        fs_prefetch_bytes -= p->file->filelen;
+        fs_prefetch_stats.inflate_msec += p->msec;
+        if (p->error && p->error != Q_ERR(ECANCELED)) {
+            FS_DPrintf("%s: %s/%s: %s\n", __func__, p->pack->filename,
+                       p->pack->names + p->file->nameofs, Q_ErrorString(p->error));
+            fs_prefetch_stats.failed++;
+        }
+        if (p->error) {
+            Z_Free(data);
+            data = NULL;
+        }
+    }
+
+    for (back = &fs_prefetch_hash[PREFETCH_HASH_INDEX(p->file)]; *back; back = &(*back)->hash_next) {
+        if (*back == p) {
+            *back = p->hash_next;
+            break;
+        }
+    }
+
+    List_Remove(&p->entry);
+    pack_put(p->pack);
+    Z_Free(p);
+    return data;
+}
+
+// called from FS_LoadFile for deflated pack entries
+static byte *prefetch_take(const packfile_t *file)
+{
+    prefetch_t *p = prefetch_find(file);
+    unsigned start;
+    byte *data;
+
+    if (!p)
+        return NULL;
+
+    start = Sys_Milliseconds();
+    data = prefetch_release(p);
+    fs_prefetch_stats.wait_msec += Sys_Milliseconds() - start;
+
+    if (data) {
+        fs_prefetch_stats.hits++;
+        fs_prefetch_stats.bytes += file->filelen;
+    }
+
+    // budget has been freed
+    prefetch_queue();
+    return data;
+}
+
+static void prefetch_flush(void)
+{
+    prefetch_t *p, *next;
+
+    // nothing will be queued after this point
+    LIST_FOR_EACH_SAFE(prefetch_t, p, next, &fs_prefetch_wait, entry) {
+        fs_prefetch_stats.wasted++;
+        prefetch_release(p);
+    }
+
+    LIST_FOR_EACH(prefetch_t, p, &fs_prefetch_busy, entry)
+        atomic_store(&p->cancel, 1);
+
+    LIST_FOR_EACH_SAFE(prefetch_t, p, next, &fs_prefetch_busy, entry) {
+        fs_prefetch_stats.wasted++;
+        Z_Free(prefetch_release(p));
+    }
+
+    Q_assert(!fs_prefetch_bytes);
+}
+
+/*
+============
+FS_BeginPrefetch
+
+Starts collecting files to be inflated in advance while loading given map.
+Returns false if prefetching is disabled.
+============
+*/
+bool FS_BeginPrefetch(const char *name)
+{
+    if (!fs_searchpaths)
+        return false;
+
+    FS_EndPrefetch();
+
+    if (!fs_prefetch->integer)
+        return false;
+
+    memset(&fs_prefetch_stats, 0, sizeof(fs_prefetch_stats));
+    Q_strlcpy(fs_prefetch_stats.name, name, sizeof(fs_prefetch_stats.name));
+    fs_prefetch_stats.start = Sys_Milliseconds();
+    return true;
+}
+
+/*
+============
+FS_PrefetchFile
+
+Schedules the file to be inflated in advance if it is a deflated pack entry.
+Next FS_LoadFile on this file will return prefetched data.
+Returns file length if file exists, error code otherwise.
+============
+*/
+int64_t FS_PrefetchFile(const char *path)
+{
+    file_t *file;
+    qhandle_t f;
+    prefetch_t *p;
+    int64_t ret;
+
+    Q_assert(path);
+
+    if (!fs_searchpaths) {
+        return Q_ERR(EAGAIN); // not yet initialized
+    }
+
+    file = alloc_handle(&f);
+    if (!file) {
+        return Q_ERR(EMFILE);
+    }
+
+    // deflate flag makes anything but deflated pack entry fail early
+    file->mode = FS_MODE_READ | FS_FLAG_LOADFILE | FS_FLAG_DEFLATE;
+
+    ret = expand_open_file_read(file, path);
+    if (ret == Q_ERR_BAD_COMPRESSION) {
+        return 0;   // exists, but not deflated
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = file->entry->filelen;
+    if (ret > 0 && ret <= MAX_LOADFILE && !prefetch_find(file->entry)) {
+        p = FS_Mallocz(sizeof(*p));
+        p->pack = pack_get(file->pack);
+        p->file = file->entry;
+        if (fs_mmap->integer && pack_map(p->pack) &&
+            p->file->filepos <= p->pack->map_size - p->file->complen) {
+            p->in = p->pack->map + p->file->filepos;
+        }
+        p->hash_next = fs_prefetch_hash[PREFETCH_HASH_INDEX(p->file)];
+        fs_prefetch_hash[PREFETCH_HASH_INDEX(p->file)] = p;
+        List_Append(&fs_prefetch_wait, &p->entry);
+        fs_prefetch_stats.files++;
+        prefetch_queue();
+    }
+
+    FS_CloseFile(f);
+    return ret;
+}
+
+/*
+============
+FS_EndPrefetch
+
+Drops prefetched data that was never loaded and prints timing report.
+============
+*/
+void FS_EndPrefetch(void)
+{
+    prefetch_flush();
+
+    if (fs_prefetch_stats.start && fs_prefetch->integer > 1) {
+        Com_Printf("Prefetch for %s: %d files, %d hits (%zu KiB), %d wasted, "
+                   "%d failed, %u msec inflating, %u msec waiting, %u msec total\n",
+                   fs_prefetch_stats.name, fs_prefetch_stats.files,
+                   fs_prefetch_stats.hits, fs_prefetch_stats.bytes >> 10,
+                   fs_prefetch_stats.wasted, fs_prefetch_stats.failed,
+                   fs_prefetch_stats.inflate_msec, fs_prefetch_stats.wait_msec,
+                   Sys_Milliseconds() - fs_prefetch_stats.start);
+    }
+
+    fs_prefetch_stats.start = 0;
+}
+
+#endif // USE_ZLIB
+
 /*
 ============
 FS_LoadFile
 
 opens non-unique file handle as an optimization
 a NULL buffer will just return the file length without loading
+
+with FS_FLAG_MAPPED, buffer may point into mapped pack file: it is read-only,
+not NUL terminated, and must be released with FS_FreeFile. Callers cast it to
+file headers with fields of at most 32 bits, so view is only returned when it
+is 4 byte aligned.
 ============
 */
 int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
@@ -1895,6 +2430,31 @@ int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
         goto done;
     }
 
+#if USE_ZLIB
+    // deflated pack entries may have been inflated in advance
+    if (file->type == FS_ZIP && tag == TAG_FILESYSTEM) {
+        buf = prefetch_take(file->entry);
+        if (buf) {
+            *buffer = buf;
+            goto done;
+        }
+    }
+#endif
+
+    // stored pack entries can be returned as a view into mapped pack,
+    // unaligned entries are copied like heap allocated buffers would be
+    if ((flags & FS_FLAG_MAPPED) && fs_mmap->integer && len > 0 &&
+        file->type == FS_PAK && !(file->mode & FS_FLAG_DEFLATE) &&
+        pack_map(file->pack) && file->entry->filepos <= file->pack->map_size - len &&
+        !((uintptr_t)(file->pack->map + file->entry->filepos) & (sizeof(uint32_t) - 1))) {
+        *buffer = (void *)(file->pack->map + file->entry->filepos);
+        pack_get(file->pack);
+        FS_COUNT_MAPPED;
+        goto done;
+    }
+
+    FS_COUNT_COPIED;
+
     // allocate chunk of memory, +1 for NUL
     buf = Z_TagMalloc(len + 1, tag);
 
@@ -1914,6 +2474,32 @@ done:
     return len;
 }
 
+/*
+============
+FS_FreeFile
+
+releases buffer returned by FS_LoadFile
+============
+*/
+void FS_FreeFile(void *buf)
+{
+    const byte *p = buf;
+    pack_t *pack;
+
+    if (!buf) {
+        return;
+    }
+
+    LIST_FOR_EACH(pack_t, pack, &fs_mapped_packs, map_entry) {
+        if (p >= pack->map && p < pack->map + pack->map_size) {
+            pack_put(pack);
+            return;
+        }
+    }
+
+    Z_Free(buf);
+}
+
 static int write_and_close(const void *data, size_t len, qhandle_t f)
 {
     int ret1 = FS_Write(data, len, f);
@@ -2006,6 +2592,8 @@ int FS_RenameFile(const char *from, const char *to)
     if (rename(frompath, topath))
         return Q_ERRNO;
 
+    FS_IndexFile(topath);
+
     return Q_ERR_SUCCESS;
 }
 
@@ -2033,8 +2621,79 @@ int FS_FPrintf(qhandle_t f, const char *format, ...)
     return FS_Write(string, len, f);
 }
 
+#ifdef _WIN32
+static const byte *os_map_file(FILE *fp, int64_t size)
+{
+    HANDLE h = CreateFileMappingA((HANDLE)_get_osfhandle(_fileno(fp)),
+                                  NULL, PAGE_READONLY, 0, 0, NULL);
+    void *map;
+
+    if (!h)
+        return NULL;
+
+    map = MapViewOfFile(h, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(h);
+    return map;
+}
+
+static void os_unmap_file(const byte *map, int64_t size)
+{
+    UnmapViewOfFile(map);
+}
+#else
+static const byte *os_map_file(FILE *fp, int64_t size)
+{
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+
+    if (map == MAP_FAILED)
+        return NULL;
+
+    return map;
+}
+
+static void os_unmap_file(const byte *map, int64_t size)
+{
+    munmap((void *)map, size);
+}
+#endif
+
+// maps the whole pack file on first use
+static bool pack_map(pack_t *pack)
+{
+    file_info_t info;
+
+    if (pack->map)
+        return true;
+    if (pack->map_failed)
+        return false;
+
+    pack->map_failed = true;
+
+    if (get_fp_info(pack->fp, &info))
+        return false;
+    if (info.size <= 0 || info.size > SIZE_MAX)
+        return false;
+
+    pack->map = os_map_file(pack->fp, info.size);
+    if (!pack->map) {
+        FS_DPrintf("%s: couldn't map %s\n", __func__, pack->filename);
+        return false;
+    }
+
+    pack->map_size = info.size;
+    pack->map_failed = false;
+    List_Append(&fs_mapped_packs, &pack->map_entry);
+
+    FS_DPrintf("%s: mapped %s: %"PRId64" bytes\n", __func__, pack->filename, pack->map_size);
+    return true;
+}
+
 static void pack_free(pack_t *pack)
 {
+    if (pack->map) {
+        os_unmap_file(pack->map, pack->map_size);
+        List_Remove(&pack->map_entry);
+    }
     fclose(pack->fp);
     Z_Free(pack->names);
     Z_Free(pack->file_hash);
@@ -2072,6 +2731,9 @@ static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
     pack->type = type;
     pack->refcount = 0;
     pack->fp = fp;
+    pack->map = NULL;
+    pack->map_size = 0;
+    pack->map_failed = false;
     pack->num_files = num_files;
     pack->files = FS_Malloc(num_files * sizeof(pack->files[0]));
     pack->hash_size = 0;
@@ -2619,6 +3281,7 @@ static void q_printf(2, 3) add_game_dir(unsigned mode, const char *fmt, ...)
         search->mode = mode;
         search->filename[0] = 0;
         search->pack = pack_get(pack);
+        search->index = NULL;
         search->next = fs_searchpaths;
         fs_searchpaths = search;
     }
@@ -2632,6 +3295,7 @@ static void q_printf(2, 3) add_game_dir(unsigned mode, const char *fmt, ...)
 	search = FS_Malloc(sizeof(*search) + len);
 	search->mode = mode;
 	search->pack = NULL;
+	search->index = NULL;
 	memcpy(search->filename, fs_gamedir, len + 1);
 	search->next = fs_searchpaths;
 	fs_searchpaths = search;
@@ -3300,6 +3964,9 @@ static void FS_Stats_f(void)
     Com_Printf("Total path comparsions: %d\n", fs_count_strcmp);
     Com_Printf("Total calls to open_from_disk: %d\n", fs_count_open);
     Com_Printf("Total mixed-case reopens: %d\n", fs_count_strlwr);
+    Com_Printf("Total loads from mapped packs: %d\n", fs_count_mapped);
+    Com_Printf("Total loads into allocated buffers: %d\n", fs_count_copied);
+    Com_Printf("Total directory lookups skipped by index: %d\n", fs_count_indexed);
 
     if (!totalHashSize) {
         Com_Printf("No stats to display\n");
@@ -3469,6 +4136,7 @@ update:
 
 static void free_search_path(searchpath_t *path)
 {
+    free_index(path->index);
     pack_put(path->pack);
     Z_Free(path);
 }
@@ -3568,6 +4236,13 @@ void FS_Restart(bool total)
 {
     Com_Printf("----- FS_Restart -----\n");
 
+#if USE_ZLIB
+    FS_EndPrefetch();
+#endif
+
+    // base paths are kept unless total, rebuild their indexes too
+    fs_index_gen++;
+
     if (total) {
         // perform full reset
         free_all_paths();
@@ -3630,6 +4305,10 @@ void FS_Shutdown(void)
         return;
     }
 
+#if USE_ZLIB
+    FS_EndPrefetch();
+#endif
+
     // close file handles
     for (i = 0, file = fs_files; i < fs_num_files; i++, file++) {
         if (file->type != FS_FREE) {
@@ -3781,6 +4460,12 @@ void FS_Init(void)
     Cmd_Register(c_fs);
 
     fs_autoexec = Cvar_Get("fs_autoexec", "1", 0);
+    fs_mmap = Cvar_Get("fs_mmap", "1", 0);
+    fs_index = Cvar_Get("fs_index", "1", 0);
+#if USE_ZLIB
+    fs_prefetch = Cvar_Get("fs_prefetch", "1", 0);
+    fs_prefetch_size = Cvar_Get("fs_prefetch_size", "64", 0);
+#endif
 
 #if USE_DEBUG
     fs_debug = Cvar_Get("fs_debug", "0", 0);
@@ -32,7 +32,7 @@ Handles byte ordering and avoids alignment errors
 ==============================================================================
 */
 
-sizebuf_t   msg_write;
+q_thread_local sizebuf_t msg_write;
 byte        msg_write_buffer[MAX_MSGLEN];
 
 sizebuf_t   msg_read;
@@ -48,8 +48,9 @@ MSG_Init
 
 Initialize default buffers, clearing allow overflow/underflow flags.
 
-This is the only place where writing buffer is initialized. Writing buffer is
-never allowed to overflow.
+This is the only place where writing buffer is initialized for the main
+thread. Writing buffer is never allowed to overflow. It is thread local, so
+worker threads that encode messages must point it at their own storage.
 
 Reading buffer is reinitialized in many other places. Reinitializing will set
 the allow underflow flag as appropriate.
@@ -495,62 +496,113 @@ void MSG_PackEntity(entity_packed_t *out, const entity_state_t *in, const entity
     }
 }
 
-void MSG_WriteDeltaEntity(const entity_packed_t *from,
-                          const entity_packed_t *to,
-                          msgEsFlags_t          flags)
-{
-    uint64_t    bits;
-    uint32_t    mask;
+/*
+Changed fields of packed entity states can be found by comparing them as
+raw memory. On SSE2 and NEON the states are compared 16 bytes at a time,
+giving a mask with one bit per differing byte. The scalar path compares
+field by field. Both must produce identical U_* bits.
+*/
+#if (defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define USE_SIMD_DELTA  1   // SSE2
+#elif defined __ARM_NEON && defined __aarch64__ && defined __BYTE_ORDER__ && \
+      __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define USE_SIMD_DELTA  2   // NEON
+#else
+#define USE_SIMD_DELTA  0
+#endif
 
-    if (!to) {
-        Q_assert(from);
-        Q_assert(from->number > 0 && from->number < MAX_EDICTS);
+// mask of bytes occupied by the field
+#define ES_FIELD(f) \
+    (((1ULL << sizeof(((entity_packed_t *)0)->f)) - 1) << q_offsetof(entity_packed_t, f))
 
-        bits = U_REMOVE;
-        if (from->number & 0xff00)
-            bits |= U_NUMBER16 | U_MOREBITS1;
+// mask of the high byte of 16-bit field (little endian only)
+#define ES_HIBYTE(f) \
+    BIT_ULL(q_offsetof(entity_packed_t, f) + 1)
 
-        MSG_WriteByte(bits & 255);
-        if (bits & 0x0000ff00)
-            MSG_WriteByte((bits >> 8) & 255);
+#if USE_SIMD_DELTA
 
-        if (bits & U_NUMBER16)
-            MSG_WriteShort(from->number);
-        else
-            MSG_WriteByte(from->number);
+// mask of all bytes up to the end of the last field, excluding tail padding
+#define ES_ALLFIELDS \
+    (BIT_ULL(q_offsetof(entity_packed_t, loop_attenuation) + 1) - 1)
 
-        return; // remove entity
-    }
+// last lane overlaps previous one to avoid reading past the end of struct
+#define ES_LAST_LANE    (sizeof(entity_packed_t) - 16)
 
-    Q_assert(to->number > 0 && to->number < MAX_EDICTS);
+_Static_assert(sizeof(entity_packed_t) >= 48 && sizeof(entity_packed_t) <= 64,
+               "entity_packed_t doesn't fit in four 16-byte lanes");
 
-    if (!from)
-        from = &nullEntityState;
+#if USE_SIMD_DELTA == 1
+static inline uint64_t diff_lane(const byte *a, const byte *b)
+{
+    __m128i va = _mm_loadu_si128((const __m128i *)a);
+    __m128i vb = _mm_loadu_si128((const __m128i *)b);
+    return (uint16_t)~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+}
+#else
+static inline uint64_t diff_lane(const byte *a, const byte *b)
+{
+    static const uint8_t weights[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    uint8x16_t ne = vmvnq_u8(vceqq_u8(vld1q_u8(a), vld1q_u8(b)));
+    uint8x16_t m = vandq_u8(ne, vld1q_u8(weights));
+    return vaddv_u8(vget_low_u8(m)) | (vaddv_u8(vget_high_u8(m)) << 8);
+}
+#endif
+
+// returns mask with bits set for each byte that differs
+static inline uint64_t entity_diff(const entity_packed_t *from, const entity_packed_t *to)
+{
+    const byte *a = (const byte *)from;
+    const byte *b = (const byte *)to;
+
+    return diff_lane(a, b) | diff_lane(a + 16, b + 16) << 16 |
+           diff_lane(a + 32, b + 32) << 32 | diff_lane(a + ES_LAST_LANE, b + ES_LAST_LANE) << ES_LAST_LANE;
+}
+
+#endif // USE_SIMD_DELTA
+
+#define CHANGED(f) \
+    (simd ? !!(diff & ES_FIELD(f)) : to->f != from->f)
+
+#define HIBYTE_CHANGED(f) \
+    (simd ? !!(diff & ES_HIBYTE(f)) : !!((to->f ^ from->f) & 0xff00))
+
+// simd is constant at each call site, so only one flavor of compares is
+// compiled into each inlined copy
+static inline uint64_t delta_entity_bits(const entity_packed_t *from,
+                                         const entity_packed_t *to,
+                                         msgEsFlags_t flags,
+                                         uint64_t diff, bool simd)
+{
+    uint64_t    bits;
+    uint32_t    mask;
 
-// send an update
     bits = 0;
 
     if (!(flags & MSG_ES_FIRSTPERSON)) {
-        if (to->origin[0] != from->origin[0])
+        if (CHANGED(origin[0]))
             bits |= U_ORIGIN1;
-        if (to->origin[1] != from->origin[1])
+        if (CHANGED(origin[1]))
             bits |= U_ORIGIN2;
-        if (to->origin[2] != from->origin[2])
+        if (CHANGED(origin[2]))
             bits |= U_ORIGIN3;
 
         if (flags & MSG_ES_SHORTANGLES) {
-            if (to->angles[0] != from->angles[0])
+            if (CHANGED(angles[0]))
                 bits |= U_ANGLE1 | U_ANGLE16;
-            if (to->angles[1] != from->angles[1])
+            if (CHANGED(angles[1]))
                 bits |= U_ANGLE2 | U_ANGLE16;
-            if (to->angles[2] != from->angles[2])
+            if (CHANGED(angles[2]))
                 bits |= U_ANGLE3 | U_ANGLE16;
         } else {
-            if ((to->angles[0] ^ from->angles[0]) & 0xff00)
+            if (HIBYTE_CHANGED(angles[0]))
                 bits |= U_ANGLE1;
-            if ((to->angles[1] ^ from->angles[1]) & 0xff00)
+            if (HIBYTE_CHANGED(angles[1]))
                 bits |= U_ANGLE2;
-            if ((to->angles[2] ^ from->angles[2]) & 0xff00)
+            if (HIBYTE_CHANGED(angles[2]))
                 bits |= U_ANGLE3;
         }
 
@@ -563,7 +615,7 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
     else
         mask = 0xffff8000;  // don't confuse old clients
 
-    if (to->skinnum != from->skinnum) {
+    if (CHANGED(skinnum)) {
         if (to->skinnum & mask)
             bits |= U_SKIN32;
         else if (to->skinnum & 0x0000ff00)
@@ -572,14 +624,14 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_SKIN8;
     }
 
-    if (to->frame != from->frame) {
+    if (CHANGED(frame)) {
         if (to->frame & 0xff00)
             bits |= U_FRAME16;
         else
             bits |= U_FRAME8;
     }
 
-    if (to->effects != from->effects) {
+    if (CHANGED(effects)) {
         if (to->effects & mask)
             bits |= U_EFFECTS32;
         else if (to->effects & 0x0000ff00)
@@ -588,7 +640,7 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_EFFECTS8;
     }
 
-    if (to->renderfx != from->renderfx) {
+    if (CHANGED(renderfx)) {
         if (to->renderfx & mask)
             bits |= U_RENDERFX32;
         else if (to->renderfx & 0x0000ff00)
@@ -597,29 +649,29 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_RENDERFX8;
     }
 
-    if (to->solid != from->solid)
+    if (CHANGED(solid))
         bits |= U_SOLID;
 
     // event is not delta compressed, just 0 compressed
     if (to->event)
         bits |= U_EVENT;
 
-    if (to->modelindex != from->modelindex)
+    if (CHANGED(modelindex))
         bits |= U_MODEL;
-    if (to->modelindex2 != from->modelindex2)
+    if (CHANGED(modelindex2))
         bits |= U_MODEL2;
-    if (to->modelindex3 != from->modelindex3)
+    if (CHANGED(modelindex3))
         bits |= U_MODEL3;
-    if (to->modelindex4 != from->modelindex4)
+    if (CHANGED(modelindex4))
         bits |= U_MODEL4;
 
     if (flags & MSG_ES_EXTENSIONS) {
         if (bits & (U_MODEL | U_MODEL2 | U_MODEL3 | U_MODEL4) &&
             (to->modelindex | to->modelindex2 | to->modelindex3 | to->modelindex4) & 0xff00)
             bits |= U_MODEL16;
-        if (to->loop_volume != from->loop_volume || to->loop_attenuation != from->loop_attenuation)
+        if (CHANGED(loop_volume) || CHANGED(loop_attenuation))
             bits |= U_SOUND;
-        if (to->morefx != from->morefx) {
+        if (CHANGED(morefx)) {
             if (to->morefx & mask)
                 bits |= U_MOREFX32;
             else if (to->morefx & 0x0000ff00)
@@ -627,13 +679,13 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             else
                 bits |= U_MOREFX8;
         }
-        if (to->alpha != from->alpha)
+        if (CHANGED(alpha))
             bits |= U_ALPHA;
-        if (to->scale != from->scale)
+        if (CHANGED(scale))
             bits |= U_SCALE;
     }
 
-    if (to->sound != from->sound)
+    if (CHANGED(sound))
         bits |= U_SOUND;
 
     if (to->renderfx & RF_FRAMELERP) {
@@ -644,6 +696,90 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_OLDORIGIN;
     }
 
+    return bits;
+}
+
+#undef CHANGED
+#undef HIBYTE_CHANGED
+
+static void write_delta_entity(const entity_packed_t *from,
+                               const entity_packed_t *to,
+                               msgEsFlags_t          flags,
+                               uint64_t              bits);
+
+void MSG_WriteDeltaEntity(const entity_packed_t *from,
+                          const entity_packed_t *to,
+                          msgEsFlags_t          flags)
+{
+    uint64_t    bits;
+
+    if (!to) {
+        Q_assert(from);
+        Q_assert(from->number > 0 && from->number < MAX_EDICTS);
+
+        bits = U_REMOVE;
+        if (from->number & 0xff00)
+            bits |= U_NUMBER16 | U_MOREBITS1;
+
+        MSG_WriteByte(bits & 255);
+        if (bits & 0x0000ff00)
+            MSG_WriteByte((bits >> 8) & 255);
+
+        if (bits & U_NUMBER16)
+            MSG_WriteShort(from->number);
+        else
+            MSG_WriteByte(from->number);
+
+        return; // remove entity
+    }
+
+    Q_assert(to->number > 0 && to->number < MAX_EDICTS);
+
+    if (!from)
+        from = &nullEntityState;
+
+// send an update
+#if USE_SIMD_DELTA
+    uint64_t diff = entity_diff(from, to) & ES_ALLFIELDS;
+
+    // fast path for unchanged entities that don't need to be sent
+    if (!diff && !to->event && !(flags & (MSG_ES_FORCE | MSG_ES_NEWENTITY)) &&
+        !(to->renderfx & (RF_FRAMELERP | RF_BEAM)))
+        return;
+
+    bits = delta_entity_bits(from, to, flags, diff, true);
+#else
+    bits = delta_entity_bits(from, to, flags, 0, false);
+#endif
+
+    write_delta_entity(from, to, flags, bits);
+}
+
+#if USE_TESTS
+// reference encoder that always uses scalar compares
+void MSG_WriteDeltaEntityScalar(const entity_packed_t *from,
+                                const entity_packed_t *to,
+                                msgEsFlags_t          flags)
+{
+    if (!to) {
+        MSG_WriteDeltaEntity(from, to, flags);
+        return;
+    }
+
+    Q_assert(to->number > 0 && to->number < MAX_EDICTS);
+
+    if (!from)
+        from = &nullEntityState;
+
+    write_delta_entity(from, to, flags, delta_entity_bits(from, to, flags, 0, false));
+}
+#endif
+
+static void write_delta_entity(const entity_packed_t *from,
+                               const entity_packed_t *to,
+                               msgEsFlags_t          flags,
+                               uint64_t              bits)
+{
     //
     // write the message
     //
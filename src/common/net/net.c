@@ -68,6 +68,38 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // prevents infinite retry loops caused by broken TCP/IP stacks
 #define MAX_ERROR_RETRIES   64
 
+// Linux can move multiple datagrams per system call
+#if defined(__linux__) && defined(_GNU_SOURCE)
+#define USE_MMSG    1
+#else
+#define USE_MMSG    0
+#endif
+
+#if USE_MMSG
+
+#define MAX_MMSG_PACKETS    32
+
+typedef struct {
+    struct mmsghdr          hdrs[MAX_MMSG_PACKETS];
+    struct iovec            iovs[MAX_MMSG_PACKETS];
+    struct sockaddr_storage addrs[MAX_MMSG_PACKETS];
+    byte                    data[MAX_MMSG_PACKETS][MAX_PACKETLEN];
+} mmsg_ring_t;
+
+// outgoing datagrams waiting for NET_FlushSendBatch
+typedef struct {
+    struct pollfd   *sock;
+    int             count;
+    netadr_t        to[MAX_MMSG_PACKETS];
+    mmsg_ring_t     ring;
+} mmsg_queue_t;
+
+static mmsg_ring_t  recv_ring;
+static mmsg_queue_t send_queues[2];     // IPv4 and IPv6
+static bool         send_batching[NS_COUNT];
+
+#endif // USE_MMSG
+
 #if USE_CLIENT
 
 #define MAX_LOOPBACK    4
@@ -106,6 +138,10 @@ static cvar_t   *net_log_flush;
 
 static cvar_t   *net_enable_ipv6;
 
+#if USE_MMSG
+static cvar_t   *net_batch;
+#endif
+
 #if USE_ICMP
 static cvar_t   *net_ignore_icmp;
 #endif
@@ -145,6 +181,12 @@ static uint64_t     net_bytes_rcvd;
 static uint64_t     net_bytes_sent;
 static uint64_t     net_packets_rcvd;
 static uint64_t     net_packets_sent;
+#if USE_MMSG
+static uint64_t     net_recv_calls;
+static uint64_t     net_recv_batched;
+static uint64_t     net_send_calls;
+static uint64_t     net_send_batched;
+#endif
 
 //=============================================================================
 
@@ -517,6 +559,14 @@ static void NET_Stats_f(void)
 #else
     Com_Printf("Total errors: %"PRIu64"/%"PRIu64" (send/recv)\n",
                net_send_errors, net_recv_errors);
+#endif
+#if USE_MMSG
+    Com_Printf("Batched recv: %"PRIu64" packets in %"PRIu64" calls (%.2f per call)\n",
+               net_recv_batched, net_recv_calls,
+               net_recv_calls ? (double)net_recv_batched / net_recv_calls : 0.0);
+    Com_Printf("Batched send: %"PRIu64" packets in %"PRIu64" calls (%.2f per call)\n",
+               net_send_batched, net_send_calls,
+               net_send_calls ? (double)net_send_batched / net_send_calls : 0.0);
 #endif
     Com_Printf("Current upload rate: %zu bytes/sec\n", net_rate_up);
     Com_Printf("Current download rate: %zu bytes/sec\n", net_rate_dn);
@@ -746,6 +796,178 @@ int NET_Sleep1(int msec, struct pollfd *e)
 
 //=============================================================================
 
+#if USE_MMSG
+
+static void NET_ResetRing(mmsg_ring_t *r, int count)
+{
+    struct mmsghdr *h;
+    int i;
+
+    for (i = 0, h = r->hdrs; i < count; i++, h++) {
+        memset(h, 0, sizeof(*h));
+        h->msg_hdr.msg_name = &r->addrs[i];
+        h->msg_hdr.msg_namelen = sizeof(r->addrs[i]);
+        h->msg_hdr.msg_iov = &r->iovs[i];
+        h->msg_hdr.msg_iovlen = 1;
+        r->iovs[i].iov_base = r->data[i];
+        r->iovs[i].iov_len = MAX_PACKETLEN;
+    }
+}
+
+/*
+=============
+NET_GetUdpBatch
+
+Receives up to MAX_MMSG_PACKETS datagrams per system call into the ring,
+then hands them to packet_cb one by one in arrival order.
+=============
+*/
+static void NET_GetUdpBatch(struct pollfd *sock, void (*packet_cb)(void))
+{
+    mmsg_ring_t *r = &recv_ring;
+    int i, ret, len;
+
+    while (1) {
+        NET_ResetRing(r, MAX_MMSG_PACKETS);
+
+        ret = os_udp_recvmmsg(sock->fd, r->hdrs, MAX_MMSG_PACKETS);
+        if (ret == NET_AGAIN) {
+            sock->revents = 0;
+            break;
+        }
+
+        if (ret == NET_ERROR) {
+            Com_DPrintf("%s: %s\n", __func__, NET_ErrorString());
+            net_recv_errors++;
+            break;
+        }
+
+        net_recv_calls++;
+        net_recv_batched += ret;
+
+        for (i = 0; i < ret; i++) {
+            len = r->hdrs[i].msg_len;
+
+            NET_SockadrToNetadr(&r->addrs[i], &net_from);
+            NET_LogPacket(&net_from, "UDP recv", r->data[i], len);
+
+            net_rate_rcvd += len;
+            net_bytes_rcvd += len;
+            net_packets_rcvd++;
+
+            // callbacks expect the packet in msg_read_buffer
+            memcpy(msg_read_buffer, r->data[i], len);
+            SZ_Init(&msg_read, msg_read_buffer, sizeof(msg_read_buffer));
+            msg_read.cursize = len;
+
+            (*packet_cb)();
+        }
+
+        // short batch means socket has been drained
+        if (ret < MAX_MMSG_PACKETS) {
+            sock->revents = 0;
+            break;
+        }
+    }
+}
+
+static void NET_FlushUdpQueue(mmsg_queue_t *q)
+{
+    mmsg_ring_t *r = &q->ring;
+    int i, j, ret;
+
+    for (i = 0; i < q->count; ) {
+        ret = os_udp_sendmmsg(q->sock->fd, r->hdrs + i, q->count - i, &q->to[i]);
+
+        // remaining packets are dropped, just like unbatched sends
+        if (ret == NET_AGAIN)
+            break;
+
+        // skip the offending packet and continue with the rest
+        if (ret == NET_ERROR) {
+            Com_DPrintf("%s: %s to %s\n", __func__,
+                        NET_ErrorString(), NET_AdrToString(&q->to[i]));
+            net_send_errors++;
+            i++;
+            continue;
+        }
+
+        net_send_calls++;
+        net_send_batched += ret;
+
+        for (j = i; j < i + ret; j++) {
+            if (r->hdrs[j].msg_len < r->iovs[j].iov_len)
+                Com_WPrintf("%s: short send to %s\n", __func__,
+                            NET_AdrToString(&q->to[j]));
+
+            NET_LogPacket(&q->to[j], "UDP send", r->data[j], r->hdrs[j].msg_len);
+
+            net_rate_sent += r->hdrs[j].msg_len;
+            net_bytes_sent += r->hdrs[j].msg_len;
+            net_packets_sent++;
+        }
+
+        i += ret;
+    }
+
+    q->count = 0;
+}
+
+static bool NET_QueueUdpPacket(struct pollfd *s, const void *data,
+                               size_t len, const netadr_t *to)
+{
+    mmsg_queue_t *q, *free = NULL;
+    struct mmsghdr *h;
+    int i;
+
+    for (i = 0, q = send_queues; i < q_countof(send_queues); i++, q++) {
+        if (q->sock == s)
+            break;
+        if (!free && !q->count)
+            free = q;
+    }
+
+    if (i == q_countof(send_queues)) {
+        if (!free) {
+            free = &send_queues[0];
+            NET_FlushUdpQueue(free);
+        }
+        q = free;
+        q->sock = s;
+    }
+
+    if (q->count == MAX_MMSG_PACKETS)
+        NET_FlushUdpQueue(q);
+
+    if (!q->count)
+        NET_ResetRing(&q->ring, MAX_MMSG_PACKETS);
+
+    i = q->count++;
+    h = &q->ring.hdrs[i];
+    h->msg_hdr.msg_namelen = NET_NetadrToSockadr(to, &q->ring.addrs[i]);
+    q->ring.iovs[i].iov_len = len;
+    memcpy(q->ring.data[i], data, len);
+    q->to[i] = *to;
+
+    return true;
+}
+
+// called when socket is closed with packets still queued
+static void NET_DropUdpQueue(struct pollfd *s)
+{
+    mmsg_queue_t *q;
+    int i;
+
+    for (i = 0, q = send_queues; i < q_countof(send_queues); i++, q++) {
+        if (q->sock == s) {
+            q->sock = NULL;
+            q->count = 0;
+        }
+    }
+}
+
+#endif // USE_MMSG
+
 static void NET_GetUdpPackets(struct pollfd *sock, void (*packet_cb)(void))
 {
     int ret;
@@ -758,6 +980,13 @@ static void NET_GetUdpPackets(struct pollfd *sock, void (*packet_cb)(void))
     if (!(sock->revents & (POLLIN | POLLERR)))
         return;
 
+#if USE_MMSG
+    if (net_batch->integer > 0) {
+        NET_GetUdpBatch(sock, packet_cb);
+        return;
+    }
+#endif
+
     while (1) {
         ret = os_udp_recv(sock->fd, msg_read_buffer, MAX_PACKETLEN, &net_from);
         if (ret == NET_AGAIN) {
@@ -810,16 +1039,46 @@ void NET_GetPackets(netsrc_t sock, void (*packet_cb)(void))
     NET_GetUdpPackets(udp6_sockets[sock], packet_cb);
 }
 
+static bool NET_SendUdpPacket(struct pollfd *s, const void *data,
+                              size_t len, const netadr_t *to)
+{
+    int ret;
+
+    ret = os_udp_send(s->fd, data, len, to);
+    if (ret == NET_AGAIN)
+        return false;
+
+    if (ret == NET_ERROR) {
+        Com_DPrintf("%s: %s to %s\n", __func__,
+                    NET_ErrorString(), NET_AdrToString(to));
+        net_send_errors++;
+        return false;
+    }
+
+    if (ret < len)
+        Com_WPrintf("%s: short send to %s\n", __func__,
+                    NET_AdrToString(to));
+
+    NET_LogPacket(to, "UDP send", data, ret);
+
+    net_rate_sent += ret;
+    net_bytes_sent += ret;
+    net_packets_sent++;
+
+    return true;
+}
+
 /*
 =============
 NET_SendPacket
 
+Between NET_BeginSendBatch and NET_FlushSendBatch UDP packets are only
+queued, and true return value means the packet was accepted for sending.
 =============
 */
 bool NET_SendPacket(netsrc_t sock, const void *data,
                     size_t len, const netadr_t *to)
 {
-    int ret;
     struct pollfd *s;
 
     if (len == 0)
@@ -852,34 +1111,59 @@ bool NET_SendPacket(netsrc_t sock, const void *data,
     if (!s)
         return false;
 
-    ret = os_udp_send(s->fd, data, len, to);
-    if (ret == NET_AGAIN)
-        return false;
+#if USE_MMSG
+    if (send_batching[sock] && net_batch->integer > 0)
+        return NET_QueueUdpPacket(s, data, len, to);
+#endif
 
-    if (ret == NET_ERROR) {
-        Com_DPrintf("%s: %s to %s\n", __func__,
-                    NET_ErrorString(), NET_AdrToString(to));
-        net_send_errors++;
-        return false;
-    }
+    return NET_SendUdpPacket(s, data, len, to);
+}
 
-    if (ret < len)
-        Com_WPrintf("%s: short send to %s\n", __func__,
-                    NET_AdrToString(to));
+/*
+=============
+NET_BeginSendBatch
 
-    NET_LogPacket(to, "UDP send", data, ret);
+Starts queuing outgoing UDP packets on the given socket.
+=============
+*/
+void NET_BeginSendBatch(netsrc_t sock)
+{
+#if USE_MMSG
+    send_batching[sock] = true;
+#endif
+}
 
-    net_rate_sent += ret;
-    net_bytes_sent += ret;
-    net_packets_sent++;
+/*
+=============
+NET_FlushSendBatch
 
-    return true;
+Transmits all queued packets and returns to unbatched sending.
+=============
+*/
+void NET_FlushSendBatch(netsrc_t sock)
+{
+#if USE_MMSG
+    mmsg_queue_t *q;
+    int i;
+
+    for (i = 0, q = send_queues; i < q_countof(send_queues); i++, q++) {
+        if (!q->count)
+            continue;
+        if (q->sock == udp_sockets[sock] || q->sock == udp6_sockets[sock])
+            NET_FlushUdpQueue(q);
+    }
+
+    send_batching[sock] = false;
+#endif
 }
 
 //=============================================================================
 
 static void NET_CloseSocket(struct pollfd *s)
 {
+#if USE_MMSG
+    NET_DropUdpQueue(s);
+#endif
     os_closesocket(s->fd);
     NET_FreePollFd(s);
 }
@@ -1515,6 +1799,11 @@ void NET_UpdateStream(netstream_t *s)
     size_t len;
     struct pollfd *e = s->socket;
 
+    // account data written by NET_SendStream
+    net_rate_sent += s->sent;
+    net_bytes_sent += s->sent;
+    s->sent = 0;
+
     if (s->state != NS_CONNECTED) {
         return;
     }
@@ -1633,6 +1922,50 @@ error:
     return NET_ERROR;
 }
 
+/*
+=============
+NET_SendStream
+
+Writes as much buffered data as socket accepts, without waiting for POLLOUT.
+Doesn't touch poll events and global statistics, so it can be called from
+worker thread while main thread leaves this stream alone. Written data is
+accounted for by the next NET_UpdateStream call.
+=============
+*/
+neterr_t NET_SendStream(netstream_t *s)
+{
+    int ret;
+    size_t len;
+    void *data;
+
+    if (s->state != NS_CONNECTED) {
+        return NET_AGAIN;
+    }
+
+    while (1) {
+        data = FIFO_Peek(&s->send, &len);
+        if (!len) {
+            return NET_OK;
+        }
+
+        ret = os_send(s->socket->fd, data, len, 0);
+        if (!ret) {
+            s->state = NS_CLOSED;
+            return NET_CLOSED;
+        }
+        if (ret == NET_ERROR) {
+            s->state = NS_BROKEN;
+            return NET_ERROR;
+        }
+        if (ret == NET_AGAIN) {
+            return NET_AGAIN;
+        }
+
+        FIFO_Decommit(&s->send, ret);
+        s->sent += ret;
+    }
+}
+
 //===================================================================
 
 static void dump_addrinfo(struct addrinfo *ai)
@@ -1771,6 +2104,119 @@ static void NET_Dns_f(void)
     freeaddrinfo(res);
 }
 
+#if USE_TESTS && USE_MMSG
+
+static int  looptest_size;
+static int  looptest_next;
+static int  looptest_rcvd;
+static int  looptest_errors;
+
+static void NET_LoopTestPacket(void)
+{
+    int seq;
+
+    looptest_rcvd++;
+
+    if (msg_read.cursize != looptest_size) {
+        looptest_errors++;
+        return;
+    }
+
+    memcpy(&seq, msg_read.data, sizeof(seq));
+    if (seq != looptest_next)
+        looptest_errors++;
+    looptest_next = seq + 1;
+}
+
+static unsigned NET_LoopTestPass(struct pollfd *send, struct pollfd *recv,
+                                 const netadr_t *to, byte *data, int count)
+{
+    unsigned start;
+    int i, seq, burst;
+
+    // stay well within default socket receive buffer
+    burst = Q_clip(65536 / looptest_size, 1, MAX_MMSG_PACKETS);
+
+    looptest_next = looptest_rcvd = looptest_errors = 0;
+
+    start = Sys_Milliseconds();
+    for (seq = 0; seq < count; ) {
+        for (i = 0; i < burst && seq < count; i++, seq++) {
+            memcpy(data, &seq, sizeof(seq));
+            if (net_batch->integer > 0)
+                NET_QueueUdpPacket(send, data, looptest_size, to);
+            else
+                NET_SendUdpPacket(send, data, looptest_size, to);
+        }
+
+        for (i = 0; i < q_countof(send_queues); i++)
+            if (send_queues[i].sock == send && send_queues[i].count)
+                NET_FlushUdpQueue(&send_queues[i]);
+
+        recv->revents = POLLIN;
+        NET_GetUdpPackets(recv, NET_LoopTestPacket);
+    }
+
+    return Sys_Milliseconds() - start;
+}
+
+/*
+====================
+NET_LoopTest_f
+
+Pumps datagrams between two sockets bound to loopback interface, first with
+one system call per packet, then batched. Verifies every packet arrives
+intact and in order.
+====================
+*/
+static void NET_LoopTest_f(void)
+{
+    struct pollfd *send, *recv;
+    netadr_t to;
+    byte *data;
+    int i, count, batch;
+    uint64_t calls;
+    unsigned msec;
+
+    count = Cmd_Argc() > 1 ? Q_clip(Q_atoi(Cmd_Argv(1)), 1, 10000000) : 100000;
+    looptest_size = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 4, MAX_PACKETLEN) : 1024;
+
+    send = UDP_OpenSocket("127.0.0.1", PORT_ANY, AF_INET);
+    recv = UDP_OpenSocket("127.0.0.1", PORT_ANY, AF_INET);
+    if (!send || !recv || os_getsockname(recv->fd, &to)) {
+        Com_EPrintf("Couldn't open loopback sockets\n");
+        goto fail;
+    }
+
+    data = Z_Mallocz(looptest_size);
+    batch = net_batch->integer;
+
+    for (i = 0; i < 2; i++) {
+        Cvar_SetInteger(net_batch, i, FROM_CODE);
+        calls = net_send_calls + net_recv_calls;
+
+        msec = NET_LoopTestPass(send, recv, &to, data, count);
+
+        calls = i ? net_send_calls + net_recv_calls - calls : count * 2;
+        Com_Printf("%s: %d packets of %d bytes in %u msec, %"PRIu64" calls, "
+                   "%d lost, %d errors\n", i ? "batched" : "single",
+                   count, looptest_size, msec, calls,
+                   count - looptest_rcvd, looptest_errors);
+    }
+
+    Cvar_SetInteger(net_batch, batch, FROM_CODE);
+    Z_Free(data);
+
+fail:
+    if (send)
+        NET_CloseSocket(send);
+    if (recv)
+        NET_CloseSocket(recv);
+}
+
+#endif // USE_TESTS && USE_MMSG
+
+
 /*
 ====================
 NET_Restart_f
@@ -1854,6 +2300,10 @@ void NET_Init(void)
     net_ignore_icmp = Cvar_Get("net_ignore_icmp", "0", 0);
 #endif
 
+#if USE_MMSG
+    net_batch = Cvar_Get("net_batch", "1", 0);
+#endif
+
 #if USE_DEBUG
     net_log_enable_changed(net_log_enable);
 #endif
@@ -1864,6 +2314,9 @@ void NET_Init(void)
     Cmd_AddCommand("net_stats", NET_Stats_f);
     Cmd_AddCommand("showip", NET_ShowIP_f);
     Cmd_AddCommand("dns", NET_Dns_f);
+#if USE_TESTS && USE_MMSG
+    Cmd_AddCommand("net_looptest", NET_LoopTest_f);
+#endif
 
     Cmd_AddMacro("net_uprate", NET_UpRate_m);
     Cmd_AddMacro("net_dnrate", NET_DnRate_m);
@@ -1888,5 +2341,8 @@ void NET_Shutdown(void)
     Cmd_RemoveCommand("net_stats");
     Cmd_RemoveCommand("showip");
     Cmd_RemoveCommand("dns");
+#if USE_TESTS && USE_MMSG
+    Cmd_RemoveCommand("net_looptest");
+#endif
 }
 
@@ -163,6 +163,59 @@ static int os_udp_send(qsocket_t sock, const void *data,
     return NET_ERROR;
 }
 
+#if USE_MMSG
+
+// returns number of datagrams received, which may be less than count
+static int os_udp_recvmmsg(qsocket_t sock, struct mmsghdr *msgs, int count)
+{
+    int ret;
+    int tries;
+
+    for (tries = 0; tries < MAX_ERROR_RETRIES; tries++) {
+        ret = recvmmsg(sock, msgs, count, 0, NULL);
+        if (ret >= 0)
+            return ret;
+
+        net_error = errno;
+
+        // wouldblock is silent
+        if (net_error == EWOULDBLOCK)
+            return NET_AGAIN;
+
+        if (!process_error_queue(sock, NULL))
+            break;
+    }
+
+    return NET_ERROR;
+}
+
+// returns number of datagrams sent, error applies to the first one
+static int os_udp_sendmmsg(qsocket_t sock, struct mmsghdr *msgs,
+                           int count, const netadr_t *to)
+{
+    int ret;
+    int tries;
+
+    for (tries = 0; tries < MAX_ERROR_RETRIES; tries++) {
+        ret = sendmmsg(sock, msgs, count, 0);
+        if (ret >= 0)
+            return ret;
+
+        net_error = errno;
+
+        // wouldblock is silent
+        if (net_error == EWOULDBLOCK)
+            return NET_AGAIN;
+
+        if (!process_error_queue(sock, to))
+            break;
+    }
+
+    return NET_ERROR;
+}
+
+#endif // USE_MMSG
+
 static neterr_t os_get_error(void)
 {
     net_error = errno;
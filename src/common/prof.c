@@ -0,0 +1,216 @@
+/*
+Copyright (C) 2026 Q2RTX contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "shared/shared.h"
+#include "common/cmd.h"
+#include "common/common.h"
+#include "common/cvar.h"
+#include "common/files.h"
+#include "common/prof.h"
+#include "system/system.h"
+
+static cvar_t   *com_profile;
+
+static char     prof_names[PROF_MAX_ZONES][MAX_QPATH] = {
+    "sv_frame",
+    "sv_packets",
+    "sv_gtv",
+    "sv_game",
+    "sv_mvd",
+    "sv_send",
+    "sv_build",
+    "sv_write",
+    "sv_wait",
+};
+
+static int      prof_numzones = PROF_NUM_STATIC;
+
+// usec spent in each zone during current frame
+static uint32_t prof_accum[PROF_MAX_ZONES];
+
+// ring of completed frames
+static uint32_t prof_samples[PROF_SAMPLES][PROF_MAX_ZONES];
+static unsigned prof_frames;
+
+/*
+=================
+Prof_Register
+
+Returns zone for the given name, adding it if not found. Returns -1 if there
+are too many zones, which Prof_End() silently ignores.
+=================
+*/
+int Prof_Register(const char *name)
+{
+    int i;
+
+    for (i = 0; i < prof_numzones; i++)
+        if (!strcmp(prof_names[i], name))
+            return i;
+
+    if (prof_numzones == PROF_MAX_ZONES) {
+        Com_WPrintf("Too many profiler zones\n");
+        return -1;
+    }
+
+    Q_strlcpy(prof_names[prof_numzones], name, sizeof(prof_names[0]));
+    return prof_numzones++;
+}
+
+// returns 0 if profiling is disabled
+uint64_t Prof_Begin(void)
+{
+    if (!com_profile->integer)
+        return 0;
+
+    return Sys_Microseconds();
+}
+
+void Prof_End(int zone, uint64_t start)
+{
+    if (!start || zone < 0 || zone >= prof_numzones)
+        return;
+
+    prof_accum[zone] += Sys_Microseconds() - start;
+}
+
+// called once per server frame
+void Prof_EndFrame(void)
+{
+    if (!com_profile->integer)
+        return;
+
+    memcpy(prof_samples[prof_frames % PROF_SAMPLES], prof_accum, sizeof(prof_accum));
+    memset(prof_accum, 0, sizeof(prof_accum));
+    prof_frames++;
+}
+
+void Prof_Reset(void)
+{
+    memset(prof_accum, 0, sizeof(prof_accum));
+    prof_frames = 0;
+}
+
+static int uintcmp(const void *p1, const void *p2)
+{
+    uint32_t a = *(const uint32_t *)p1;
+    uint32_t b = *(const uint32_t *)p2;
+
+    return (a > b) - (a < b);
+}
+
+// prints per zone statistics for the last PROF_SAMPLES frames
+void Prof_PrintStats(void)
+{
+    uint32_t sorted[PROF_SAMPLES];
+    uint64_t total;
+    int i, j, count;
+
+    count = min(prof_frames, PROF_SAMPLES);
+    if (!count) {
+        Com_Printf("No frames profiled yet.\n");
+        return;
+    }
+
+    Com_Printf("Last %d frames, times in msec:\n", count);
+    Com_Printf("zone                  avg      p50      p99      max\n"
+               "---------------- -------- -------- -------- --------\n");
+    for (i = 0; i < prof_numzones; i++) {
+        total = 0;
+        for (j = 0; j < count; j++) {
+            sorted[j] = prof_samples[j][i];
+            total += sorted[j];
+        }
+        if (!total)
+            continue;
+
+        qsort(sorted, count, sizeof(sorted[0]), uintcmp);
+        Com_Printf("%-16.16s %8.3f %8.3f %8.3f %8.3f\n", prof_names[i],
+                   total * 0.001 / count, sorted[count / 2] * 0.001,
+                   sorted[min(count * 99 / 100, count - 1)] * 0.001,
+                   sorted[count - 1] * 0.001);
+    }
+}
+
+static void Prof_Stats_f(void)
+{
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        Prof_Reset();
+        return;
+    }
+
+    if (!com_profile->integer) {
+        Com_Printf("Profiler is disabled, set com_profile to 1.\n");
+        return;
+    }
+
+    Prof_PrintStats();
+}
+
+static void Prof_Dump_f(void)
+{
+    char buffer[MAX_OSPATH];
+    const uint32_t *s;
+    unsigned frame;
+    qhandle_t f;
+    int i;
+
+    if (!prof_frames) {
+        Com_Printf("No frames profiled yet.\n");
+        return;
+    }
+
+    f = FS_EasyOpenFile(buffer, sizeof(buffer), FS_MODE_WRITE | FS_FLAG_TEXT,
+                        "", Cmd_Argc() > 1 ? Cmd_Argv(1) : "profile", ".csv");
+    if (!f)
+        return;
+
+    // one row per frame, oldest first, usec per zone
+    FS_FPrintf(f, "frame");
+    for (i = 0; i < prof_numzones; i++)
+        FS_FPrintf(f, ",%s", prof_names[i]);
+    FS_FPrintf(f, "\n");
+
+    frame = prof_frames > PROF_SAMPLES ? prof_frames - PROF_SAMPLES : 0;
+    for (; frame < prof_frames; frame++) {
+        s = prof_samples[frame % PROF_SAMPLES];
+        FS_FPrintf(f, "%u", frame);
+        for (i = 0; i < prof_numzones; i++)
+            FS_FPrintf(f, ",%u", s[i]);
+        FS_FPrintf(f, "\n");
+    }
+
+    if (FS_CloseFile(f))
+        Com_EPrintf("Error writing %s\n", buffer);
+    else
+        Com_Printf("Wrote %s.\n", buffer);
+}
+
+static void com_profile_changed(cvar_t *self)
+{
+    Prof_Reset();
+}
+
+void Prof_Init(void)
+{
+    com_profile = Cvar_Get("com_profile", "0", 0);
+    com_profile->changed = com_profile_changed;
+
+    Cmd_AddCommand("prof_stats", Prof_Stats_f);
+    Cmd_AddCommand("prof_dump", Prof_Dump_f);
+}
@@ -17,13 +17,21 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "shared/shared.h"
+#include "common/async.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
+#include "common/cmodel.h"
 #include "common/common.h"
 #include "common/files.h"
 #include "common/mdfour.h"
+#include "common/msg.h"
 #include "common/tests.h"
+#include "common/zone.h"
 #include "refresh/refresh.h"
+#if USE_REF
+#include "refresh/images.h"
+#endif
+#include "system/pthread.h"
 #include "system/system.h"
 #include "client/sound/sound.h"
 
@@ -679,6 +687,1353 @@ static void Com_ExtCmpTest_f(void)
     Com_Printf("%d failures, %d strings tested\n", errors, numextcmptests);
 }
 
+typedef struct {
+    vec3_t  start, end;
+    vec3_t  mins, maxs;
+    vec3_t  origin, angles;
+    vec3_t  boxmins, boxmaxs;   // clip against box hull if non-empty
+    int     mask;
+} tracecase_t;
+
+typedef struct {
+    pthread_t           thread;
+    const tracecase_t   *cases;
+    const trace_t       *results;
+    mnode_t             *headnode;
+    int                 count;
+    int                 passes;
+    int                 errors;
+    cm_trace_t          ctx;        // zone is not thread safe, allocated with job
+} tracejob_t;
+
+static bool trace_equal(const trace_t *a, const trace_t *b)
+{
+    return a->allsolid == b->allsolid &&
+        a->startsolid == b->startsolid &&
+        a->fraction == b->fraction &&
+        VectorCompare(a->endpos, b->endpos) &&
+        VectorCompare(a->plane.normal, b->plane.normal) &&
+        a->plane.dist == b->plane.dist &&
+        a->surface == b->surface &&
+        a->contents == b->contents;
+}
+
+static void trace_case(cm_trace_t *ctx, trace_t *tr, const tracecase_t *c, mnode_t *headnode)
+{
+    if (!VectorEmpty(c->boxmins) || !VectorEmpty(c->boxmaxs)) {
+        if (ctx)
+            headnode = CM_HeadnodeForBoxEx(ctx, c->boxmins, c->boxmaxs);
+        else
+            headnode = CM_HeadnodeForBox(c->boxmins, c->boxmaxs);
+    }
+
+    if (ctx)
+        CM_TransformedBoxTraceEx(ctx, tr, c->start, c->end, c->mins, c->maxs,
+                                 headnode, c->mask, c->origin, c->angles);
+    else
+        CM_TransformedBoxTrace(tr, c->start, c->end, c->mins, c->maxs,
+                               headnode, c->mask, c->origin, c->angles);
+}
+
+static void *trace_thread(void *arg)
+{
+    tracejob_t *job = arg;
+    cm_trace_t *ctx = &job->ctx;
+    trace_t tr;
+    int i, j;
+
+    CM_InitTraceContext(ctx);
+
+    for (i = 0; i < job->passes; i++) {
+        for (j = 0; j < job->count; j++) {
+            trace_case(ctx, &tr, &job->cases[j], job->headnode);
+            if (!trace_equal(&tr, &job->results[j]))
+                job->errors++;
+        }
+    }
+
+    return NULL;
+}
+
+static void random_vector(vec3_t v, const vec3_t mins, const vec3_t maxs)
+{
+    for (int i = 0; i < 3; i++)
+        v[i] = mins[i] + frand() * (maxs[i] - mins[i]);
+}
+
+/*
+=================
+Com_TraceTest_f
+
+Runs the same set of random traces on several threads at once, each
+using private trace context, and compares results with the ones obtained
+using non-reentrant API on the main thread. Without a map only box hulls
+are traced against.
+=================
+*/
+static void Com_TraceTest_f(void)
+{
+    static const vec3_t boxsize = { 64, 64, 64 };
+    static const vec3_t hullsize = { 16, 16, 32 };
+    cm_t cm = { 0 };
+    tracecase_t *cases;
+    trace_t *results;
+    tracejob_t *jobs;
+    vec3_t mins, maxs;
+    mnode_t *headnode = NULL;
+    int i, numthreads, count, passes, errors, ret;
+    unsigned start, end;
+    tracecase_t *c;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <threads> [traces] [passes] [map]\n", Cmd_Argv(0));
+        return;
+    }
+
+    numthreads = Q_clip(Q_atoi(Cmd_Argv(1)), 1, 64);
+    count = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 1000000) : 10000;
+    passes = Cmd_Argc() > 3 ? Q_clip(Q_atoi(Cmd_Argv(3)), 1, 1000) : 10;
+
+    if (Cmd_Argc() > 4) {
+        ret = CM_LoadMap(&cm, va("maps/%s.bsp", Cmd_Argv(4)));
+        if (!cm.cache) {
+            Com_EPrintf("Couldn't load %s: %s\n", Cmd_Argv(4), BSP_ErrorString(ret));
+            return;
+        }
+        headnode = cm.cache->nodes;
+        VectorCopy(cm.cache->models[0].mins, mins);
+        VectorCopy(cm.cache->models[0].maxs, maxs);
+    } else {
+        VectorScale(boxsize, -2, mins);
+        VectorScale(boxsize, 2, maxs);
+    }
+
+    cases = Z_Mallocz(sizeof(cases[0]) * count);
+    results = Z_Malloc(sizeof(results[0]) * count);
+    jobs = Z_Mallocz(sizeof(jobs[0]) * numthreads);
+
+    Q_srand(count);
+    for (i = 0, c = cases; i < count; i++, c++) {
+        random_vector(c->start, mins, maxs);
+        // every 8th trace is a position test
+        if (i & 7)
+            random_vector(c->end, mins, maxs);
+        else
+            VectorCopy(c->start, c->end);
+        // half of traces are point traces
+        if (i & 1) {
+            VectorNegate(hullsize, c->mins);
+            VectorCopy(hullsize, c->maxs);
+        }
+        if (!headnode || !(i & 2)) {
+            VectorScale(boxsize, -frand(), c->boxmins);
+            VectorScale(boxsize, frand(), c->boxmaxs);
+            random_vector(c->origin, c->boxmins, c->boxmaxs);
+            // box hulls must ignore rotation
+            if (i & 4)
+                VectorSet(c->angles, crand() * 180, crand() * 180, crand() * 180);
+        }
+        c->mask = MASK_SOLID | MASK_MONSTERSOLID;
+    }
+
+    // reference results
+    start = Sys_Milliseconds();
+    for (i = 0; i < count; i++)
+        trace_case(NULL, &results[i], &cases[i], headnode);
+    end = Sys_Milliseconds();
+
+    Com_Printf("%d msec, %d traces on main thread\n", end - start, count);
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < numthreads; i++) {
+        jobs[i].cases = cases;
+        jobs[i].results = results;
+        jobs[i].headnode = headnode;
+        jobs[i].count = count;
+        jobs[i].passes = passes;
+        if (pthread_create(&jobs[i].thread, NULL, trace_thread, &jobs[i]))
+            Com_Error(ERR_FATAL, "Couldn't create trace test thread");
+    }
+
+    errors = 0;
+    for (i = 0; i < numthreads; i++) {
+        Q_assert(!pthread_join(jobs[i].thread, NULL));
+        errors += jobs[i].errors;
+    }
+    end = Sys_Milliseconds();
+
+    Com_Printf("%d msec, %d failures, %d traces tested on %d threads\n",
+               end - start, errors, count * passes * numthreads, numthreads);
+
+    Z_Free(jobs);
+    Z_Free(results);
+    Z_Free(cases);
+    CM_FreeMap(&cm);
+}
+
+#define RAND_CHANCE(n)  (Q_rand_uniform(n) == 0)
+
+static void random_entity(entity_packed_t *ent, int number)
+{
+    memset(ent, 0, sizeof(*ent));
+    ent->number = number;
+    for (int i = 0; i < 3; i++) {
+        ent->origin[i] = Q_rand();
+        ent->angles[i] = RAND_CHANCE(2) ? Q_rand() : 0;
+    }
+    VectorCopy(ent->origin, ent->old_origin);
+    ent->modelindex = RAND_CHANCE(8) ? 255 + Q_rand_uniform(512) : Q_rand_uniform(256);
+    ent->modelindex2 = RAND_CHANCE(4) ? Q_rand_uniform(256) : 0;
+    ent->skinnum = RAND_CHANCE(8) ? Q_rand() : Q_rand_uniform(16);
+    ent->effects = RAND_CHANCE(4) ? BIT(Q_rand_uniform(32)) : 0;
+    ent->renderfx = RAND_CHANCE(8) ? RF_BEAM : RAND_CHANCE(4) ? RF_FRAMELERP : 0;
+    ent->solid = RAND_CHANCE(2) ? Q_rand() : 0;
+    ent->frame = Q_rand_uniform(300);
+    ent->sound = RAND_CHANCE(8) ? Q_rand_uniform(256) : 0;
+    ent->alpha = RAND_CHANCE(8) ? Q_rand() : 0;
+    ent->scale = RAND_CHANCE(8) ? Q_rand() : 0;
+}
+
+// advances entity state the way typical game frame does. most of visible
+// entities are items and other static things, only every 4th one moves.
+static void advance_entity(entity_packed_t *ent)
+{
+    VectorCopy(ent->origin, ent->old_origin);
+    if (ent->number & 3) {
+        ent->event = RAND_CHANCE(256) ? Q_rand_uniform(8) : 0;
+        return;
+    }
+    if (RAND_CHANCE(2))
+        for (int i = 0; i < 3; i++)
+            ent->origin[i] += Q_rand_uniform(64) - 32;
+    if (RAND_CHANCE(4))
+        ent->angles[1] += Q_rand_uniform(4096) - 2048;
+    if (RAND_CHANCE(2))
+        ent->frame++;
+    if (RAND_CHANCE(32))
+        ent->modelindex = Q_rand_uniform(512);
+    if (RAND_CHANCE(64))
+        ent->effects ^= BIT(Q_rand_uniform(32));
+    if (RAND_CHANCE(64))
+        ent->skinnum = Q_rand_uniform(0x20000);
+    if (RAND_CHANCE(128))
+        ent->loop_volume = Q_rand();
+    ent->event = RAND_CHANCE(16) ? Q_rand_uniform(8) : 0;
+}
+
+static entity_packed_t *make_entity_stream(int numframes, int numents)
+{
+    entity_packed_t *stream = Z_Malloc(sizeof(stream[0]) * numframes * numents);
+    int i, j;
+
+    for (j = 0; j < numents; j++)
+        random_entity(&stream[j], j + 1);
+
+    for (i = 1; i < numframes; i++) {
+        for (j = 0; j < numents; j++) {
+            stream[i * numents + j] = stream[(i - 1) * numents + j];
+            advance_entity(&stream[i * numents + j]);
+        }
+    }
+
+    return stream;
+}
+
+static msgEsFlags_t stream_flags(int number)
+{
+    msgEsFlags_t flags = MSG_ES_UMASK | MSG_ES_LONGSOLID | MSG_ES_BEAMORIGIN | MSG_ES_EXTENSIONS;
+
+    if (number <= 8)
+        flags |= MSG_ES_NEWENTITY;
+
+    return flags;
+}
+
+/*
+=================
+Com_DeltaTest_f
+
+Checks that vectorized entity delta encoder produces byte-for-byte the
+same output as scalar one. Tests pairs of fully random states (including
+struct padding), pairs from a simulated entity stream and all flag
+combinations.
+=================
+*/
+static void Com_DeltaTest_f(void)
+{
+    static byte ref[MAX_MSGLEN];
+    entity_packed_t *stream, from, to;
+    int i, count, errors;
+    msgEsFlags_t flags;
+    size_t reflen;
+
+    count = Cmd_Argc() > 1 ? Q_clip(Q_atoi(Cmd_Argv(1)), 1, 10000000) : 1000000;
+
+    stream = make_entity_stream(256, 64);
+
+    Q_srand(count);
+    for (i = errors = 0; i < count; i++) {
+        flags = Q_rand_uniform(MSG_ES_REMOVE << 1);
+        switch (i % 3) {
+        case 0:
+            for (int j = 0; j < sizeof(from); j++) {
+                ((byte *)&from)[j] = Q_rand();
+                ((byte *)&to)[j] = RAND_CHANCE(4) ? Q_rand() : ((byte *)&from)[j];
+            }
+            from.number = to.number = 1 + Q_rand_uniform(MAX_EDICTS - 1);
+            break;
+        case 1:
+            random_entity(&from, 1 + Q_rand_uniform(MAX_EDICTS - 1));
+            random_entity(&to, from.number);
+            break;
+        default: {
+                int f = 1 + Q_rand_uniform(255);
+                int e = Q_rand_uniform(64);
+                from = stream[(f - 1) * 64 + e];
+                to = stream[f * 64 + e];
+            }
+            break;
+        }
+
+        SZ_Clear(&msg_write);
+        MSG_WriteDeltaEntityScalar(&from, &to, flags);
+        reflen = msg_write.cursize;
+        memcpy(ref, msg_write.data, reflen);
+
+        SZ_Clear(&msg_write);
+        MSG_WriteDeltaEntity(&from, &to, flags);
+        if (msg_write.cursize != reflen || memcmp(msg_write.data, ref, reflen)) {
+            if (errors++ < 10)
+                Com_Printf("Mismatch on case %d (flags %#x): %zu != %zu bytes\n",
+                           i, flags, msg_write.cursize, reflen);
+        }
+    }
+    SZ_Clear(&msg_write);
+
+    Com_Printf("%d failures, %d entity deltas tested\n", errors, count);
+
+    Z_Free(stream);
+}
+
+/*
+=================
+Com_DeltaBench_f
+
+Encodes simulated entity stream using scalar and vectorized encoders.
+=================
+*/
+static void Com_DeltaBench_f(void)
+{
+    entity_packed_t *stream, *from, *to;
+    int i, j, numframes, numents, passes, pass;
+    unsigned start, scalar_msec, simd_msec;
+    size_t bytes;
+
+    numframes = Cmd_Argc() > 1 ? Q_clip(Q_atoi(Cmd_Argv(1)), 2, 10000) : 1000;
+    numents = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 1000) : 256;
+    passes = Cmd_Argc() > 3 ? Q_clip(Q_atoi(Cmd_Argv(3)), 1, 1000) : 10;
+
+    Q_srand(numframes);
+    stream = make_entity_stream(numframes, numents);
+
+    start = Sys_Milliseconds();
+    for (pass = 0; pass < passes; pass++) {
+        for (i = 1; i < numframes; i++) {
+            from = &stream[(i - 1) * numents];
+            to = &stream[i * numents];
+            for (j = 0; j < numents; j++)
+                MSG_WriteDeltaEntityScalar(&from[j], &to[j], stream_flags(to[j].number));
+            bytes = msg_write.cursize;
+            SZ_Clear(&msg_write);
+        }
+    }
+    scalar_msec = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    for (pass = 0; pass < passes; pass++) {
+        for (i = 1; i < numframes; i++) {
+            from = &stream[(i - 1) * numents];
+            to = &stream[i * numents];
+            for (j = 0; j < numents; j++)
+                MSG_WriteDeltaEntity(&from[j], &to[j], stream_flags(to[j].number));
+            bytes = msg_write.cursize;
+            SZ_Clear(&msg_write);
+        }
+    }
+    simd_msec = Sys_Milliseconds() - start;
+
+    Com_Printf("%d frames x %d entities x %d passes (%zu bytes last frame): "
+               "scalar %u msec, vectorized %u msec\n", numframes, numents,
+               passes, bytes, scalar_msec, simd_msec);
+
+    Z_Free(stream);
+}
+
+typedef struct {
+    int         work_calls;
+    int         done_calls;
+    bool        misordered;
+    unsigned    result;
+} asynctest_t;
+
+static void async_test_work(void *arg)
+{
+    asynctest_t *t = arg;
+    unsigned i, h = 0;
+
+    for (i = 0; i < 10000; i++)
+        h = h * 31 + i;
+
+    t->result = h;
+    t->work_calls++;
+}
+
+static void async_test_done(void *arg)
+{
+    asynctest_t *t = arg;
+
+    if (!t->work_calls)
+        t->misordered = true;
+    t->done_calls++;
+}
+
+/*
+=================
+Com_AsyncTest_f
+
+Queues a burst of work with mixed priorities and joins it in reverse order,
+so that part of it runs on the calling thread. Then checks that every work
+and completion callback ran exactly once, in order, and that stale handles
+are ignored.
+=================
+*/
+static void Com_AsyncTest_f(void)
+{
+    asynctest_t *tests;
+    asynchandle_t *handles;
+    int i, count, errors = 0;
+    unsigned start, msec;
+
+    count = Cmd_Argc() > 1 ? Q_clip(Q_atoi(Cmd_Argv(1)), 1, 1000000) : 10000;
+
+    tests = Z_Mallocz(sizeof(tests[0]) * count);
+    handles = Z_Malloc(sizeof(handles[0]) * count);
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < count; i++) {
+        asyncwork_t work = {
+            .work_cb = async_test_work,
+            .done_cb = async_test_done,
+            .cb_arg = &tests[i],
+            .priority = i % 3 - 1,
+        };
+        handles[i] = Com_QueueAsyncWork(&work);
+    }
+
+    for (i = count - 1; i >= 0; i--)
+        Com_WaitAsyncWork(handles[i]);
+    msec = Sys_Milliseconds() - start;
+
+    for (i = 0; i < count; i++)
+        Com_WaitAsyncWork(handles[i]);
+
+    for (i = 0; i < count; i++) {
+        if (tests[i].work_calls != 1 || tests[i].done_calls != 1 || tests[i].misordered) {
+            if (errors++ < 10)
+                Com_Printf("Job %d: %d work calls, %d done calls%s\n", i,
+                           tests[i].work_calls, tests[i].done_calls,
+                           tests[i].misordered ? ", misordered" : "");
+        }
+    }
+
+    Com_Printf("%d failures, %d jobs completed in %u msec\n", errors, count, msec);
+
+    Z_Free(tests);
+    Z_Free(handles);
+}
+
+static ztrace_t  *ztrace_buffer;
+static size_t   ztrace_count;
+
+static void Com_ZTrace_f(void)
+{
+    const ztrace_t *trace;
+    const char *cmd = Cmd_Argv(1);
+
+    if (!strcmp(cmd, "start")) {
+        Z_StartTrace();
+        return;
+    }
+
+    if (strcmp(cmd, "stop")) {
+        Com_Printf("Usage: %s <start|stop> [file]\n", Cmd_Argv(0));
+        return;
+    }
+
+    trace = Z_StopTrace(&ztrace_count);
+    Z_Freep((void **)&ztrace_buffer);
+    if (ztrace_count)
+        ztrace_buffer = memcpy(Z_Malloc(sizeof(*trace) * ztrace_count),
+                               trace, sizeof(*trace) * ztrace_count);
+    Com_Printf("Recorded %zu allocator calls\n", ztrace_count);
+
+    if (Cmd_Argc() > 2 && ztrace_count) {
+        if (FS_WriteFile(Cmd_Argv(2), ztrace_buffer, sizeof(*trace) * ztrace_count) < 0)
+            Com_EPrintf("Couldn't write %s\n", Cmd_Argv(2));
+    }
+}
+
+typedef struct {
+    uint8_t     op;
+    uint16_t    tag;
+    uint32_t    size;
+    uint32_t    id;
+} zreplay_t;
+
+typedef struct {
+    uint64_t    ptr;
+    uint32_t    id;
+} zreplaymap_t;
+
+#define ZMAP_EMPTY      0
+#define ZMAP_DELETED    1
+
+static zreplaymap_t *zmap_find(zreplaymap_t *map, size_t mask, uint64_t ptr, bool insert)
+{
+    size_t i = (ptr >> 4) * 0x9E3779B97F4A7C15ULL & mask;
+    zreplaymap_t *tomb = NULL;
+
+    while (map[i].ptr != ZMAP_EMPTY) {
+        if (map[i].ptr == ptr)
+            return &map[i];
+        if (map[i].ptr == ZMAP_DELETED && !tomb)
+            tomb = &map[i];
+        i = (i + 1) & mask;
+    }
+
+    if (!insert)
+        return NULL;
+    return tomb ? tomb : &map[i];
+}
+
+// converts recorded pointers into dense identifiers, drops calls on blocks
+// allocated before recording started
+static zreplay_t *make_replay(const ztrace_t *trace, size_t count,
+                              size_t *numops, uint32_t *numids)
+{
+    zreplay_t *ops = Z_Malloc(sizeof(*ops) * count);
+    zreplaymap_t *map, *m;
+    size_t i, n = 0, mask = 1;
+    uint32_t ids = 0;
+
+    while (mask < count * 2)
+        mask <<= 1;
+    map = Z_Mallocz(sizeof(*map) * mask--);
+
+    for (i = 0; i < count; i++) {
+        const ztrace_t *t = &trace[i];
+        zreplay_t *op = &ops[n];
+
+        op->op = t->op;
+        op->tag = t->tag;
+        op->size = t->size;
+
+        switch (t->op) {
+        case ZTRACE_ALLOC:
+            op->id = ids++;
+            break;
+        case ZTRACE_FREE:
+        case ZTRACE_REALLOC:
+            m = zmap_find(map, mask, t->op == ZTRACE_FREE ? t->ptr : t->old, false);
+            if (!m) {
+                if (t->op == ZTRACE_FREE)
+                    continue;
+                op->op = ZTRACE_ALLOC;
+                op->id = ids++;
+                break;
+            }
+            op->id = m->id;
+            m->ptr = ZMAP_DELETED;
+            break;
+        default:
+            continue;
+        }
+
+        if (t->op != ZTRACE_FREE) {
+            m = zmap_find(map, mask, t->ptr, true);
+            m->ptr = t->ptr;
+            m->id = op->id;
+        }
+        n++;
+    }
+
+    Z_Free(map);
+    *numops = n;
+    *numids = ids;
+    return ops;
+}
+
+static unsigned replay_trace(const zreplay_t *ops, size_t numops, void **blocks,
+                             uint32_t numids, int passes)
+{
+    unsigned start = Sys_Milliseconds();
+    size_t i;
+    int pass;
+
+    for (pass = 0; pass < passes; pass++) {
+        for (i = 0; i < numops; i++) {
+            const zreplay_t *op = &ops[i];
+            switch (op->op) {
+            case ZTRACE_ALLOC:
+                blocks[op->id] = Z_TagMalloc(op->size, op->tag);
+                break;
+            case ZTRACE_FREE:
+                Z_Free(blocks[op->id]);
+                blocks[op->id] = NULL;
+                break;
+            case ZTRACE_REALLOC:
+                blocks[op->id] = Z_Realloc(blocks[op->id], op->size);
+                break;
+            }
+        }
+        for (i = 0; i < numids; i++) {
+            Z_Free(blocks[i]);
+            blocks[i] = NULL;
+        }
+    }
+
+    return Sys_Milliseconds() - start;
+}
+
+/*
+=================
+Com_ZBench_f
+
+Replays recorded (or loaded from file) allocator trace with and without
+slab allocator.
+=================
+*/
+static void Com_ZBench_f(void)
+{
+    const ztrace_t *trace = ztrace_buffer;
+    size_t count = ztrace_count, numops;
+    void *data = NULL, **blocks;
+    zreplay_t *ops;
+    uint32_t numids;
+    unsigned heap_msec, slab_msec;
+    int ret, passes;
+
+    if (Cmd_Argc() > 1 && strcmp(Cmd_Argv(1), "-")) {
+        ret = FS_LoadFile(Cmd_Argv(1), &data);
+        if (!data) {
+            Com_EPrintf("Couldn't load %s: %s\n", Cmd_Argv(1), Q_ErrorString(ret));
+            return;
+        }
+        trace = data;
+        count = ret / sizeof(*trace);
+    }
+
+    if (!count) {
+        Com_Printf("No allocator trace recorded\n");
+        return;
+    }
+
+    passes = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 100000) : 100;
+
+    ops = make_replay(trace, count, &numops, &numids);
+    blocks = Z_Mallocz(sizeof(blocks[0]) * max(numids, 1));
+
+    Z_SetSlabsEnabled(false);
+    heap_msec = replay_trace(ops, numops, blocks, numids, passes);
+    Z_SetSlabsEnabled(true);
+    slab_msec = replay_trace(ops, numops, blocks, numids, passes);
+
+    Com_Printf("%zu calls on %u blocks x %d passes: heap %u msec, slab %u msec\n",
+               numops, numids, passes, heap_msec, slab_msec);
+
+    Z_Free(blocks);
+    Z_Free(ops);
+    FS_FreeFile(data);
+}
+
+// loads map and its wall textures the way level load does, returns bytes read
+static size_t load_level_files(const char *name, int *errors)
+{
+    char buffer[MAX_QPATH];
+    size_t total = 0;
+    bsp_t *bsp;
+    byte *data;
+    int i, ret;
+
+    ret = BSP_Load(name, &bsp);
+    if (!bsp) {
+        Com_EPrintf("Couldn't load %s: %s\n", name, BSP_ErrorString(ret));
+        (*errors)++;
+        return 0;
+    }
+
+    for (i = 0; i < bsp->numtexinfo; i++) {
+        if (Q_concat(buffer, sizeof(buffer), "textures/",
+                     bsp->texinfo[i].name, ".wal") >= sizeof(buffer))
+            continue;
+        ret = FS_LoadFileFlags(buffer, (void **)&data, FS_FLAG_MAPPED);
+        if (!data)
+            continue;
+        // touch every byte so that mapped pages are actually read in
+        Com_BlockChecksum(data, ret);
+        FS_FreeFile(data);
+        total += ret;
+    }
+
+    BSP_Free(bsp);
+    return total;
+}
+
+static void Com_LoadBench_f(void)
+{
+    char name[MAX_QPATH];
+    cvar_t *fs_mmap;
+    size_t bytes;
+    unsigned start, msec[2];
+    int i, mode, saved, passes, errors;
+    bsp_t *bsp;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [passes]\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (Q_concat(name, sizeof(name), "maps/", Cmd_Argv(1), ".bsp") >= sizeof(name)) {
+        Com_Printf("Oversize map name\n");
+        return;
+    }
+
+    passes = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 10000) : 20;
+
+    // cached map would be returned without loading
+    BSP_Load(name, &bsp);
+    if (!bsp) {
+        Com_Printf("Couldn't load %s\n", name);
+        return;
+    }
+    i = bsp->refcount;
+    BSP_Free(bsp);
+    if (i > 1) {
+        Com_Printf("%s is in use, can't benchmark\n", name);
+        return;
+    }
+
+    fs_mmap = Cvar_FindVar("fs_mmap");
+    if (!fs_mmap) {
+        return;
+    }
+
+    saved = fs_mmap->integer;
+    errors = 0;
+    bytes = 0;
+    for (mode = 0; mode < 2; mode++) {
+        Cvar_SetInteger(fs_mmap, mode, FROM_CODE);
+        start = Sys_Milliseconds();
+        for (i = 0; i < passes; i++)
+            bytes = load_level_files(name, &errors);
+        msec[mode] = Sys_Milliseconds() - start;
+    }
+    Cvar_SetInteger(fs_mmap, saved, FROM_CODE);
+
+    Com_Printf("%s: %d passes, %zu bytes of textures: "
+               "copied %u msec, mapped %u msec, %d failures\n",
+               name, passes, bytes, msec[0], msec[1], errors);
+}
+
+static void Com_PrefetchTest_f(void)
+{
+    void **list;
+    uint32_t *sums;
+    void *data;
+    unsigned start, seq_msec, pre_msec;
+    int i, count, ret, errors;
+    size_t bytes;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <directory> [extension]\n", Cmd_Argv(0));
+        return;
+    }
+
+    list = FS_ListFiles(Cmd_Argv(1), Cmd_Argv(2), FS_SEARCH_SAVEPATH, &count);
+    if (!list) {
+        Com_Printf("No files found\n");
+        return;
+    }
+
+    sums = Z_Malloc(sizeof(sums[0]) * count);
+    bytes = 0;
+    errors = 0;
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < count; i++) {
+        ret = FS_LoadFile(list[i], &data);
+        if (!data) {
+            Com_EPrintf("Couldn't load %s: %s\n", (char *)list[i], Q_ErrorString(ret));
+            sums[i] = 0;
+            continue;
+        }
+        sums[i] = Com_BlockChecksum(data, ret);
+        bytes += ret;
+        FS_FreeFile(data);
+    }
+    seq_msec = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    if (!FS_BeginPrefetch(Cmd_Argv(1)))
+        Com_WPrintf("Prefetching is disabled\n");
+    for (i = 0; i < count; i++)
+        FS_PrefetchFile(list[i]);
+    for (i = 0; i < count; i++) {
+        ret = FS_LoadFile(list[i], &data);
+        if (!data)
+            continue;
+        if (Com_BlockChecksum(data, ret) != sums[i]) {
+            Com_EPrintf("Mismatched contents of %s\n", (char *)list[i]);
+            errors++;
+        }
+        FS_FreeFile(data);
+    }
+    FS_EndPrefetch();
+    pre_msec = Sys_Milliseconds() - start;
+
+    Com_Printf("%d files, %zu KiB: sequential %u msec, prefetched %u msec, %d mismatches\n",
+               count, bytes >> 10, seq_msec, pre_msec, errors);
+
+    Z_Free(sums);
+    FS_FreeList(list);
+}
+
+// probes for the names image loader tries for each wall texture
+static int probe_level_files(const bsp_t *bsp, unsigned flags, bool *found)
+{
+    static const char *const fmts[] = {
+        "overrides/%s.%s", "textures/%s.%s", "textures/%s_n.%s", "textures/%s_light.%s"
+    };
+    static const char *const exts[] = { "png", "jpg", "tga", "wal" };
+    static const unsigned paths[] = { FS_PATH_GAME, FS_PATH_BASE };
+    char buffer[MAX_QPATH];
+    const char *name, *base;
+    int i, j, k, l, count = 0;
+
+    for (i = 0; i < bsp->numtexinfo; i++) {
+        name = bsp->texinfo[i].name;
+        base = COM_SkipPath(name);
+        for (j = 0; j < q_countof(fmts); j++) {
+            for (k = 0; k < q_countof(exts); k++) {
+                Q_snprintf(buffer, sizeof(buffer), fmts[j], j ? name : base, exts[k]);
+                for (l = 0; l < q_countof(paths); l++)
+                    found[count++] = FS_FileExistsEx(buffer, paths[l] | flags);
+            }
+        }
+    }
+
+    return count;
+}
+
+static void Com_ProbeTest_f(void)
+{
+    char name[MAX_QPATH];
+    bool *found[2];
+    uint64_t start, usec[2];
+    int i, j, mode, count, hits, passes, errors;
+    bsp_t *bsp;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [passes]\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (Q_concat(name, sizeof(name), "maps/", Cmd_Argv(1), ".bsp") >= sizeof(name)) {
+        Com_Printf("Oversize map name\n");
+        return;
+    }
+
+    passes = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 10000) : 20;
+
+    i = BSP_Load(name, &bsp);
+    if (!bsp) {
+        Com_Printf("Couldn't load %s: %s\n", name, BSP_ErrorString(i));
+        return;
+    }
+
+    for (mode = 0; mode < 2; mode++) {
+        found[mode] = Z_Malloc(sizeof(bool) * bsp->numtexinfo * 32);
+        start = Sys_Microseconds();
+        for (i = 0; i < passes; i++)
+            count = probe_level_files(bsp, mode ? FS_FLAG_INDEXED : 0, found[mode]);
+        usec[mode] = Sys_Microseconds() - start;
+    }
+
+    hits = errors = 0;
+    for (j = 0; j < count; j++) {
+        hits += found[0][j];
+        errors += found[0][j] != found[1][j];
+    }
+
+    Com_Printf("%s: %d passes, %d probes, %d found: plain %.1f msec, "
+               "indexed %.1f msec, %d mismatches\n", name, passes, count, hits,
+               usec[0] * 0.001, usec[1] * 0.001, errors);
+
+    Z_Free(found[0]);
+    Z_Free(found[1]);
+    BSP_Free(bsp);
+}
+
+// original serial PVS matrix builders, used as reference for threaded ones
+static void ref_pvs_matrix(bsp_t *bsp, byte *matrix)
+{
+    int i;
+
+    for (i = 0; i < bsp->vis->numclusters; i++)
+        BSP_ClusterVis(bsp, matrix + bsp->visrowsize * i, i, DVIS_PVS);
+}
+
+static void ref_pvs2_matrix(bsp_t *bsp, const byte *pvs, byte *matrix)
+{
+    int i, j, k, rowsize = bsp->visrowsize;
+
+    for (i = 0; i < bsp->vis->numclusters; i++) {
+        const byte *row = pvs + rowsize * i;
+        byte *dst = matrix + rowsize * i;
+
+        memcpy(dst, row, rowsize);
+        for (j = 0; j < rowsize * 8; j++) {
+            if (!row[j >> 3]) {
+                j |= 7;
+                continue;
+            }
+            if (!Q_IsBitSet(row, j) || j >= bsp->vis->numclusters)
+                continue;
+            for (k = 0; k < rowsize; k++)
+                dst[k] |= pvs[rowsize * j + k];
+        }
+    }
+}
+
+/*
+=================
+Com_PvsBench_f
+
+Builds PVS and second-order PVS matrices for the given map the original way
+and with current code, with and without threads. Checks that the results
+match and prints times.
+=================
+*/
+static void Com_PvsBench_f(void)
+{
+    static const char names[3][16] = { "reference", "serial", "threaded" };
+    char name[MAX_QPATH];
+    uint64_t start, usec[3][2];
+    cvar_t *var = Cvar_FindVar("map_pvs_threads");
+    int saved = var ? var->integer : 0;
+    int i, mode, passes, errors;
+    byte *ref, *ref2, *pvs;
+    size_t size;
+    bsp_t *bsp;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [passes]\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (Q_concat(name, sizeof(name), "maps/", Cmd_Argv(1), ".bsp") >= sizeof(name)) {
+        Com_Printf("Oversize map name\n");
+        return;
+    }
+
+    passes = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 10000) : 10;
+
+    // matrices of a map in use can't be rebuilt
+    BSP_Load(name, &bsp);
+    if (!bsp) {
+        Com_Printf("Couldn't load %s\n", name);
+        return;
+    }
+    if (bsp->refcount > 1) {
+        Com_Printf("%s is in use, can't benchmark\n", name);
+        BSP_Free(bsp);
+        return;
+    }
+    if (!bsp->vis) {
+        Com_Printf("%s has no visibility\n", name);
+        BSP_Free(bsp);
+        return;
+    }
+
+    // drop patched matrices loaded from disk
+    BSP_RebuildPvsMatrix(bsp);
+
+    size = bsp->visrowsize * bsp->vis->numclusters;
+    ref = Z_Malloc(size);
+    ref2 = Z_Malloc(size);
+
+    // reference decompression must not see the matrix
+    pvs = bsp->pvs_matrix;
+    bsp->pvs_matrix = NULL;
+    start = Sys_Microseconds();
+    for (i = 0; i < passes; i++)
+        ref_pvs_matrix(bsp, ref);
+    usec[0][0] = Sys_Microseconds() - start;
+    bsp->pvs_matrix = pvs;
+
+    start = Sys_Microseconds();
+    for (i = 0; i < passes; i++)
+        ref_pvs2_matrix(bsp, ref, ref2);
+    usec[0][1] = Sys_Microseconds() - start;
+
+    errors = 0;
+    for (mode = 1; mode < 3; mode++) {
+        if (var)
+            Cvar_SetInteger(var, mode == 2, FROM_CODE);
+
+        start = Sys_Microseconds();
+        for (i = 0; i < passes; i++)
+            BSP_RebuildPvsMatrix(bsp);
+        usec[mode][0] = Sys_Microseconds() - start;
+
+        start = Sys_Microseconds();
+        for (i = 0; i < passes; i++)
+            BSP_BuildPvs2Matrix(bsp);
+        usec[mode][1] = Sys_Microseconds() - start;
+
+        if (memcmp(bsp->pvs_matrix, ref, size)) {
+            Com_Printf("PVS matrix, %s: mismatch\n", names[mode]);
+            errors++;
+        }
+        if (memcmp(bsp->pvs2_matrix, ref2, size)) {
+            Com_Printf("PVS2 matrix, %s: mismatch\n", names[mode]);
+            errors++;
+        }
+    }
+
+    if (var)
+        Cvar_SetInteger(var, saved, FROM_CODE);
+
+    Com_Printf("%s: %d clusters, %d passes, msec per pass\n",
+               name, bsp->vis->numclusters, passes);
+    Com_Printf("builder          pvs     pvs2\n");
+    for (mode = 0; mode < 3; mode++)
+        Com_Printf("%-10s %8.3f %8.3f\n", names[mode],
+                   usec[mode][0] * 0.001 / passes, usec[mode][1] * 0.001 / passes);
+    Com_Printf("%d failures\n", errors);
+
+    Z_Free(ref);
+    Z_Free(ref2);
+    BSP_Free(bsp);
+}
+
+#if USE_REF
+
+// original scalar kernels, used as reference for optimized ones
+static void ref_resample(const byte *in, int inwidth, int inheight,
+                         byte *out, int outwidth, int outheight)
+{
+    int i, j;
+    const byte  *inrow1, *inrow2;
+    unsigned    frac, fracstep;
+    unsigned    p1[MAX_TEXTURE_SIZE], p2[MAX_TEXTURE_SIZE];
+    const byte  *pix1, *pix2, *pix3, *pix4;
+    float       heightScale;
+
+    fracstep = inwidth * 0x10000 / outwidth;
+
+    frac = fracstep >> 2;
+    for (i = 0; i < outwidth; i++) {
+        p1[i] = 4 * (frac >> 16);
+        frac += fracstep;
+    }
+    frac = 3 * (fracstep >> 2);
+    for (i = 0; i < outwidth; i++) {
+        p2[i] = 4 * (frac >> 16);
+        frac += fracstep;
+    }
+
+    heightScale = (float)inheight / outheight;
+    inwidth <<= 2;
+    for (i = 0; i < outheight; i++) {
+        inrow1 = in + inwidth * (int)((i + 0.25f) * heightScale);
+        inrow2 = in + inwidth * (int)((i + 0.75f) * heightScale);
+        for (j = 0; j < outwidth; j++) {
+            pix1 = inrow1 + p1[j];
+            pix2 = inrow1 + p2[j];
+            pix3 = inrow2 + p1[j];
+            pix4 = inrow2 + p2[j];
+            out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
+            out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
+            out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
+            out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
+            out += 4;
+        }
+    }
+}
+
+static void ref_mipmap(byte *out, byte *in, int width, int height)
+{
+    int     i, j;
+
+    width <<= 2;
+    height >>= 1;
+    for (i = 0; i < height; i++, in += width) {
+        for (j = 0; j < width; j += 8, out += 4, in += 8) {
+            out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
+            out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
+            out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
+            out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
+        }
+    }
+}
+
+static const struct {
+    int w, h;
+} mipmap_tests[] = {
+    { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 }, { 3, 3 }, { 5, 4 }, { 4, 4 },
+    { 6, 2 }, { 8, 8 }, { 14, 6 }, { 64, 32 }, { 256, 256 }, { 512, 512 },
+    { 1024, 512 }, { 2048, 2048 },
+};
+
+// odd sizes take the legacy path, which must still honor linear
+static const struct {
+    int w, h;
+} mipmap_linear_tests[] = {
+    { 3, 2 }, { 5, 3 }, { 63, 17 }, { 2, 9 },
+};
+
+static const struct {
+    int inw, inh, outw, outh;
+} resample_tests[] = {
+    { 1, 1, 1, 1 }, { 7, 7, 1, 1 }, { 5, 3, 3, 2 }, { 64, 64, 48, 24 },
+    { 256, 256, 200, 200 }, { 300, 200, 256, 128 }, { 1000, 600, 512, 512 },
+    { 640, 480, 1024, 1024 }, { 2000, 2000, 1024, 1024 },
+};
+
+// extra bytes for legacy mipmap reading past the row
+#define IMGTEST_SLACK   64
+
+static byte *imgtest_alloc(size_t size, bool random)
+{
+    byte *p = Z_Malloc(size + IMGTEST_SLACK);
+    size_t i;
+
+    for (i = 0; i < size + IMGTEST_SLACK; i++)
+        p[i] = random ? Q_rand() : 0;
+
+    return p;
+}
+
+// alternates black and white pixels, so that every 2x2 block averages
+// the same, even when odd width shifts blocks between rows
+static void imgtest_stripes(byte *p, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++, p += 4) {
+        p[0] = p[1] = p[2] = i & 1 ? 255 : 0;
+        p[3] = 255;
+    }
+}
+
+// compares kernels against reference with and without threads, in place
+// and not, then checks that linear averaging keeps flat colors intact
+// and is used for odd sizes too
+static int test_image_kernels(void)
+{
+    byte *src, *ref, *buf, *out;
+    size_t size, outsize;
+    int i, j, v, threads, errors = 0;
+    cvar_t *var = Cvar_FindVar("r_image_threads");
+    int saved = var ? var->integer : 0;
+
+    for (threads = 0; threads < 2; threads++) {
+        if (var)
+            Cvar_SetInteger(var, threads, FROM_CODE);
+
+        for (i = 0; i < q_countof(mipmap_tests); i++) {
+            int w = mipmap_tests[i].w, h = mipmap_tests[i].h;
+
+            size = w * h * 4;
+            src = imgtest_alloc(size, true);
+            ref = Z_Malloc(size + IMGTEST_SLACK);
+            buf = Z_Malloc(size + IMGTEST_SLACK);
+            out = imgtest_alloc(size, false);
+
+            memcpy(ref, src, size + IMGTEST_SLACK);
+            ref_mipmap(ref, ref, w, h);
+            memcpy(buf, src, size + IMGTEST_SLACK);
+            IMG_MipMap(buf, buf, w, h, false);
+            if (memcmp(ref, buf, size + IMGTEST_SLACK)) {
+                Com_Printf("MipMap %dx%d in place, threads %d: mismatch\n", w, h, threads);
+                errors++;
+            }
+
+            memset(ref, 0, size + IMGTEST_SLACK);
+            ref_mipmap(ref, src, w, h);
+            IMG_MipMap(out, src, w, h, false);
+            if (memcmp(ref, out, size + IMGTEST_SLACK)) {
+                Com_Printf("MipMap %dx%d, threads %d: mismatch\n", w, h, threads);
+                errors++;
+            }
+
+            Z_Free(src);
+            Z_Free(ref);
+            Z_Free(buf);
+            Z_Free(out);
+        }
+
+        for (i = 0; i < q_countof(resample_tests); i++) {
+            int inw = resample_tests[i].inw, inh = resample_tests[i].inh;
+            int outw = resample_tests[i].outw, outh = resample_tests[i].outh;
+
+            size = inw * inh * 4;
+            outsize = outw * outh * 4;
+            src = imgtest_alloc(size, true);
+            ref = imgtest_alloc(outsize, false);
+            out = imgtest_alloc(outsize, false);
+
+            ref_resample(src, inw, inh, ref, outw, outh);
+            IMG_ResampleTexture(src, inw, inh, out, outw, outh, false);
+            if (memcmp(ref, out, outsize + IMGTEST_SLACK)) {
+                Com_Printf("ResampleTexture %dx%d -> %dx%d, threads %d: mismatch\n",
+                           inw, inh, outw, outh, threads);
+                errors++;
+            }
+
+            Z_Free(src);
+            Z_Free(ref);
+            Z_Free(out);
+        }
+    }
+
+    // averaging equal colors must not change them
+    buf = Z_Malloc(64 * 64 * 4);
+    out = Z_Malloc(48 * 48 * 4);
+    for (v = 0; v < 256; v++) {
+        memset(buf, v, 64 * 64 * 4);
+        IMG_ResampleTexture(buf, 64, 64, out, 48, 48, true);
+        IMG_MipMap(buf, buf, 64, 64, true);
+        for (i = 0; i < 32 * 32 * 4; i++)
+            if (buf[i] != v)
+                break;
+        if (i < 32 * 32 * 4 || memcmp(out, buf, 48 * 4)) {
+            Com_Printf("Linear average of %d changed it\n", v);
+            errors++;
+        }
+    }
+    Z_Free(buf);
+    Z_Free(out);
+
+    // odd sizes must average in linear space like even ones do
+    ref = Z_Malloc(4 * 4 * 4);
+    imgtest_stripes(ref, 4 * 4);
+    IMG_MipMap(ref, ref, 4, 4, true);
+    if (ref[0] <= 128) {
+        Com_Printf("Linear average of stripes is %d\n", ref[0]);
+        errors++;
+    }
+    for (i = 0; i < q_countof(mipmap_linear_tests); i++) {
+        int w = mipmap_linear_tests[i].w, h = mipmap_linear_tests[i].h;
+
+        size = w * h * 4;
+        buf = Z_Malloc(size + IMGTEST_SLACK);
+        imgtest_stripes(buf, (size + IMGTEST_SLACK) / 4);
+        IMG_MipMap(buf, buf, w, h, true);
+        for (j = 0; j < (w + 1) / 2 * (h / 2); j++)
+            if (memcmp(buf + j * 4, ref, 4))
+                break;
+        if (j < (w + 1) / 2 * (h / 2)) {
+            Com_Printf("Linear MipMap %dx%d: mismatch\n", w, h);
+            errors++;
+        }
+        Z_Free(buf);
+    }
+    Z_Free(ref);
+
+    if (var)
+        Cvar_SetInteger(var, saved, FROM_CODE);
+
+    return errors;
+}
+
+static void Com_ImageTest_f(void)
+{
+    int errors = test_image_kernels();
+
+    Com_Printf("%d failures, %zu mipmap and %zu resample cases tested\n", errors,
+               q_countof(mipmap_tests) * 4 + q_countof(mipmap_linear_tests),
+               q_countof(resample_tests) * 2);
+}
+
+/*
+=================
+Com_ImageBench_f
+
+Times building a full mip chain and resampling a large texture using the
+original scalar kernels and the current ones, with and without threads, in
+legacy and linear mode.
+=================
+*/
+static void Com_ImageBench_f(void)
+{
+    static const char names[4][16] = { "reference", "serial", "threaded", "linear" };
+    uint64_t start, usec[4][2];
+    cvar_t *var = Cvar_FindVar("r_image_threads");
+    int saved = var ? var->integer : 0;
+    int i, mode, passes, w, h;
+    byte *src, *buf, *out;
+
+    passes = Cmd_Argc() > 1 ? Q_clip(Q_atoi(Cmd_Argv(1)), 1, 10000) : 20;
+
+    src = imgtest_alloc(1024 * 1024 * 4, true);
+    buf = Z_Malloc(1024 * 1024 * 4);
+    out = Z_Malloc(1024 * 1024 * 4);
+
+    for (mode = 0; mode < 4; mode++) {
+        if (var)
+            Cvar_SetInteger(var, mode >= 2, FROM_CODE);
+
+        usec[mode][0] = 0;
+        for (i = 0; i < passes; i++) {
+            memcpy(buf, src, 1024 * 1024 * 4);
+            start = Sys_Microseconds();
+            for (w = h = 1024; w > 1; w >>= 1, h >>= 1) {
+                if (mode)
+                    IMG_MipMap(buf, buf, w, h, mode == 3);
+                else
+                    ref_mipmap(buf, buf, w, h);
+            }
+            usec[mode][0] += Sys_Microseconds() - start;
+        }
+
+        start = Sys_Microseconds();
+        for (i = 0; i < passes; i++) {
+            if (mode)
+                IMG_ResampleTexture(src, 1024, 1024, out, 640, 960, mode == 3);
+            else
+                ref_resample(src, 1024, 1024, out, 640, 960);
+        }
+        usec[mode][1] = Sys_Microseconds() - start;
+    }
+
+    if (var)
+        Cvar_SetInteger(var, saved, FROM_CODE);
+
+    Com_Printf("%d passes, msec per pass\n", passes);
+    Com_Printf("kernel     mipmap 1024^2  resample 1024^2->640x960\n");
+    for (mode = 0; mode < 4; mode++)
+        Com_Printf("%-10s %13.3f %13.3f\n", names[mode],
+                   usec[mode][0] * 0.001 / passes, usec[mode][1] * 0.001 / passes);
+
+    Z_Free(src);
+    Z_Free(buf);
+    Z_Free(out);
+}
+
+#endif // USE_REF
+
 void TST_Init(void)
 {
     Cmd_AddCommand("error", Com_Error_f);
@@ -699,5 +2054,19 @@ void TST_Init(void)
 #endif
     Cmd_AddCommand("mdfourtest", Com_MdfourTest_f);
     Cmd_AddCommand("extcmptest", Com_ExtCmpTest_f);
+    Cmd_AddCommand("tracetest", Com_TraceTest_f);
+    Cmd_AddCommand("deltatest", Com_DeltaTest_f);
+    Cmd_AddCommand("deltabench", Com_DeltaBench_f);
+    Cmd_AddCommand("asynctest", Com_AsyncTest_f);
+    Cmd_AddCommand("ztrace", Com_ZTrace_f);
+    Cmd_AddCommand("zbench", Com_ZBench_f);
+    Cmd_AddCommand("loadbench", Com_LoadBench_f);
+    Cmd_AddCommand("prefetchtest", Com_PrefetchTest_f);
+    Cmd_AddCommand("probetest", Com_ProbeTest_f);
+    Cmd_AddCommand("pvsbench", Com_PvsBench_f);
+#if USE_REF
+    Cmd_AddCommand("imagetest", Com_ImageTest_f);
+    Cmd_AddCommand("imagebench", Com_ImageBench_f);
+#endif
 }
 
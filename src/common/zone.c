@@ -21,7 +21,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/common.h"
 #include "common/zone.h"
 
-#define Z_MAGIC     0x1d0d
+#define Z_MAGIC         0x1d0d
+#define Z_SLAB_MAGIC    0x1d0e
 
 typedef struct {
     uint16_t        magic;
@@ -43,6 +44,39 @@ typedef struct {
 static list_t       z_chain;
 static zstats_t     z_stats[TAG_MAX];
 
+// small blocks are carved from pages and recycled through per-size free
+// lists. slab blocks are linked into z_chain and accounted for just like
+// heap blocks, but pages are never returned to the system.
+#define Z_SLAB_MAX      512
+#define Z_SLAB_PAGE     32768
+
+static const uint16_t z_slab_sizes[] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+
+#define Z_SLAB_CLASSES  q_countof(z_slab_sizes)
+
+typedef struct {
+    zhead_t     *free;      // linked through entry.next
+    size_t      pages;
+    size_t      inuse;
+    size_t      peak;
+    size_t      allocs;
+    size_t      reused;
+} zslab_t;
+
+static zslab_t      z_slabs[Z_SLAB_CLASSES];
+static byte         z_slab_index[Z_SLAB_MAX / 16 + 1];
+static size_t       z_heap_allocs;
+static bool         z_slabs_enabled = true;
+
+#if USE_TESTS
+static ztrace_t     *z_trace;
+static size_t       z_trace_count;
+static size_t       z_trace_alloc;
+static bool         z_tracing;
+#endif
+
 #define S(d) \
     { .z = { .magic = Z_MAGIC, .tag = TAG_STATIC, .size = sizeof(zstatic_t) }, .data = d }
 
@@ -84,7 +118,102 @@ static inline void Z_CountAlloc(const zhead_t *z)
 }
 
 #define Z_Validate(z) \
-    Q_assert((z)->magic == Z_MAGIC && (z)->tag != TAG_FREE)
+    Q_assert(((z)->magic == Z_MAGIC || (z)->magic == Z_SLAB_MAGIC) && (z)->tag != TAG_FREE)
+
+// size includes header
+#define Z_SlabIndex(size) \
+    z_slab_index[((size) - sizeof(zhead_t) + 15) >> 4]
+
+#define Z_SlabSize(size) \
+    ((size) - sizeof(zhead_t) <= Z_SLAB_MAX)
+
+#if USE_TESTS
+
+static void Z_TraceEvent(ztraceop_t op, const void *ptr, const void *old, size_t size, memtag_t tag)
+{
+    ztrace_t *t;
+
+    if (!ptr) {
+        return;
+    }
+
+    if (z_trace_count == z_trace_alloc) {
+        z_trace_alloc = max(z_trace_alloc * 2, 4096);
+        z_trace = realloc(z_trace, z_trace_alloc * sizeof(*t));
+        if (!z_trace)
+            Com_Error(ERR_FATAL, "%s: couldn't grow allocation trace", __func__);
+    }
+
+    t = &z_trace[z_trace_count++];
+    t->op = op;
+    t->tag = tag;
+    t->size = size;
+    t->ptr = (uintptr_t)ptr;
+    t->old = (uintptr_t)old;
+}
+
+#define Z_Trace(op, ptr, old, size, tag) \
+    do { if (z_tracing) Z_TraceEvent(op, ptr, old, size, tag); } while (0)
+
+#else
+#define Z_Trace(op, ptr, old, size, tag)    (void)0
+#endif
+
+static void Z_SlabGrow(zslab_t *s)
+{
+    size_t blocksize = sizeof(zhead_t) + z_slab_sizes[s - z_slabs];
+    size_t i, count = Z_SLAB_PAGE / blocksize;
+    byte *page;
+    zhead_t *z;
+
+    page = malloc(blocksize * count);
+    if (!page) {
+        Com_Error(ERR_FATAL, "%s: couldn't allocate %zu bytes", __func__, blocksize * count);
+    }
+
+    for (i = 0; i < count; i++) {
+        z = (zhead_t *)(page + i * blocksize);
+        z->magic = 0xdead;
+        z->tag = TAG_FREE;
+        z->size = 0;    // never allocated, see Z_SlabAlloc
+        z->entry.next = (list_t *)s->free;
+        s->free = z;
+    }
+
+    s->pages++;
+}
+
+static zhead_t *Z_SlabAlloc(size_t size)
+{
+    zslab_t *s = &z_slabs[Z_SlabIndex(size)];
+    zhead_t *z;
+
+    if (!s->free)
+        Z_SlabGrow(s);
+
+    z = s->free;
+    s->free = (zhead_t *)z->entry.next;
+
+    // blocks returned by Z_SlabFree keep their size
+    if (z->size)
+        s->reused++;
+
+    s->allocs++;
+    s->inuse++;
+    s->peak = max(s->peak, s->inuse);
+
+    z->magic = Z_SLAB_MAGIC;
+    return z;
+}
+
+static void Z_SlabFree(zhead_t *z)
+{
+    zslab_t *s = &z_slabs[Z_SlabIndex(z->size)];
+
+    z->entry.next = (list_t *)s->free;
+    s->free = z;
+    s->inuse--;
+}
 
 void Z_LeakTest(memtag_t tag)
 {
@@ -108,6 +237,28 @@ void Z_LeakTest(memtag_t tag)
     }
 }
 
+static void Z_FreeBlock(zhead_t *z)
+{
+    Z_CountFree(z);
+
+    if (z->tag == TAG_STATIC) {
+        return;
+    }
+
+    List_Remove(&z->entry);
+    z->tag = TAG_FREE;
+
+    if (z->magic == Z_SLAB_MAGIC) {
+        z->magic = 0xdead;
+        Z_SlabFree(z);
+    } else {
+        z->magic = 0xdead;
+        free(z);
+    }
+}
+
+static void *Z_TagMallocInternal(size_t size, memtag_t tag, bool init);
+
 /*
 ========================
 Z_Free
@@ -125,14 +276,11 @@ void Z_Free(void *ptr)
 
     Z_Validate(z);
 
-    Z_CountFree(z);
-
     if (z->tag != TAG_STATIC) {
-        List_Remove(&z->entry);
-        z->magic = 0xdead;
-        z->tag = TAG_FREE;
-        free(z);
+        Z_Trace(ZTRACE_FREE, ptr, NULL, 0, z->tag);
     }
+
+    Z_FreeBlock(z);
 }
 
 /*
@@ -180,6 +328,24 @@ void *Z_Realloc(void *ptr, size_t size)
 
     Q_assert(z->tag != TAG_STATIC);
 
+    // slab blocks stay in place while size class is unchanged,
+    // otherwise they are moved
+    if (z->magic == Z_SLAB_MAGIC) {
+        if (Z_SlabSize(size) && Z_SlabIndex(size) == Z_SlabIndex(z->size)) {
+            Z_Trace(ZTRACE_REALLOC, ptr, ptr, size - sizeof(*z), z->tag);
+            Z_CountFree(z);
+            z->size = size;
+            Z_CountAlloc(z);
+            return ptr;
+        }
+
+        void *copy = Z_TagMallocInternal(size - sizeof(*z), z->tag, false);
+        memcpy(copy, ptr, min(size, z->size) - sizeof(*z));
+        Z_Trace(ZTRACE_REALLOC, copy, ptr, size - sizeof(*z), z->tag);
+        Z_FreeBlock(z);
+        return copy;
+    }
+
     Z_CountFree(z);
 
     z = realloc(z, size);
@@ -192,6 +358,8 @@ void *Z_Realloc(void *ptr, size_t size)
 
     Z_CountAlloc(z);
 
+    Z_Trace(ZTRACE_REALLOC, z + 1, ptr, size - sizeof(*z), z->tag);
+
     return z + 1;
 }
 
@@ -223,6 +391,59 @@ void Z_Stats_f(void)
                bytes, count);
 }
 
+/*
+========================
+Z_SlabStats_f
+========================
+*/
+void Z_SlabStats_f(void)
+{
+    size_t allocs = 0, reused = 0, bytes = 0;
+    zslab_t *s;
+    int i;
+
+    Com_Printf(" size pages  in use    peak     allocs reused\n"
+               "----- ----- ------- ------- ---------- ------\n");
+
+    for (i = 0, s = z_slabs; i < Z_SLAB_CLASSES; i++, s++) {
+        Com_Printf("%5d %5zu %7zu %7zu %10zu %5.1f%%\n", z_slab_sizes[i],
+                   s->pages, s->inuse, s->peak, s->allocs,
+                   s->allocs ? s->reused * 100.0 / s->allocs : 0.0);
+        allocs += s->allocs;
+        reused += s->reused;
+        bytes += s->pages * Z_SLAB_PAGE;
+    }
+
+    Com_Printf("----- ----- ------- ------- ---------- ------\n"
+               "%zu of %zu allocations from slabs (%.1f%%), %zu KiB reserved\n",
+               allocs, allocs + z_heap_allocs,
+               allocs ? allocs * 100.0 / (allocs + z_heap_allocs) : 0.0,
+               bytes / 1024);
+}
+
+#if USE_TESTS
+
+void Z_SetSlabsEnabled(bool enable)
+{
+    z_slabs_enabled = enable;
+}
+
+void Z_StartTrace(void)
+{
+    z_trace_count = 0;
+    z_tracing = true;
+}
+
+// returned buffer is valid until the next trace is started
+const ztrace_t *Z_StopTrace(size_t *count)
+{
+    z_tracing = false;
+    *count = z_trace_count;
+    return z_trace;
+}
+
+#endif
+
 /*
 ========================
 Z_FreeTags
@@ -257,11 +478,19 @@ static void *Z_TagMallocInternal(size_t size, memtag_t tag, bool init)
     Q_assert(tag > TAG_FREE && tag <= UINT16_MAX);
 
     size += sizeof(*z);
-    z = init ? calloc(1, size) : malloc(size);
-    if (!z) {
-        Com_Error(ERR_FATAL, "%s: couldn't allocate %zu bytes", __func__, size);
+    if (z_slabs_enabled && Z_SlabSize(size)) {
+        z = Z_SlabAlloc(size);
+        if (init) {
+            memset(z + 1, 0, size - sizeof(*z));
+        }
+    } else {
+        z = init ? calloc(1, size) : malloc(size);
+        if (!z) {
+            Com_Error(ERR_FATAL, "%s: couldn't allocate %zu bytes", __func__, size);
+        }
+        z->magic = Z_MAGIC;
+        z_heap_allocs++;
     }
-    z->magic = Z_MAGIC;
     z->tag = tag;
     z->size = size;
 
@@ -280,12 +509,16 @@ static void *Z_TagMallocInternal(size_t size, memtag_t tag, bool init)
 
 void *Z_TagMalloc(size_t size, memtag_t tag)
 {
-    return Z_TagMallocInternal(size, tag, false);
+    void *ptr = Z_TagMallocInternal(size, tag, false);
+    Z_Trace(ZTRACE_ALLOC, ptr, NULL, size, tag);
+    return ptr;
 }
 
 void *Z_TagMallocz(size_t size, memtag_t tag)
 {
-    return Z_TagMallocInternal(size, tag, true);
+    void *ptr = Z_TagMallocInternal(size, tag, true);
+    Z_Trace(ZTRACE_ALLOC, ptr, NULL, size, tag);
+    return ptr;
 }
 
 void *Z_Malloc(size_t size)
@@ -305,7 +538,15 @@ Z_Init
 */
 void Z_Init(void)
 {
+    int i, j;
+
     List_Init(&z_chain);
+
+    for (i = j = 0; i < q_countof(z_slab_index); i++) {
+        while (z_slab_sizes[j] < i * 16)
+            j++;
+        z_slab_index[i] = j;
+    }
 }
 
 /*
@@ -350,6 +350,7 @@ void FoundTarget(edict_t *self)
 
     // clear the targetname, that point is ours!
     self->movetarget->targetname = NULL;
+    G_IndexEdict(self->movetarget);
     self->monsterinfo.pause_framenum = 0;
 
     // run for it
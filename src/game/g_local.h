@@ -430,6 +430,7 @@ extern  game_locals_t   game;
 extern  level_locals_t  level;
 extern  game_import_t   gi;
 extern  game_export_t   globals;
+extern  const game_import_ex_t  *gix;
 extern  spawn_temp_t    st;
 
 extern  int sm_meat_index;
@@ -533,6 +534,9 @@ extern  cvar_t  *sv_features;
 
 extern  cvar_t  *sv_flaregun;
 
+extern  cvar_t  *g_target_index;
+extern  cvar_t  *g_radius_index;
+
 #define world   (&g_edicts[0])
 
 // item spawnflags
@@ -609,6 +613,10 @@ edict_t *G_PickTarget(char *targetname);
 void    G_UseTargets(edict_t *ent, edict_t *activator);
 void    G_SetMovedir(vec3_t angles, vec3_t movedir);
 
+void    G_IndexEdict(edict_t *ent);
+void    G_ClearEdictIndex(void);
+void    G_InitEdictIndex(void);
+
 void    G_InitEdict(edict_t *e);
 edict_t *G_Spawn(void);
 void    G_FreeEdict(edict_t *e);
@@ -743,6 +751,12 @@ void player_die(edict_t *self, edict_t *inflictor, edict_t *attacker, int damage
 //
 void ServerCommand(void);
 bool SV_FilterPacket(char *from);
+bool Svcmd_BenchAllowed(void);
+
+//
+// g_save.c
+//
+void Svcmd_SaveBench_f(void);
 
 //
 // p_view.c
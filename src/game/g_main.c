@@ -22,6 +22,7 @@ game_locals_t   game;
 level_locals_t  level;
 game_import_t   gi;
 game_export_t   globals;
+const game_import_ex_t  *gix;
 spawn_temp_t    st;
 
 int sm_meat_index;
@@ -44,6 +45,8 @@ cvar_t  *maxspectators;
 cvar_t  *maxentities;
 cvar_t  *g_select_empty;
 cvar_t  *g_protocol_extensions;
+cvar_t  *g_target_index;
+cvar_t  *g_radius_index;
 cvar_t  *dedicated;
 cvar_t  *nomonsters;
 cvar_t  *aimfix;
@@ -92,6 +95,10 @@ void ReadLevel(const char *filename);
 void InitGame(void);
 void G_RunFrame(void);
 
+// server profiler zones, -1 if not supported
+static int prof_entities = -1;
+static int prof_clients = -1;
+
 //===================================================================
 
 void ShutdownGame(void)
@@ -159,6 +166,8 @@ void InitGame(void)
 
     g_select_empty = gi.cvar("g_select_empty", "0", CVAR_ARCHIVE);
     g_protocol_extensions = gi.cvar("g_protocol_extensions", "0", CVAR_LATCH);
+    g_target_index = gi.cvar("g_target_index", "1", 0);
+    g_radius_index = gi.cvar("g_radius_index", "0", 0);
 
     run_pitch = gi.cvar("run_pitch", "0.002", 0);
     run_roll = gi.cvar("run_roll", "0.005", 0);
@@ -177,6 +186,11 @@ void InitGame(void)
     // obtain server features
     sv_features = gi.cvar("sv_features", NULL, 0);
 
+    if (gix && gix->apiversion >= 4 && gix->ProfRegister) {
+        prof_entities = gix->ProfRegister("g_entities");
+        prof_clients = gix->ProfRegister("g_clients");
+    }
+
 	// flare gun switch: 
 	//   0 = no flare gun
 	//   1 = spawn with the flare gun
@@ -205,6 +219,7 @@ void InitGame(void)
     g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
     globals.edicts = g_edicts;
     globals.max_edicts = game.maxentities;
+    G_InitEdictIndex();
 
     // initialize all clients for this game
     game.maxclients = maxclients->value;
@@ -250,6 +265,26 @@ q_exported game_export_t *GetGameAPI(game_import_t *import)
     return &globals;
 }
 
+static const game_export_ex_t gex = {
+    .apiversion = GAME_API_VERSION_EX,
+    .SeedRandom = Q_srand,
+};
+
+/*
+=================
+GetExtendedGameAPI
+
+Optional extensions. Fields of import structure must only be used when
+server apiversion is high enough.
+=================
+*/
+q_exported const game_export_ex_t *GetExtendedGameAPI(const game_import_ex_t *import)
+{
+    gix = import;
+
+    return &gex;
+}
+
 #ifndef GAME_HARD_LINKED
 // this is only here so the functions in q_shared.c can link
 void Com_LPrintf(print_type_t type, const char *fmt, ...)
@@ -473,6 +508,20 @@ void ExitLevel(void)
 
 }
 
+static uint64_t G_ProfBegin(void)
+{
+    if (prof_entities < 0)
+        return 0;
+
+    return gix->ProfBegin();
+}
+
+static void G_ProfEnd(int zone, uint64_t start)
+{
+    if (start)
+        gix->ProfEnd(zone, start);
+}
+
 /*
 ================
 G_RunFrame
@@ -484,6 +533,7 @@ void G_RunFrame(void)
 {
     int     i;
     edict_t *ent;
+    uint64_t prof;
 
     level.framenum++;
     level.time = level.framenum * FRAMETIME;
@@ -501,6 +551,7 @@ void G_RunFrame(void)
     // treat each object in turn
     // even the world gets a chance to think
     //
+    prof = G_ProfBegin();
     ent = &g_edicts[0];
     for (i = 0; i < globals.num_edicts; i++, ent++) {
         if (!ent->inuse)
@@ -526,6 +577,7 @@ void G_RunFrame(void)
 
         G_RunEntity(ent);
     }
+    G_ProfEnd(prof_entities, prof);
 
     // exit intermission right now to avoid annoying fov change
     if (level.exitintermission) {
@@ -540,6 +592,8 @@ void G_RunFrame(void)
     CheckNeedPass();
 
     // build the playerstate_t structures for all players
+    prof = G_ProfBegin();
     ClientEndServerFrames();
+    G_ProfEnd(prof_clients, prof);
 }
 
@@ -443,33 +443,81 @@ static const save_field_t gamefields[] = {
 
 //=========================================================
 
-static void write_data(void *buf, size_t len, gzFile f)
+#define SAVE_MAGIC1     MakeLittleLong('S','S','V','1')
+#define SAVE_MAGIC2     MakeLittleLong('S','A','V','1')
+
+// version 9 stores each struct as a fixed size record, with strings moved
+// into a table at the end of the file. version 8 stores a stream of fields.
+// version 2 was written by Q2RTX 1.5.0, and the savegame code was crafted
+// such to allow reading it.
+#define SAVE_VERSION        9
+#define SAVE_VERSION_FIELDS 8
+
+// save data is first serialized to memory, so that writing it to disk
+// can be done in background if server supports that
+typedef struct {
+    byte    *data;
+    size_t  len, size;
+} save_buffer_t;
+
+typedef struct {
+    save_buffer_t   buf;
+    save_buffer_t   strings;    // string table of bulk format
+    int             version;
+    int             *ptr_order; // save_ptrs indices sorted by address
+} game_write_context_t;
+
+static void free_write_context(game_write_context_t *f)
+{
+    gi.TagFree(f->buf.data);
+    gi.TagFree(f->strings.data);
+    gi.TagFree(f->ptr_order);
+    memset(f, 0, sizeof(*f));
+}
+
+static byte *grow_buffer(save_buffer_t *b, size_t len)
 {
-    if (gzwrite(f, buf, len) != len) {
-        gzclose(f);
-        gi.error("%s: couldn't write %zu bytes", __func__, len);
+    byte *data;
+
+    if (b->len + len > b->size) {
+        b->size = max(b->size * 2, b->len + len);
+        data = gi.TagMalloc(b->size, TAG_GAME);
+        if (b->data) {
+            memcpy(data, b->data, b->len);
+            gi.TagFree(b->data);
+        }
+        b->data = data;
     }
+
+    data = b->data + b->len;
+    b->len += len;
+    return data;
 }
 
-static void write_short(gzFile f, int16_t v)
+static void write_data(void *buf, size_t len, game_write_context_t *f)
+{
+    memcpy(grow_buffer(&f->buf, len), buf, len);
+}
+
+static void write_short(game_write_context_t *f, int16_t v)
 {
     v = LittleShort(v);
     write_data(&v, sizeof(v), f);
 }
 
-static void write_int(gzFile f, int32_t v)
+static void write_int(game_write_context_t *f, int32_t v)
 {
     v = LittleLong(v);
     write_data(&v, sizeof(v), f);
 }
 
-static void write_float(gzFile f, float v)
+static void write_float(game_write_context_t *f, float v)
 {
     v = LittleFloat(v);
     write_data(&v, sizeof(v), f);
 }
 
-static void write_string(gzFile f, char *s)
+static void write_string(game_write_context_t *f, char *s)
 {
     size_t len;
 
@@ -480,63 +528,88 @@ static void write_string(gzFile f, char *s)
 
     len = strlen(s);
     if (len >= 65536) {
-        gzclose(f);
+        free_write_context(f);
         gi.error("%s: bad length", __func__);
     }
     write_int(f, len);
     write_data(s, len, f);
 }
 
-static void write_vector(gzFile f, vec_t *v)
+static void write_vector(game_write_context_t *f, vec_t *v)
 {
     write_float(f, v[0]);
     write_float(f, v[1]);
     write_float(f, v[2]);
 }
 
-static void write_index(gzFile f, void *p, size_t size, const void *start, int max_index)
+static int index_for(game_write_context_t *f, void *p, size_t size, const void *start, int max_index)
 {
     uintptr_t diff;
 
     if (!p) {
-        write_int(f, -1);
-        return;
+        return -1;
     }
 
     diff = (uintptr_t)p - (uintptr_t)start;
     if (diff > max_index * size) {
-        gzclose(f);
+        free_write_context(f);
         gi.error("%s: pointer out of range: %p", __func__, p);
     }
     if (diff % size) {
-        gzclose(f);
+        free_write_context(f);
         gi.error("%s: misaligned pointer: %p", __func__, p);
     }
-    write_int(f, (int)(diff / size));
+    return (int)(diff / size);
+}
+
+static int ptrcmp(const void *p1, const void *p2)
+{
+    int i1 = *(const int *)p1;
+    int i2 = *(const int *)p2;
+    uintptr_t a1 = (uintptr_t)save_ptrs[i1].ptr;
+    uintptr_t a2 = (uintptr_t)save_ptrs[i2].ptr;
+
+    if (a1 != a2)
+        return a1 < a2 ? -1 : 1;
+    if (save_ptrs[i1].type != save_ptrs[i2].type)
+        return save_ptrs[i1].type < save_ptrs[i2].type ? -1 : 1;
+    return i1 - i2;
 }
 
-static void write_pointer(gzFile f, void *p, ptr_type_t type)
+// binary search over save_ptrs sorted by (address, type, index), so that
+// the first matching index is found just like a linear search would
+static int pointer_for(game_write_context_t *f, void *p, ptr_type_t type)
 {
     const save_ptr_t *ptr;
-    int i;
+    int lo, hi, mid;
 
     if (!p) {
-        write_int(f, -1);
-        return;
+        return -1;
     }
 
-    for (i = 0, ptr = save_ptrs; i < num_save_ptrs; i++, ptr++) {
-        if (ptr->type == type && ptr->ptr == p) {
-            write_int(f, i);
-            return;
-        }
+    lo = 0;
+    hi = num_save_ptrs;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        ptr = &save_ptrs[f->ptr_order[mid]];
+        if ((uintptr_t)ptr->ptr < (uintptr_t)p || (ptr->ptr == p && ptr->type < type))
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    gzclose(f);
+    if (lo < num_save_ptrs) {
+        ptr = &save_ptrs[f->ptr_order[lo]];
+        if (ptr->ptr == p && ptr->type == type)
+            return f->ptr_order[lo];
+    }
+
+    free_write_context(f);
     gi.error("%s: unknown pointer: %p", __func__, p);
+    return -1;
 }
 
-static void write_field(gzFile f, const save_field_t *field, void *base)
+static void write_field(game_write_context_t *f, const save_field_t *field, void *base)
 {
     void *p = (byte *)base + field->ofs;
     int i;
@@ -577,17 +650,17 @@ static void write_field(gzFile f, const save_field_t *field, void *base)
         break;
 
     case F_EDICT:
-        write_index(f, *(void **)p, sizeof(edict_t), g_edicts, game.maxentities - 1);
+        write_int(f, index_for(f, *(void **)p, sizeof(edict_t), g_edicts, game.maxentities - 1));
         break;
     case F_CLIENT:
-        write_index(f, *(void **)p, sizeof(gclient_t), game.clients, game.maxclients - 1);
+        write_int(f, index_for(f, *(void **)p, sizeof(gclient_t), game.clients, game.maxclients - 1));
         break;
     case F_ITEM:
-        write_index(f, *(void **)p, sizeof(gitem_t), itemlist, game.num_items - 1);
+        write_int(f, index_for(f, *(void **)p, sizeof(gitem_t), itemlist, game.num_items - 1));
         break;
 
     case F_POINTER:
-        write_pointer(f, *(void **)p, field->size);
+        write_int(f, pointer_for(f, *(void **)p, field->size));
         break;
 
     case F_FRAMETIME:
@@ -602,7 +675,7 @@ static void write_field(gzFile f, const save_field_t *field, void *base)
     }
 }
 
-static void write_fields(gzFile f, const save_field_t *fields, void *base)
+static void write_fields(game_write_context_t *f, const save_field_t *fields, void *base)
 {
     const save_field_t *field;
 
@@ -611,106 +684,351 @@ static void write_fields(gzFile f, const save_field_t *fields, void *base)
     }
 }
 
-typedef struct game_read_context_s {
-    gzFile f;
-    bool frametime_is_float;
-    const save_ptr_t* save_ptrs;
-    int num_save_ptrs;
+/*
+==============================================================================
+
+BULK RECORDS
+
+Every field type encodes to a fixed number of bytes, so a struct is written
+as one record of known size. Strings are appended to a separate table and
+the record holds their offset; edict, client, item and function pointers
+are replaced by indices, same as in the field stream.
+
+==============================================================================
+*/
+
+static size_t field_size(const save_field_t *field)
+{
+    switch (field->type) {
+    case F_BYTE:
+        return field->size;
+    case F_SHORT:
+        return field->size * 2;
+    case F_INT:
+    case F_BOOL:
+    case F_FLOAT:
+    case F_FRAMETIME:
+        return field->size * 4;
+    case F_VECTOR:
+        return 12;
+    default:
+        return 4;
+    }
+}
+
+static size_t record_size(const save_field_t *fields)
+{
+    const save_field_t *field;
+    size_t size = 0;
+
+    for (field = fields; field->type; field++) {
+        size += field_size(field);
+    }
+
+    return size;
+}
+
+static byte *put_short(byte *out, int16_t v)
+{
+    v = LittleShort(v);
+    memcpy(out, &v, sizeof(v));
+    return out + sizeof(v);
+}
+
+static byte *put_int(byte *out, int32_t v)
+{
+    v = LittleLong(v);
+    memcpy(out, &v, sizeof(v));
+    return out + sizeof(v);
+}
+
+static byte *put_float(byte *out, float v)
+{
+    v = LittleFloat(v);
+    memcpy(out, &v, sizeof(v));
+    return out + sizeof(v);
+}
+
+static byte *put_string(game_write_context_t *f, byte *out, char *s)
+{
+    size_t len;
+
+    if (!s) {
+        return put_int(out, -1);
+    }
+
+    len = strlen(s);
+    if (len >= 65536) {
+        free_write_context(f);
+        gi.error("%s: bad length", __func__);
+    }
+
+    out = put_int(out, f->strings.len);
+    memcpy(grow_buffer(&f->strings, len + 1), s, len + 1);
+    return out;
+}
+
+static byte *put_field(game_write_context_t *f, byte *out, const save_field_t *field, void *base)
+{
+    void *p = (byte *)base + field->ofs;
+    int i;
+
+    switch (field->type) {
+    case F_BYTE:
+        memcpy(out, p, field->size);
+        return out + field->size;
+    case F_SHORT:
+        for (i = 0; i < field->size; i++) {
+            out = put_short(out, ((short *)p)[i]);
+        }
+        return out;
+    case F_INT:
+    case F_FRAMETIME:
+        for (i = 0; i < field->size; i++) {
+            out = put_int(out, ((int *)p)[i]);
+        }
+        return out;
+    case F_BOOL:
+        for (i = 0; i < field->size; i++) {
+            out = put_int(out, ((bool *)p)[i]);
+        }
+        return out;
+    case F_FLOAT:
+        for (i = 0; i < field->size; i++) {
+            out = put_float(out, ((float *)p)[i]);
+        }
+        return out;
+    case F_VECTOR:
+        for (i = 0; i < 3; i++) {
+            out = put_float(out, ((vec_t *)p)[i]);
+        }
+        return out;
+
+    case F_ZSTRING:
+        return put_string(f, out, (char *)p);
+    case F_LSTRING:
+        return put_string(f, out, *(char **)p);
+
+    case F_EDICT:
+        return put_int(out, index_for(f, *(void **)p, sizeof(edict_t), g_edicts, game.maxentities - 1));
+    case F_CLIENT:
+        return put_int(out, index_for(f, *(void **)p, sizeof(gclient_t), game.clients, game.maxclients - 1));
+    case F_ITEM:
+        return put_int(out, index_for(f, *(void **)p, sizeof(gitem_t), itemlist, game.num_items - 1));
+
+    case F_POINTER:
+        return put_int(out, pointer_for(f, *(void **)p, field->size));
+
+    default:
+        free_write_context(f);
+        gi.error("%s: unknown field type", __func__);
+        return out;
+    }
+}
+
+static void write_record(game_write_context_t *f, const save_field_t *fields, void *base, size_t size)
+{
+    const save_field_t *field;
+    size_t ofs = f->buf.len;
+    byte *out;
+
+    grow_buffer(&f->buf, size);
+    out = f->buf.data + ofs;
+
+    for (field = fields; field->type; field++) {
+        out = put_field(f, out, field, base);
+    }
+}
+
+//=========================================================
+
+static void write_struct(game_write_context_t *f, const save_field_t *fields, void *base, size_t size)
+{
+    if (f->version == SAVE_VERSION)
+        write_record(f, fields, base, size);
+    else
+        write_fields(f, fields, base);
+}
+
+static void begin_write(game_write_context_t *f, int magic, int version, size_t size)
+{
+    int i;
+
+    memset(f, 0, sizeof(*f));
+    f->buf.size = size;
+    f->buf.data = gi.TagMalloc(size, TAG_GAME);
+    f->version = version;
+
+    f->ptr_order = gi.TagMalloc(num_save_ptrs * sizeof(f->ptr_order[0]), TAG_GAME);
+    for (i = 0; i < num_save_ptrs; i++)
+        f->ptr_order[i] = i;
+    qsort(f->ptr_order, num_save_ptrs, sizeof(f->ptr_order[0]), ptrcmp);
+
+    write_int(f, magic);
+    write_int(f, version);
+
+    // length of records, patched by end_write
+    if (version == SAVE_VERSION)
+        write_int(f, 0);
+}
+
+// appends string table to bulk format
+static void end_write(game_write_context_t *f)
+{
+    int32_t len;
+
+    if (f->version != SAVE_VERSION)
+        return;
+
+    len = LittleLong(f->buf.len - 12);
+    memcpy(f->buf.data + 8, &len, sizeof(len));
+
+    if (f->strings.len)
+        memcpy(grow_buffer(&f->buf, f->strings.len), f->strings.data, f->strings.len);
+}
+
+// hands serialized data to server for writing in background, or writes
+// it synchronously if server is too old
+static void write_file(const char *filename, game_write_context_t *f)
+{
+    gzFile  file;
+
+    if (gix && gix->apiversion >= 3 && gix->WriteFileAsync) {
+        gix->WriteFileAsync(filename, f->buf.data, f->buf.len, true);
+        free_write_context(f);
+        return;
+    }
+
+    file = gzopen(filename, "wb");
+    if (!file) {
+        free_write_context(f);
+        gi.error("Couldn't open %s", filename);
+    }
+
+    if (gzwrite(file, f->buf.data, f->buf.len) != f->buf.len) {
+        gzclose(file);
+        free_write_context(f);
+        gi.error("Couldn't write %s", filename);
+    }
+
+    free_write_context(f);
+
+    if (gzclose(file))
+        gi.error("Couldn't write %s", filename);
+}
+
+// whole file is decompressed to memory before parsing
+typedef struct {
+    byte    *data;
+    size_t  len, pos;
+    int     version;
+    bool    frametime_is_float;
+    const save_ptr_t *save_ptrs;
+    int     num_save_ptrs;
+    const char *strings;    // string table of bulk format
+    size_t  strings_len;
 } game_read_context_t;
 
-static void read_data(void *buf, size_t len, gzFile f)
+static void free_read_context(game_read_context_t *ctx)
 {
-    if (gzread(f, buf, len) != len) {
-        gzclose(f);
+    gi.TagFree(ctx->data);
+    ctx->data = NULL;
+}
+
+static void read_data(game_read_context_t *ctx, void *buf, size_t len)
+{
+    if (len > ctx->len - ctx->pos) {
+        free_read_context(ctx);
         gi.error("%s: couldn't read %zu bytes", __func__, len);
     }
+
+    memcpy(buf, ctx->data + ctx->pos, len);
+    ctx->pos += len;
 }
 
-static int read_short(gzFile f)
+static int read_short(game_read_context_t *ctx)
 {
     int16_t v;
 
-    read_data(&v, sizeof(v), f);
+    read_data(ctx, &v, sizeof(v));
     v = LittleShort(v);
 
     return v;
 }
 
-static int read_int(gzFile f)
+static int read_int(game_read_context_t *ctx)
 {
     int32_t v;
 
-    read_data(&v, sizeof(v), f);
+    read_data(ctx, &v, sizeof(v));
     v = LittleLong(v);
 
     return v;
 }
 
-static float read_float(gzFile f)
+static float read_float(game_read_context_t *ctx)
 {
     float v;
 
-    read_data(&v, sizeof(v), f);
+    read_data(ctx, &v, sizeof(v));
     v = LittleFloat(v);
 
     return v;
 }
 
-static char *read_string(gzFile f)
+static char *read_string(game_read_context_t *ctx)
 {
     int len;
     char *s;
 
-    len = read_int(f);
+    len = read_int(ctx);
     if (len == -1) {
         return NULL;
     }
 
     if (len < 0 || len >= 65536) {
-        gzclose(f);
+        free_read_context(ctx);
         gi.error("%s: bad length", __func__);
     }
 
     s = gi.TagMalloc(len + 1, TAG_LEVEL);
-    read_data(s, len, f);
+    read_data(ctx, s, len);
     s[len] = 0;
 
     return s;
 }
 
-static void read_zstring(gzFile f, char *s, size_t size)
+static void read_zstring(game_read_context_t *ctx, char *s, size_t size)
 {
     int len;
 
-    len = read_int(f);
+    len = read_int(ctx);
     if (len < 0 || len >= size) {
-        gzclose(f);
+        free_read_context(ctx);
         gi.error("%s: bad length", __func__);
     }
 
-    read_data(s, len, f);
+    read_data(ctx, s, len);
     s[len] = 0;
 }
 
-static void read_vector(gzFile f, vec_t *v)
+static void read_vector(game_read_context_t *ctx, vec_t *v)
 {
-    v[0] = read_float(f);
-    v[1] = read_float(f);
-    v[2] = read_float(f);
+    v[0] = read_float(ctx);
+    v[1] = read_float(ctx);
+    v[2] = read_float(ctx);
 }
 
-static void *read_index(gzFile f, size_t size, const void *start, int max_index)
+static void *resolve_index(game_read_context_t *ctx, int index, size_t size, const void *start, int max_index)
 {
-    int index;
     byte *p;
 
-    index = read_int(f);
     if (index == -1) {
         return NULL;
     }
 
     if (index < 0 || index > max_index) {
-        gzclose(f);
+        free_read_context(ctx);
         gi.error("%s: bad index", __func__);
     }
 
@@ -718,93 +1036,91 @@ static void *read_index(gzFile f, size_t size, const void *start, int max_index)
     return p;
 }
 
-static void *read_pointer(game_read_context_t* ctx, ptr_type_t type)
+static void *resolve_pointer(game_read_context_t *ctx, int index, ptr_type_t type)
 {
-    int index;
     const save_ptr_t *ptr;
 
-    index = read_int(ctx->f);
     if (index == -1) {
         return NULL;
     }
 
     if (index < 0 || index >= ctx->num_save_ptrs) {
-        gzclose(ctx->f);
+        free_read_context(ctx);
         gi.error("%s: bad index", __func__);
     }
 
     ptr = &ctx->save_ptrs[index];
     if (ptr->type != type) {
-        gzclose(ctx->f);
+        free_read_context(ctx);
         gi.error("%s: type mismatch", __func__);
     }
 
     return (void *)ptr->ptr;
 }
 
-static void read_field(game_read_context_t* ctx, const save_field_t *field, void *base)
+static void read_field(game_read_context_t *ctx, const save_field_t *field, void *base)
 {
     void *p = (byte *)base + field->ofs;
     int i;
 
     switch (field->type) {
     case F_BYTE:
-        read_data(p, field->size, ctx->f);
+        read_data(ctx, p, field->size);
         break;
     case F_SHORT:
         for (i = 0; i < field->size; i++) {
-            ((short *)p)[i] = read_short(ctx->f);
+            ((short *)p)[i] = read_short(ctx);
         }
         break;
     case F_INT:
         for (i = 0; i < field->size; i++) {
-            ((int *)p)[i] = read_int(ctx->f);
+            ((int *)p)[i] = read_int(ctx);
         }
         break;
     case F_BOOL:
         for (i = 0; i < field->size; i++) {
-            ((bool *)p)[i] = read_int(ctx->f);
+            ((bool *)p)[i] = read_int(ctx);
         }
         break;
     case F_FLOAT:
         for (i = 0; i < field->size; i++) {
-            ((float *)p)[i] = read_float(ctx->f);
+            ((float *)p)[i] = read_float(ctx);
         }
         break;
     case F_VECTOR:
-        read_vector(ctx->f, (vec_t *)p);
+        read_vector(ctx, (vec_t *)p);
         break;
 
     case F_LSTRING:
-        *(char **)p = read_string(ctx->f);
+        *(char **)p = read_string(ctx);
         break;
     case F_ZSTRING:
-        read_zstring(ctx->f, (char *)p, field->size);
+        read_zstring(ctx, (char *)p, field->size);
         break;
 
     case F_EDICT:
-        *(edict_t **)p = read_index(ctx->f, sizeof(edict_t), g_edicts, game.maxentities - 1);
+        *(edict_t **)p = resolve_index(ctx, read_int(ctx), sizeof(edict_t), g_edicts, game.maxentities - 1);
         break;
     case F_CLIENT:
-        *(gclient_t **)p = read_index(ctx->f, sizeof(gclient_t), game.clients, game.maxclients - 1);
+        *(gclient_t **)p = resolve_index(ctx, read_int(ctx), sizeof(gclient_t), game.clients, game.maxclients - 1);
         break;
     case F_ITEM:
-        *(gitem_t **)p = read_index(ctx->f, sizeof(gitem_t), itemlist, game.num_items - 1);
+        *(gitem_t **)p = resolve_index(ctx, read_int(ctx), sizeof(gitem_t), itemlist, game.num_items - 1);
         break;
 
     case F_POINTER:
-        *(void **)p = read_pointer(ctx, field->size);
+        *(void **)p = resolve_pointer(ctx, read_int(ctx), field->size);
         break;
 
     case F_FRAMETIME:
         for (i = 0; i < field->size; i++) {
             if(ctx->frametime_is_float) {
                 // "Old" savegame: read float timestamp, convert to frame number
-                float timestamp = read_float(ctx->f);
+                float timestamp = read_float(ctx);
                 ((int *)p)[i] = (int)(timestamp * BASE_FRAMERATE);
             } else {
                 // "New" savegame: simple int
-                ((int *)p)[i] = read_int(ctx->f);
+                ((int *)p)[i] = read_int(ctx);
             }
         }
         break;
@@ -814,7 +1130,7 @@ static void read_field(game_read_context_t* ctx, const save_field_t *field, void
     }
 }
 
-static void read_fields(game_read_context_t* ctx, const save_field_t *fields, void *base)
+static void read_fields(game_read_context_t *ctx, const save_field_t *fields, void *base)
 {
     const save_field_t *field;
 
@@ -823,11 +1139,145 @@ static void read_fields(game_read_context_t* ctx, const save_field_t *fields, vo
     }
 }
 
-//=========================================================
+static int get_short(const byte *in)
+{
+    int16_t v;
 
-#define SAVE_MAGIC1     MakeLittleLong('S','S','V','1')
-#define SAVE_MAGIC2     MakeLittleLong('S','A','V','1')
-#define SAVE_VERSION    8
+    memcpy(&v, in, sizeof(v));
+    return LittleShort(v);
+}
+
+static int get_int(const byte *in)
+{
+    int32_t v;
+
+    memcpy(&v, in, sizeof(v));
+    return LittleLong(v);
+}
+
+static float get_float(const byte *in)
+{
+    float v;
+
+    memcpy(&v, in, sizeof(v));
+    return LittleFloat(v);
+}
+
+// returns string at given offset into string table, or NULL
+static const char *get_string(game_read_context_t *ctx, int ofs, size_t maxlen)
+{
+    const char *s;
+    size_t len;
+
+    if (ofs == -1) {
+        return NULL;
+    }
+
+    if (ofs < 0 || ofs >= ctx->strings_len) {
+        free_read_context(ctx);
+        gi.error("%s: bad offset", __func__);
+    }
+
+    s = ctx->strings + ofs;
+    len = Q_strnlen(s, ctx->strings_len - ofs);
+    if (len == ctx->strings_len - ofs || len >= maxlen) {
+        free_read_context(ctx);
+        gi.error("%s: bad length", __func__);
+    }
+
+    return s;
+}
+
+static const byte *get_field(game_read_context_t *ctx, const byte *in, const save_field_t *field, void *base)
+{
+    void *p = (byte *)base + field->ofs;
+    const char *s;
+    int i;
+
+    switch (field->type) {
+    case F_BYTE:
+        memcpy(p, in, field->size);
+        return in + field->size;
+    case F_SHORT:
+        for (i = 0; i < field->size; i++, in += 2) {
+            ((short *)p)[i] = get_short(in);
+        }
+        return in;
+    case F_INT:
+    case F_FRAMETIME:
+        for (i = 0; i < field->size; i++, in += 4) {
+            ((int *)p)[i] = get_int(in);
+        }
+        return in;
+    case F_BOOL:
+        for (i = 0; i < field->size; i++, in += 4) {
+            ((bool *)p)[i] = get_int(in);
+        }
+        return in;
+    case F_FLOAT:
+        for (i = 0; i < field->size; i++, in += 4) {
+            ((float *)p)[i] = get_float(in);
+        }
+        return in;
+    case F_VECTOR:
+        for (i = 0; i < 3; i++, in += 4) {
+            ((vec_t *)p)[i] = get_float(in);
+        }
+        return in;
+
+    case F_LSTRING:
+        s = get_string(ctx, get_int(in), 65536);
+        *(char **)p = s ? G_CopyString((char *)s) : NULL;
+        return in + 4;
+    case F_ZSTRING:
+        s = get_string(ctx, get_int(in), field->size);
+        if (!s) {
+            free_read_context(ctx);
+            gi.error("%s: missing string", __func__);
+        }
+        strcpy((char *)p, s);
+        return in + 4;
+
+    case F_EDICT:
+        *(edict_t **)p = resolve_index(ctx, get_int(in), sizeof(edict_t), g_edicts, game.maxentities - 1);
+        return in + 4;
+    case F_CLIENT:
+        *(gclient_t **)p = resolve_index(ctx, get_int(in), sizeof(gclient_t), game.clients, game.maxclients - 1);
+        return in + 4;
+    case F_ITEM:
+        *(gitem_t **)p = resolve_index(ctx, get_int(in), sizeof(gitem_t), itemlist, game.num_items - 1);
+        return in + 4;
+
+    case F_POINTER:
+        *(void **)p = resolve_pointer(ctx, get_int(in), field->size);
+        return in + 4;
+
+    default:
+        free_read_context(ctx);
+        gi.error("%s: unknown field type", __func__);
+        return in;
+    }
+}
+
+static void read_record(game_read_context_t *ctx, const save_field_t *fields, void *base, size_t size)
+{
+    const save_field_t *field;
+    const byte *in;
+
+    if (size > ctx->len - ctx->pos) {
+        free_read_context(ctx);
+        gi.error("%s: couldn't read %zu bytes", __func__, size);
+    }
+
+    in = ctx->data + ctx->pos;
+    ctx->pos += size;
+
+    for (field = fields; field->type; field++) {
+        in = get_field(ctx, in, field, base);
+    }
+}
+
+//=========================================================
 
 static void check_gzip(int magic)
 {
@@ -837,6 +1287,102 @@ static void check_gzip(int magic)
 #endif
 }
 
+static void read_struct(game_read_context_t *ctx, const save_field_t *fields, void *base, size_t size)
+{
+    if (ctx->version == SAVE_VERSION)
+        read_record(ctx, fields, base, size);
+    else
+        read_fields(ctx, fields, base);
+}
+
+// validates header of data loaded into ctx
+static void begin_read(game_read_context_t *ctx, int magic)
+{
+    int i;
+
+    ctx->pos = 0;
+
+    i = read_int(ctx);
+    if (i != magic) {
+        free_read_context(ctx);
+        check_gzip(i);
+        gi.error("Not a Q2PRO save game");
+    }
+
+    i = read_int(ctx);
+    if (i != SAVE_VERSION && i != SAVE_VERSION_FIELDS && i != 2) {
+        free_read_context(ctx);
+        gi.error("Savegame from different version (got %d, expected %d)", i, SAVE_VERSION);
+    }
+
+    ctx->version = i;
+    if (i == 2) {
+        // Old savegame
+        ctx->frametime_is_float = true;
+        ctx->save_ptrs = save_ptrs_v2;
+        ctx->num_save_ptrs = num_save_ptrs_v2;
+    } else {
+        // Newer savegame
+        ctx->frametime_is_float = false;
+        ctx->save_ptrs = save_ptrs;
+        ctx->num_save_ptrs = num_save_ptrs;
+    }
+
+    ctx->strings = NULL;
+    ctx->strings_len = 0;
+
+    // split off string table
+    if (i == SAVE_VERSION) {
+        i = read_int(ctx);
+        if (i < 0 || i > ctx->len - ctx->pos) {
+            free_read_context(ctx);
+            gi.error("%s: bad records length", __func__);
+        }
+        ctx->strings = (const char *)ctx->data + ctx->pos + i;
+        ctx->strings_len = ctx->len - ctx->pos - i;
+        ctx->len = ctx->pos + i;
+    }
+}
+
+static void read_file(const char *filename, game_read_context_t *ctx, int magic)
+{
+    gzFile  f;
+    size_t  size;
+    byte    *data;
+    int     ret;
+
+    f = gzopen(filename, "rb");
+    if (!f)
+        gi.error("Couldn't open %s", filename);
+
+    memset(ctx, 0, sizeof(*ctx));
+    size = 0x40000;
+    ctx->data = gi.TagMalloc(size, TAG_GAME);
+
+    while (1) {
+        if (ctx->len == size) {
+            size *= 2;
+            data = gi.TagMalloc(size, TAG_GAME);
+            memcpy(data, ctx->data, ctx->len);
+            gi.TagFree(ctx->data);
+            ctx->data = data;
+        }
+        ret = gzread(f, ctx->data + ctx->len, size - ctx->len);
+        if (ret <= 0)
+            break;
+        ctx->len += ret;
+    }
+
+    gzclose(f);
+
+    if (ret < 0) {
+        free_read_context(ctx);
+        gi.error("Couldn't read %s", filename);
+    }
+
+    begin_read(ctx, magic);
+}
+
 /*
 ============
 WriteGame
@@ -853,220 +1399,148 @@ last save position.
 */
 void WriteGame(const char *filename, qboolean autosave)
 {
-    gzFile  f;
+    game_write_context_t f;
+    size_t  size;
     int     i;
 
     if (!autosave)
         SaveClientData();
 
-    f = gzopen(filename, "wb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
-
-    write_int(f, SAVE_MAGIC1);
-    write_int(f, SAVE_VERSION);
+    begin_write(&f, SAVE_MAGIC1, SAVE_VERSION, 0x10000);
 
     game.autosaved = autosave;
-    write_fields(f, gamefields, &game);
+    write_struct(&f, gamefields, &game, record_size(gamefields));
     game.autosaved = false;
 
+    size = record_size(clientfields);
     for (i = 0; i < game.maxclients; i++) {
-        write_fields(f, clientfields, &game.clients[i]);
+        write_struct(&f, clientfields, &game.clients[i], size);
     }
 
-    if (gzclose(f))
-        gi.error("Couldn't write %s", filename);
-}
-
-static game_read_context_t make_read_context(gzFile f, int version)
-{
-    game_read_context_t ctx;
-    ctx.f = f;
-    if(version == 2) {
-        // Old savegame
-        ctx.frametime_is_float = true;
-        ctx.save_ptrs = save_ptrs_v2;
-        ctx.num_save_ptrs = num_save_ptrs_v2;
-    } else {
-        // Newer savegame
-        ctx.frametime_is_float = false;
-        ctx.save_ptrs = save_ptrs;
-        ctx.num_save_ptrs = num_save_ptrs;
-    }
-    return ctx;
+    end_write(&f);
+    write_file(filename, &f);
 }
 
 void ReadGame(const char *filename)
 {
-    gzFile  f;
+    game_read_context_t ctx;
+    size_t  size;
     int     i;
 
     gi.FreeTags(TAG_GAME);
 
-    f = gzopen(filename, "rb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
-
-    gzbuffer(f, 65536);
-
-    i = read_int(f);
-    if (i != SAVE_MAGIC1) {
-        gzclose(f);
-        check_gzip(i);
-        gi.error("Not a Q2PRO save game");
-    }
-
-    i = read_int(f);
-    if ((i != SAVE_VERSION)  && (i != 2)) {
-        // Version 2 was written by Q2RTX 1.5.0, and the savegame code was crafted such to allow reading it
-        gzclose(f);
-        gi.error("Savegame from different version (got %d, expected %d)", i, SAVE_VERSION);
-    }
-
-    game_read_context_t ctx = make_read_context(f, i);
+    read_file(filename, &ctx, SAVE_MAGIC1);
 
-    read_fields(&ctx, gamefields, &game);
+    read_struct(&ctx, gamefields, &game, record_size(gamefields));
 
     // should agree with server's version
     if (game.maxclients != (int)maxclients->value) {
-        gzclose(f);
+        free_read_context(&ctx);
         gi.error("Savegame has bad maxclients");
     }
     if (game.maxentities <= game.maxclients || game.maxentities > game.csr.max_edicts) {
-        gzclose(f);
+        free_read_context(&ctx);
         gi.error("Savegame has bad maxentities");
     }
 
     g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
     globals.edicts = g_edicts;
     globals.max_edicts = game.maxentities;
+    G_InitEdictIndex();
 
     game.clients = gi.TagMalloc(game.maxclients * sizeof(game.clients[0]), TAG_GAME);
+    size = record_size(clientfields);
     for (i = 0; i < game.maxclients; i++) {
-        read_fields(&ctx, clientfields, &game.clients[i]);
+        read_struct(&ctx, clientfields, &game.clients[i], size);
     }
 
-    gzclose(f);
+    free_read_context(&ctx);
 }
 
 //==========================================================
 
-/*
-=================
-WriteLevel
-
-=================
-*/
-void WriteLevel(const char *filename)
+static void write_level(game_write_context_t *f, int version)
 {
     int     i;
     edict_t *ent;
-    gzFile  f;
+    size_t  size;
 
-    f = gzopen(filename, "wb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
-
-    write_int(f, SAVE_MAGIC2);
-    write_int(f, SAVE_VERSION);
+    begin_write(f, SAVE_MAGIC2, version, 0x40000);
 
     // write out level_locals_t
-    write_fields(f, levelfields, &level);
+    write_struct(f, levelfields, &level, record_size(levelfields));
 
     // write out all the entities
+    size = record_size(entityfields);
     for (i = 0; i < globals.num_edicts; i++) {
         ent = &g_edicts[i];
         if (!ent->inuse)
             continue;
         write_int(f, i);
-        write_fields(f, entityfields, ent);
+        write_struct(f, entityfields, ent, size);
     }
     write_int(f, -1);
 
-    if (gzclose(f))
-        gi.error("Couldn't write %s", filename);
+    end_write(f);
 }
 
 /*
 =================
-ReadLevel
-
-SpawnEntities will allready have been called on the
-level the same way it was when the level was saved.
-
-That is necessary to get the baselines
-set up identically.
-
-The server will have cleared all of the world links before
-calling ReadLevel.
+WriteLevel
 
-No clients are connected yet.
 =================
 */
-void ReadLevel(const char *filename)
+void WriteLevel(const char *filename)
+{
+    game_write_context_t f;
+
+    write_level(&f, SAVE_VERSION);
+    write_file(filename, &f);
+}
+
+static void read_level(game_read_context_t *ctx)
 {
     int     entnum;
-    gzFile  f;
     int     i;
     edict_t *ent;
+    size_t  size;
 
     // free any dynamic memory allocated by loading the level
     // base state
     gi.FreeTags(TAG_LEVEL);
 
-    f = gzopen(filename, "rb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
-
-    gzbuffer(f, 65536);
-
     // wipe all the entities
     memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
     globals.num_edicts = maxclients->value + 1;
-
-    i = read_int(f);
-    if (i != SAVE_MAGIC2) {
-        gzclose(f);
-        check_gzip(i);
-        gi.error("Not a Q2PRO save game");
-    }
-
-    i = read_int(f);
-    if ((i != SAVE_VERSION) && (i != 2)) {
-        // Version 2 was written by Q2RTX 1.5.0, and the savegame code was crafted such to allow reading it
-        gzclose(f);
-        gi.error("Savegame from different version (got %d, expected %d)", i, SAVE_VERSION);
-    }
-
-    game_read_context_t ctx = make_read_context(f, i);
+    G_ClearEdictIndex();
 
     // load the level locals
-    read_fields(&ctx, levelfields, &level);
+    read_struct(ctx, levelfields, &level, record_size(levelfields));
 
     // load all the entities
+    size = record_size(entityfields);
     while (1) {
-        entnum = read_int(f);
+        entnum = read_int(ctx);
         if (entnum == -1)
             break;
         if (entnum < 0 || entnum >= game.maxentities) {
-            gzclose(f);
+            free_read_context(ctx);
             gi.error("%s: bad entity number", __func__);
         }
         if (entnum >= globals.num_edicts)
             globals.num_edicts = entnum + 1;
 
         ent = &g_edicts[entnum];
-        read_fields(&ctx, entityfields, ent);
+        read_struct(ctx, entityfields, ent, size);
         ent->inuse = true;
         ent->s.number = entnum;
+        G_IndexEdict(ent);
 
         // let the server rebuild world links for this ent
         memset(&ent->area, 0, sizeof(ent->area));
         gi.linkentity(ent);
     }
 
-    gzclose(f);
-
     // mark all clients as unconnected
     for (i = 0; i < maxclients->value; i++) {
         ent = &g_edicts[i + 1];
@@ -1097,3 +1571,177 @@ void ReadLevel(const char *filename)
     }
 }
 
+/*
+=================
+ReadLevel
+
+SpawnEntities will allready have been called on the
+level the same way it was when the level was saved.
+
+That is necessary to get the baselines
+set up identically.
+
+The server will have cleared all of the world links before
+calling ReadLevel.
+
+No clients are connected yet.
+=================
+*/
+void ReadLevel(const char *filename)
+{
+    game_read_context_t ctx;
+
+    read_file(filename, &ctx, SAVE_MAGIC2);
+    read_level(&ctx);
+    free_read_context(&ctx);
+}
+
+//==========================================================
+
+// parses save data back into the level, returns compressed size
+static size_t SaveBench_Reload(game_write_context_t *f, clock_t *zip_time, clock_t *read_time)
+{
+    game_read_context_t ctx;
+    clock_t start;
+    size_t  size;
+    int     i;
+#if USE_ZLIB
+    byte    *zbuf;
+    uLongf  zlen, ulen;
+#endif
+
+    memset(&ctx, 0, sizeof(ctx));
+#if USE_ZLIB
+    start = clock();
+    zlen = compressBound(f->buf.len);
+    zbuf = gi.TagMalloc(zlen, TAG_GAME);
+    compress(zbuf, &zlen, f->buf.data, f->buf.len);
+    ulen = f->buf.len;
+    ctx.data = gi.TagMalloc(ulen, TAG_GAME);
+    uncompress(ctx.data, &ulen, zbuf, zlen);
+    gi.TagFree(zbuf);
+    *zip_time += clock() - start;
+    ctx.len = ulen;
+    size = zlen;
+#else
+    ctx.data = gi.TagMalloc(f->buf.len, TAG_GAME);
+    memcpy(ctx.data, f->buf.data, f->buf.len);
+    ctx.len = size = f->buf.len;
+#endif
+
+    // server clears world links before ReadLevel
+    for (i = 0; i < globals.num_edicts; i++) {
+        if (g_edicts[i].inuse)
+            gi.unlinkentity(&g_edicts[i]);
+    }
+
+    start = clock();
+    begin_read(&ctx, SAVE_MAGIC2);
+    read_level(&ctx);
+    *read_time += clock() - start;
+
+    free_read_context(&ctx);
+    return size;
+}
+
+/*
+=================
+Svcmd_SaveBench_f
+
+sv savebench [passes] [count]
+
+Populates current level with count monsters and items, then times
+serializing and parsing it in field stream and bulk record formats, entirely
+in memory. Compression time is reported separately. Each pass reloads the
+level from its own save data and checks that writing it again gives
+identical bytes. Spawned entities are freed and level state is restored
+afterwards.
+=================
+*/
+void Svcmd_SaveBench_f(void)
+{
+    static const char *const classnames[] = {
+        "monster_soldier", "item_health", "ammo_shells", "weapon_shotgun", "monster_infantry"
+    };
+    static const int versions[2] = { SAVE_VERSION_FIELDS, SAVE_VERSION };
+    void    ED_CallSpawn(edict_t *ent);
+    game_write_context_t f, check;
+    clock_t start, write_time = 0, read_time = 0, zip_time = 0;
+    int     i, j, k, passes, count;
+    size_t  size, zsize;
+    edict_t **ents;
+    level_locals_t saved;
+    bool    mismatch;
+
+    if (!Svcmd_BenchAllowed())
+        return;
+
+    passes = gi.argc() > 2 ? atoi(gi.argv(2)) : 10;
+    count = gi.argc() > 3 ? atoi(gi.argv(3)) : 512;
+    passes = Q_clip(passes, 1, 1000);
+    count = Q_clip(count, 0, game.maxentities - globals.num_edicts);
+
+    for (i = 0; i < game.maxclients; i++) {
+        if (game.clients[i].pers.connected) {
+            gi.cprintf(NULL, PRINT_HIGH, "Can't run savebench with clients connected\n");
+            return;
+        }
+    }
+
+    // spawned monsters and items bump level counters
+    saved = level;
+
+    ents = gi.TagMalloc((count + 1) * sizeof(ents[0]), TAG_GAME);
+    for (i = 0; i < count; i++) {
+        ents[i] = G_Spawn();
+        ents[i]->classname = (char *)classnames[i % q_countof(classnames)];
+        for (j = 0; j < 2; j++)
+            ents[i]->s.origin[j] = crandom() * 1024;
+        ED_CallSpawn(ents[i]);
+    }
+
+    // first reload links entities that were never linked,
+    // do it untimed to settle the level
+    write_level(&f, SAVE_VERSION);
+    SaveBench_Reload(&f, &zip_time, &read_time);
+    free_write_context(&f);
+
+    for (k = 0; k < 2; k++) {
+        write_time = read_time = zip_time = 0;
+        size = zsize = 0;
+        mismatch = false;
+
+        for (j = 0; j < passes; j++) {
+            start = clock();
+            write_level(&f, versions[k]);
+            write_time += clock() - start;
+
+            size = f.buf.len;
+            zsize = SaveBench_Reload(&f, &zip_time, &read_time);
+
+            write_level(&check, versions[k]);
+            if (check.buf.len != f.buf.len || memcmp(check.buf.data, f.buf.data, f.buf.len))
+                mismatch = true;
+
+            free_write_context(&check);
+            free_write_context(&f);
+        }
+
+        gi.cprintf(NULL, PRINT_HIGH, "version %d: %d edicts, %zu bytes, %zu compressed\n",
+                   versions[k], globals.num_edicts, size, zsize);
+        gi.cprintf(NULL, PRINT_HIGH, "version %d: write %.3f msec, read %.3f msec, zlib %.3f msec per pass\n",
+                   versions[k], write_time * 1000.0 / CLOCKS_PER_SEC / passes,
+                   read_time * 1000.0 / CLOCKS_PER_SEC / passes,
+                   zip_time * 1000.0 / CLOCKS_PER_SEC / passes);
+        if (mismatch)
+            gi.cprintf(NULL, PRINT_HIGH, "version %d: level changed after reload\n", versions[k]);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (ents[i]->inuse)
+            G_FreeEdict(ents[i]);
+    }
+    gi.TagFree(ents);
+
+    level = saved;
+}
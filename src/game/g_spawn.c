@@ -506,6 +506,8 @@ void ED_ParseEdict(const char **data, edict_t *ent)
 
     if (!init)
         memset(ent, 0, sizeof(*ent));
+
+    G_IndexEdict(ent);
 }
 
 /*
@@ -583,6 +585,7 @@ void SpawnEntities(const char *mapname, const char *entities, const char *spawnp
 
     memset(&level, 0, sizeof(level));
     memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
+    G_ClearEdictIndex();
 
     Q_strlcpy(level.mapname, mapname, sizeof(level.mapname));
     Q_strlcpy(game.spawnpoint, spawnpoint, sizeof(game.spawnpoint));
@@ -23,6 +23,138 @@ void    Svcmd_Test_f(void)
     gi.cprintf(NULL, PRINT_HIGH, "Svcmd_Test_f()\n");
 }
 
+/*
+=================
+Svcmd_BenchAllowed
+
+Benchmarks spawn entities into the live level, so they are cheats
+=================
+*/
+bool Svcmd_BenchAllowed(void)
+{
+    if ((deathmatch->value || coop->value) && !sv_cheats->value) {
+        gi.cprintf(NULL, PRINT_HIGH, "You must run the server with '+set cheats 1' to enable this command.\n");
+        return false;
+    }
+    return true;
+}
+
+// returns number of edicts G_Spawn can return without error
+static int RadiusBench_FreeEdicts(void)
+{
+    edict_t *e;
+    int i, count = game.maxentities - globals.num_edicts;
+
+    for (i = game.maxclients + 1, e = &g_edicts[i]; i < globals.num_edicts; i++, e++)
+        if (!e->inuse && (e->freetime < 2 || level.time - e->freetime > 0.5f))
+            count++;
+
+    return count;
+}
+
+// returns hash of entity numbers found, in order
+static unsigned RadiusBench_Sum(const vec3_t *orgs, const float *rads, int queries, int *hits)
+{
+    edict_t *ent;
+    unsigned sum = 0;
+    int i;
+
+    *hits = 0;
+    for (i = 0; i < queries; i++) {
+        ent = NULL;
+        while ((ent = findradius(ent, (float *)orgs[i], rads[i])) != NULL) {
+            sum = sum * 31 + (ent - g_edicts);
+            (*hits)++;
+        }
+    }
+
+    return sum;
+}
+
+/*
+=================
+Svcmd_RadiusBench_f
+
+sv radiusbench [count] [queries]
+
+Fills the level with growing number of small boxes and times findradius
+queries of splash damage sized radii with and without area index. Entities
+must be returned in the same order in both cases.
+=================
+*/
+void    Svcmd_RadiusBench_f(void)
+{
+    edict_t     **ents;
+    vec3_t      *orgs;
+    float       *rads, saved;
+    int         i, j, k, n, count, queries, spawned, hits[2];
+    unsigned    sums[2];
+    clock_t     start, msec[2];
+
+    if (!Svcmd_BenchAllowed())
+        return;
+
+    n = RadiusBench_FreeEdicts();
+    if (!n) {
+        gi.cprintf(NULL, PRINT_HIGH, "No free edicts\n");
+        return;
+    }
+
+    count = gi.argc() > 2 ? atoi(gi.argv(2)) : 1024;
+    queries = gi.argc() > 3 ? atoi(gi.argv(3)) : 1000;
+    count = Q_clip(count, 1, n);
+    queries = Q_clip(queries, 1, 100000);
+
+    ents = gi.TagMalloc(count * sizeof(ents[0]), TAG_GAME);
+    orgs = gi.TagMalloc(queries * sizeof(orgs[0]), TAG_GAME);
+    rads = gi.TagMalloc(queries * sizeof(rads[0]), TAG_GAME);
+    saved = g_radius_index->value;
+
+    for (i = 0; i < queries; i++) {
+        for (j = 0; j < 3; j++)
+            orgs[i][j] = crandom() * 2048;
+        rads[i] = 64 + random() * 448;
+    }
+
+    spawned = 0;
+    for (n = min(64, count); ; n = min(n * 2, count)) {
+        for (; spawned < n; spawned++) {
+            ents[spawned] = G_Spawn();
+            ents[spawned]->classname = "radiusbench";
+            ents[spawned]->solid = SOLID_BBOX;
+            VectorSet(ents[spawned]->mins, -16, -16, -16);
+            VectorSet(ents[spawned]->maxs, 16, 16, 16);
+            for (j = 0; j < 3; j++)
+                ents[spawned]->s.origin[j] = crandom() * 2048;
+            gi.linkentity(ents[spawned]);
+        }
+
+        for (k = 0; k < 2; k++) {
+            gi.cvar_set("g_radius_index", k ? "1" : "0");
+            start = clock();
+            sums[k] = RadiusBench_Sum(orgs, rads, queries, &hits[k]);
+            msec[k] = (clock() - start) * 1000 / CLOCKS_PER_SEC;
+        }
+
+        gi.cprintf(NULL, PRINT_HIGH, "%4d edicts: scan %d msec, area %d msec, %d hits\n",
+                   globals.num_edicts, (int)msec[0], (int)msec[1], hits[1]);
+        if (sums[0] != sums[1] || hits[0] != hits[1])
+            gi.cprintf(NULL, PRINT_HIGH, "findradius results differ\n");
+
+        if (n == count)
+            break;
+    }
+
+    for (i = 0; i < spawned; i++)
+        G_FreeEdict(ents[i]);
+
+    gi.cvar_set("g_radius_index", va("%g", saved));
+
+    gi.TagFree(rads);
+    gi.TagFree(orgs);
+    gi.TagFree(ents);
+}
+
 /*
 ==============================================================================
 
@@ -285,6 +417,10 @@ void    ServerCommand(void)
     cmd = gi.argv(1);
     if (Q_stricmp(cmd, "test") == 0)
         Svcmd_Test_f();
+    else if (Q_stricmp(cmd, "radiusbench") == 0)
+        Svcmd_RadiusBench_f();
+    else if (Q_stricmp(cmd, "savebench") == 0)
+        Svcmd_SaveBench_f();
     else if (Q_stricmp(cmd, "addip") == 0)
         SVCmd_AddIP_f();
     else if (Q_stricmp(cmd, "removeip") == 0)
@@ -26,6 +26,165 @@ void G_ProjectSource(const vec3_t point, const vec3_t distance, const vec3_t for
     result[2] = point[2] + forward[2] * distance[0] + right[2] * distance[1] + distance[2];
 }
 
+/*
+=============
+Targetname index
+
+Entities are hashed by targetname, so that finding targets doesn't need to
+scan every edict. Hash chains are kept sorted by entity number to preserve
+the order of linear search. G_IndexEdict must be called after changing
+targetname of an entity.
+=============
+*/
+
+#define TARGET_HASH_SIZE    1024
+
+typedef struct {
+    const char  *key;       // indexed targetname, NULL if not in index
+    unsigned    hash;
+    int         prev, next; // entity numbers, -1 terminates chain
+} targetindex_t;
+
+static targetindex_t    *target_index;
+static int              target_hash[TARGET_HASH_SIZE];
+
+static unsigned G_HashTargetname(const char *s)
+{
+    unsigned hash = 0;
+
+    while (*s)
+        hash = hash * 31 + Q_tolower(*s++);
+
+    return hash;
+}
+
+static void G_UnindexEdict(int num)
+{
+    targetindex_t *t = &target_index[num];
+
+    if (!t->key)
+        return;
+
+    if (t->prev != -1)
+        target_index[t->prev].next = t->next;
+    else
+        target_hash[t->hash & (TARGET_HASH_SIZE - 1)] = t->next;
+    if (t->next != -1)
+        target_index[t->next].prev = t->prev;
+
+    t->key = NULL;
+}
+
+/*
+=============
+G_IndexEdict
+
+Updates targetname index for the given entity.
+=============
+*/
+void G_IndexEdict(edict_t *ent)
+{
+    int num = ent - g_edicts;
+    targetindex_t *t = &target_index[num];
+    int *head, prev, next;
+
+    if (t->key == ent->targetname)
+        return;
+
+    G_UnindexEdict(num);
+
+    if (!ent->targetname)
+        return;
+
+    t->key = ent->targetname;
+    t->hash = G_HashTargetname(ent->targetname);
+
+    head = &target_hash[t->hash & (TARGET_HASH_SIZE - 1)];
+    prev = -1;
+    next = *head;
+    while (next != -1 && next < num) {
+        prev = next;
+        next = target_index[next].next;
+    }
+
+    t->prev = prev;
+    t->next = next;
+    if (prev != -1)
+        target_index[prev].next = num;
+    else
+        *head = num;
+    if (next != -1)
+        target_index[next].prev = num;
+}
+
+/*
+=============
+G_ClearEdictIndex
+
+Should be called after all edicts are wiped.
+=============
+*/
+void G_ClearEdictIndex(void)
+{
+    int i;
+
+    for (i = 0; i < game.maxentities; i++)
+        target_index[i].key = NULL;
+    for (i = 0; i < TARGET_HASH_SIZE; i++)
+        target_hash[i] = -1;
+}
+
+/*
+=============
+G_InitEdictIndex
+
+Allocates index after g_edicts array has been (re)allocated.
+=============
+*/
+void G_InitEdictIndex(void)
+{
+    target_index = gi.TagMalloc(game.maxentities * sizeof(target_index[0]), TAG_GAME);
+    G_ClearEdictIndex();
+}
+
+static edict_t *G_FindTargetname(edict_t *from, const char *match)
+{
+    unsigned hash;
+    targetindex_t *t;
+    edict_t *ent;
+    int num;
+
+    if (!match)
+        return NULL;
+
+    hash = G_HashTargetname(match);
+
+    // continue from the previous match if it is in the same chain
+    if (from && target_index[from - g_edicts].key && target_index[from - g_edicts].hash == hash) {
+        num = target_index[from - g_edicts].next;
+    } else {
+        num = target_hash[hash & (TARGET_HASH_SIZE - 1)];
+        if (from)
+            while (num != -1 && num <= from - g_edicts)
+                num = target_index[num].next;
+    }
+
+    for (; num != -1 && num < globals.num_edicts; num = t->next) {
+        t = &target_index[num];
+        if (t->hash != hash)
+            continue;
+        ent = &g_edicts[num];
+        if (!ent->inuse)
+            continue;
+        if (!ent->targetname)
+            continue;
+        if (!Q_stricmp(ent->targetname, match))
+            return ent;
+    }
+
+    return NULL;
+}
+
 /*
 =============
 G_Find
@@ -42,6 +201,9 @@ edict_t *G_Find(edict_t *from, int fieldofs, char *match)
 {
     char    *s;
 
+    if (fieldofs == FOFS(targetname) && g_target_index->value)
+        return G_FindTargetname(from, match);
+
     if (!from)
         from = g_edicts;
     else
@@ -60,6 +222,94 @@ edict_t *G_Find(edict_t *from, int fieldofs, char *match)
     return NULL;
 }
 
+static bool G_InRadius(const edict_t *ent, const vec3_t org, float rad)
+{
+    vec3_t  eorg;
+    int     j;
+
+    if (!ent->inuse)
+        return false;
+    if (ent->solid == SOLID_NOT)
+        return false;
+    for (j = 0; j < 3; j++)
+        eorg[j] = org[j] - (ent->s.origin[j] + (ent->mins[j] + ent->maxs[j]) * 0.5f);
+    return DotProduct(eorg, eorg) <= rad * rad;
+}
+
+static edict_t *G_FindRadiusScan(edict_t *from, const vec3_t org, float rad)
+{
+    if (!from)
+        from = g_edicts;
+    else
+        from++;
+    for (; from < &g_edicts[globals.num_edicts]; from++)
+        if (G_InRadius(from, org, rad))
+            return from;
+
+    return NULL;
+}
+
+// candidates of the last area query, sorted by entity number. kept while
+// caller iterates over results, unless new entities are spawned.
+static struct {
+    vec3_t      org;
+    float       rad;
+    unsigned    spawncount;
+    edict_t     *last;
+    int         count, next;
+    edict_t     *list[MAX_EDICTS];
+} radius_cache;
+
+static unsigned spawn_count;
+
+static int radiuscmp(const void *p1, const void *p2)
+{
+    const edict_t *a = *(const edict_t **)p1;
+    const edict_t *b = *(const edict_t **)p2;
+
+    return (a > b) - (a < b);
+}
+
+static edict_t *G_FindRadiusArea(edict_t *from, const vec3_t org, float rad)
+{
+    edict_t *ent;
+    vec3_t  mins, maxs;
+    int     i, num;
+
+    if (!from || from != radius_cache.last || radius_cache.rad != rad ||
+        !VectorCompare(radius_cache.org, org) || radius_cache.spawncount != spawn_count) {
+        for (i = 0; i < 3; i++) {
+            mins[i] = org[i] - rad;
+            maxs[i] = org[i] + rad;
+        }
+
+        // world is never linked
+        num = 0;
+        if (!from)
+            radius_cache.list[num++] = world;
+
+        // solid and trigger lists don't intersect, so this never overflows
+        num += gi.BoxEdicts(mins, maxs, radius_cache.list + num, MAX_EDICTS - num, AREA_SOLID);
+        num += gi.BoxEdicts(mins, maxs, radius_cache.list + num, MAX_EDICTS - num, AREA_TRIGGERS);
+
+        qsort(radius_cache.list, num, sizeof(radius_cache.list[0]), radiuscmp);
+
+        VectorCopy(org, radius_cache.org);
+        radius_cache.rad = rad;
+        radius_cache.spawncount = spawn_count;
+        radius_cache.count = num;
+        radius_cache.next = 0;
+    }
+
+    while (radius_cache.next < radius_cache.count) {
+        ent = radius_cache.list[radius_cache.next++];
+        if (ent > from && G_InRadius(ent, org, rad))
+            return radius_cache.last = ent;
+    }
+
+    return radius_cache.last = NULL;
+}
+
 /*
 =================
 findradius
@@ -67,30 +317,21 @@ findradius
 Returns entities that have origins within a spherical area
 
 findradius (origin, radius)
+
+Entities are returned in number order. If g_radius_index is enabled, only
+entities linked into the world are considered, and entities that move into
+the sphere while caller iterates over results are not guaranteed to be found.
 =================
 */
 edict_t *findradius(edict_t *from, vec3_t org, float rad)
 {
-    vec3_t  eorg;
-    int     j;
+    if (rad < 0)
+        return NULL;
 
-    if (!from)
-        from = g_edicts;
-    else
-        from++;
-    for (; from < &g_edicts[globals.num_edicts]; from++) {
-        if (!from->inuse)
-            continue;
-        if (from->solid == SOLID_NOT)
-            continue;
-        for (j = 0; j < 3; j++)
-            eorg[j] = org[j] - (from->s.origin[j] + (from->mins[j] + from->maxs[j]) * 0.5f);
-        if (VectorLength(eorg) > rad)
-            continue;
-        return from;
-    }
+    if (g_radius_index->value)
+        return G_FindRadiusArea(from, org, rad);
 
-    return NULL;
+    return G_FindRadiusScan(from, org, rad);
 }
 
 /*
@@ -331,6 +572,8 @@ edict_t *G_Spawn(void)
     int         i;
     edict_t     *e;
 
+    spawn_count++;
+
     e = &g_edicts[game.maxclients + 1];
     for (i = game.maxclients + 1; i < globals.num_edicts; i++, e++) {
         // the first couple seconds of server time can involve a lot of
@@ -365,6 +608,8 @@ void G_FreeEdict(edict_t *ed)
         return;
     }
 
+    G_UnindexEdict(ed - g_edicts);
+
     memset(ed, 0, sizeof(*ed));
     ed->classname = "freed";
     ed->freetime = level.time;
@@ -538,6 +538,7 @@ void SP_monster_flyer(edict_t *self)
     if (!Q_stricmp(level.mapname, "jail5") && (self->s.origin[2] == -104)) {
         self->targetname = self->target;
         self->target = NULL;
+        G_IndexEdict(self);
     }
 
     sound_sight = gi.soundindex("flyer/flysght1.wav");
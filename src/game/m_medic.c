@@ -578,6 +578,7 @@ void medic_cable_attack(edict_t *self)
         self->enemy->monsterinfo.aiflags = 0;
         self->enemy->target = NULL;
         self->enemy->targetname = NULL;
+        G_IndexEdict(self->enemy);
         self->enemy->combattarget = NULL;
         self->enemy->deathtarget = NULL;
         self->enemy->owner = self;
@@ -53,6 +53,7 @@ void SP_FixCoopSpots(edict_t *self)
             if ((!self->targetname) || Q_stricmp(self->targetname, spot->targetname) != 0) {
 //              gi.dprintf("FixCoopSpots changed %s at %s targetname from %s to %s\n", self->classname, vtos(self->s.origin), self->targetname, spot->targetname);
                 self->targetname = spot->targetname;
+                G_IndexEdict(self);
             }
             return;
         }
@@ -74,6 +75,7 @@ void SP_CreateCoopSpots(edict_t *self)
         spot->s.origin[1] = -164;
         spot->s.origin[2] = 80;
         spot->targetname = "jail3";
+        G_IndexEdict(spot);
         spot->s.angles[1] = 90;
 
         spot = G_Spawn();
@@ -82,6 +84,7 @@ void SP_CreateCoopSpots(edict_t *self)
         spot->s.origin[1] = -164;
         spot->s.origin[2] = 80;
         spot->targetname = "jail3";
+        G_IndexEdict(spot);
         spot->s.angles[1] = 90;
 
         spot = G_Spawn();
@@ -90,6 +93,7 @@ void SP_CreateCoopSpots(edict_t *self)
         spot->s.origin[1] = -164;
         spot->s.origin[2] = 80;
         spot->targetname = "jail3";
+        G_IndexEdict(spot);
         spot->s.angles[1] = 90;
 
         return;
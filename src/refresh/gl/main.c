@@ -1054,6 +1054,7 @@ R_EndRegistration
 */
 void R_EndRegistration_GL(void)
 {
+    IMG_EndPrefetch();
     IMG_FreeUnused();
     MOD_FreeUnused();
     Scrap_Upload();
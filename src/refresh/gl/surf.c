@@ -944,6 +944,14 @@ void GL_LoadWorld(const char *name)
     // calculate world size for far clip plane and sky box
     set_world_size();
 
+    // decode all texinfo on worker threads first
+    for (i = 0, info = bsp->texinfo; i < bsp->numtexinfo; i++, info++) {
+        imageflags_t flags = (info->c.flags & SURF_WARP) ? IF_TURBULENT : IF_NONE;
+        Q_concat(buffer, sizeof(buffer), "textures/", info->name, ".wal");
+        FS_NormalizePath(buffer);
+        IMG_Prefetch(buffer, IT_WALL, flags);
+    }
+
     // register all texinfo
     for (i = 0, info = bsp->texinfo; i < bsp->numtexinfo; i++, info++) {
         imageflags_t flags = (info->c.flags & SURF_WARP) ? IF_TURBULENT : IF_NONE;
@@ -36,6 +36,7 @@ static cvar_t *gl_noscrap;
 static cvar_t *gl_round_down;
 static cvar_t *gl_picmip;
 static cvar_t *gl_downsample_skins;
+static cvar_t *gl_srgb_mipmaps;
 static cvar_t *gl_gamma_scale_pics;
 static cvar_t *gl_bilerp_chars;
 static cvar_t *gl_bilerp_pics;
@@ -437,14 +438,14 @@ static void GL_Upload32(byte *data, int width, int height, int baselevel, imaget
         // optimized case, use faster mipmap operation
         scaled = data;
         while (width > scaled_width || height > scaled_height) {
-            IMG_MipMap(scaled, scaled, width, height);
+            IMG_MipMap(scaled, scaled, width, height, gl_srgb_mipmaps->integer);
             width >>= 1;
             height >>= 1;
         }
     } else {
         scaled = FS_AllocTempMem(scaled_width * scaled_height * 4);
         IMG_ResampleTexture(data, width, height, scaled,
-                            scaled_width, scaled_height);
+                            scaled_width, scaled_height, gl_srgb_mipmaps->integer);
     }
 
     if (flags & IF_TRANSPARENT) {
@@ -472,7 +473,7 @@ static void GL_Upload32(byte *data, int width, int height, int baselevel, imaget
             int miplevel = 0;
 
             while (scaled_width > 1 || scaled_height > 1) {
-                IMG_MipMap(scaled, scaled, scaled_width, scaled_height);
+                IMG_MipMap(scaled, scaled, scaled_width, scaled_height, gl_srgb_mipmaps->integer);
                 scaled_width >>= 1;
                 scaled_height >>= 1;
                 if (scaled_width < 1)
@@ -988,6 +989,7 @@ void GL_InitImages(void)
     gl_round_down = Cvar_Get("gl_round_down", "0", CVAR_FILES);
     gl_picmip = Cvar_Get("gl_picmip", "0", CVAR_FILES);
     gl_downsample_skins = Cvar_Get("gl_downsample_skins", "1", CVAR_FILES);
+    gl_srgb_mipmaps = Cvar_Get("gl_srgb_mipmaps", "0", CVAR_FILES);
     gl_gamma_scale_pics = Cvar_Get("gl_gamma_scale_pics", "0", CVAR_FILES);
     gl_upscale_pcx = Cvar_Get("gl_upscale_pcx", "0", CVAR_FILES);
     gl_saturation = Cvar_Get("gl_saturation", "1", CVAR_FILES);
@@ -353,7 +353,8 @@ static bool supports_extended_pixel_format(void)
 	return cls.ref_type == REF_TYPE_VKPT;
 }
 
-IMG_LOAD(STB)
+// doesn't modify any globals, so can be called from worker threads
+static int decode_stb(const byte *rawdata, size_t rawlen, image_t *image, byte **pic)
 {
 	int w, h, channels;
 	byte* data = NULL;
@@ -378,10 +379,7 @@ IMG_LOAD(STB)
 	}
 
 	if (!data)
-	{
-		Com_SetLastError(stbi_failure_reason());
 		return Q_ERR_LIBRARY_ERROR;
-	}
 
 	*pic = data;
 
@@ -394,6 +392,16 @@ IMG_LOAD(STB)
     return Q_ERR_SUCCESS;
 }
 
+IMG_LOAD(STB)
+{
+    int ret = decode_stb(rawdata, rawlen, image, pic);
+
+    if (ret < 0)
+        Com_SetLastError(stbi_failure_reason());
+
+    return ret;
+}
+
 
 /*
 =================================================================
@@ -792,18 +800,270 @@ static void IMG_ScreenShotHDR_f(void)
 
 IMAGE PROCESSING
 
+Both kernels average 2x2 samples per output pixel. By default this is done
+on raw 8-bit values with the result truncated, and SIMD versions reproduce
+the original scalar code bit for bit. With `linear' set, color channels are
+treated as sRGB and averaged in linear space instead, which keeps bright
+details from darkening in smaller mips. Output rows of large images are
+split into bands that are processed on the async work pool.
+
 =========================================================
 */
 
-void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
-                         byte *out, int outwidth, int outheight)
+#if (defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define USE_SIMD_IMAGE  1   // SSE2
+#elif defined __ARM_NEON && defined __aarch64__
+#include <arm_neon.h>
+#define USE_SIMD_IMAGE  2   // NEON
+#else
+#define USE_SIMD_IMAGE  0
+#endif
+
+#define IMG_BAND_PIXELS     (128 * 128)     // minimum output pixels per band
+#define IMG_MAX_BANDS       8
+
+static cvar_t   *r_image_threads;
+
+// 12 bits of linear precision keep all 256 sRGB values distinct
+static uint16_t img_srgb_to_linear[256];
+static byte     img_linear_to_srgb[4096];
+
+typedef struct {
+    const byte      *in;
+    byte            *out;
+    int             inwidth;        // in pixels
+    int             outwidth;
+    const unsigned  *p1, *p2;       // resample: byte offsets of input columns
+    float           heightScale;    // resample: input rows per output row
+    bool            linear;
+} imgscale_t;
+
+typedef void (*imgrows_t)(const imgscale_t *s, int start, int end);
+
+typedef struct {
+    const imgscale_t    *s;
+    imgrows_t           rows;
+    int                 start, end;
+} imgband_t;
+
+static void init_srgb_tables(void)
+{
+    int i;
+    float f;
+
+    for (i = 0; i < 256; i++) {
+        f = i / 255.0f;
+        f = f <= 0.04045f ? f / 12.92f : powf((f + 0.055f) / 1.055f, 2.4f);
+        img_srgb_to_linear[i] = Q_rint(f * 4095);
+    }
+
+    for (i = 0; i < 4096; i++) {
+        f = i / 4095.0f;
+        f = f <= 0.0031308f ? f * 12.92f : 1.055f * powf(f, 1 / 2.4f) - 0.055f;
+        img_linear_to_srgb[i] = Q_rint(f * 255);
+    }
+}
+
+static inline void average_pixel(byte *out, const byte *p1, const byte *p2,
+                                 const byte *p3, const byte *p4, bool linear)
+{
+    const uint16_t *lin = img_srgb_to_linear;
+
+    if (linear) {
+        out[0] = img_linear_to_srgb[(lin[p1[0]] + lin[p2[0]] + lin[p3[0]] + lin[p4[0]] + 2) >> 2];
+        out[1] = img_linear_to_srgb[(lin[p1[1]] + lin[p2[1]] + lin[p3[1]] + lin[p4[1]] + 2) >> 2];
+        out[2] = img_linear_to_srgb[(lin[p1[2]] + lin[p2[2]] + lin[p3[2]] + lin[p4[2]] + 2) >> 2];
+    } else {
+        out[0] = (p1[0] + p2[0] + p3[0] + p4[0]) >> 2;
+        out[1] = (p1[1] + p2[1] + p3[1] + p4[1]) >> 2;
+        out[2] = (p1[2] + p2[2] + p3[2] + p4[2]) >> 2;
+    }
+    out[3] = (p1[3] + p2[3] + p3[3] + p4[3]) >> 2;
+}
+
+#if USE_SIMD_IMAGE == 1
+
+// averages 4 pixels from each argument, per channel, truncating
+static inline __m128i average_4x4(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+    __m128i z = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, z), _mm_unpacklo_epi8(b, z)),
+                               _mm_add_epi16(_mm_unpacklo_epi8(c, z), _mm_unpacklo_epi8(d, z)));
+    __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, z), _mm_unpackhi_epi8(b, z)),
+                               _mm_add_epi16(_mm_unpackhi_epi8(c, z), _mm_unpackhi_epi8(d, z)));
+    return _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2));
+}
+
+static inline __m128i gather_4x4(const byte *row, const unsigned *ofs)
+{
+    uint32_t p[4];
+
+    memcpy(&p[0], row + ofs[0], 4);
+    memcpy(&p[1], row + ofs[1], 4);
+    memcpy(&p[2], row + ofs[2], 4);
+    memcpy(&p[3], row + ofs[3], 4);
+    return _mm_setr_epi32(p[0], p[1], p[2], p[3]);
+}
+
+// splits 8 pixels into even and odd ones
+static inline void deinterleave_4x4(const byte *in, __m128i *even, __m128i *odd)
+{
+    __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)in));
+    __m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(in + 16)));
+
+    *even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    *odd  = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+#elif USE_SIMD_IMAGE == 2
+
+static inline uint8x16_t average_4x4(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d)
+{
+    uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a), vget_low_u8(b)),
+                              vaddl_u8(vget_low_u8(c), vget_low_u8(d)));
+    uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a), vget_high_u8(b)),
+                              vaddl_u8(vget_high_u8(c), vget_high_u8(d)));
+    return vcombine_u8(vshrn_n_u16(lo, 2), vshrn_n_u16(hi, 2));
+}
+
+static inline uint8x16_t gather_4x4(const byte *row, const unsigned *ofs)
+{
+    uint32_t p[4];
+
+    memcpy(&p[0], row + ofs[0], 4);
+    memcpy(&p[1], row + ofs[1], 4);
+    memcpy(&p[2], row + ofs[2], 4);
+    memcpy(&p[3], row + ofs[3], 4);
+    return vreinterpretq_u8_u32(vld1q_u32(p));
+}
+
+#endif
+
+static void resample_rows(const imgscale_t *s, int start, int end)
 {
+    const byte *inrow1, *inrow2;
+    byte *out;
     int i, j;
-    const byte  *inrow1, *inrow2;
+
+    for (i = start; i < end; i++) {
+        inrow1 = s->in + s->inwidth * 4 * (int)((i + 0.25f) * s->heightScale);
+        inrow2 = s->in + s->inwidth * 4 * (int)((i + 0.75f) * s->heightScale);
+        out = s->out + s->outwidth * 4 * i;
+        j = 0;
+
+#if USE_SIMD_IMAGE == 1
+        if (!s->linear) {
+            for (; j + 4 <= s->outwidth; j += 4, out += 16) {
+                __m128i v = average_4x4(gather_4x4(inrow1, s->p1 + j), gather_4x4(inrow1, s->p2 + j),
+                                        gather_4x4(inrow2, s->p1 + j), gather_4x4(inrow2, s->p2 + j));
+                _mm_storeu_si128((__m128i *)out, v);
+            }
+        }
+#elif USE_SIMD_IMAGE == 2
+        if (!s->linear) {
+            for (; j + 4 <= s->outwidth; j += 4, out += 16) {
+                uint8x16_t v = average_4x4(gather_4x4(inrow1, s->p1 + j), gather_4x4(inrow1, s->p2 + j),
+                                           gather_4x4(inrow2, s->p1 + j), gather_4x4(inrow2, s->p2 + j));
+                vst1q_u8(out, v);
+            }
+        }
+#endif
+
+        for (; j < s->outwidth; j++, out += 4)
+            average_pixel(out, inrow1 + s->p1[j], inrow1 + s->p2[j],
+                          inrow2 + s->p1[j], inrow2 + s->p2[j], s->linear);
+    }
+}
+
+// works in place: output row never overlaps input rows not yet consumed
+static void mipmap_rows(const imgscale_t *s, int start, int end)
+{
+    const byte *in;
+    byte *out;
+    int i, j, stride = s->inwidth * 4;
+
+    for (i = start; i < end; i++) {
+        in = s->in + stride * 2 * i;
+        out = s->out + s->outwidth * 4 * i;
+        j = 0;
+
+#if USE_SIMD_IMAGE == 1
+        if (!s->linear) {
+            for (; j + 4 <= s->outwidth; j += 4, in += 32, out += 16) {
+                __m128i e1, o1, e2, o2;
+                deinterleave_4x4(in, &e1, &o1);
+                deinterleave_4x4(in + stride, &e2, &o2);
+                _mm_storeu_si128((__m128i *)out, average_4x4(e1, o1, e2, o2));
+            }
+        }
+#elif USE_SIMD_IMAGE == 2
+        if (!s->linear) {
+            for (; j + 4 <= s->outwidth; j += 4, in += 32, out += 16) {
+                uint32x4x2_t r1 = vld2q_u32((const uint32_t *)in);
+                uint32x4x2_t r2 = vld2q_u32((const uint32_t *)(in + stride));
+                vst1q_u8(out, average_4x4(vreinterpretq_u8_u32(r1.val[0]), vreinterpretq_u8_u32(r1.val[1]),
+                                          vreinterpretq_u8_u32(r2.val[0]), vreinterpretq_u8_u32(r2.val[1])));
+            }
+        }
+#endif
+
+        for (; j < s->outwidth; j++, in += 8, out += 4)
+            average_pixel(out, in, in + 4, in + stride, in + stride + 4, s->linear);
+    }
+}
+
+static void band_work_cb(void *arg)
+{
+    imgband_t *band = arg;
+
+    band->rows(band->s, band->start, band->end);
+}
+
+static int num_bands(int width, int height)
+{
+    if (!r_image_threads || !r_image_threads->integer)
+        return 1;
+
+    return Q_clip(width * height / IMG_BAND_PIXELS, 1, min(height, IMG_MAX_BANDS));
+}
+
+// runs first band on calling thread, the rest on async work pool
+static void run_bands(const imgscale_t *s, imgrows_t rows, int height, int count)
+{
+    imgband_t bands[IMG_MAX_BANDS];
+    asynchandle_t handles[IMG_MAX_BANDS];
+    int i;
+
+    for (i = 0; i < count; i++) {
+        bands[i].s = s;
+        bands[i].rows = rows;
+        bands[i].start = height * i / count;
+        bands[i].end = height * (i + 1) / count;
+    }
+
+    for (i = 1; i < count; i++) {
+        asyncwork_t work = {
+            .work_cb = band_work_cb,
+            .cb_arg = &bands[i],
+            .priority = ASYNC_PRIO_HIGH,
+        };
+        handles[i] = Com_QueueAsyncWork(&work);
+    }
+
+    band_work_cb(&bands[0]);
+
+    // bands not yet picked up by the pool are run here
+    for (i = 1; i < count; i++)
+        Com_WaitAsyncWork(handles[i]);
+}
+
+void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
+                         byte *out, int outwidth, int outheight, bool linear)
+{
+    int i;
     unsigned    frac, fracstep;
     unsigned    p1[MAX_TEXTURE_SIZE], p2[MAX_TEXTURE_SIZE];
-    const byte  *pix1, *pix2, *pix3, *pix4;
-    float       heightScale;
 
     if (outwidth > MAX_TEXTURE_SIZE) {
         Com_Error(ERR_FATAL, "%s: outwidth > %d", __func__, MAX_TEXTURE_SIZE);
@@ -822,26 +1082,22 @@ void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
         frac += fracstep;
     }
 
-    heightScale = (float)inheight / outheight;
-    inwidth <<= 2;
-    for (i = 0; i < outheight; i++) {
-        inrow1 = in + inwidth * (int)((i + 0.25f) * heightScale);
-        inrow2 = in + inwidth * (int)((i + 0.75f) * heightScale);
-        for (j = 0; j < outwidth; j++) {
-            pix1 = inrow1 + p1[j];
-            pix2 = inrow1 + p2[j];
-            pix3 = inrow2 + p1[j];
-            pix4 = inrow2 + p2[j];
-            out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
-            out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
-            out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
-            out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
-            out += 4;
-        }
-    }
+    imgscale_t s = {
+        .in = in,
+        .out = out,
+        .inwidth = inwidth,
+        .outwidth = outwidth,
+        .p1 = p1,
+        .p2 = p2,
+        .heightScale = (float)inheight / outheight,
+        .linear = linear,
+    };
+
+    run_bands(&s, resample_rows, outheight, num_bands(outwidth, outheight));
 }
 
-void IMG_MipMap(byte *out, byte *in, int width, int height)
+// without linear, gives the same bytes as the original loop did
+static void mipmap_legacy(byte *out, byte *in, int width, int height, bool linear)
 {
     int     i, j;
 
@@ -849,14 +1105,44 @@ void IMG_MipMap(byte *out, byte *in, int width, int height)
     height >>= 1;
     for (i = 0; i < height; i++, in += width) {
         for (j = 0; j < width; j += 8, out += 4, in += 8) {
-            out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
-            out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
-            out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
-            out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
+            average_pixel(out, in, in + 4, in + width, in + width + 4, linear);
         }
     }
 }
 
+void IMG_MipMap(byte *out, byte *in, int width, int height, bool linear)
+{
+    int count;
+
+    // odd sizes read past the row, keep doing that the way it always was
+    if ((width | height) & 1) {
+        mipmap_legacy(out, in, width, height, linear);
+        return;
+    }
+
+    imgscale_t s = {
+        .in = in,
+        .out = out,
+        .inwidth = width,
+        .outwidth = width >> 1,
+        .linear = linear,
+    };
+
+    width >>= 1;
+    height >>= 1;
+
+    // bands can't work in place, later ones would overwrite input of earlier
+    count = num_bands(width, height);
+    if (count > 1 && out == in) {
+        s.out = FS_AllocTempMem(width * height * 4);
+        run_bands(&s, mipmap_rows, height, count);
+        memcpy(out, s.out, width * height * 4);
+        FS_FreeTempMem(s.out);
+    } else {
+        run_bands(&s, mipmap_rows, height, count);
+    }
+}
+
 /*
 =========================================================
 
@@ -891,6 +1177,9 @@ static int              img_total;
 static cvar_t   *r_override_textures;
 static cvar_t   *r_texture_formats;
 static cvar_t   *r_texture_overrides;
+static cvar_t   *r_image_prefetch;
+static cvar_t   *r_image_prefetch_size;
+static cvar_t   *r_image_report;
 
 static const cmd_option_t o_imagelist[] = {
     { "f", "fonts", "list fonts" },
@@ -1071,28 +1360,280 @@ static image_t *lookup_image(const char *name,
     return NULL;
 }
 
+/*
+=================================================================
+
+DECODE AHEAD
+
+Images known to be needed soon are probed using the same rules as
+find_or_load_image(), and those in STB formats are decoded on async worker
+threads. Lookup that follows picks up decoded pixels, so image slots are still
+assigned in registration order. Files are loaded and output buffers are
+allocated on the main thread when work is queued, and stb decodes straight
+into the output buffer, using system malloc for anything else on worker
+threads. Total size of files and buffers in flight is bounded by
+r_image_prefetch_size, items that don't fit wait in request order and are
+queued as results are taken.
+
+=================================================================
+*/
+
+#define DECODE_HASH         256
+#define MAX_DECODE_SIZE     8192
+
+typedef struct decode_s {
+    list_t          entry;      // in img_decode_wait or img_decode_busy
+    struct decode_s *hash_next;
+    char            name[MAX_QPATH];
+    int             fs_flags;
+    imageformat_t   fmt;
+    int             len;        // file length
+    byte            *data;      // file contents, loaded when queued
+    byte            *pic;       // allocated when queued
+    size_t          size;
+    asynchandle_t   handle;
+    image_t         image;      // set by worker
+    int             error;      // set by worker
+    unsigned        usec;       // set by worker
+} decode_t;
+
+extern q_thread_local bool stbi_system_malloc;
+void stbi_set_output(void *buffer, size_t size);
+
+static LIST_DECL(img_decode_wait);      // not yet queued, in request order
+static LIST_DECL(img_decode_busy);      // queued or finished, not taken
+static decode_t     *img_decode_hash[DECODE_HASH];
+static int          img_decode_count;
+static size_t       img_decode_bytes;   // size of files and buffers in flight
+static bool         img_prefetching;
+
+static struct {
+    struct {
+        int         count;
+        int         async;
+        uint64_t    usec;
+    } formats[IM_MAX];
+    int             wasted;
+    uint64_t        wait_usec;
+} img_decode_stats;
+
+// runs on worker thread, must not touch anything but the item itself
+static void decode_work(void *arg)
+{
+    decode_t *d = arg;
+    uint64_t start = Sys_Microseconds();
+    byte *pic;
+    size_t size;
+
+    stbi_system_malloc = true;
+    stbi_set_output(d->pic, d->size);
+    d->error = decode_stb(d->data, d->len, &d->image, &pic);
+    stbi_set_output(NULL, 0);
+    stbi_system_malloc = false;
+
+    // 16-bit images and some odd layouts end up in a separate buffer
+    if (d->error >= 0 && pic != d->pic) {
+        size = d->image.upload_width * d->image.upload_height;
+        size *= d->image.pixel_format == PF_R16_UNORM ? 2 : 4;
+        if (size > d->size)
+            d->error = Q_ERR_INVALID_FORMAT;
+        else
+            memcpy(d->pic, pic, size);
+        free(pic);
+    }
+
+    d->usec = Sys_Microseconds() - start;
+}
+
+// loads and queues waiting items in request order while they fit into the
+// budget, bad files are left for the loader to report
+static void queue_waiting_decodes(void)
+{
+    size_t limit = (size_t)Cvar_ClampInteger(r_image_prefetch_size, 1, 4096) << 20;
+    asyncwork_t work = { .work_cb = decode_work };
+    decode_t *d, *next;
+    int len, w, h, comp;
+
+    LIST_FOR_EACH_SAFE(decode_t, d, next, &img_decode_wait, entry) {
+        // image size is not known until file is loaded
+        if (img_decode_bytes && img_decode_bytes + d->len > limit)
+            break;
+
+        List_Remove(&d->entry);
+        List_Append(&img_decode_busy, &d->entry);
+
+        len = FS_LoadFileFlags(d->name, (void **)&d->data, d->fs_flags);
+        if (!d->data)
+            continue;
+
+        if (!stbi_info_from_memory(d->data, len, &w, &h, &comp) ||
+            w < 1 || w > MAX_DECODE_SIZE || h < 1 || h > MAX_DECODE_SIZE) {
+            FS_FreeFile(d->data);
+            d->data = NULL;
+            continue;
+        }
+
+        d->len = len;
+        d->size = (size_t)w * h * 4;    // enough for any output format
+        d->pic = R_Malloc(d->size);
+        img_decode_bytes += d->len + d->size;
+
+        work.cb_arg = d;
+        d->handle = Com_QueueAsyncWork(&work);
+    }
+}
+
+static decode_t *find_decode(const char *name, int fs_flags)
+{
+    decode_t *d;
+
+    if (!img_decode_count)
+        return NULL;
+
+    for (d = img_decode_hash[FS_HashPath(name, DECODE_HASH)]; d; d = d->hash_next)
+        if (d->fs_flags == fs_flags && !FS_pathcmp(d->name, name))
+            return d;
+
+    return NULL;
+}
+
+// waits for queued work and frees the item
+static void release_decode(decode_t *d)
+{
+    decode_t **back;
+
+    if (d->handle) {
+        Com_WaitAsyncWork(d->handle);
+        img_decode_bytes -= d->len + d->size;
+    }
+
+    for (back = &img_decode_hash[FS_HashPath(d->name, DECODE_HASH)]; *back; back = &(*back)->hash_next) {
+        if (*back == d) {
+            *back = d->hash_next;
+            break;
+        }
+    }
+
+    List_Remove(&d->entry);
+    img_decode_count--;
+    FS_FreeFile(d->data);
+    Z_Free(d->pic);
+    Z_Free(d);
+}
+
+// called from _try_image_format in place of loading
+static int take_decode(decode_t *d, image_t *image, byte **pic)
+{
+    uint64_t start = Sys_Microseconds();
+    int ret;
+
+    // not queued yet or not decodable, load it inline
+    if (!d->handle) {
+        release_decode(d);
+        return Q_ERR(ENOENT);
+    }
+
+    Com_WaitAsyncWork(d->handle);
+    img_decode_stats.wait_usec += Sys_Microseconds() - start;
+
+    ret = d->error;
+    if (ret >= 0) {
+        image->upload_width = image->width = d->image.width;
+        image->upload_height = image->height = d->image.height;
+        image->pixel_format = d->image.pixel_format;
+        image->flags |= d->image.flags;
+        *pic = d->pic;
+        d->pic = NULL;
+
+        img_decode_stats.formats[d->fmt].count++;
+        img_decode_stats.formats[d->fmt].async++;
+        img_decode_stats.formats[d->fmt].usec += d->usec;
+    }
+
+    release_decode(d);
+
+    // budget has been freed
+    queue_waiting_decodes();
+    return ret;
+}
+
+// called from _try_image_format in prefetch mode, returns the same as it
+// would if the image was loaded
+static int queue_decode(imageformat_t fmt, image_t *image, int fs_flags)
+{
+    decode_t *d;
+    int len;
+    unsigned hash;
+
+    // only check the file exists, it is loaded when queued
+    len = FS_LoadFileFlags(image->name, NULL, fs_flags);
+    if (len < 0)
+        return len;
+
+    // 8-bit formats are cheap to decode
+    if (fmt <= IM_WAL)
+        return fmt;
+
+    if (find_decode(image->name, fs_flags))
+        return fmt;
+
+    d = R_Mallocz(sizeof(*d));
+    Q_strlcpy(d->name, image->name, sizeof(d->name));
+    d->fs_flags = fs_flags;
+    d->fmt = fmt;
+    d->len = len;
+
+    hash = FS_HashPath(d->name, DECODE_HASH);
+    d->hash_next = img_decode_hash[hash];
+    img_decode_hash[hash] = d;
+    img_decode_count++;
+
+    List_Append(&img_decode_wait, &d->entry);
+    queue_waiting_decodes();
+    return fmt;
+}
+
 #define TRY_IMAGE_SRC_GAME      1
 #define TRY_IMAGE_SRC_BASE      0
 
 static int _try_image_format(imageformat_t fmt, image_t *image, int try_src, byte **pic)
 {
+    decode_t    *d;
     byte        *data;
     int         len;
     int         ret;
+    uint64_t    start;
 
-    // load the file
-    int fs_flags = 0;
+    // most probes miss, let directory index answer them
+    int fs_flags = FS_FLAG_INDEXED;
     if (try_src > 0)
-        fs_flags = try_src == TRY_IMAGE_SRC_GAME ? FS_PATH_GAME : FS_PATH_BASE;
-    len = FS_LoadFileFlags(image->name, (void **)&data, fs_flags);
-    if (!data) {
-        return len;
-    }
+        fs_flags |= try_src == TRY_IMAGE_SRC_GAME ? FS_PATH_GAME : FS_PATH_BASE;
 
-    // decompress the image
-    ret = img_loaders[fmt].load(data, len, image, pic);
+    if (img_prefetching)
+        return queue_decode(fmt, image, fs_flags);
 
-    FS_FreeFile(data);
+    // pick up pixels decoded in advance, failed decode is retried below to
+    // set the error message
+    d = find_decode(image->name, fs_flags);
+    ret = d ? take_decode(d, image, pic) : Q_ERR(ENOENT);
+
+    if (ret < 0) {
+        // load the file
+        len = FS_LoadFileFlags(image->name, (void **)&data, fs_flags);
+        if (!data) {
+            return len;
+        }
+
+        // decompress the image
+        start = Sys_Microseconds();
+        ret = img_loaders[fmt].load(data, len, image, pic);
+        if (ret >= 0) {
+            img_decode_stats.formats[fmt].count++;
+            img_decode_stats.formats[fmt].usec += Sys_Microseconds() - start;
+        }
+
+        FS_FreeFile(data);
+    }
 
     image->filepath[0] = 0;
     if (ret >= 0) {
@@ -1415,41 +1956,11 @@ static void print_error(const char *name, imageflags_t flags, int err)
     Com_LPrintf(level, "Couldn't load %s: %s\n", name, msg);
 }
 
-// finds or loads the given image, adding it to the hash table.
-static image_t *find_or_load_image(const char *name, size_t len,
-                                   imagetype_t type, imageflags_t flags)
+// tries overrides first, then game and base directories
+static int load_image_pixels(image_t *image, const char *name, size_t len,
+                             imagetype_t type, imageflags_t flags, byte **pic)
 {
-    image_t         *image;
-    byte            *pic;
-    unsigned        hash;
-    int             ret = Q_ERR(ENOENT);
-
-    Q_assert(len < MAX_QPATH);
-
-    // must have an extension and at least 1 char of base name
-    if (len <= 4 || name[len - 4] != '.') {
-        ret = Q_ERR_INVALID_PATH;
-        goto fail;
-    }
-
-    hash = FS_HashPathLen(name, len - 4, RIMAGES_HASH);
-
-    // look for it
-    if ((image = lookup_image(name, type, hash, len - 4)) != NULL) {
-        image->registration_sequence = registration_sequence;
-        if (image->upload_width && image->upload_height) {
-            image->flags |= flags & IF_PERMANENT;
-            return image;
-        }
-        return NULL;
-    }
-
-    // allocate image slot
-    image = alloc_image();
-    if (!image) {
-        ret = Q_ERR_OUT_OF_SLOTS;
-        goto fail;
-    }
+    int ret = Q_ERR(ENOENT);
 
 #if REF_GL
     bool allow_override = cls.ref_type != REF_TYPE_GL || type == IT_PIC || gl_use_hd_assets->integer;
@@ -1468,7 +1979,7 @@ static image_t *find_or_load_image(const char *name, size_t len,
         strcpy(image->name, "overrides/");
         strcat(image->name, last_slash);
         image->baselen = strlen(image->name) - 4;
-        ret = try_load_image_candidate(image, name, len, &pic, type, flags, true, -1);
+        ret = try_load_image_candidate(image, name, len, pic, type, flags, true, -1);
         memcpy(image->name, name, len + 1);
         image->baselen = len - 4;
     }
@@ -1490,7 +2001,7 @@ static image_t *find_or_load_image(const char *name, size_t len,
             // fill in some basic info
             memcpy(image->name, name, len + 1);
             image->baselen = len - 4;
-            ret = try_load_image_candidate(image, NULL, 0, &pic, type, flags, !!allow_override, try_location);
+            ret = try_load_image_candidate(image, NULL, 0, pic, type, flags, !!allow_override, try_location);
             image->flags |= location_flag;
 
             if (ret >= 0)
@@ -1498,6 +2009,47 @@ static image_t *find_or_load_image(const char *name, size_t len,
         }
     }
 
+    return ret;
+}
+
+// finds or loads the given image, adding it to the hash table.
+static image_t *find_or_load_image(const char *name, size_t len,
+                                   imagetype_t type, imageflags_t flags)
+{
+    image_t         *image;
+    byte            *pic;
+    unsigned        hash;
+    int             ret = Q_ERR(ENOENT);
+
+    Q_assert(len < MAX_QPATH);
+
+    // must have an extension and at least 1 char of base name
+    if (len <= 4 || name[len - 4] != '.') {
+        ret = Q_ERR_INVALID_PATH;
+        goto fail;
+    }
+
+    hash = FS_HashPathLen(name, len - 4, RIMAGES_HASH);
+
+    // look for it
+    if ((image = lookup_image(name, type, hash, len - 4)) != NULL) {
+        image->registration_sequence = registration_sequence;
+        if (image->upload_width && image->upload_height) {
+            image->flags |= flags & IF_PERMANENT;
+            return image;
+        }
+        return NULL;
+    }
+
+    // allocate image slot
+    image = alloc_image();
+    if (!image) {
+        ret = Q_ERR_OUT_OF_SLOTS;
+        goto fail;
+    }
+
+    ret = load_image_pixels(image, name, len, type, flags, &pic);
+
     if (ret < 0) {
         print_error(image->name, flags, ret);
         if (flags & IF_PERMANENT) {
@@ -1538,6 +2090,89 @@ image_t *IMG_Find(const char *name, imagetype_t type, imageflags_t flags)
     return R_NOTEXTURE;
 }
 
+/*
+===============
+IMG_Prefetch
+
+Starts decoding the image on worker threads if it is not yet loaded. Next
+IMG_Find for the same image picks up the result. Pixels not picked up until
+IMG_EndPrefetch are dropped.
+===============
+*/
+void IMG_Prefetch(const char *name, imagetype_t type, imageflags_t flags)
+{
+    image_t image;
+    byte *pic;
+    size_t len;
+
+    Q_assert(name);
+
+    if (!r_image_prefetch->integer)
+        return;
+
+    len = strlen(name);
+    if (len >= MAX_QPATH || len <= 4 || name[len - 4] != '.')
+        return;
+
+    if (lookup_image(name, type, FS_HashPathLen(name, len - 4, RIMAGES_HASH), len - 4))
+        return;
+
+    memset(&image, 0, sizeof(image));
+    img_prefetching = true;
+    load_image_pixels(&image, name, len, type, flags, &pic);
+    img_prefetching = false;
+}
+
+/*
+===============
+IMG_EndPrefetch
+
+Drops decoded images that were never looked up and prints decode time per
+format for images loaded since last call.
+===============
+*/
+void IMG_EndPrefetch(void)
+{
+    decode_t *d, *next;
+    uint64_t usec = 0;
+    int i, count = 0;
+
+    for (i = 0; i < DECODE_HASH; i++) {
+        for (d = img_decode_hash[i]; d; d = next) {
+            next = d->hash_next;
+            img_decode_stats.wasted++;
+            release_decode(d);
+        }
+    }
+
+    Q_assert(!img_decode_count);
+    Q_assert(!img_decode_bytes);
+
+    for (i = 0; i < IM_MAX; i++) {
+        count += img_decode_stats.formats[i].count;
+        usec += img_decode_stats.formats[i].usec;
+    }
+
+    if (count && r_image_report->integer) {
+        Com_Printf("Decoded %d images in %.1f msec, %.1f msec waiting, %d wasted\n",
+                   count, usec * 0.001, img_decode_stats.wait_usec * 0.001,
+                   img_decode_stats.wasted);
+        Com_Printf("format count async     msec  avg msec\n"
+                   "------ ----- ----- -------- ---------\n");
+        for (i = 0; i < IM_MAX; i++) {
+            count = img_decode_stats.formats[i].count;
+            usec = img_decode_stats.formats[i].usec;
+            if (!count)
+                continue;
+            Com_Printf("%-6s %5d %5d %8.1f %9.3f\n", img_loaders[i].ext, count,
+                       img_decode_stats.formats[i].async, usec * 0.001,
+                       usec * 0.001 / count);
+        }
+    }
+
+    memset(&img_decode_stats, 0, sizeof(img_decode_stats));
+}
+
 image_t *IMG_FindExisting(const char *name, imagetype_t type)
 {
     image_t *image;
@@ -1791,6 +2426,8 @@ void IMG_FreeAll(void)
     image_t *image;
     int i, count = 0;
 
+    IMG_EndPrefetch();
+
     for (i = 1, image = r_images + 1; i < r_numImages; i++, image++) {
         if (!image->registration_sequence)
             continue;        // free image_t slot
@@ -1872,6 +2509,12 @@ void IMG_Init(void)
     r_texture_formats->changed = r_texture_formats_changed;
     r_texture_formats_changed(r_texture_formats);
     r_texture_overrides = Cvar_Get("r_texture_overrides", "-1", CVAR_FILES);
+    r_image_prefetch = Cvar_Get("r_image_prefetch", "1", 0);
+    r_image_prefetch_size = Cvar_Get("r_image_prefetch_size", "256", 0);
+    r_image_report = Cvar_Get("r_image_report", "0", 0);
+    r_image_threads = Cvar_Get("r_image_threads", "1", 0);
+
+    init_srgb_tables();
 
     r_screenshot_format = Cvar_Get("gl_screenshot_format", "png", CVAR_ARCHIVE);
     r_screenshot_async = Cvar_Get("gl_screenshot_async", "1", 0);
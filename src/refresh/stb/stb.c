@@ -21,9 +21,71 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/common.h"
 #include "common/zone.h"
 
-#define STBI_MALLOC(sz)           Z_Malloc(sz)
-#define STBI_REALLOC(p,newsz)     Z_Realloc(p,newsz)
-#define STBI_FREE(p)              Z_Free(p)
+// set by image decoding jobs, zone allocator is not thread safe
+q_thread_local bool stbi_system_malloc;
+
+// Buffer preallocated by image decoding job. It is handed out for the first
+// allocation of exactly its size, which is normally the decoded image, so
+// that the result doesn't need to be copied. Intermediate buffers that
+// happen to match are handled too, result just ends up elsewhere.
+static q_thread_local byte      *stbi_output;
+static q_thread_local size_t    stbi_output_size;
+static q_thread_local bool      stbi_output_busy;
+
+void stbi_set_output(void *buffer, size_t size)
+{
+    stbi_output = buffer;
+    stbi_output_size = size;
+    stbi_output_busy = false;
+}
+
+static void *stbi_malloc(size_t size)
+{
+    if (!stbi_system_malloc)
+        return Z_Malloc(size);
+
+    if (stbi_output && !stbi_output_busy && size == stbi_output_size) {
+        stbi_output_busy = true;
+        return stbi_output;
+    }
+
+    return malloc(size);
+}
+
+static void *stbi_realloc(void *ptr, size_t size)
+{
+    void *out;
+
+    if (!stbi_system_malloc)
+        return Z_Realloc(ptr, size);
+
+    if (!ptr || ptr != stbi_output)
+        return realloc(ptr, size);
+
+    if (size <= stbi_output_size)
+        return ptr;
+
+    out = malloc(size);
+    if (out) {
+        memcpy(out, ptr, stbi_output_size);
+        stbi_output_busy = false;
+    }
+    return out;
+}
+
+static void stbi_free(void *ptr)
+{
+    if (!stbi_system_malloc)
+        Z_Free(ptr);
+    else if (ptr && ptr == stbi_output)
+        stbi_output_busy = false;
+    else
+        free(ptr);
+}
+
+#define STBI_MALLOC(sz)           stbi_malloc(sz)
+#define STBI_REALLOC(p,newsz)     stbi_realloc(p,newsz)
+#define STBI_FREE(p)              stbi_free(p)
 
 #define STBI_FAILURE_USERMSG
 #define STB_IMAGE_IMPLEMENTATION
@@ -604,26 +604,6 @@ static void make_pvs_symmetric(bsp_t* bsp)
 	}
 }
 
-static void build_pvs2(bsp_t* bsp)
-{
-	size_t matrix_size = bsp->visrowsize * bsp->vis->numclusters;
-
-	bsp->pvs2_matrix = Z_Mallocz(matrix_size);
-
-	for (int cluster = 0; cluster < bsp->vis->numclusters; cluster++)
-	{
-		byte* pvs = BSP_GetPvs(bsp, cluster);
-		byte* dest_pvs = BSP_GetPvs2(bsp, cluster);
-		memcpy(dest_pvs, pvs, bsp->visrowsize);
-
-		FOREACH_BIT_BEGIN(pvs, bsp->visrowsize, vis_cluster)
-			byte* pvs2 = BSP_GetPvs(bsp, vis_cluster);
-			merge_pvs_rows(bsp, pvs2, dest_pvs);
-		FOREACH_BIT_END
-	}
-
-}
-
 // Provides an upper estimate (not counting the collinear edge removal, invisible materials etc.)
 // for the total number of triangles needed to represent the bsp and one instance of every model.
 static int count_triangles(const bsp_t* bsp)
@@ -1926,7 +1906,7 @@ bsp_mesh_create_from_bsp(bsp_mesh_t *wm, bsp_t *bsp, const char* map_name)
 
 	if (!bsp->pvs_patched)
 	{
-		build_pvs2(bsp);
+		BSP_BuildPvs2Matrix(bsp);
 
 		if (!BSP_SavePatchedPVS(bsp))
 		{
@@ -1999,6 +1979,18 @@ void
 bsp_mesh_register_textures(bsp_t *bsp)
 {
 	MAT_ChangeMap(bsp->name);
+
+	// decode textures on worker threads while materials are set up in order
+	for (int i = 0; i < bsp->numtexinfo; i++) {
+		mtexinfo_t *info = bsp->texinfo + i;
+		imageflags_t flags = (info->c.flags & SURF_WARP) ? IF_TURBULENT : IF_NONE;
+
+		char buffer[MAX_QPATH];
+		Q_concat(buffer, sizeof(buffer), "textures/", info->name, ".wal");
+		FS_NormalizePath(buffer);
+
+		MAT_Prefetch(buffer, IT_WALL, flags);
+	}
 	
 	for (int i = 0; i < bsp->numtexinfo; i++) {
 		mtexinfo_t *info = bsp->texinfo + i;
@@ -62,6 +62,7 @@ cvar_t *cvar_pt_enable_surface_lights = NULL;
 cvar_t *cvar_pt_enable_surface_lights_warp = NULL;
 cvar_t* cvar_pt_surface_lights_fake_emissive_algo = NULL;
 cvar_t* cvar_pt_surface_lights_threshold = NULL;
+cvar_t *cvar_pt_texture_cache = NULL;
 cvar_t* cvar_pt_bsp_radiance_scale = NULL;
 cvar_t *cvar_pt_bsp_sky_lights = NULL;
 cvar_t *cvar_pt_accumulation_rendering = NULL;
@@ -3791,6 +3792,9 @@ R_Init_RTX(bool total)
 	// Threshold for pixel values used when constructing a fake emissive image.
 	cvar_pt_surface_lights_threshold = Cvar_Get("pt_surface_lights_threshold", "215", CVAR_FILES);
 
+	// When nonzero, synthesized emissive textures are cached in texcache/ in the game directory
+	cvar_pt_texture_cache = Cvar_Get("pt_texture_cache", "1", CVAR_ARCHIVE);
+
 	// Multiplier for texinfo radiance field to convert radiance to emissive factors
 	cvar_pt_bsp_radiance_scale = Cvar_Get("pt_bsp_radiance_scale", "0.001", CVAR_FILES);
 
@@ -3926,6 +3930,7 @@ R_Init_RTX(bool total)
 	Cmd_AddCommand("reload_textures", (xcommand_t)&vkpt_reload_textures);
 	Cmd_AddCommand("show_pvs", (xcommand_t)&vkpt_show_pvs);
 	Cmd_AddCommand("next_sun", (xcommand_t)&vkpt_next_sun_preset);
+	Cmd_AddCommand("texture_cache_bench", vkpt_texture_cache_bench);
 
 	vkpt_fog_init();
 	vkpt_cameras_init();
@@ -3959,6 +3964,7 @@ R_Shutdown_RTX(bool total)
 	Cmd_RemoveCommand("reload_textures");
 	Cmd_RemoveCommand("show_pvs");
 	Cmd_RemoveCommand("next_sun");
+	Cmd_RemoveCommand("texture_cache_bench");
 
 	if (vkpt_refdef.bsp_mesh_world_loaded)
 	{
@@ -4366,6 +4372,7 @@ R_EndRegistration_RTX(void)
 	
 	vkpt_physical_sky_endRegistration();
 
+	IMG_EndPrefetch();
 	IMG_FreeUnused();
 	MOD_FreeUnused();
 	MAT_FreeUnused();
@@ -812,6 +812,56 @@ static qboolean game_image_identical_to_base(const char* name)
 	return result;
 }
 
+void MAT_Prefetch(const char* name, imagetype_t type, imageflags_t flags)
+{
+	char mat_name_no_ext[MAX_QPATH];
+	truncate_extension(name, mat_name_no_ext);
+	Q_strlwr(mat_name_no_ext);
+
+	uint32_t hash = Com_HashString(mat_name_no_ext, RMATERIALS_HASH);
+
+	if (find_material(mat_name_no_ext, hash, r_materials, MAX_PBR_MATERIALS))
+		return;
+
+	pbr_material_t* matdef = find_material_sorted(mat_name_no_ext, r_global_materials, num_global_materials);
+
+	if (type == IT_WALL)
+	{
+		pbr_material_t* map_mat = find_material_sorted(mat_name_no_ext, r_map_materials, num_map_materials);
+
+		if (map_mat)
+			matdef = map_mat;
+	}
+
+	/* Request the same images as MAT_Find would. Images for a material definition
+	   that MAT_Find ends up ignoring are decoded in vain, but that is rare. */
+	if (matdef)
+	{
+		flags |= IF_EXACT | (matdef->image_flags & IF_SRC_MASK);
+
+		if (matdef->filename_base[0])
+			IMG_Prefetch(matdef->filename_base, type, flags | IF_SRGB);
+		if (matdef->filename_normals[0])
+			IMG_Prefetch(matdef->filename_normals, type, flags);
+		if (matdef->filename_emissive[0])
+			IMG_Prefetch(matdef->filename_emissive, type, flags | IF_SRGB);
+		if (matdef->filename_mask[0])
+			IMG_Prefetch(matdef->filename_mask, type, flags);
+	}
+	else
+	{
+		char file_name[MAX_QPATH];
+
+		IMG_Prefetch(name, type, flags | IF_SRGB);
+
+		Q_snprintf(file_name, sizeof(file_name), "%s_n.tga", mat_name_no_ext);
+		IMG_Prefetch(file_name, type, flags);
+
+		Q_snprintf(file_name, sizeof(file_name), "%s_light.tga", mat_name_no_ext);
+		IMG_Prefetch(file_name, type, flags | IF_SRGB);
+	}
+}
+
 pbr_material_t* MAT_Find(const char* name, imagetype_t type, imageflags_t flags)
 {
 	char mat_name_no_ext[MAX_QPATH];
@@ -1296,7 +1346,8 @@ void MAT_SynthesizeEmissive(pbr_material_t * mat)
 		mat->image_emissive = get_fake_emissive_image(mat->image_base, mat->emissive_threshold);
 		mat->synth_emissive = true;
 
-		if (mat->image_emissive) {
+		// fake emissive images come out of texture cache already processed
+		if (mat->image_emissive && !mat->image_emissive->processing_complete) {
 			vkpt_extract_emissive_texture_info(mat->image_emissive);
 		}
 	}
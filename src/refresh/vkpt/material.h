@@ -81,6 +81,9 @@ void MAT_ChangeMap(const char* map_name);
 // all available textures will be initialized in the returned material
 pbr_material_t* MAT_Find(const char* name, imagetype_t type, imageflags_t flags);
 
+// starts decoding images MAT_Find would load for the material in background
+void MAT_Prefetch(const char* name, imagetype_t type, imageflags_t flags);
+
 // registration sequence: update registration sequence of images used by the material
 void MAT_UpdateRegistration(pbr_material_t * mat);
 
@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <assert.h>
 
 #include "color.h"
+#include "dds.h"
 #include "material.h"
 #include "../stb/stb_image.h"
 #include "../stb/stb_image_resize2.h"
@@ -94,6 +95,7 @@ static const float megabyte = 1048576.0f;
 extern cvar_t* cvar_pt_nearest;
 extern cvar_t* cvar_pt_bilerp_chars;
 extern cvar_t* cvar_pt_bilerp_pics;
+extern cvar_t* cvar_pt_texture_cache;
 
 void vkpt_textures_prefetch()
 {
@@ -851,6 +853,291 @@ static void apply_fake_emissive_threshold(image_t *image, int bright_threshold_i
 	Z_Free(final_2x);
 }
 
+/*
+=================================================================
+
+PROCESSED TEXTURE CACHE
+
+Synthesizing a fake emissive texture and extracting its emissive info is
+done on the CPU and costs several milliseconds per texture on every map
+load. Results are stored in the game directory under texcache/, one file
+per texture, named after a hash of the source pixels and the processing
+parameters, so stale entries are never picked up and need no bookkeeping.
+
+Entries are DDS files with a DX10 header and a single RGBA8 sRGB level.
+Emissive info lives in the reserved header words. Mip levels and normal map
+normalization are produced on the GPU at upload time and are not cached.
+
+=================================================================
+*/
+
+#define TEXCACHE_VERSION    1
+#define TEXCACHE_MARKER     MAKEFOURCC('Q', '2', 'T', 'C')
+
+// stored in DDS_HEADER.reserved1, must fit into 11 words
+typedef struct {
+	uint32_t    marker;
+	uint32_t    version;
+	float       light_color[3];
+	float       min_light_texcoord[2];
+	float       max_light_texcoord[2];
+	uint32_t    entire_texture_emissive;
+} texcache_info_t;
+
+static uint64_t texcache_key(const image_t *image, int bright_threshold_int)
+{
+	const byte *data = image->pix_data;
+	size_t size = image->upload_width * image->upload_height * 4;
+	uint64_t h, v;
+
+	h = ((uint64_t)image->upload_width << 32 | image->upload_height) * 0x9e3779b97f4a7c15ull;
+	h ^= TEXCACHE_VERSION << 8 | Q_clip_uint8(bright_threshold_int);
+
+	for (; size >= 8; data += 8, size -= 8) {
+		memcpy(&v, data, 8);
+		h = (h ^ v) * 0xff51afd7ed558ccdull;
+		h ^= h >> 32;
+	}
+	if (size) {
+		v = 0;
+		memcpy(&v, data, size);
+		h = (h ^ v) * 0xff51afd7ed558ccdull;
+	}
+
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+static void texcache_path(char *buffer, uint64_t key)
+{
+	Q_snprintf(buffer, MAX_QPATH, "texcache/%016"PRIx64".dds", key);
+}
+
+// replaces pixels and emissive info of the image with cached ones
+static bool texcache_load(image_t *image, uint64_t key)
+{
+	char path[MAX_QPATH];
+	DDS_HEADER hdr;
+	DDS_HEADER_DXT10 dx10;
+	texcache_info_t info;
+	qhandle_t f;
+	int64_t len;
+	size_t size;
+	byte *pic;
+
+	texcache_path(path, key);
+
+	// misses are answered by directory index without going to disk
+	len = FS_OpenFile(path, &f, FS_MODE_READ | FS_TYPE_REAL | FS_PATH_GAME | FS_FLAG_INDEXED);
+	if (len < 0)
+		return false;
+
+	if (FS_Read(&hdr, sizeof(hdr), f) != sizeof(hdr) ||
+		FS_Read(&dx10, sizeof(dx10), f) != sizeof(dx10))
+		goto fail;
+
+	memcpy(&info, hdr.reserved1, sizeof(info));
+	if (hdr.magic != DDS_MAGIC || hdr.size != sizeof(DDS_HEADER) - 4 ||
+		hdr.ddspf.fourCC != MAKEFOURCC('D', 'X', '1', '0') ||
+		dx10.dxgiFormat != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB ||
+		info.marker != TEXCACHE_MARKER || info.version != TEXCACHE_VERSION)
+		goto fail;
+
+	// fake emissive image is always upscaled 2x
+	if (hdr.width != image->upload_width * 2 || hdr.height != image->upload_height * 2)
+		goto fail;
+
+	size = hdr.width * hdr.height * 4;
+	if (len != sizeof(hdr) + sizeof(dx10) + size)
+		goto fail;
+
+	pic = IMG_AllocPixels(size);
+	if (FS_Read(pic, size, f) != size) {
+		Z_Free(pic);
+		goto fail;
+	}
+
+	FS_CloseFile(f);
+
+	Z_Free(image->pix_data);
+	image->pix_data = pic;
+	image->upload_width = hdr.width;
+	image->upload_height = hdr.height;
+
+	VectorCopy(info.light_color, image->light_color);
+	Vector2Copy(info.min_light_texcoord, image->min_light_texcoord);
+	Vector2Copy(info.max_light_texcoord, image->max_light_texcoord);
+	image->entire_texture_emissive = info.entire_texture_emissive;
+	image->processing_complete = true;
+	return true;
+
+fail:
+	FS_CloseFile(f);
+	Com_DPrintf("Ignoring bad texture cache entry %s\n", path);
+	return false;
+}
+
+static void texcache_store(const image_t *image, uint64_t key)
+{
+	char path[MAX_QPATH];
+	DDS_HEADER hdr = {
+		.magic = DDS_MAGIC,
+		.size = sizeof(DDS_HEADER) - 4,
+		.flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_PITCH,
+		.height = image->upload_height,
+		.width = image->upload_width,
+		.pitchOrLinearSize = image->upload_width * 4,
+		.mipMapCount = 1,
+		.ddspf = {
+			.size = sizeof(DDS_PIXELFORMAT),
+			.flags = DDS_FOURCC,
+			.fourCC = MAKEFOURCC('D', 'X', '1', '0'),
+		},
+		.caps = DDS_SURFACE_FLAGS_TEXTURE,
+	};
+	DDS_HEADER_DXT10 dx10 = {
+		.dxgiFormat = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
+		.resourceDimension = DDS_DIMENSION_TEXTURE2D,
+		.arraySize = 1,
+	};
+	texcache_info_t info = {
+		.marker = TEXCACHE_MARKER,
+		.version = TEXCACHE_VERSION,
+		.entire_texture_emissive = image->entire_texture_emissive,
+	};
+	size_t size = image->upload_width * image->upload_height * 4;
+	qhandle_t f;
+	int ret;
+
+	VectorCopy(image->light_color, info.light_color);
+	Vector2Copy(image->min_light_texcoord, info.min_light_texcoord);
+	Vector2Copy(image->max_light_texcoord, info.max_light_texcoord);
+	memcpy(hdr.reserved1, &info, sizeof(info));
+
+	texcache_path(path, key);
+
+	ret = FS_OpenFile(path, &f, FS_MODE_WRITE);
+	if (!f) {
+		Com_DPrintf("Couldn't write %s: %s\n", path, Q_ErrorString(ret));
+		return;
+	}
+
+	FS_Write(&hdr, sizeof(hdr), f);
+	FS_Write(&dx10, sizeof(dx10), f);
+	FS_Write(image->pix_data, size, f);
+
+	// truncated entry would be rejected by size check on load
+	if ((ret = FS_CloseFile(f)) < 0)
+		Com_DPrintf("Couldn't write %s: %s\n", path, Q_ErrorString(ret));
+}
+
+// Synthesizes fake emissive image in place and extracts its emissive info,
+// reusing results from texture cache if possible.
+static void process_fake_emissive(image_t *image, int bright_threshold_int)
+{
+	uint64_t key = 0;
+
+	if (cvar_pt_texture_cache->integer) {
+		key = texcache_key(image, bright_threshold_int);
+		if (texcache_load(image, key))
+			return;
+	}
+
+	apply_fake_emissive_threshold(image, bright_threshold_int);
+	vkpt_extract_emissive_texture_info(image);
+
+	if (cvar_pt_texture_cache->integer)
+		texcache_store(image, key);
+}
+
+/*
+=================
+vkpt_texture_cache_bench
+
+Runs fake emissive processing for base textures of registered materials
+with and without texture cache, compares results and prints timings.
+Nothing is written to the cache if it is disabled.
+=================
+*/
+void vkpt_texture_cache_bench(void)
+{
+	uint64_t start, cold_usec = 0, store_usec = 0, warm_usec = 0;
+	int count = 0, misses = 0, mismatches = 0;
+	size_t bytes = 0;
+	bool cache = cvar_pt_texture_cache->integer;
+
+	if (!cache)
+		Com_WPrintf("Texture cache is disabled, timing processing only.\n");
+
+	for (int i = 0; i < MAX_PBR_MATERIALS; i++) {
+		const pbr_material_t *mat = r_materials + i;
+		const image_t *base = mat->image_base;
+
+		if (!mat->registration_sequence || !mat->synth_emissive)
+			continue;
+		if (!mat->image_emissive || mat->image_emissive == base || !base->pix_data)
+			continue;
+
+		size_t size = base->upload_width * base->upload_height * 4;
+		image_t cold = *base, warm = *base;
+		cold.pix_data = IMG_AllocPixels(size);
+		warm.pix_data = IMG_AllocPixels(size);
+		memcpy(cold.pix_data, base->pix_data, size);
+		memcpy(warm.pix_data, base->pix_data, size);
+
+		// what map load does without cache, plus writing the entry
+		start = Sys_Microseconds();
+		uint64_t key = texcache_key(&cold, mat->emissive_threshold);
+		apply_fake_emissive_threshold(&cold, mat->emissive_threshold);
+		vkpt_extract_emissive_texture_info(&cold);
+		cold_usec += Sys_Microseconds() - start;
+
+		if (cache) {
+			start = Sys_Microseconds();
+			texcache_store(&cold, key);
+			store_usec += Sys_Microseconds() - start;
+
+			start = Sys_Microseconds();
+			if (texcache_load(&warm, texcache_key(&warm, mat->emissive_threshold))) {
+				warm_usec += Sys_Microseconds() - start;
+				if (warm.upload_width != cold.upload_width ||
+					warm.upload_height != cold.upload_height ||
+					memcmp(warm.pix_data, cold.pix_data, warm.upload_width * warm.upload_height * 4) ||
+					!VectorCompare(warm.light_color, cold.light_color) ||
+					warm.entire_texture_emissive != cold.entire_texture_emissive)
+					mismatches++;
+			} else {
+				misses++;
+			}
+		}
+
+		bytes += cold.upload_width * cold.upload_height * 4;
+		count++;
+
+		Z_Free(cold.pix_data);
+		Z_Free(warm.pix_data);
+	}
+
+	if (!count) {
+		Com_Printf("No synthesized emissive textures registered.\n");
+		return;
+	}
+
+	if (!cache) {
+		Com_Printf("%d textures, %zu KB\n", count, bytes / 1024);
+		Com_Printf("cold: %.1f msec processing\n", cold_usec * 0.001);
+		return;
+	}
+
+	Com_Printf("%d textures, %zu KB cached\n", count, bytes / 1024);
+	Com_Printf("cold: %.1f msec processing, %.1f msec writing cache\n",
+			   cold_usec * 0.001, store_usec * 0.001);
+	Com_Printf("warm: %.1f msec reading cache, %d misses, %d mismatches\n",
+			   warm_usec * 0.001, misses, mismatches);
+}
+
 image_t *vkpt_fake_emissive_texture(image_t *image, int bright_threshold_int)
 {
 	if(!image)
@@ -884,7 +1171,7 @@ image_t *vkpt_fake_emissive_texture(image_t *image, int bright_threshold_int)
 		return image;
 
 	new_image->flags |= IF_FAKE_EMISSIVE | (Q_clip_uint8(bright_threshold_int) << IF_FAKE_EMISSIVE_THRESH_SHIFT);
-	apply_fake_emissive_threshold(new_image, bright_threshold_int);
+	process_fake_emissive(new_image, bright_threshold_int);
 
 	return new_image;
 }
@@ -1032,10 +1319,11 @@ void IMG_ReloadAll(void)
             }
             if(image->flags & IF_FAKE_EMISSIVE)
             {
-                apply_fake_emissive_threshold(image, (image->flags >> IF_FAKE_EMISSIVE_THRESH_SHIFT) & 0xff);
+                process_fake_emissive(image, (image->flags >> IF_FAKE_EMISSIVE_THRESH_SHIFT) & 0xff);
             }
 
-            IMG_Load(image, new_image.pix_data);
+            // pixels may have been replaced by fake emissive processing
+            IMG_Load(image, image->pix_data);
 
             image->last_modified = last_modifed; // reset time stamp because load_img doesn't
 
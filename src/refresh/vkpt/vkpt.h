@@ -552,6 +552,7 @@ void vkpt_textures_destroy_unused(void);
 void vkpt_textures_update_descriptor_set(void);
 image_t *vkpt_fake_emissive_texture(image_t *image, int bright_threshold_int);
 void vkpt_extract_emissive_texture_info(image_t *image);
+void vkpt_texture_cache_bench(void);
 void vkpt_textures_prefetch(void);
 void vkpt_invalidate_texture_descriptors(void);
 void vkpt_init_light_textures(void);
@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "server.h"
+#include "common/mdfour.h"
 
 /*
 ===============================================================================
@@ -1741,6 +1742,664 @@ static void SV_Stop_f(void)
 
 #endif
 
+#if USE_TESTS
+
+static bool SV_TraceEqual(const trace_t *a, const trace_t *b)
+{
+    return a->allsolid == b->allsolid &&
+        a->startsolid == b->startsolid &&
+        a->fraction == b->fraction &&
+        VectorCompare(a->endpos, b->endpos) &&
+        VectorCompare(a->plane.normal, b->plane.normal) &&
+        a->surface == b->surface &&
+        a->contents == b->contents &&
+        a->ent == b->ent;
+}
+
+/*
+==================
+SV_TraceBench_f
+
+Compares TraceBatch() against scalar SV_Trace() calls on the current map.
+Requests are generated in bursts of pellets fired from random player or
+monster positions, similar to what shotguns and AI visibility checks do.
+==================
+*/
+static void SV_TraceBench_f(void)
+{
+    tracereq_t *reqs;
+    trace_t *scalar, *batch;
+    edict_t *ent;
+    vec3_t aim;
+    int i, j, count, passes, burst, errors;
+    unsigned start, scalar_msec, batch_msec;
+
+    if (!sv.cm.cache || !ge) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    count = Cmd_Argc() > 1 ? Q_clip(Q_atoi(Cmd_Argv(1)), 1, 100000) : 1000;
+    passes = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 10000) : 100;
+    burst = Cmd_Argc() > 3 ? Q_clip(Q_atoi(Cmd_Argv(3)), 1, 64) : 12;
+
+    reqs = Z_Mallocz(sizeof(reqs[0]) * count);
+    scalar = Z_Malloc(sizeof(scalar[0]) * count);
+    batch = Z_Malloc(sizeof(batch[0]) * count);
+
+    Q_srand(count);
+    for (i = 0, ent = NULL; i < count; i++) {
+        tracereq_t *r = &reqs[i];
+
+        // pick new shooter for each burst
+        if (!(i % burst)) {
+            for (j = 0; j < ge->num_edicts; j++) {
+                ent = EDICT_NUM(Q_rand_uniform(ge->num_edicts));
+                if (ent->inuse && ent->solid == SOLID_BBOX)
+                    break;
+            }
+            if (j == ge->num_edicts)
+                ent = NULL;
+        }
+
+        if (ent) {
+            VectorCopy(ent->s.origin, r->start);
+            r->start[2] += ent->maxs[2] * 0.8f;
+        } else {
+            for (j = 0; j < 3; j++)
+                r->start[j] = sv.cm.cache->models[0].mins[j] + frand() *
+                    (sv.cm.cache->models[0].maxs[j] - sv.cm.cache->models[0].mins[j]);
+        }
+
+        // spread pellets around base direction like fire_lead() does
+        if (!(i % burst)) {
+            VectorSet(aim, crand(), crand(), crand() * 0.25f);
+            VectorNormalize(aim);
+        }
+        VectorMA(r->start, 8192, aim, r->end);
+        for (j = 0; j < 3; j++)
+            r->end[j] += crand() * 500;
+        r->passent = ent;
+        r->contentmask = MASK_SHOT;
+    }
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < passes; i++)
+        for (j = 0; j < count; j++)
+            scalar[j] = SV_Trace(reqs[j].start, reqs[j].mins, reqs[j].maxs,
+                                 reqs[j].end, reqs[j].passent, reqs[j].contentmask);
+    scalar_msec = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < passes; i++)
+        SV_TraceBatch(reqs, batch, count);
+    batch_msec = Sys_Milliseconds() - start;
+
+    for (i = errors = 0; i < count; i++)
+        if (!SV_TraceEqual(&scalar[i], &batch[i]))
+            errors++;
+
+    Com_Printf("%d traces x %d passes, burst %d: scalar %u msec, batch %u msec, %d mismatches\n",
+               count, passes, burst, scalar_msec, batch_msec, errors);
+
+    Z_Free(batch);
+    Z_Free(scalar);
+    Z_Free(reqs);
+}
+
+/*
+==================
+SV_AreaBench_f
+
+Compares link and query time of area index implementations on the current
+map. Boxes of mixed sizes are put into free edict slots and moved around
+the world, and surroundings of each box are queried every frame, like
+SV_Trace does for moving entities. Random sequence is the same for each
+implementation, so the number of entities found must match.
+==================
+*/
+static void SV_AreaBench_f(void)
+{
+    static const char *const names[] = { "tree", "bvh" };
+    edict_t *touch[MAX_EDICTS];
+    vec3_t mins, maxs, wmins, wmaxs, *vel;
+    server_entity_t *saved_sents;
+    edict_t *ent;
+    byte *saved;
+    int i, j, f, mode, first, count, frames, saved_index;
+    unsigned start, link_msec, query_msec;
+    uint64_t hits[2];
+    float half;
+
+    if (!sv.cm.cache || !ge) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    count = Cmd_Argc() > 1 ? Q_clip(Q_atoi(Cmd_Argv(1)), 1, MAX_EDICTS) : 500;
+    frames = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 10000) : 100;
+
+    first = ge->num_edicts;
+    count = min(count, ge->max_edicts - first);
+    if (count < 1) {
+        Com_Printf("No free edicts.\n");
+        return;
+    }
+
+    // free slots are restored afterwards
+    saved = Z_Malloc(ge->edict_size * count);
+    memcpy(saved, EDICT_NUM(first), ge->edict_size * count);
+    saved_sents = Z_Malloc(sizeof(saved_sents[0]) * count);
+    memcpy(saved_sents, &sv.entities[first], sizeof(saved_sents[0]) * count);
+    saved_index = sv_area_index->integer;
+
+    vel = Z_Malloc(sizeof(vel[0]) * count);
+    VectorCopy(sv.cm.cache->models[0].mins, wmins);
+    VectorCopy(sv.cm.cache->models[0].maxs, wmaxs);
+
+    for (mode = 0; mode < 2; mode++) {
+        SV_SetAreaIndex(mode);
+
+        Q_srand(count);
+        for (i = 0; i < count; i++) {
+            ent = EDICT_NUM(first + i);
+            ent->inuse = true;
+            ent->area.prev = ent->area.next = NULL;
+            ent->svflags = 0;
+            ent->owner = NULL;
+            ent->linkcount = 0;
+            ent->solid = (i & 7) ? SOLID_BBOX : SOLID_TRIGGER;
+            // mostly small projectiles and monsters, some big objects
+            half = (i & 15) ? 4 + Q_rand_uniform(28) : 32 + Q_rand_uniform(96);
+            VectorSet(ent->mins, -half, -half, -half);
+            VectorSet(ent->maxs, half, half, half);
+            VectorClear(ent->s.angles);
+            for (j = 0; j < 3; j++) {
+                ent->s.origin[j] = wmins[j] + frand() * (wmaxs[j] - wmins[j]);
+                vel[i][j] = crand() * 40;
+            }
+            PF_LinkEdict(ent);
+        }
+
+        link_msec = query_msec = 0;
+        hits[mode] = 0;
+        for (f = 0; f < frames; f++) {
+            start = Sys_Milliseconds();
+            for (i = 0; i < count; i++) {
+                ent = EDICT_NUM(first + i);
+                for (j = 0; j < 3; j++) {
+                    ent->s.origin[j] += vel[i][j];
+                    if (ent->s.origin[j] < wmins[j] || ent->s.origin[j] > wmaxs[j])
+                        vel[i][j] = -vel[i][j];
+                }
+                PF_LinkEdict(ent);
+            }
+            link_msec += Sys_Milliseconds() - start;
+
+            start = Sys_Milliseconds();
+            for (i = 0; i < count; i++) {
+                ent = EDICT_NUM(first + i);
+                for (j = 0; j < 3; j++) {
+                    mins[j] = ent->absmin[j] - fabsf(vel[i][j]);
+                    maxs[j] = ent->absmax[j] + fabsf(vel[i][j]);
+                }
+                hits[mode] += SV_AreaEdicts(mins, maxs, touch, MAX_EDICTS, AREA_SOLID);
+                hits[mode] += SV_AreaEdicts(mins, maxs, touch, MAX_EDICTS, AREA_TRIGGERS);
+            }
+            query_msec += Sys_Milliseconds() - start;
+        }
+
+        for (i = 0; i < count; i++)
+            PF_UnlinkEdict(EDICT_NUM(first + i));
+
+        Com_Printf("%-6s: %d boxes x %d frames: link %u msec, query %u msec, %"PRIu64" hits\n",
+                   names[mode], count, frames, link_msec, query_msec, hits[mode]);
+    }
+
+    if (hits[0] != hits[1])
+        Com_EPrintf("Area index implementations disagree\n");
+
+    memcpy(EDICT_NUM(first), saved, ge->edict_size * count);
+    memcpy(&sv.entities[first], saved_sents, sizeof(saved_sents[0]) * count);
+    SV_SetAreaIndex(saved_index);
+
+    Z_Free(vel);
+    Z_Free(saved_sents);
+    Z_Free(saved);
+}
+
+static uint32_t SV_EdictStatesChecksum(void)
+{
+    uint32_t sum = 0;
+    edict_t *ent;
+    int i;
+
+    for (i = 0; i < ge->num_edicts; i++) {
+        ent = EDICT_NUM(i);
+        if (ent->inuse)
+            sum = sum * 31 + Com_BlockChecksum(&ent->s, sizeof(ent->s));
+    }
+
+    return sum;
+}
+
+/*
+==================
+SV_SpawnBench_f
+
+Times spawning of the current map entities plus the first second of game
+frames, during which most entities look up their targets, with game
+targetname index disabled and enabled. Optional stress entities are pairs
+of target_laser and info_notnull with unique names, appended after the map
+entities. Game random number generator is reseeded before each spawn, so
+entity states after each run must match. Map entities are respawned
+afterwards.
+==================
+*/
+static void SV_SpawnBench_f(void)
+{
+    static const char *const names[] = { "scan", "index" };
+    char *entstring;
+    cvar_t *var;
+    client_t *cl;
+    size_t len, size;
+    unsigned start, msec;
+    uint32_t sums[2];
+    int i, f, mode, passes, stress;
+    char saved[MAX_QPATH];
+
+    if (sv.state != ss_game || !ge) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    FOR_EACH_CLIENT(cl) {
+        if (cl->state > cs_zombie) {
+            Com_Printf("Can't run with clients connected.\n");
+            return;
+        }
+    }
+
+    var = Cvar_FindVar("g_target_index");
+    if (!var) {
+        Com_Printf("Game library doesn't support target index.\n");
+        return;
+    }
+
+    passes = Cmd_Argc() > 1 ? Q_clip(Q_atoi(Cmd_Argv(1)), 1, 1000) : 10;
+    stress = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 0, MAX_EDICTS) : 0;
+    stress = min(stress, (ge->max_edicts - sv_maxclients->integer - 16) / 2);
+
+    if (!SV_SeedGameRandom(1))
+        Com_WPrintf("Game library can't be reseeded, entity states may differ.\n");
+
+    entstring = sv.cm.entitystring;
+    if (stress > 0) {
+        len = strlen(entstring);
+        size = len + stress * 160 + 1;
+        entstring = Z_Malloc(size);
+        memcpy(entstring, sv.cm.entitystring, len + 1);
+        for (i = 0; i < stress; i++)
+            len += Q_scnprintf(entstring + len, size - len,
+                               "\n{\n\"classname\" \"info_notnull\"\n\"targetname\" \"stress%d\"\n}"
+                               "\n{\n\"classname\" \"target_laser\"\n\"target\" \"stress%d\"\n}", i, i);
+    }
+
+    Q_strlcpy(saved, var->string, sizeof(saved));
+
+    for (mode = 0; mode < 2; mode++) {
+        Cvar_Set("g_target_index", va("%d", mode));
+
+        msec = 0;
+        for (i = 0; i < passes; i++) {
+            SV_ClearWorld();
+            SV_SeedGameRandom(1);
+            start = Sys_Milliseconds();
+            ge->SpawnEntities(sv.name, entstring, "");
+            for (f = 0; f < BASE_FRAMERATE + 2; f++)
+                ge->RunFrame();
+            msec += Sys_Milliseconds() - start;
+        }
+        sums[mode] = SV_EdictStatesChecksum();
+
+        Com_Printf("%-6s: %d entities x %d passes: %u msec\n",
+                   names[mode], ge->num_edicts, passes, msec);
+    }
+
+    if (sums[0] != sums[1])
+        Com_EPrintf("Entity states differ\n");
+
+    Cvar_Set("g_target_index", saved);
+
+    if (entstring != sv.cm.entitystring)
+        Z_Free(entstring);
+
+    // run two frames to allow everything to settle, like SV_SpawnServer does
+    SV_ClearWorld();
+    ge->SpawnEntities(sv.name, sv.cm.entitystring, "");
+    ge->RunFrame();
+    ge->RunFrame();
+}
+
+// spawns a fake Q2PRO client that never acknowledges frames, so that
+// each frame is encoded in full. packets are sent to unspecified address.
+static client_t *SV_AddBenchClient(int index)
+{
+    char userinfo[MAX_INFO_STRING * 2];
+    netadr_t adr;
+    client_t *newcl;
+    int number;
+
+    newcl = NULL;
+    for (number = 0; number < sv_maxclients->integer; number++) {
+        if (!svs.client_pool[number].state) {
+            newcl = &svs.client_pool[number];
+            break;
+        }
+    }
+    if (!newcl)
+        return NULL;
+
+    memset(newcl, 0, sizeof(*newcl));
+    newcl->number = newcl->slot = number;
+    newcl->protocol = PROTOCOL_VERSION_Q2PRO;
+    newcl->version = PROTOCOL_VERSION_Q2PRO_CURRENT;
+    newcl->edict = EDICT_NUM(number + 1);
+    newcl->gamedir = fs_game->string;
+    newcl->mapname = sv.name;
+    newcl->configstrings = sv.configstrings;
+    newcl->csr = &svs.csr;
+    newcl->ge = ge;
+    newcl->cm = &sv.cm;
+    newcl->spawncount = sv.spawncount;
+    newcl->maxclients = sv_maxclients->integer;
+    newcl->last_valid_cluster = -1;
+    newcl->esFlags = MSG_ES_UMASK | MSG_ES_LONGSOLID | MSG_ES_BEAMORIGIN;
+    if (svs.csr.extended)
+        newcl->esFlags |= MSG_ES_EXTENSIONS;
+#if USE_FPS
+    newcl->framediv = sv.framediv;
+    newcl->settings[CLS_FPS] = BASE_FRAMERATE;
+#endif
+
+    Q_snprintf(userinfo, MAX_INFO_STRING, "\\name\\bench%d\\skin\\male/grunt", index);
+    userinfo[strlen(userinfo) + 1] = 0;
+
+    sv_client = newcl;
+    sv_player = newcl->edict;
+    if (!ge->ClientConnect(newcl->edict, userinfo)) {
+        sv_client = NULL;
+        sv_player = NULL;
+        return NULL;
+    }
+
+    memset(&adr, 0, sizeof(adr));
+    Netchan_Setup(&newcl->netchan, NS_SERVER, NETCHAN_NEW, &adr, 0, MAX_PACKETLEN_WRITABLE, newcl->protocol);
+    newcl->numpackets = 1;
+
+    Q_strlcpy(newcl->userinfo, userinfo, sizeof(newcl->userinfo));
+    SV_UserinfoChanged(newcl);
+    newcl->rate = 0;
+
+    SV_InitClientSend(newcl);
+    newcl->WriteFrame = SV_WriteFrameToClient_Enhanced;
+
+    List_SeqAdd(&sv_clientlist, &newcl->entry);
+
+    newcl->state = cs_spawned;
+    newcl->framenum = 1;
+    newcl->lastframe = -1;
+    newcl->lastmessage = svs.realtime;
+    newcl->lastactivity = svs.realtime;
+
+    ge->ClientBegin(sv_player);
+    sv_client = NULL;
+    sv_player = NULL;
+
+    return newcl;
+}
+
+static unsigned SV_TimeSendFrames(int frames)
+{
+    unsigned start;
+    int i;
+
+    // warm up, this also (re)starts worker threads
+    SV_SendClientMessages();
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < frames; i++)
+        SV_SendClientMessages();
+
+    return Sys_Milliseconds() - start;
+}
+
+static void SV_SendBench_f(void)
+{
+    client_t *bench[MAX_CLIENTS];
+    int i, count, frames, threads, num_bench, old_threads;
+    unsigned serial_msec, threaded_msec;
+
+    if (sv.state != ss_game) {
+        Com_Printf("No game running.\n");
+        return;
+    }
+
+    count = Cmd_Argc() > 1 ? Q_clip(Q_atoi(Cmd_Argv(1)), 1, sv_maxclients->integer) : sv_maxclients->integer;
+    frames = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 10000) : 100;
+    threads = Cmd_Argc() > 3 ? Q_clip(Q_atoi(Cmd_Argv(3)), 1, 16) : 4;
+
+    old_threads = sv_threads->integer;
+    num_bench = 0;
+
+    Com_Printf("%d frames per run, %d threads\n", frames, threads);
+    Com_Printf("clients   serial ms/frame   threaded ms/frame\n");
+
+    for (i = 1; num_bench < count; i = min(i * 2, count)) {
+        while (num_bench < i) {
+            bench[num_bench] = SV_AddBenchClient(num_bench);
+            if (!bench[num_bench])
+                break;
+            num_bench++;
+        }
+        if (num_bench < i) {
+            Com_Printf("Out of client slots.\n");
+            break;
+        }
+
+        Cvar_SetInteger(sv_threads, 0, FROM_CODE);
+        serial_msec = SV_TimeSendFrames(frames);
+
+        Cvar_SetInteger(sv_threads, threads, FROM_CODE);
+        threaded_msec = SV_TimeSendFrames(frames);
+
+        Com_Printf("%7d   %15.3f   %17.3f\n", num_bench,
+                   (float)serial_msec / frames, (float)threaded_msec / frames);
+    }
+
+    Cvar_SetInteger(sv_threads, old_threads, FROM_CODE);
+
+    for (i = 0; i < num_bench; i++) {
+        SV_DropClient(bench[i], NULL);
+        SV_RemoveClient(bench[i]);
+    }
+}
+
+// compares frame sending time with and without sv_delta_cache. bench
+// clients acknowledge frames, so entities are delta encoded.
+static void SV_DeltaCacheBench_f(void)
+{
+    client_t *bench[MAX_CLIENTS];
+    int i, j, mode, count, frames, num_bench, saved;
+    uint64_t start, usec[2];
+
+    if (sv.state != ss_game) {
+        Com_Printf("No game running.\n");
+        return;
+    }
+
+    count = Cmd_Argc() > 1 ? Q_clip(Q_atoi(Cmd_Argv(1)), 1, sv_maxclients->integer) : sv_maxclients->integer;
+    frames = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 10000) : 100;
+
+    for (num_bench = 0; num_bench < count; num_bench++) {
+        bench[num_bench] = SV_AddBenchClient(num_bench);
+        if (!bench[num_bench])
+            break;
+    }
+
+    saved = sv_delta_cache->integer;
+
+    for (mode = 0; mode < 2; mode++) {
+        Cvar_SetInteger(sv_delta_cache, mode, FROM_CODE);
+        usec[mode] = 0;
+        for (i = 0; i < frames; i++) {
+            ge->RunFrame();
+            sv.framenum++;
+
+            for (j = 0; j < num_bench; j++)
+                bench[j]->lastframe = bench[j]->framenum - 1 - (j & 1);
+
+            start = Sys_Microseconds();
+            SV_SendClientMessages();
+            usec[mode] += Sys_Microseconds() - start;
+        }
+    }
+
+    Cvar_SetInteger(sv_delta_cache, saved, FROM_CODE);
+
+    Com_Printf("%d clients, %d frames\n", num_bench, frames);
+    Com_Printf("uncached: %.3f ms/frame\n", usec[0] * 0.001 / frames);
+    Com_Printf("cached:   %.3f ms/frame\n", usec[1] * 0.001 / frames);
+    Com_Printf("saved:    %.3f ms/frame\n", ((int64_t)usec[0] - (int64_t)usec[1]) * 0.001 / frames);
+
+    for (i = 0; i < num_bench; i++) {
+        SV_DropClient(bench[i], NULL);
+        SV_RemoveClient(bench[i]);
+    }
+}
+
+// scripted commands make every client run in circles, strafing, jumping
+// and firing periodically. random commands change every few frames.
+static void SV_BenchCommand(client_t *client, int index, int frame, bool random)
+{
+    usercmd_t *cmd = &client->lastcmd;
+
+    cmd->msec = SV_FRAMETIME;
+    cmd->impulse = 0;
+
+    if (random) {
+        if ((frame + index) % 5)
+            return;
+        cmd->angles[PITCH] = ANGLE2SHORT(crand() * 30);
+        cmd->angles[YAW] += ANGLE2SHORT(crand() * 45);
+        cmd->forwardmove = ((int)Q_rand_uniform(3) - 1) * 400;
+        cmd->sidemove = ((int)Q_rand_uniform(3) - 1) * 200;
+        cmd->upmove = Q_rand_uniform(8) ? 0 : 200;
+        cmd->buttons = Q_rand_uniform(4) ? 0 : BUTTON_ATTACK;
+        return;
+    }
+
+    frame += index * 7;
+    cmd->angles[PITCH] = 0;
+    cmd->angles[YAW] = ANGLE2SHORT(frame * 6 + index * 37);
+    cmd->forwardmove = 400;
+    cmd->sidemove = frame / 20 % 2 ? 200 : -200;
+    cmd->upmove = frame % 30 ? 0 : 200;
+    cmd->buttons = frame % 10 < 3 ? BUTTON_ATTACK : 0;
+}
+
+/*
+==================
+SV_Bench_f
+
+Loads the map, adds pseudo-clients driven by scripted or random commands,
+and runs the given number of frames back to back without any networking.
+Per-phase timings are collected by the frame profiler, bench client commands
+and ClientThink are timed as sv_bench_think.
+==================
+*/
+static void SV_Bench_f(void)
+{
+    client_t *bench[MAX_CLIENTS];
+    char saved[MAX_QPATH];
+    cvar_t *com_profile;
+    int i, j, count, frames, num_bench, zone;
+    uint64_t start, prof;
+    bool random;
+    float sec;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <mapname> [clients] [frames] [script|random]\n", Cmd_Argv(0));
+        return;
+    }
+
+    count = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 16;
+    frames = Cmd_Argc() > 3 ? Q_clip(Q_atoi(Cmd_Argv(3)), 1, 1000000) : 1000;
+    random = !strcmp(Cmd_Argv(4), "random");
+
+    // restart the game for each run
+    SV_Map(true);
+    if (sv.state != ss_game)
+        return;
+
+    count = Q_clip(count, 0, sv_maxclients->integer);
+    for (num_bench = 0; num_bench < count; num_bench++) {
+        bench[num_bench] = SV_AddBenchClient(num_bench);
+        if (!bench[num_bench])
+            break;
+    }
+    if (num_bench < count)
+        Com_WPrintf("Only %d of %d clients added.\n", num_bench, count);
+
+    com_profile = Cvar_Get("com_profile", "0", 0);
+    Q_strlcpy(saved, com_profile->string, sizeof(saved));
+    Cvar_SetInteger(com_profile, 1, FROM_CODE);
+    Prof_Reset();
+    zone = Prof_Register("sv_bench_think");
+
+    Q_srand(1);
+    if (!SV_SeedGameRandom(1))
+        Com_WPrintf("Game library can't be reseeded, runs may differ.\n");
+
+    start = Sys_Microseconds();
+    for (i = 0; i < frames; i++) {
+        // bench clients stand in for incoming packets
+        prof = Prof_Begin();
+        for (j = 0; j < num_bench; j++) {
+            if (bench[j]->state != cs_spawned)
+                continue;
+            // half of clients lag one more frame behind
+            bench[j]->lastframe = bench[j]->framenum - 1 - (j & 1);
+            SV_BenchCommand(bench[j], j, i, random);
+            bench[j]->lastmessage = svs.realtime;
+            bench[j]->lastactivity = svs.realtime;
+            sv_client = bench[j];
+            sv_player = bench[j]->edict;
+            ge->ClientThink(sv_player, &bench[j]->lastcmd);
+        }
+        sv_client = NULL;
+        sv_player = NULL;
+        Prof_End(zone, prof);
+
+        SV_RunFrame();
+    }
+    sec = (Sys_Microseconds() - start) * 1e-6f;
+
+    Com_Printf("%s, %d %s clients, %d frames: %.3f sec, %.1f frames/sec, %.3f ms/frame\n",
+               sv.name, num_bench, random ? "random" : "scripted", frames,
+               sec, frames / sec, sec * 1000 / frames);
+    Prof_PrintStats();
+
+    Cvar_Set("com_profile", saved);
+
+    for (i = 0; i < num_bench; i++) {
+        SV_DropClient(bench[i], NULL);
+        SV_RemoveClient(bench[i]);
+    }
+}
+
+#endif
+
 //===========================================================
 
 static const cmdreg_t c_server[] = {
@@ -1791,6 +2450,16 @@ static const cmdreg_t c_server[] = {
     { "mvdrecord", SV_Record_f, SV_Record_c },
     { "mvdstop", SV_Stop_f },
 #endif
+    { "sv_pvs_cache_stats", SV_PvsCacheStats_f },
+    { "sv_delta_cache_stats", SV_DeltaCacheStats_f },
+#if USE_TESTS
+    { "tracebench", SV_TraceBench_f },
+    { "areabench", SV_AreaBench_f },
+    { "spawnbench", SV_SpawnBench_f },
+    { "sendbench", SV_SendBench_f },
+    { "sv_bench", SV_Bench_f, SV_Map_c },
+    { "deltacachebench", SV_DeltaCacheBench_f },
+#endif
 
     { NULL }
 };
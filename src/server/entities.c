@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "server.h"
+#include "system/pthread.h"
 
 /*
 =============================================================================
@@ -31,6 +32,143 @@ Encode a client frame onto the network channel
 #define Q2PRO_OPTIMIZE(c) \
     ((c)->protocol == PROTOCOL_VERSION_Q2PRO && !(c)->settings[CLS_RECORDING])
 
+/*
+Per-frame cache of encoded entity deltas. Clients that acknowledged the same
+server frame mostly delta encode identical (from, to) pairs, so encoded bytes
+are kept keyed by entity number and server frame delta'ing from. Entity states
+can be customized per client, so both states and flags are compared before
+the cached bytes are reused. Each thread encoding frames has its own cache to
+avoid locking; main thread uses the static one.
+
+To estimate encode time saved by hits, every DELTA_TIME_SAMPLE-th miss is
+timed and kept if it gets stored. Sys_Microseconds is too coarse for a single
+delta, but truncation error averages out over many samples.
+*/
+
+#define DELTA_CACHE_SIZE    2048    // must be power of two
+#define DELTA_BASELINE      ~0U     // delta'ing from baseline
+#define DELTA_TIME_SAMPLE   8       // must be power of two
+
+typedef struct {
+    unsigned        framenum;       // sv.framenum + 1, 0 if unused
+    msgEsFlags_t    flags;
+    unsigned        size;
+    entity_packed_t to;
+    entity_packed_t from;
+    byte            data[MAX_PACKETENTITY_BYTES];
+} deltaentry_t;
+
+struct deltacache_s {
+    deltaentry_t    entries[DELTA_CACHE_SIZE];
+    unsigned        hits;
+    unsigned        misses;
+    size_t          bytes;
+    unsigned        timed;          // sampled misses
+    uint64_t        usec;           // time spent encoding them
+};
+
+static deltacache_t                 delta_cache_main;
+static q_thread_local deltacache_t  *delta_cache = &delta_cache_main;
+static pthread_mutex_t              delta_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+    uint64_t    frames;
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    bytes;
+    uint64_t    timed;
+    uint64_t    usec;
+    unsigned    framenum;
+} delta_cache_stats;
+
+deltacache_t *SV_CreateDeltaCache(void)
+{
+    return SV_Mallocz(sizeof(deltacache_t));
+}
+
+// called by each worker thread before encoding any frames
+void SV_SetDeltaCache(deltacache_t *cache)
+{
+    delta_cache = cache;
+}
+
+static void write_delta_entity(const entity_packed_t *from,
+                               const entity_packed_t *to,
+                               msgEsFlags_t flags, unsigned from_framenum)
+{
+    deltacache_t *cache = delta_cache;
+    deltaentry_t *e;
+    unsigned key, size, start;
+    bool timed;
+    uint64_t usec = 0;
+
+    if (!sv_delta_cache->integer) {
+        MSG_WriteDeltaEntity(from, to, flags);
+        return;
+    }
+
+    key = (to->number ^ from_framenum * 0x9e3779b1) & (DELTA_CACHE_SIZE - 1);
+    e = &cache->entries[key];
+    if (e->framenum == sv.framenum + 1 && e->flags == flags &&
+        !memcmp(&e->to, to, sizeof(*to)) && !memcmp(&e->from, from, sizeof(*from))) {
+        MSG_WriteData(e->data, e->size);
+        cache->hits++;
+        cache->bytes += e->size;
+        return;
+    }
+
+    timed = !(cache->misses & (DELTA_TIME_SAMPLE - 1));
+    if (timed)
+        usec = Sys_Microseconds();
+
+    start = msg_write.cursize;
+    MSG_WriteDeltaEntity(from, to, flags);
+    size = msg_write.cursize - start;
+    cache->misses++;
+
+    // unchanged entities are cheaper to check again than to look up
+    if (!size || size > sizeof(e->data) || msg_write.overflowed)
+        return;
+
+    if (timed) {
+        cache->usec += Sys_Microseconds() - usec;
+        cache->timed++;
+    }
+
+    e->from = *from;
+    e->to = *to;
+    e->framenum = sv.framenum + 1;
+    e->flags = flags;
+    e->size = size;
+    memcpy(e->data, msg_write.data + start, size);
+}
+
+// merges counters of the calling thread into global statistics
+static void flush_delta_stats(void)
+{
+    deltacache_t *cache = delta_cache;
+
+    if (!cache->hits && !cache->misses)
+        return;
+
+    pthread_mutex_lock(&delta_cache_lock);
+    if (delta_cache_stats.framenum != sv.framenum + 1) {
+        delta_cache_stats.framenum = sv.framenum + 1;
+        delta_cache_stats.frames++;
+    }
+    delta_cache_stats.hits += cache->hits;
+    delta_cache_stats.misses += cache->misses;
+    delta_cache_stats.bytes += cache->bytes;
+    delta_cache_stats.timed += cache->timed;
+    delta_cache_stats.usec += cache->usec;
+    pthread_mutex_unlock(&delta_cache_lock);
+
+    cache->hits = cache->misses = 0;
+    cache->bytes = 0;
+    cache->timed = 0;
+    cache->usec = 0;
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -46,19 +184,23 @@ static void SV_EmitPacketEntities(client_t         *client,
     entity_packed_t *newent;
     const entity_packed_t *oldent;
     int i, oldnum, newnum, oldindex, newindex, from_num_entities;
+    unsigned from_framenum;
     msgEsFlags_t flags;
 
-    if (!from)
+    if (!from) {
         from_num_entities = 0;
-    else
+        from_framenum = DELTA_BASELINE;
+    } else {
         from_num_entities = from->num_entities;
+        from_framenum = from->sv_framenum;
+    }
 
     newindex = 0;
     oldindex = 0;
     oldent = newent = NULL;
     while (newindex < to->num_entities || oldindex < from_num_entities) {
         if (msg_write.cursize + MAX_PACKETENTITY_BYTES > msg_write.maxsize) {
-            Com_WPrintf("%s: frame got too large, aborting.\n", __func__);
+            SV_FrameWPrintf("%s: frame got too large, aborting.\n", __func__);
             break;
         }
 
@@ -96,7 +238,7 @@ static void SV_EmitPacketEntities(client_t         *client,
             if (Q2PRO_SHORTANGLES(client, newnum)) {
                 flags |= MSG_ES_SHORTANGLES;
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            write_delta_entity(oldent, newent, flags, from_framenum);
             oldindex++;
             newindex++;
             continue;
@@ -119,7 +261,7 @@ static void SV_EmitPacketEntities(client_t         *client,
             if (Q2PRO_SHORTANGLES(client, newnum)) {
                 flags |= MSG_ES_SHORTANGLES;
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            write_delta_entity(oldent, newent, flags, DELTA_BASELINE);
             newindex++;
             continue;
         }
@@ -133,6 +275,8 @@ static void SV_EmitPacketEntities(client_t         *client,
     }
 
     MSG_WriteShort(0);      // end of packetentities
+
+    flush_delta_stats();
 }
 
 static client_frame_t *get_last_frame(client_t *client)
@@ -149,7 +293,7 @@ static client_frame_t *get_last_frame(client_t *client)
 
     if (client->framenum - client->lastframe >= UPDATE_BACKUP) {
         // client hasn't gotten a good message through in a long time
-        Com_DPrintf("%s: delta request from out-of-date packet.\n", client->name);
+        SV_FrameDPrintf("%s: delta request from out-of-date packet.\n", client->name);
         return NULL;
     }
 
@@ -157,13 +301,13 @@ static client_frame_t *get_last_frame(client_t *client)
     frame = &client->frames[client->lastframe & UPDATE_MASK];
     if (frame->number != client->lastframe) {
         // but it got never sent
-        Com_DPrintf("%s: delta request from dropped frame.\n", client->name);
+        SV_FrameDPrintf("%s: delta request from dropped frame.\n", client->name);
         return NULL;
     }
 
     if (svs.next_entity - frame->first_entity > svs.num_entities) {
         // but entities are too old
-        Com_DPrintf("%s: delta request from out-of-date entities.\n", client->name);
+        SV_FrameDPrintf("%s: delta request from out-of-date entities.\n", client->name);
         return NULL;
     }
 
@@ -374,7 +518,7 @@ fix_old_origin(client_t *client, entity_packed_t *state, edict_t *ent, int e)
 }
 #endif
 
-static bool SV_EntityVisible(client_t *client, edict_t *ent, byte *mask)
+static bool SV_EntityVisible(client_t *client, edict_t *ent, const byte *mask)
 {
     if (ent->num_clusters == -1)
         // too many leafs for individual check, go by headnode
@@ -399,15 +543,284 @@ static bool SV_EntityAttenuatedAway(vec3_t org, edict_t *ent)
     return (dist - SOUND_FULLVOLUME) * dist_mult > 1.0f;
 }
 
+/*
+=============================================================================
+
+Per-frame cache of PVS and PHS masks. Clients standing in the same set of
+clusters share one mask instead of rebuilding it from vis rows each time.
+Masks stay valid until SV_ClearVisCache is called at the start of the next
+frame, so they are handed out by pointer. Lookups are locked only when frames
+are built by worker threads.
+
+=============================================================================
+*/
+
+#define VIS_CACHE_SIZE  128     // masks per frame
+#define VIS_CACHE_HASH  256     // must be power of two
+
+typedef struct {
+    bsp_t   *bsp;
+    int     vis;
+    int     numclusters;
+    int     clusters[CM_MAX_FATCLUSTERS];
+    int     next;
+} viscache_t;
+
+static viscache_t       vis_cache[VIS_CACHE_SIZE];
+static int              vis_cache_hash[VIS_CACHE_HASH];
+static int              vis_cache_count;
+static size_t           vis_cache_masks[VIS_CACHE_SIZE][VIS_MAX_BYTES / sizeof(size_t)];
+static pthread_mutex_t  vis_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool             vis_cache_threaded;
+
+static struct {
+    uint64_t    frames;
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    overflows;
+    int         peak;
+} vis_cache_stats;
+
+void SV_ClearVisCache(bool threaded)
+{
+    vis_cache_threaded = threaded;
+
+    if (vis_cache_count > vis_cache_stats.peak)
+        vis_cache_stats.peak = vis_cache_count;
+
+    memset(vis_cache_hash, -1, sizeof(vis_cache_hash));
+    vis_cache_count = 0;
+    vis_cache_stats.frames++;
+}
+
+static unsigned vis_cache_key(int vis, const int *clusters, int numclusters)
+{
+    unsigned hash = vis;
+
+    for (int i = 0; i < numclusters; i++)
+        hash = (hash ^ clusters[i]) * 0x9e3779b1;
+
+    return (hash >> 16) & (VIS_CACHE_HASH - 1);
+}
+
+static byte *union_vis(bsp_t *bsp, byte *mask, const int *clusters, int numclusters, int vis)
+{
+    byte    temp[VIS_MAX_BYTES];
+    int     i, j, longs;
+    size_t  *src, *dst;
+
+    BSP_ClusterVis(bsp, mask, clusters[0], vis);
+    longs = VIS_FAST_LONGS(bsp);
+
+    for (i = 1; i < numclusters; i++) {
+        src = (size_t *)BSP_ClusterVis(bsp, temp, clusters[i], vis);
+        dst = (size_t *)mask;
+        for (j = 0; j < longs; j++) {
+            *dst++ |= *src++;
+        }
+    }
+
+    return mask;
+}
+
+// returns union of vis rows of given clusters, either cached or built in mask
+static const byte *SV_CachedVis(bsp_t *bsp, byte *mask, const int *clusters, int numclusters, int vis)
+{
+    unsigned key = vis_cache_key(vis, clusters, numclusters);
+    const byte *ret = NULL;
+    viscache_t *c;
+    int i;
+
+    if (vis_cache_threaded)
+        pthread_mutex_lock(&vis_cache_lock);
+    for (i = vis_cache_hash[key]; i != -1; i = c->next) {
+        c = &vis_cache[i];
+        if (c->bsp == bsp && c->vis == vis && c->numclusters == numclusters &&
+            !memcmp(c->clusters, clusters, sizeof(clusters[0]) * numclusters)) {
+            ret = (const byte *)vis_cache_masks[i];
+            vis_cache_stats.hits++;
+            break;
+        }
+    }
+    if (vis_cache_threaded)
+        pthread_mutex_unlock(&vis_cache_lock);
+
+    if (ret)
+        return ret;
+
+    // build it outside of the lock
+    union_vis(bsp, mask, clusters, numclusters, vis);
+
+    if (vis_cache_threaded)
+        pthread_mutex_lock(&vis_cache_lock);
+    vis_cache_stats.misses++;
+    if (vis_cache_count < VIS_CACHE_SIZE) {
+        i = vis_cache_count++;
+        c = &vis_cache[i];
+        c->bsp = bsp;
+        c->vis = vis;
+        c->numclusters = numclusters;
+        memcpy(c->clusters, clusters, sizeof(clusters[0]) * numclusters);
+        memcpy(vis_cache_masks[i], mask, bsp->visrowsize);
+        c->next = vis_cache_hash[key];
+        vis_cache_hash[key] = i;
+    } else {
+        vis_cache_stats.overflows++;
+    }
+    if (vis_cache_threaded)
+        pthread_mutex_unlock(&vis_cache_lock);
+
+    return mask;
+}
+
+static const byte *SV_FatPVS(client_t *client, byte *mask, const vec3_t org)
+{
+    int clusters[CM_MAX_FATCLUSTERS];
+    int numclusters;
+
+    if (!sv_pvs_cache->integer || !client->cm->cache || !client->cm->cache->vis)
+        return CM_FatPVS(client->cm, mask, org, DVIS_PVS2);
+
+    numclusters = CM_FatClusters(client->cm, org, clusters);
+    return SV_CachedVis(client->cm->cache, mask, clusters, numclusters, DVIS_PVS2);
+}
+
+static const byte *SV_ClusterVis(client_t *client, byte *mask, int cluster, int vis)
+{
+    if (!sv_pvs_cache->integer || !client->cm->cache || !client->cm->cache->vis)
+        return BSP_ClusterVis(client->cm->cache, mask, cluster, vis);
+
+    return SV_CachedVis(client->cm->cache, mask, &cluster, 1, vis);
+}
+
+void SV_PvsCacheStats_f(void)
+{
+    uint64_t lookups = vis_cache_stats.hits + vis_cache_stats.misses;
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&vis_cache_stats, 0, sizeof(vis_cache_stats));
+        return;
+    }
+
+    Com_Printf("Frames: %"PRIu64"\n", vis_cache_stats.frames);
+    Com_Printf("Lookups: %"PRIu64" (%.1f per frame)\n", lookups,
+               vis_cache_stats.frames ? (double)lookups / vis_cache_stats.frames : 0.0);
+    Com_Printf("Hits: %"PRIu64" (%.1f%%)\n", vis_cache_stats.hits,
+               lookups ? vis_cache_stats.hits * 100.0 / lookups : 0.0);
+    Com_Printf("Misses: %"PRIu64" (%"PRIu64" not cached)\n",
+               vis_cache_stats.misses, vis_cache_stats.overflows);
+    Com_Printf("Peak entries: %d/%d\n", vis_cache_stats.peak, VIS_CACHE_SIZE);
+}
+
+void SV_DeltaCacheStats_f(void)
+{
+    uint64_t lookups = delta_cache_stats.hits + delta_cache_stats.misses;
+    uint64_t frames = max(delta_cache_stats.frames, 1);
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&delta_cache_stats, 0, sizeof(delta_cache_stats));
+        return;
+    }
+
+    Com_Printf("Frames: %"PRIu64"\n", delta_cache_stats.frames);
+    Com_Printf("Lookups: %"PRIu64" (%.1f per frame)\n", lookups, (double)lookups / frames);
+    Com_Printf("Hits: %"PRIu64" (%.1f%%, %.1f per frame)\n", delta_cache_stats.hits,
+               lookups ? delta_cache_stats.hits * 100.0 / lookups : 0.0,
+               (double)delta_cache_stats.hits / frames);
+    Com_Printf("Reused bytes: %"PRIu64" (%.1f per frame)\n", delta_cache_stats.bytes,
+               (double)delta_cache_stats.bytes / frames);
+    if (delta_cache_stats.timed) {
+        double encode = (double)delta_cache_stats.usec / delta_cache_stats.timed;
+        double saved = encode * delta_cache_stats.hits;
+        Com_Printf("Encode time: %.3f usec per delta (%"PRIu64" sampled)\n",
+                   encode, delta_cache_stats.timed);
+        Com_Printf("Encode time saved: %.1f msec (%.3f msec per frame)\n",
+                   saved * 0.001, saved * 0.001 / frames);
+    }
+}
+
+/*
+=============
+SV_MaxPacketEntities
+
+Returns maximum number of entities in client frame. When frames are built
+by worker threads each one reserves this many states up front, so it never
+exceeds per client share of svs.entities, which SV_InitGame sizes for the
+protocol limit. Otherwise frames can't overlap and sv_max_packet_entities
+is used as is.
+=============
+*/
+int SV_MaxPacketEntities(client_t *client)
+{
+    int max_packet_entities;
+
+    if (sv_max_packet_entities->integer > 0)
+        max_packet_entities = sv_max_packet_entities->integer;
+    else
+        max_packet_entities = client->csr->extended ? MAX_PACKET_ENTITIES : MAX_PACKET_ENTITIES_OLD;
+
+    if (sv_threads->integer > 0)
+        max_packet_entities = min(max_packet_entities, svs.num_entities / (sv_maxclients->integer * UPDATE_BACKUP));
+
+    return max_packet_entities;
+}
+
+/*
+=============
+SV_FixEntityNumbers
+
+Fixes up entity numbers of edicts that may be sent to clients. Called on
+main thread before building client frames, which must not write to edicts.
+=============
+*/
+void SV_FixEntityNumbers(const game_export_t *ge)
+{
+    edict_t *ent;
+    int e;
+
+    for (e = 1; e < ge->num_edicts; e++) {
+        ent = EDICT_NUM2(ge, e);
+        if (ent->s.number == e)
+            continue;
+        if (!ent->inuse && (g_features->integer & GMF_PROPERINUSE))
+            continue;
+        if ((ent->svflags & SVF_NOCLIENT) || !HAS_EFFECTS(ent))
+            continue;
+
+        Com_WPrintf("%s: fixing ent->s.number: %d to %d\n",
+                    __func__, ent->s.number, e);
+        ent->s.number = e;
+    }
+}
+
+// CM_AreasConnected prints on bad areas, check them here instead
+static bool areas_connected(client_t *client, int area1, int area2)
+{
+    bsp_t *cache = client->cm->cache;
+
+    if (cache && (area1 >= cache->numareas || area2 >= cache->numareas)) {
+        SV_FrameWPrintf("%s: area > numareas\n", __func__);
+        return false;
+    }
+
+    return CM_AreasConnected(client->cm, area1, area2);
+}
+
 /*
 =============
 SV_BuildClientFrame
 
 Decides which entities are going to be visible to the client, and
 copies off the playerstat and areabits.
+
+Entity states are stored into the circular svs.entities array starting at
+first_entity. Returns the number of states used. Doesn't modify any global
+server state, so frames for different clients can be built in parallel as
+long as their ranges don't overlap. For the same reason, this and frame
+writing functions print with SV_FramePrintf and never call Com_Error.
 =============
 */
-void SV_BuildClientFrame(client_t *client)
+int SV_BuildClientFrame(client_t *client, unsigned first_entity)
 {
     int         e;
     vec3_t      org;
@@ -419,20 +832,22 @@ void SV_BuildClientFrame(client_t *client)
 	entity_state_t  es;
     int         clientarea, clientcluster;
     mleaf_t     *leaf;
-    byte        clientphs[VIS_MAX_BYTES];
-    byte        clientpvs[VIS_MAX_BYTES];
+    byte        phsbuf[VIS_MAX_BYTES];
+    byte        pvsbuf[VIS_MAX_BYTES];
+    const byte  *clientphs, *clientpvs;
     bool    ent_visible;
-    int cull_nonvisible_entities = Cvar_Get("sv_cull_nonvisible_entities", "1", CVAR_CHEAT)->integer;
+    int cull_nonvisible_entities = sv_cull_nonvisible_entities->integer;
     bool        need_clientnum_fix;
     int         max_packet_entities;
 
     clent = client->edict;
     if (!clent->client)
-        return;        // not in game yet
+        return 0;       // not in game yet
 
     // this is the frame we are creating
     frame = &client->frames[client->framenum & UPDATE_MASK];
     frame->number = client->framenum;
+    frame->sv_framenum = sv.framenum;
     frame->sentTime = com_eventTime; // save it for ping calc later
     frame->latency = -1; // not yet acked
 
@@ -460,7 +875,7 @@ void SV_BuildClientFrame(client_t *client)
     if (g_features->integer & GMF_CLIENTNUM) {
         frame->clientNum = clent->client->clientNum;
         if (!VALIDATE_CLIENTNUM(client->csr, frame->clientNum)) {
-            Com_WPrintf("%s: bad clientNum %d for client %d\n",
+            SV_FrameWPrintf("%s: bad clientNum %d for client %d\n",
                         __func__, frame->clientNum, client->number);
             frame->clientNum = client->number;
         }
@@ -474,24 +889,27 @@ void SV_BuildClientFrame(client_t *client)
         && frame->clientNum >= CLIENTNUM_NONE;
 
     // limit maximum number of entities in client frame
-    max_packet_entities =
-        sv_max_packet_entities->integer > 0 ? sv_max_packet_entities->integer :
-        client->csr->extended ? MAX_PACKET_ENTITIES : MAX_PACKET_ENTITIES_OLD;
+    max_packet_entities = SV_MaxPacketEntities(client);
 
 	if (clientcluster >= 0)
 	{
-		CM_FatPVS(client->cm, clientpvs, org, DVIS_PVS2);
+		clientpvs = SV_FatPVS(client, pvsbuf, org);
 		client->last_valid_cluster = clientcluster;
 	}
 	else
 	{
-		BSP_ClusterVis(client->cm->cache, clientpvs, client->last_valid_cluster, DVIS_PVS2);
+		// may be left over from previous map, BSP_ClusterVis would error out
+		if (client->cm->cache && client->cm->cache->vis &&
+			client->last_valid_cluster >= client->cm->cache->vis->numclusters)
+			client->last_valid_cluster = -1;
+
+		clientpvs = SV_ClusterVis(client, pvsbuf, client->last_valid_cluster, DVIS_PVS2);
 	}
-    BSP_ClusterVis(client->cm->cache, clientphs, clientcluster, DVIS_PHS);
+    clientphs = SV_ClusterVis(client, phsbuf, clientcluster, DVIS_PHS);
 
     // build up the list of visible entities
     frame->num_entities = 0;
-    frame->first_entity = svs.next_entity;
+    frame->first_entity = first_entity;
 
     for (e = 1; e < client->ge->num_edicts; e++) {
         ent = EDICT_NUM2(client->ge, e);
@@ -519,10 +937,10 @@ void SV_BuildClientFrame(client_t *client)
         // ignore if not touching a PV leaf
         if (ent != clent && !(client->csr->extended && ent->svflags & SVF_NOCULL)) {
             // check area
-			if (clientcluster >= 0 && !CM_AreasConnected(client->cm, clientarea, ent->areanum)) {
+			if (clientcluster >= 0 && !areas_connected(client, clientarea, ent->areanum)) {
                 // doors can legally straddle two areas, so
                 // we may need to check another one
-                if (!CM_AreasConnected(client->cm, clientarea, ent->areanum2)) {
+                if (!areas_connected(client, clientarea, ent->areanum2)) {
                     ent_visible = false;        // blocked by a door
                 }
             }
@@ -553,12 +971,6 @@ void SV_BuildClientFrame(client_t *client)
 
         if(!ent_visible && (!sv_novis->integer || !ent->s.modelindex))
             continue;
-        
-		if (ent->s.number != e) {
-			Com_WPrintf("%s: fixing ent->s.number: %d to %d\n",
-				__func__, ent->s.number, e);
-			ent->s.number = e;
-		}
 
 		memcpy(&es, &ent->s, sizeof(entity_state_t));
 
@@ -568,7 +980,7 @@ void SV_BuildClientFrame(client_t *client)
 		}
 
         // add it to the circular client_entities array
-        state = &svs.entities[svs.next_entity % svs.num_entities];
+        state = &svs.entities[(first_entity + frame->num_entities) % svs.num_entities];
         MSG_PackEntity(state, &ent->s, ENT_EXTENSION(client->csr, ent));
 
 #if USE_FPS
@@ -605,8 +1017,6 @@ void SV_BuildClientFrame(client_t *client)
             state->solid = sv.entities[e].solid32;
         }
 
-        svs.next_entity++;
-
         if (++frame->num_entities == max_packet_entities) {
             break;
         }
@@ -614,5 +1024,7 @@ void SV_BuildClientFrame(client_t *client)
 
     if (need_clientnum_fix)
         frame->clientNum = client->slot;
+
+    return frame->num_entities;
 }
 
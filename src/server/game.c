@@ -836,10 +836,34 @@ static const game_import_ex_t game_import_ex = {
 
     .ErrorString = Q_ErrorString,
     .TagRealloc = PF_TagRealloc,
+
+    .TraceBatch = SV_TraceBatch,
+    .WriteFileAsync = SV_WriteFileAsync,
+
+    .ProfRegister = Prof_Register,
+    .ProfBegin = Prof_Begin,
+    .ProfEnd = Prof_End,
 };
 
 static void *game_library;
 
+/*
+===============
+SV_SeedGameRandom
+
+Reseeds random number generator of the game library, if it supports that.
+Used by benchmarks that must be repeatable.
+===============
+*/
+bool SV_SeedGameRandom(uint32_t seed)
+{
+    if (!gex || gex->apiversion < 5 || !gex->SeedRandom)
+        return false;
+
+    gex->SeedRandom(seed);
+    return true;
+}
+
 /*
 ===============
 SV_ShutdownGameProgs
@@ -83,6 +83,11 @@ cvar_t  *sv_calcpings_method;
 cvar_t  *sv_changemapcmd;
 cvar_t  *sv_max_download_size;
 cvar_t  *sv_max_packet_entities;
+cvar_t  *sv_area_index;
+cvar_t  *sv_cull_nonvisible_entities;
+cvar_t  *sv_pvs_cache;
+cvar_t  *sv_delta_cache;
+cvar_t  *sv_threads;
 
 cvar_t  *sv_strafejump_hack;
 cvar_t  *sv_waterjump_hack;
@@ -1778,15 +1783,21 @@ SV_RunGameFrame
 */
 static void SV_RunGameFrame(void)
 {
+    uint64_t prof;
+
     // save the entire world state if recording a serverdemo
+    prof = Prof_Begin();
     SV_MvdBeginFrame();
+    Prof_End(PROF_SV_MVD, prof);
 
 #if USE_CLIENT
     if (host_speeds->integer)
         time_before_game = Sys_Milliseconds();
 #endif
 
+    prof = Prof_Begin();
     ge->RunFrame();
+    Prof_End(PROF_SV_GAME, prof);
 
 #if USE_CLIENT
     if (host_speeds->integer)
@@ -1801,7 +1812,9 @@ static void SV_RunGameFrame(void)
     }
 
     // save the entire world state if recording a serverdemo
+    prof = Prof_Begin();
     SV_MvdEndFrame();
+    Prof_End(PROF_SV_MVD, prof);
 }
 
 /*
@@ -1888,6 +1901,50 @@ static void SV_MasterShutdown(void)
     }
 }
 
+/*
+==================
+SV_RunFrame
+
+Runs one server frame: game logic, then client updates.
+Also used by sv_bench to run frames back to back.
+==================
+*/
+void SV_RunFrame(void)
+{
+    uint64_t prof, prof_frame;
+
+    prof_frame = Prof_Begin();
+
+    // check timeouts
+    SV_CheckTimeouts();
+
+    // update ping based on the last known frame from all clients
+    SV_CalcPings();
+
+    // give the clients some timeslices
+    SV_GiveMsec();
+
+    // let everything in the world think and move
+    SV_RunGameFrame();
+
+    // send messages back to the UDP clients
+    prof = Prof_Begin();
+    SV_SendClientMessages();
+    Prof_End(PROF_SV_SEND, prof);
+
+    // send a heartbeat to the master if needed
+    SV_MasterHeartbeat();
+
+    // clear teleport flags, etc for next frame
+    SV_PrepWorldFrame();
+
+    // advance for next frame
+    sv.framenum++;
+
+    Prof_End(PROF_SV_FRAME, prof_frame);
+    Prof_EndFrame();
+}
+
 /*
 ==================
 SV_Frame
@@ -1900,6 +1957,8 @@ Returns amount of extra frametime available for sleeping on IO.
 */
 unsigned SV_Frame(unsigned msec)
 {
+    uint64_t prof;
+
 #if USE_CLIENT
     time_before_game = time_after_game = 0;
 #endif
@@ -1918,14 +1977,18 @@ unsigned SV_Frame(unsigned msec)
 #endif
 
     // read packets from UDP clients
+    prof = Prof_Begin();
     NET_GetPackets(NS_SERVER, SV_PacketEvent);
+    Prof_End(PROF_SV_PACKETS, prof);
 
     if (svs.initialized) {
         // run connection to the anticheat server
         AC_Run();
 
         // run connections from MVD/GTV clients
+        prof = Prof_Begin();
         SV_MvdRunClients();
+        Prof_End(PROF_SV_GTV, prof);
 
         // deliver fragments and reliable messages for connecting clients
         SV_SendAsyncPackets();
@@ -1938,29 +2001,7 @@ unsigned SV_Frame(unsigned msec)
     }
 
     if (svs.initialized && !check_paused()) {
-        // check timeouts
-        SV_CheckTimeouts();
-
-        // update ping based on the last known frame from all clients
-        SV_CalcPings();
-
-        // give the clients some timeslices
-        SV_GiveMsec();
-
-        // let everything in the world think and move
-        SV_RunGameFrame();
-
-        // send messages back to the UDP clients
-        SV_SendClientMessages();
-
-        // send a heartbeat to the master if needed
-        SV_MasterHeartbeat();
-
-        // clear teleport flags, etc for next frame
-        SV_PrepWorldFrame();
-
-        // advance for next frame
-        sv.framenum++;
+        SV_RunFrame();
     }
 
     if (COM_DEDICATED) {
@@ -2120,6 +2161,11 @@ static void sv_namechange_limit_changed(cvar_t *self)
     }
 }
 
+static void sv_area_index_changed(cvar_t *self)
+{
+    SV_SetAreaIndex(self->integer);
+}
+
 #if USE_SYSCON
 static void sv_hostname_changed(cvar_t *self)
 {
@@ -2224,6 +2270,12 @@ void SV_Init(void)
     sv_changemapcmd = Cvar_Get("sv_changemapcmd", "", 0);
     sv_max_download_size = Cvar_Get("sv_max_download_size", "8388608", 0);
     sv_max_packet_entities = Cvar_Get("sv_max_packet_entities", "0", 0);
+    sv_area_index = Cvar_Get("sv_area_index", "0", 0);
+    sv_area_index->changed = sv_area_index_changed;
+    sv_cull_nonvisible_entities = Cvar_Get("sv_cull_nonvisible_entities", "1", CVAR_CHEAT);
+    sv_pvs_cache = Cvar_Get("sv_pvs_cache", "1", 0);
+    sv_delta_cache = Cvar_Get("sv_delta_cache", "1", 0);
+    sv_threads = Cvar_Get("sv_threads", "0", 0);
 
     sv_strafejump_hack = Cvar_Get("sv_strafejump_hack", "1", CVAR_LATCH);
     sv_waterjump_hack = Cvar_Get("sv_waterjump_hack", "1", CVAR_LATCH);
@@ -2358,6 +2410,16 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
     if (!sv_registered)
         return;
 
+    // stop frame building threads before anything they use is freed
+    SV_ShutdownSendThreads();
+
+    // Com_Error may have longjmp'd out of SV_SendClientMessages with
+    // packets still batched, send them and go back to unbatched sending
+    NET_FlushSendBatch(NS_SERVER);
+
+    // finish writing savegame
+    SV_WaitSavegame();
+
     R_ClearDebugLines();    // for local system
 
 #if USE_MVD_CLIENT
@@ -2378,6 +2440,7 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
     SV_ShutdownGameProgs();
 
     // free current level
+    SV_ShutdownWorld();
     CM_FreeMap(&sv.cm);
     memset(&sv, 0, sizeof(sv));
 
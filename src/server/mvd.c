@@ -22,6 +22,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "server.h"
 #include "server/mvd/protocol.h"
+#include "common/async.h"
+
+#if USE_TESTS && USE_ZLIB && !defined(_WIN32)
+#include <sys/socket.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define FOR_EACH_GTV(client) \
     LIST_FOR_EACH(gtv_client_t, client, &gtv_client_list, entry)
@@ -29,6 +37,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define FOR_EACH_ACTIVE_GTV(client) \
     LIST_FOR_EACH(gtv_client_t, client, &gtv_active_list, active)
 
+// shared deflate stream is reset this often to let new clients join it
+#define GTV_KEYFRAME_INTERVAL   (5 * BASE_FRAMERATE)
+
 typedef struct {
     list_t      entry;
     list_t      active;
@@ -36,7 +47,10 @@ typedef struct {
     netstream_t stream;
 #if USE_ZLIB
     z_stream    z;
+    uLong       adler;      // of all data deflated so far
+    bool        shared;     // deflated stream is in sync with shared one
 #endif
+    const char  *senderr;   // set by send job
     unsigned    msglen;
     unsigned    lastmessage;
 
@@ -51,6 +65,23 @@ typedef struct {
     char        version[MAX_QPATH];
 } gtv_client_t;
 
+// Frame is encoded and deflated only once, then appended to each client
+// send buffer by worker thread. Clients that have deflate enabled join the
+// shared stream at keyframes, and fall back to private deflater after any
+// private message until the next keyframe.
+typedef struct {
+    byte        *data;      // raw frame
+    size_t      len;
+#if USE_ZLIB
+    byte        *zdata;     // frame deflated by shared stream
+    size_t      zlen;
+    size_t      zsize;
+    uLong       adler;      // of raw frame
+    bool        deflate;    // shared stream is in use
+    bool        keyframe;   // shared stream was reset before this frame
+#endif
+} gtv_chunk_t;
+
 typedef struct {
     bool            enabled;
     bool            active;
@@ -79,6 +110,14 @@ typedef struct {
 
     // TCP client pool
     gtv_client_t    *clients; // [sv_mvd_maxclients]
+
+    // frame being sent by worker thread
+    gtv_chunk_t     chunk;
+    asynchandle_t   send_job;
+#if USE_ZLIB
+    z_stream        z;          // shared raw deflater
+    unsigned        zframes;    // since last keyframe
+#endif
 } mvd_server_t;
 
 static mvd_server_t     mvd;
@@ -117,7 +156,10 @@ static void     write_stream(gtv_client_t *client, void *data, size_t len);
 static void     write_message(gtv_client_t *client, gtv_serverop_t op);
 #if USE_ZLIB
 static void     flush_stream(gtv_client_t *client, int flush);
+static const char *deflate_stream(gtv_client_t *client, const void *data, size_t len, int flush);
 #endif
+static void     drop_client(gtv_client_t *client, const char *error);
+static void     remove_client(gtv_client_t *client);
 
 static void     rec_stop(void);
 static bool     rec_allowed(void);
@@ -988,6 +1030,221 @@ fail:
     rec_stop();
 }
 
+#if USE_ZLIB
+static bool init_shared_stream(void)
+{
+    gtv_chunk_t *chunk = &mvd.chunk;
+    z_streamp z = &mvd.z;
+
+    if (z->state) {
+        return true;
+    }
+
+    // raw stream, zlib header and trailer are private to each client
+    z->zalloc = SV_zalloc;
+    z->zfree = SV_zfree;
+    if (deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        Com_EPrintf("Couldn't initialize shared MVD stream: %s\n", z->msg);
+        return false;
+    }
+
+    // leave space for sync flush marker
+    chunk->zsize = deflateBound(z, MAX_MSGLEN) + 16;
+    chunk->zdata = SV_Malloc(chunk->zsize);
+    mvd.zframes = 0;
+    return true;
+}
+
+// called from worker thread
+static bool deflate_chunk(gtv_chunk_t *chunk)
+{
+    z_streamp z = &mvd.z;
+
+    if (chunk->keyframe && deflateReset(z) != Z_OK) {
+        return false;
+    }
+
+    z->next_in = chunk->data;
+    z->avail_in = (uInt)chunk->len;
+    z->next_out = chunk->zdata;
+    z->avail_out = (uInt)chunk->zsize;
+
+    // always end on byte boundary so that clients can leave at any frame
+    if (deflate(z, Z_SYNC_FLUSH) != Z_OK || z->avail_in || !z->avail_out) {
+        return false;
+    }
+
+    chunk->zlen = chunk->zsize - z->avail_out;
+    chunk->adler = adler32(adler32(0, Z_NULL, 0), chunk->data, (uInt)chunk->len);
+    return true;
+}
+#endif
+
+// called from worker thread
+static const char *send_chunk(gtv_client_t *client, const gtv_chunk_t *chunk)
+{
+    fifo_t *fifo = &client->stream.send;
+
+#if USE_ZLIB
+    if (client->z.state) {
+        const char *error;
+
+        // full flush makes private stream byte aligned and independent of
+        // previous data, after that shared stream can be appended to it
+        if (chunk->deflate && chunk->keyframe && !client->shared) {
+            error = deflate_stream(client, NULL, 0, Z_FULL_FLUSH);
+            if (error) {
+                return error;
+            }
+            client->shared = true;
+        }
+
+        if (chunk->deflate && client->shared) {
+            if (FIFO_Write(fifo, chunk->zdata, chunk->zlen) != chunk->zlen) {
+                return "overflowed";
+            }
+            client->adler = adler32_combine(client->adler, chunk->adler, chunk->len);
+            client->bufcount = 0;
+            return NULL;
+        }
+
+        client->shared = false;
+        error = deflate_stream(client, chunk->data, chunk->len, Z_NO_FLUSH);
+        if (!error && ++client->bufcount > client->maxbuf) {
+            error = deflate_stream(client, NULL, 0, Z_SYNC_FLUSH);
+        }
+        return error;
+    }
+#endif
+
+    if (FIFO_Write(fifo, chunk->data, chunk->len) != chunk->len) {
+        return "overflowed";
+    }
+
+    return NULL;
+}
+
+// called from worker thread
+static void send_job_work(void *arg)
+{
+    gtv_chunk_t *chunk = arg;
+    gtv_client_t *client;
+    neterr_t ret;
+
+#if USE_ZLIB
+    if (chunk->deflate && !deflate_chunk(chunk)) {
+        chunk->deflate = false;
+        mvd.zframes = 0;
+    }
+#endif
+
+    FOR_EACH_ACTIVE_GTV(client) {
+        client->senderr = send_chunk(client, chunk);
+        if (client->senderr) {
+            continue;
+        }
+        ret = NET_SendStream(&client->stream);
+        if (ret == NET_ERROR || ret == NET_CLOSED) {
+            client->senderr = "connection reset by peer";
+        }
+    }
+}
+
+static void send_job_done(void *arg)
+{
+    gtv_client_t *client, *next;
+
+    mvd.send_job = 0;
+
+    LIST_FOR_EACH_SAFE(gtv_client_t, client, next, &gtv_active_list, active) {
+        if (client->senderr) {
+            drop_client(client, client->senderr);
+            client->senderr = NULL;
+            if (client->stream.state != NS_CONNECTED) {
+                remove_client(client);
+                continue;
+            }
+        }
+        NET_UpdateStream(&client->stream);
+    }
+}
+
+// GTV clients may not be touched while frame is being sent
+static void wait_send_job(void)
+{
+    if (mvd.send_job) {
+        Com_WaitAsyncWork(mvd.send_job);
+    }
+}
+
+#if USE_TESTS
+static bool send_inline; // private deflate on main thread, for comparison
+#endif
+
+// copies frame and queues it for sending to all active clients
+static void queue_send_job(const byte *header, size_t total)
+{
+    gtv_chunk_t *chunk = &mvd.chunk;
+    asyncwork_t work = {
+        .work_cb = send_job_work,
+        .done_cb = send_job_done,
+        .cb_arg = chunk,
+    };
+
+    if (!chunk->data) {
+        chunk->data = SV_Malloc(MAX_MSGLEN + 3);
+    }
+
+    memcpy(chunk->data, header, 3);
+    chunk->len = 3;
+    memcpy(chunk->data + chunk->len, mvd.message.data, mvd.message.cursize);
+    chunk->len += mvd.message.cursize;
+    memcpy(chunk->data + chunk->len, msg_write.data, msg_write.cursize);
+    chunk->len += msg_write.cursize;
+    memcpy(chunk->data + chunk->len, mvd.datagram.data, mvd.datagram.cursize);
+    chunk->len += mvd.datagram.cursize;
+    Q_assert(chunk->len == total + 3);
+
+#if USE_ZLIB
+    {
+        gtv_client_t *client;
+
+        chunk->deflate = false;
+        FOR_EACH_ACTIVE_GTV(client) {
+            if (client->z.state) {
+                chunk->deflate = true;
+                break;
+            }
+        }
+
+#if USE_TESTS
+        if (send_inline) {
+            chunk->deflate = false;
+        }
+#endif
+
+        if (chunk->deflate && init_shared_stream()) {
+            chunk->keyframe = !mvd.zframes;
+            mvd.zframes = (mvd.zframes + 1) % GTV_KEYFRAME_INTERVAL;
+        } else {
+            chunk->deflate = false;
+            mvd.zframes = 0;
+        }
+    }
+#endif
+
+#if USE_TESTS
+    if (send_inline) {
+        send_job_work(chunk);
+        send_job_done(chunk);
+        return;
+    }
+#endif
+
+    mvd.send_job = Com_QueueAsyncWork(&work);
+}
+
 /*
 ==================
 SV_MvdBeginFrame
@@ -995,6 +1252,8 @@ SV_MvdBeginFrame
 */
 void SV_MvdBeginFrame(void)
 {
+    wait_send_job();
+
     if (mvd.enabled)
         check_clients_activity();
 
@@ -1009,13 +1268,14 @@ SV_MvdEndFrame
 */
 void SV_MvdEndFrame(void)
 {
-    gtv_client_t *client;
     size_t total;
     byte header[3];
 
     if (!SV_FRAMESYNC)
         return;
 
+    wait_send_job();
+
     // do nothing if not enabled
     if (!mvd.enabled) {
         return;
@@ -1061,17 +1321,8 @@ void SV_MvdEndFrame(void)
     header[2] = GTS_STREAM_DATA;
 
     // send frame to clients
-    FOR_EACH_ACTIVE_GTV(client) {
-        write_stream(client, header, sizeof(header));
-        write_stream(client, mvd.message.data, mvd.message.cursize);
-        write_stream(client, msg_write.data, msg_write.cursize);
-        write_stream(client, mvd.datagram.data, mvd.datagram.cursize);
-#if USE_ZLIB
-        if (++client->bufcount > client->maxbuf) {
-            flush_stream(client, Z_SYNC_FLUSH);
-        }
-#endif
-        NET_UpdateStream(&client->stream);
+    if (!LIST_EMPTY(&gtv_active_list)) {
+        queue_send_job(header, total);
     }
 
     // write frame to demofile
@@ -1310,42 +1561,58 @@ static void remove_client(gtv_client_t *client)
 }
 
 #if USE_ZLIB
-static void flush_stream(gtv_client_t *client, int flush)
+// deflates data with private deflater into send buffer.
+// returns error string on failure.
+static const char *deflate_stream(gtv_client_t *client, const void *data, size_t len, int flush)
 {
     fifo_t *fifo = &client->stream.send;
     z_streamp z = &client->z;
-    byte *data;
-    size_t len;
+    byte *buf;
+    size_t size;
     int ret;
 
-    if (client->state <= cs_zombie) {
-        return;
-    }
-    if (!z->state) {
-        return;
+    if (len) {
+        client->adler = adler32(client->adler, data, (uInt)len);
     }
 
-    z->next_in = NULL;
-    z->avail_in = 0;
+    z->next_in = (Bytef *)data;
+    z->avail_in = (uInt)len;
 
     do {
-        data = FIFO_Reserve(fifo, &len);
-        if (!len) {
-            // FIXME: this is not an error when flushing
-            return;
+        buf = FIFO_Reserve(fifo, &size);
+        if (!size) {
+            return "overflowed";
         }
 
-        z->next_out = data;
-        z->avail_out = (uInt)len;
+        z->next_out = buf;
+        z->avail_out = (uInt)size;
 
         ret = deflate(z, flush);
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return "deflate() failed";
+        }
 
-        len -= z->avail_out;
-        if (len) {
-            FIFO_Commit(fifo, len);
+        size -= z->avail_out;
+        if (size) {
+            FIFO_Commit(fifo, size);
             client->bufcount = 0;
         }
-    } while (ret == Z_OK);
+    } while (z->avail_in || (flush != Z_NO_FLUSH && !z->avail_out));
+
+    return NULL;
+}
+
+static void flush_stream(gtv_client_t *client, int flush)
+{
+    if (client->state <= cs_zombie) {
+        return;
+    }
+    if (!client->z.state) {
+        return;
+    }
+
+    // FIXME: overflow is not an error when flushing
+    deflate_stream(client, NULL, 0, flush);
 }
 #endif
 
@@ -1363,8 +1630,17 @@ static void drop_client(gtv_client_t *client, const char *error)
 
 #if USE_ZLIB
     if (client->z.state) {
-        // finish zlib stream
-        flush_stream(client, Z_FINISH);
+        // finish zlib stream. private deflater hasn't seen shared data, so
+        // append final empty block and checksum of the whole stream manually.
+        byte trailer[6] = { 0x03, 0x00 };
+
+        trailer[2] = client->adler >> 24;
+        trailer[3] = client->adler >> 16;
+        trailer[4] = client->adler >> 8;
+        trailer[5] = client->adler;
+
+        flush_stream(client, Z_SYNC_FLUSH);
+        FIFO_Write(&client->stream.send, trailer, sizeof(trailer));
         deflateEnd(&client->z);
     }
 #endif
@@ -1389,32 +1665,15 @@ static void write_stream(gtv_client_t *client, void *data, size_t len)
 
 #if USE_ZLIB
     if (client->z.state) {
-        z_streamp z = &client->z;
-
-        z->next_in = data;
-        z->avail_in = (uInt)len;
+        const char *error;
 
-        do {
-            data = FIFO_Reserve(fifo, &len);
-            if (!len) {
-                drop_client(client, "overflowed");
-                return;
-            }
-
-            z->next_out = data;
-            z->avail_out = (uInt)len;
-
-            if (deflate(z, Z_NO_FLUSH) != Z_OK) {
-                drop_client(client, "deflate() failed");
-                return;
-            }
+        // private data puts client out of sync with shared stream
+        client->shared = false;
 
-            len -= z->avail_out;
-            if (len) {
-                FIFO_Commit(fifo, len);
-                client->bufcount = 0;
-            }
-        } while (z->avail_in);
+        error = deflate_stream(client, data, len, Z_NO_FLUSH);
+        if (error) {
+            drop_client(client, error);
+        }
     } else
 #endif
 
@@ -1520,6 +1779,7 @@ static void parse_hello(gtv_client_t *client)
             drop_client(client, "deflateInit failed");
             return;
         }
+        client->adler = adler32(0, Z_NULL, 0);
     }
 #endif
 
@@ -1784,6 +2044,8 @@ void SV_MvdRunClients(void)
         return; // do nothing if disabled
     }
 
+    wait_send_job();
+
     // accept new connections
     ret = NET_Accept(&stream);
     if (ret == NET_ERROR) {
@@ -1901,6 +2163,8 @@ static void dump_versions(void)
 
 void SV_MvdStatus_f(void)
 {
+    wait_send_job();
+
     if (LIST_EMPTY(&gtv_client_list)) {
         Com_Printf("No TCP clients.\n");
     } else {
@@ -1917,6 +2181,8 @@ static void mvd_drop(gtv_serverop_t op)
 {
     gtv_client_t *client;
 
+    wait_send_job();
+
     // drop GTV clients
     FOR_EACH_GTV(client) {
         switch (client->state) {
@@ -1986,6 +2252,8 @@ void SV_MvdMapChanged(void)
         return; // do nothing if disabled
     }
 
+    wait_send_job();
+
     // spawn MVD dummy now if listening for autorecord command
     if (sv_mvd_autorecord->integer) {
         ret = dummy_create();
@@ -2154,6 +2422,15 @@ void SV_MvdShutdown(error_type_t type)
     Z_Free(mvd.entities);
     Z_Free(mvd.clients);
 
+    // free shared stream
+#if USE_ZLIB
+    if (mvd.z.state) {
+        deflateEnd(&mvd.z);
+    }
+    Z_Free(mvd.chunk.zdata);
+#endif
+    Z_Free(mvd.chunk.data);
+
     // close server TCP socket
     NET_Listen(false);
 
@@ -2368,6 +2645,238 @@ static void SV_ListGtvBans_f(void)
     SV_ListMatches_f(&gtv_black_list);
 }
 
+#if USE_TESTS && USE_ZLIB && !defined(_WIN32)
+
+typedef struct {
+    int         fd;
+    z_stream    z;
+    size_t      bytes;      // as received
+    size_t      rawbytes;   // after inflating
+    bool        done;
+    const char  *error;
+} gtv_peer_t;
+
+static void bench_read_peer(gtv_peer_t *peer, bool deflated)
+{
+    static byte in[0x10000], out[0x10000];
+    z_streamp z = &peer->z;
+    ssize_t len;
+    int ret;
+
+    while (!peer->error && (len = read(peer->fd, in, sizeof(in))) > 0) {
+        peer->bytes += len;
+        if (!deflated) {
+            peer->rawbytes += len;
+            continue;
+        }
+
+        z->next_in = in;
+        z->avail_in = len;
+        do {
+            if (peer->done) {
+                peer->error = "data after end of stream";
+                break;
+            }
+            z->next_out = out;
+            z->avail_out = sizeof(out);
+            ret = inflate(z, Z_NO_FLUSH);
+            peer->rawbytes += sizeof(out) - z->avail_out;
+            if (ret == Z_STREAM_END)
+                peer->done = true;
+            else if (ret != Z_OK && ret != Z_BUF_ERROR)
+                peer->error = z->msg ? z->msg : "inflate() failed";
+        } while (!peer->error && (z->avail_in || !z->avail_out));
+    }
+}
+
+static void bench_flush(gtv_client_t *clients, gtv_peer_t *peers, int count, bool deflated)
+{
+    gtv_client_t *client;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        client = &clients[i];
+        do {
+            NET_SendStream(&client->stream);
+            bench_read_peer(&peers[i], deflated);
+        } while (FIFO_Usage(&client->stream.send) &&
+                 client->stream.state == NS_CONNECTED && !peers[i].error);
+        NET_UpdateStream(&client->stream);
+    }
+}
+
+static bool bench_add_client(gtv_client_t *client, gtv_peer_t *peer, bool deflated, int num)
+{
+    struct pollfd *e;
+    size_t size;
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+        Com_EPrintf("Couldn't create socket pair: %s\n", strerror(errno));
+        return false;
+    }
+
+    e = NET_AllocPollFd();
+    if (!e) {
+        Com_EPrintf("Too many open sockets\n");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    e->fd = fds[0];
+    e->events = e->revents = 0;
+    peer->fd = fds[1];
+
+    size = MAX_GTS_MSGLEN * sv_mvd_bufsize->integer;
+    client->data = SV_Malloc(size);
+    client->stream.send.data = client->data;
+    client->stream.send.size = size;
+    client->stream.recv.data = client->buffer;
+    client->stream.recv.size = MAX_GTC_MSGLEN;
+    client->stream.socket = e;
+    client->stream.address.type = NA_LOOPBACK;
+    client->stream.state = NS_CONNECTED;
+
+    Q_snprintf(client->name, sizeof(client->name), "bench%d", num);
+    client->lastmessage = svs.realtime;
+    client->maxbuf = 10;
+    client->state = cs_spawned;
+
+    if (deflated) {
+        client->flags = GTF_DEFLATE;
+        client->z.zalloc = SV_zalloc;
+        client->z.zfree = SV_zfree;
+        Q_assert(deflateInit(&client->z, Z_DEFAULT_COMPRESSION) == Z_OK);
+        client->adler = adler32(0, Z_NULL, 0);
+        Q_assert(inflateInit(&peer->z) == Z_OK);
+    }
+
+    List_SeqAdd(&gtv_client_list, &client->entry);
+    List_Append(&gtv_active_list, &client->active);
+    return true;
+}
+
+/*
+Attaches fake GTV clients connected over local socket pairs, runs game frames
+and measures CPU time spent sending them. Each stream is inflated on the other
+end and must finish with matching checksum.
+*/
+static void SV_MvdBench_f(void)
+{
+    gtv_client_t *clients, *client;
+    gtv_peer_t *peers;
+    const char *mode = Cmd_Argc() > 3 ? Cmd_Argv(3) : "shared";
+    int i, count, frames, errors;
+    bool deflated = strcmp(mode, "raw");
+    unsigned start, main_msec = 0;
+    clock_t cpu_start, cpu = 0;
+    size_t bytes = 0, rawbytes = 0;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <clients> [frames] [shared|inline|raw]\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (sv.state != ss_game || !mvd.entities) {
+        Com_Printf("Need a running game with sv_mvd_enable.\n");
+        return;
+    }
+
+    count = Q_clip(Q_atoi(Cmd_Argv(1)), 1, 256);
+    frames = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, 10000) : 100;
+
+    if (!mvd_enable()) {
+        return;
+    }
+    if (!mvd.active) {
+        Com_Printf("MVD streams are suspended, set sv_mvd_suspend_time to 0.\n");
+        return;
+    }
+
+    wait_send_job();
+
+    clients = SV_Mallocz(sizeof(clients[0]) * count);
+    peers = SV_Mallocz(sizeof(peers[0]) * count);
+
+    for (i = 0; i < count; i++)
+        if (!bench_add_client(&clients[i], &peers[i], deflated, i))
+            break;
+    count = i;
+
+    // send gamestate privately, clients join shared stream at keyframe
+    emit_gamestate();
+    for (i = 0; i < count; i++) {
+        write_message(&clients[i], GTS_STREAM_DATA);
+        flush_stream(&clients[i], Z_SYNC_FLUSH);
+    }
+    SZ_Clear(&msg_write);
+    bench_flush(clients, peers, count, deflated);
+
+    send_inline = !strcmp(mode, "inline");
+
+    for (i = 0; i < frames && SV_FRAMESYNC; i++) {
+        SV_MvdBeginFrame();
+        ge->RunFrame();
+
+        cpu_start = clock();
+        start = Sys_Milliseconds();
+        SV_MvdEndFrame();
+        main_msec += Sys_Milliseconds() - start;
+        wait_send_job();
+        cpu += clock() - cpu_start;
+
+        bench_flush(clients, peers, count, deflated);
+    }
+    frames = i;
+
+    send_inline = false;
+
+    // finish streams and check them
+    for (i = 0; i < count; i++)
+        drop_client(&clients[i], NULL);
+    bench_flush(clients, peers, count, deflated);
+
+    errors = 0;
+    for (i = 0; i < count; i++) {
+        gtv_peer_t *peer = &peers[i];
+
+        client = &clients[i];
+        if (!peer->error && deflated && !peer->done)
+            peer->error = "stream not finished";
+        if (!peer->error && peer->rawbytes != peers[0].rawbytes)
+            peer->error = "stream length mismatch";
+        if (peer->error) {
+            Com_EPrintf("%s: %s\n", client->name, peer->error);
+            errors++;
+        }
+        bytes += peer->bytes;
+        rawbytes += peer->rawbytes;
+
+        if (client->state)
+            remove_client(client);
+        close(peer->fd);
+        if (deflated)
+            inflateEnd(&peer->z);
+    }
+
+    if (count && frames) {
+        Com_Printf("%d clients, %d frames, %s: %.3f msec CPU/frame, %.3f msec main thread/frame\n",
+                   count, frames, mode,
+                   (double)cpu * 1000 / CLOCKS_PER_SEC / frames, (double)main_msec / frames);
+        Com_Printf("%zu bytes/client (%zu raw), %d stream errors\n",
+                   bytes / count, rawbytes / count, errors);
+    }
+
+    Z_Free(clients);
+    Z_Free(peers);
+}
+
+#endif
+
 static const cmdreg_t c_svmvd[] = {
     { "mvdstuff", SV_MvdStuff_f },
     { "addgtvhost", SV_AddGtvHost_f },
@@ -2376,6 +2885,9 @@ static const cmdreg_t c_svmvd[] = {
     { "addgtvban", SV_AddGtvBan_f },
     { "delgtvban", SV_DelGtvBan_f },
     { "listgtvbans", SV_ListGtvBans_f },
+#if USE_TESTS && USE_ZLIB && !defined(_WIN32)
+    { "gtvbench", SV_MvdBench_f },
+#endif
 
     { NULL }
 };
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "client.h"
 #include "server/mvd/protocol.h"
+#include "common/mdfour.h"
 
 #define FOR_EACH_GTV(gtv) \
     LIST_FOR_EACH(gtv_t, gtv, &mvd_gtv_list, entry)
@@ -77,6 +78,7 @@ typedef struct gtv_s {
     int             demoloop, demoskip;
     string_entry_t  *demohead, *demoentry;
     int64_t         demosize, demoofs;
+    uint32_t        demochecksum;
     float           demoprogress;
     bool            demowait;
 } gtv_t;
@@ -120,6 +122,7 @@ static cvar_t  *mvd_buffer_size;
 static cvar_t  *mvd_username;
 static cvar_t  *mvd_password;
 static cvar_t  *mvd_snaps;
+static cvar_t  *mvd_snaps_index;
 
 // ====================================================================
 
@@ -178,6 +181,9 @@ static void MVD_Destroy(mvd_t *mvd)
         MVD_SwitchChannel(client, &mvd_waitingRoom);
     }
 
+    // save demo index while demo info is still there
+    MVD_SaveDemoIndex(mvd);
+
     // destroy any existing GTV connection
     if (mvd->gtv) {
         mvd->gtv->mvd = NULL; // don't double destroy
@@ -674,6 +680,202 @@ static mvd_snap_t *demo_find_snapshot(mvd_t *mvd, int64_t dest, bool byte_seek)
     return mvd->snapshots[max(r, 0)];
 }
 
+/*
+Snapshots of the first map in demo file can be saved into sidecar index file
+next to the demo. When the demo is played again, index is loaded and seeking
+anywhere in the indexed part of the demo only needs to read from the closest
+snapshot, instead of reading all the demo up to destination.
+*/
+
+#define MVD_INDEX_MAGIC     MakeLittleLong('M','V','D','X')
+#define MVD_INDEX_VERSION   1
+
+static void write_index_long(qhandle_t f, uint32_t v)
+{
+    v = LittleLong(v);
+    FS_Write(&v, sizeof(v), f);
+}
+
+static void write_index_pos(qhandle_t f, int64_t v)
+{
+    write_index_long(f, (uint32_t)v);
+    write_index_long(f, (uint32_t)((uint64_t)v >> 32));
+}
+
+static int64_t read_index_pos(sizebuf_t *sz)
+{
+    uint32_t lo = SZ_ReadLong(sz);
+    uint32_t hi = SZ_ReadLong(sz);
+
+    return (int64_t)(((uint64_t)hi << 32) | lo);
+}
+
+static bool demo_index_path(gtv_t *gtv, char *buffer, size_t size)
+{
+    return Q_snprintf(buffer, size, "%s.idx", gtv->demoentry->string) < size;
+}
+
+static void demo_write_index(mvd_t *mvd)
+{
+    gtv_t *gtv = mvd->gtv;
+    char buffer[MAX_OSPATH];
+    qhandle_t f;
+    mvd_snap_t *snap;
+    int64_t ret;
+    int i;
+
+    if (!demo_index_path(gtv, buffer, sizeof(buffer))) {
+        Com_WPrintf("[%s] Oversize demo index path\n", mvd->name);
+        return;
+    }
+
+    ret = FS_OpenFile(buffer, &f, FS_MODE_WRITE);
+    if (!f) {
+        Com_EPrintf("[%s] Couldn't open %s for writing: %s\n",
+                    mvd->name, buffer, Q_ErrorString(ret));
+        return;
+    }
+
+    write_index_long(f, MVD_INDEX_MAGIC);
+    write_index_long(f, MVD_INDEX_VERSION);
+    write_index_long(f, gtv->demochecksum);
+    write_index_pos(f, gtv->demoofs);
+    write_index_pos(f, gtv->demosize);
+    write_index_long(f, mvd->numsnapshots);
+
+    for (i = 0; i < mvd->numsnapshots; i++) {
+        snap = mvd->snapshots[i];
+        write_index_long(f, snap->framenum);
+        write_index_pos(f, snap->filepos);
+        write_index_long(f, snap->msglen);
+        FS_Write(snap->data, snap->msglen, f);
+    }
+
+    ret = FS_CloseFile(f);
+    if (ret < 0) {
+        Com_EPrintf("[%s] Couldn't write %s: %s\n",
+                    mvd->name, buffer, Q_ErrorString(ret));
+        return;
+    }
+
+    Com_DPrintf("[%s] Wrote %d snapshots to %s\n", mvd->name, mvd->numsnapshots, buffer);
+    mvd->numindexsnaps = mvd->numsnapshots;
+}
+
+// called when snapshots of the first map are about to be freed
+void MVD_SaveDemoIndex(mvd_t *mvd)
+{
+    if (!mvd->demoindexing)
+        return;
+
+    mvd->demoindexing = false;
+
+    if (mvd_snaps_index->integer < 2)
+        return;
+
+    if (!mvd->gtv || !mvd->gtv->demoentry || !mvd->gtv->demosize)
+        return;
+
+    // nothing new since index was loaded
+    if (mvd->numsnapshots <= mvd->numindexsnaps)
+        return;
+
+    demo_write_index(mvd);
+}
+
+static void demo_free_snapshots(mvd_t *mvd, int count)
+{
+    int i;
+
+    for (i = count; i < mvd->numsnapshots; i++) {
+        Z_Free(mvd->snapshots[i]);
+    }
+    mvd->numsnapshots = min(mvd->numsnapshots, count);
+    mvd->numindexsnaps = min(mvd->numindexsnaps, count);
+    mvd->last_snapshot = count ? mvd->snapshots[count - 1]->framenum : INT_MIN;
+}
+
+// replaces snapshots with ones from index file, returns false if
+// index is missing or doesn't match the demo
+static bool demo_load_index(mvd_t *mvd)
+{
+    gtv_t *gtv = mvd->gtv;
+    char buffer[MAX_OSPATH];
+    sizebuf_t sz;
+    mvd_snap_t *snap, **snapshots;
+    void *data;
+    int i, ret, count, framenum, msglen;
+    int64_t filepos;
+
+    if (!demo_index_path(gtv, buffer, sizeof(buffer)))
+        return false;
+
+    ret = FS_LoadFile(buffer, &data);
+    if (!data)
+        return false;
+
+    SZ_Init(&sz, data, ret);
+    sz.cursize = ret;
+    sz.allowunderflow = true;
+
+    if (SZ_ReadLong(&sz) != MVD_INDEX_MAGIC ||
+        SZ_ReadLong(&sz) != MVD_INDEX_VERSION ||
+        (uint32_t)SZ_ReadLong(&sz) != gtv->demochecksum ||
+        read_index_pos(&sz) != gtv->demoofs ||
+        read_index_pos(&sz) != gtv->demosize) {
+        Com_DPrintf("[%s] Ignoring stale %s\n", mvd->name, buffer);
+        FS_FreeFile(data);
+        return false;
+    }
+
+    count = SZ_ReadLong(&sz);
+    if (count < 1 || count > MAX_SNAPSHOTS || count > sz.cursize / 16) {
+        Com_WPrintf("[%s] Bad number of snapshots in %s\n", mvd->name, buffer);
+        FS_FreeFile(data);
+        return false;
+    }
+
+    snapshots = MVD_Malloc(sizeof(snapshots[0]) * ALIGN(count, MIN_SNAPSHOTS));
+    for (i = 0; i < count; i++) {
+        framenum = SZ_ReadLong(&sz);
+        filepos = read_index_pos(&sz);
+        msglen = SZ_ReadLong(&sz);
+        if (sz.readcount > sz.cursize ||
+            (i && framenum <= snapshots[i - 1]->framenum) ||
+            filepos < gtv->demoofs || filepos > gtv->demoofs + gtv->demosize ||
+            msglen < 1 || msglen > msg_write.maxsize ||
+            msglen > sz.cursize - sz.readcount) {
+            break;
+        }
+
+        snap = MVD_Malloc(sizeof(*snap) + msglen - 1);
+        snap->framenum = framenum;
+        snap->filepos = filepos;
+        snap->msglen = msglen;
+        memcpy(snap->data, SZ_ReadData(&sz, msglen), msglen);
+        snapshots[i] = snap;
+    }
+
+    FS_FreeFile(data);
+
+    if (i < count) {
+        Com_WPrintf("[%s] Bad snapshot %d in %s\n", mvd->name, i, buffer);
+        while (i--)
+            Z_Free(snapshots[i]);
+        Z_Free(snapshots);
+        return false;
+    }
+
+    demo_free_snapshots(mvd, 0);
+    Z_Free(mvd->snapshots);
+    mvd->snapshots = snapshots;
+    mvd->numsnapshots = mvd->numindexsnaps = count;
+    mvd->last_snapshot = snapshots[count - 1]->framenum;
+
+    Com_DPrintf("[%s] Loaded %d snapshots from %s\n", mvd->name, count, buffer);
+    return true;
+}
+
 static void demo_update(gtv_t *gtv)
 {
     if (gtv->demosize) {
@@ -759,6 +961,8 @@ static void demo_play_next(gtv_t *gtv, string_entry_t *entry)
 
     // close previous file
     if (gtv->demoplayback) {
+        if (gtv->mvd)
+            MVD_SaveDemoIndex(gtv->mvd);
         FS_CloseFile(gtv->demoplayback);
         gtv->demoplayback = 0;
     }
@@ -775,6 +979,9 @@ static void demo_play_next(gtv_t *gtv, string_entry_t *entry)
         gtv_destroyf(gtv, "Couldn't read %s: %s", entry->string, Q_ErrorString(ret));
     }
 
+    // identifies demo in index file
+    gtv->demochecksum = Com_BlockChecksum(msg_read.data, msg_read.cursize);
+
     // create MVD channel
     if (!gtv->mvd) {
         gtv->mvd = create_channel(gtv);
@@ -807,6 +1014,13 @@ static void demo_play_next(gtv_t *gtv, string_entry_t *entry)
         gtv->demosize = gtv->demoofs = 0;
     }
 
+    // index is only kept for the first map
+    gtv->mvd->demoindexing = false;
+    if (mvd_snaps_index->integer && mvd_snaps->integer > 0 && gtv->demosize) {
+        demo_load_index(gtv->mvd);
+        gtv->mvd->demoindexing = true;
+    }
+
     demo_emit_snapshot(gtv->mvd);
 }
 
@@ -828,6 +1042,7 @@ static void demo_destroy(gtv_t *gtv)
 
     // destroy any associated MVD channel
     if (mvd) {
+        MVD_SaveDemoIndex(mvd);
         mvd->gtv = NULL;
         MVD_Destroy(mvd);
     }
@@ -2312,6 +2527,13 @@ static void MVD_Seek_f(void)
     if (back_seek || mvd->last_snapshot > mvd->framenum) {
         snap = demo_find_snapshot(mvd, dest, byte_seek);
 
+        // when seeking forward, use snapshot only if it's ahead
+        if (snap && !back_seek) {
+            int64_t pos = byte_seek ? FS_Tell(gtv->demoplayback) : mvd->framenum;
+            if ((byte_seek ? snap->filepos : snap->framenum) <= pos)
+                snap = NULL;
+        }
+
         if (snap) {
             Com_DPrintf("found snap at %d\n", snap->framenum);
             ret = FS_Seek(gtv->demoplayback, snap->filepos, SEEK_SET);
@@ -2661,6 +2883,92 @@ void MVD_Shutdown(void)
     Z_LeakTest(TAG_MVD);
 }
 
+#if USE_TESTS
+
+static void seek_bench(mvd_t *mvd, const char *to)
+{
+    char buffer[MAX_STRING_CHARS];
+
+    Q_snprintf(buffer, sizeof(buffer), "mvdseek %s %d", to, mvd->id);
+    Cmd_ExecuteString(&cmd_buffer, buffer);
+}
+
+/*
+==============
+MVD_SeekBench_f
+
+mvdseekbench [chanid] [steps]
+
+Times seeking from the start of demo to increasing positions, first by
+reading the demo from the start, then with snapshots from demo index.
+Index is written from snapshots collected by the first pass.
+==============
+*/
+static void MVD_SeekBench_f(void)
+{
+    mvd_t *mvd;
+    gtv_t *gtv;
+    char to[16];
+    unsigned start, read_msec[100], index_msec;
+    int i, steps;
+
+    mvd = MVD_SetChannel(1);
+    if (!mvd) {
+        Com_Printf("Usage: %s [chanid] [steps]\n", Cmd_Argv(0));
+        return;
+    }
+
+    gtv = mvd->gtv;
+    if (!gtv || !gtv->demoplayback || !gtv->demosize || mvd->demorecording) {
+        Com_Printf("[%s] Seek benchmark needs a seekable demo channel.\n", mvd->name);
+        return;
+    }
+
+    if (mvd_snaps->integer <= 0) {
+        Com_Printf("[%s] Seek benchmark needs mvd_snaps enabled.\n", mvd->name);
+        return;
+    }
+
+    steps = Cmd_Argc() > 2 ? Q_clip(Q_atoi(Cmd_Argv(2)), 1, q_countof(read_msec)) : 9;
+
+    // first pass reads demo up to destination
+    for (i = 1; i <= steps; i++) {
+        seek_bench(mvd, "0%");
+        demo_free_snapshots(mvd, 1);
+        Q_snprintf(to, sizeof(to), "%d%%", 90 * i / steps);
+        start = Sys_Milliseconds();
+        seek_bench(mvd, to);
+        read_msec[i - 1] = Sys_Milliseconds() - start;
+    }
+
+    if (mvd->gtv != gtv || !mvd->numsnapshots) {
+        Com_Printf("[%s] Demo ended during benchmark.\n", mvd->name);
+        return;
+    }
+
+    demo_write_index(mvd);
+
+    Com_Printf("[%s] %d snapshots, %"PRId64" bytes\n", mvd->name, mvd->numsnapshots, gtv->demosize);
+    Com_Printf("position  frame  read msec  index msec\n");
+
+    // second pass loads index and seeks from closest snapshot
+    for (i = 1; i <= steps; i++) {
+        seek_bench(mvd, "0%");
+        demo_free_snapshots(mvd, 1);
+        Q_snprintf(to, sizeof(to), "%d%%", 90 * i / steps);
+        start = Sys_Milliseconds();
+        if (!demo_load_index(mvd)) {
+            Com_Printf("[%s] Couldn't load demo index.\n", mvd->name);
+            return;
+        }
+        seek_bench(mvd, to);
+        index_msec = Sys_Milliseconds() - start;
+        Com_Printf("%8s  %5d  %9u  %10u\n", to, mvd->framenum, read_msec[i - 1], index_msec);
+    }
+}
+
+#endif
+
 static const cmdreg_t c_mvd[] = {
     { "mvdplay", MVD_Play_f, MVD_Play_c },
     { "mvdconnect", MVD_Connect_f, MVD_Connect_c },
@@ -2673,6 +2981,9 @@ static const cmdreg_t c_mvd[] = {
     { "mvdpause", MVD_Pause_f },
     { "mvdskip", MVD_Skip_f },
     { "mvdseek", MVD_Seek_f },
+#if USE_TESTS
+    { "mvdseekbench", MVD_SeekBench_f },
+#endif
 
     { NULL }
 };
@@ -2706,6 +3017,7 @@ void MVD_Register(void)
     mvd_username = Cvar_Get("mvd_username", "unnamed", 0);
     mvd_password = Cvar_Get("mvd_password", "", CVAR_PRIVATE);
     mvd_snaps = Cvar_Get("mvd_snaps", "10", 0);
+    mvd_snaps_index = Cvar_Get("mvd_snaps_index", "1", 0);
 
     Cmd_Register(c_mvd);
 }
@@ -138,9 +138,11 @@ typedef struct mvd_s {
     qhandle_t   demorecording;
     char        *demoname;
     bool        demoseeking;
+    bool        demoindexing;   // snapshots are of the first map in demo file
     int         last_snapshot;
     mvd_snap_t  **snapshots;
     int         numsnapshots;
+    int         numindexsnaps;  // loaded from demo index
 
     // delay buffer
     fifo_t      delay;
@@ -209,6 +211,7 @@ void MVD_File_g(genctx_t *ctx);
 void MVD_Spawn(void);
 
 void MVD_StopRecord(mvd_t *mvd);
+void MVD_SaveDemoIndex(mvd_t *mvd);
 
 void MVD_StreamedStop_f(void);
 void MVD_StreamedRecord_f(void);
@@ -827,11 +827,15 @@ void MVD_ClearState(mvd_t *mvd, bool full)
     if (!full)
         return;
 
+    // save snapshots of previous map in demo file
+    MVD_SaveDemoIndex(mvd);
+
     // free all snapshots
     for (i = 0; i < mvd->numsnapshots; i++) {
         Z_Free(mvd->snapshots[i]);
     }
     mvd->numsnapshots = 0;
+    mvd->numindexsnaps = 0;
 
     Z_Freep((void**)&mvd->snapshots);
 
@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "server.h"
+#include "common/async.h"
 
 #define SAVE_MAGIC1     MakeLittleLong('S','S','V','2')
 #define SAVE_MAGIC2     MakeLittleLong('S','A','V','2')
@@ -31,30 +32,145 @@ cvar_t *sv_savedir = NULL;
  * Still, allow it as an option for cautious people. */
 cvar_t *sv_force_enhanced_savegames = NULL;
 static cvar_t   *sv_noreload;
+static cvar_t   *sv_async_saves;
 
-static int write_binary_file(char const* name, void const* data, size_t size)
+/*
+Savegames are written in two steps. Server and game state is serialized
+into memory on the main thread first, which is fast. Then a worker thread
+writes files, replacing each one atomically, and copies .current directory
+into the target one. Directories are created on the main thread before the
+job is queued. Anything that reads save files must wait for the
+pending job to finish.
+*/
+
+#define MAX_SAVE_FILES  8
+
+typedef struct {
+    char        name[MAX_OSPATH];   // relative to .current
+    void        *data;
+    size_t      len;
+    bool        compress;
+} savefile_t;
+
+typedef struct {
+    char        base[MAX_OSPATH];   // game dir + save dir
+    char        dir[MAX_QPATH];     // directory to copy to, empty if none
+    savefile_t  files[MAX_SAVE_FILES];
+    int         numfiles;
+    void        **wipe;             // old files in dir
+    int         numwipe;
+    void        **copy;             // unchanged files in .current
+    int         numcopy;
+    const char  *message;
+    unsigned    start, snapshot, write;
+    char        error[MAX_OSPATH + 32];
+} savejob_t;
+
+static savejob_t        *save_job;      // being built
+static asynchandle_t    save_handle;    // being written
+
+// writes file atomically by renaming it over the old one,
+// directory must already exist (may be called from worker thread)
+static int write_file_atomic(const char *path, const void *data, size_t len, bool compress)
 {
-    char namecopy[MAX_OSPATH];
-    if (Q_strlcpy(namecopy, name, MAX_OSPATH) >= MAX_OSPATH)
-        return -1;
+    char tmp[MAX_OSPATH];
+    int ret = -1;
 
-    if (FS_CreatePath(namecopy) < 0)
+    if (Q_snprintf(tmp, MAX_OSPATH, "%s.tmp", path) >= MAX_OSPATH)
         return -1;
 
-    FILE* fp = fopen(name, "wb");
-    if (!fp)
+    if (compress) {
+        gzFile gz = gzopen(tmp, "wb");
+        if (!gz)
+            return -1;
+        if (gzwrite(gz, data, len) == len)
+            ret = 0;
+        if (gzclose(gz))
+            ret = -1;
+    } else {
+        FILE *fp = fopen(tmp, "wb");
+        if (!fp)
+            return -1;
+        if (fwrite(data, 1, len, fp) == len)
+            ret = 0;
+        if (fclose(fp))
+            ret = -1;
+    }
+
+    if (ret < 0) {
+        remove(tmp);
         return -1;
+    }
+
+#ifdef _WIN32
+    // rename doesn't replace existing files here
+    remove(path);
+#endif
 
-    if (fwrite(data, 1, size, fp) < size)
-    {
-        fclose(fp);
+    if (rename(tmp, path)) {
+        remove(tmp);
         return -1;
     }
 
-    fclose(fp);
     return 0;
 }
 
+// creates directories for file on main thread
+static int create_path(const char *name)
+{
+    char path[MAX_OSPATH];
+
+    if (Q_strlcpy(path, name, MAX_OSPATH) >= MAX_OSPATH)
+        return -1;
+
+    return FS_CreatePath(path);
+}
+
+static int write_binary_file(char const* name, void const* data, size_t size, bool compress)
+{
+    static const char current[] = "/" SAVE_CURRENT "/";
+    savefile_t *f;
+    size_t len;
+
+    if (!save_job)
+        goto write;
+
+    // only files in .current can be written in background
+    len = strlen(save_job->base);
+    if (strncmp(name, save_job->base, len) || strncmp(name + len, current, sizeof(current) - 1))
+        goto write;
+
+    if (save_job->numfiles == MAX_SAVE_FILES)
+        return -1;
+
+    f = &save_job->files[save_job->numfiles++];
+    Q_strlcpy(f->name, name + len + sizeof(current) - 1, sizeof(f->name));
+    f->data = Z_Malloc(size);
+    memcpy(f->data, data, size);
+    f->len = size;
+    f->compress = compress;
+    return 0;
+
+write:
+    if (create_path(name) < 0)
+        return -1;
+
+    return write_file_atomic(name, data, size, compress);
+}
+
+/*
+==================
+SV_WriteFileAsync
+
+Called by the game to write serialized savegame data.
+==================
+*/
+void SV_WriteFileAsync(const char *path, const void *data, size_t len, bool compress)
+{
+    if (write_binary_file(path, data, len, compress))
+        Com_Error(ERR_DROP, "Couldn't write %s", path);
+}
+
 static int write_server_file(bool autosave)
 {
     char        name[MAX_OSPATH];
@@ -89,7 +205,7 @@ static int write_server_file(bool autosave)
 	if (Q_snprintf(name, MAX_OSPATH, "%s/%s/%s/server.ssv", fs_gamedir, sv_savedir->string, SAVE_CURRENT) >= MAX_OSPATH)
         return -1;
 
-    ret = write_binary_file(name, msg_write.data, msg_write.cursize);
+    ret = write_binary_file(name, msg_write.data, msg_write.cursize, false);
 
     SZ_Clear(&msg_write);
 
@@ -136,7 +252,7 @@ static int write_level_file(void)
     if (Q_snprintf(name, MAX_OSPATH, "%s/%s/%s/%s.sv2", fs_gamedir, sv_savedir->string, SAVE_CURRENT, sv.name) >= MAX_OSPATH)
         ret = -1;
     else
-        ret = write_binary_file(name, msg_write.data, msg_write.cursize);
+        ret = write_binary_file(name, msg_write.data, msg_write.cursize, false);
 
     SZ_Clear(&msg_write);
 
@@ -151,28 +267,19 @@ static int write_level_file(void)
     return 0;
 }
 
-static int copy_file(const char *src, const char *dst, const char *name)
+// directory must already exist (may be called from worker thread)
+static int copy_file_path(const char *src, const char *dst)
 {
-    char    path[MAX_OSPATH];
     byte    buf[0x10000];
     FILE    *ifp, *ofp;
     size_t  len, res;
     int     ret = -1;
 
-    if (Q_snprintf(path, MAX_OSPATH, "%s/%s/%s/%s", fs_gamedir, sv_savedir->string, src, name) >= MAX_OSPATH)
-        goto fail0;
-
-    ifp = fopen(path, "rb");
+    ifp = fopen(src, "rb");
     if (!ifp)
         goto fail0;
 
-    if (Q_snprintf(path, MAX_OSPATH, "%s/%s/%s/%s", fs_gamedir, sv_savedir->string, dst, name) >= MAX_OSPATH)
-        goto fail1;
-
-    if (FS_CreatePath(path))
-        goto fail1;
-
-    ofp = fopen(path, "wb");
+    ofp = fopen(dst, "wb");
     if (!ofp)
         goto fail1;
 
@@ -196,6 +303,23 @@ fail0:
     return ret;
 }
 
+static int copy_file(const char *src, const char *dst, const char *name)
+{
+    char    srcpath[MAX_OSPATH];
+    char    dstpath[MAX_OSPATH];
+
+    if (Q_snprintf(srcpath, MAX_OSPATH, "%s/%s/%s/%s", fs_gamedir, sv_savedir->string, src, name) >= MAX_OSPATH)
+        return -1;
+
+    if (Q_snprintf(dstpath, MAX_OSPATH, "%s/%s/%s/%s", fs_gamedir, sv_savedir->string, dst, name) >= MAX_OSPATH)
+        return -1;
+
+    if (create_path(dstpath) < 0)
+        return -1;
+
+    return copy_file_path(srcpath, dstpath);
+}
+
 static int remove_file(const char *dir, const char *name)
 {
     char path[MAX_OSPATH];
@@ -258,6 +382,185 @@ static int copy_save_dir(const char *src, const char *dst)
     return ret;
 }
 
+static void free_save_job(savejob_t *job);
+
+static void begin_save_job(void)
+{
+    // left over if game errored out while writing
+    if (save_job)
+        free_save_job(save_job);
+
+    save_job = Z_Mallocz(sizeof(*save_job));
+    save_job->start = Sys_Milliseconds();
+    Q_snprintf(save_job->base, sizeof(save_job->base), "%s/%s", fs_gamedir, sv_savedir->string);
+}
+
+static void free_save_job(savejob_t *job)
+{
+    int i;
+
+    for (i = 0; i < job->numfiles; i++)
+        Z_Free(job->files[i].data);
+    FS_FreeList(job->wipe);
+    FS_FreeList(job->copy);
+    Z_Free(job);
+}
+
+static void abort_save_job(void)
+{
+    free_save_job(save_job);
+    save_job = NULL;
+}
+
+static bool save_job_has_file(const savejob_t *job, const char *name)
+{
+    int i;
+
+    for (i = 0; i < job->numfiles; i++)
+        if (!strcmp(job->files[i].name, name))
+            return true;
+
+    return false;
+}
+
+static void save_job_work(void *arg)
+{
+    savejob_t *job = arg;
+    char src[MAX_OSPATH], dst[MAX_OSPATH];
+    unsigned start = Sys_Milliseconds();
+    savefile_t *f;
+    int i;
+
+    for (i = 0, f = job->files; i < job->numfiles; i++, f++) {
+        Q_snprintf(dst, MAX_OSPATH, "%s/%s/%s", job->base, SAVE_CURRENT, f->name);
+        if (write_file_atomic(dst, f->data, f->len, f->compress)) {
+            Q_snprintf(job->error, sizeof(job->error), "Couldn't write %s", dst);
+            goto done;
+        }
+    }
+
+    if (!job->dir[0])
+        goto done;
+
+    for (i = 0; i < job->numwipe; i++) {
+        Q_snprintf(dst, MAX_OSPATH, "%s/%s/%s", job->base, job->dir, (char *)job->wipe[i]);
+        if (remove(dst)) {
+            Q_snprintf(job->error, sizeof(job->error), "Couldn't wipe '%s' directory", job->dir);
+            goto done;
+        }
+    }
+
+    for (i = 0, f = job->files; i < job->numfiles; i++, f++) {
+        Q_snprintf(dst, MAX_OSPATH, "%s/%s/%s", job->base, job->dir, f->name);
+        if (write_file_atomic(dst, f->data, f->len, f->compress)) {
+            Q_snprintf(job->error, sizeof(job->error), "Couldn't write %s", dst);
+            goto done;
+        }
+    }
+
+    for (i = 0; i < job->numcopy; i++) {
+        Q_snprintf(src, MAX_OSPATH, "%s/%s/%s", job->base, SAVE_CURRENT, (char *)job->copy[i]);
+        Q_snprintf(dst, MAX_OSPATH, "%s/%s/%s", job->base, job->dir, (char *)job->copy[i]);
+        if (copy_file_path(src, dst)) {
+            Q_snprintf(job->error, sizeof(job->error), "Couldn't write '%s' directory", job->dir);
+            goto done;
+        }
+    }
+
+done:
+    job->write = Sys_Milliseconds() - start;
+}
+
+static void save_job_done(void *arg)
+{
+    savejob_t *job = arg;
+
+    if (job->error[0])
+        Com_EPrintf("%s.\n", job->error);
+    else if (job->message)
+        Com_Printf("%s (snapshot %u msec, write %u msec).\n", job->message, job->snapshot, job->write);
+    else
+        Com_DPrintf("Autosave: snapshot %u msec, write %u msec\n", job->snapshot, job->write);
+
+    free_save_job(job);
+    save_handle = 0;
+}
+
+// creates directories for files worker thread is going to write, failures
+// are reported by the worker when it can't open the file
+static void create_job_paths(const savejob_t *job)
+{
+    char path[MAX_OSPATH];
+    int i;
+
+    for (i = 0; i < job->numfiles; i++) {
+        if (Q_snprintf(path, MAX_OSPATH, "%s/%s/%s", job->base, SAVE_CURRENT, job->files[i].name) < MAX_OSPATH)
+            FS_CreatePath(path);
+        if (job->dir[0] && Q_snprintf(path, MAX_OSPATH, "%s/%s/%s", job->base, job->dir, job->files[i].name) < MAX_OSPATH)
+            FS_CreatePath(path);
+    }
+
+    for (i = 0; i < job->numcopy; i++)
+        if (Q_snprintf(path, MAX_OSPATH, "%s/%s/%s", job->base, job->dir, (char *)job->copy[i]) < MAX_OSPATH)
+            FS_CreatePath(path);
+}
+
+// queues built job for writing, followed by copying .current to dir
+static void queue_save_job(const char *dir, const char *message)
+{
+    savejob_t *job = save_job;
+    asyncwork_t work = {
+        .work_cb = save_job_work,
+        .done_cb = save_job_done,
+        .cb_arg = job,
+    };
+    void **list;
+    int i, j, count;
+
+    save_job = NULL;
+
+    if (dir) {
+        Q_strlcpy(job->dir, dir, sizeof(job->dir));
+        job->wipe = list_save_dir(dir, &job->numwipe);
+
+        // files being written are taken from memory
+        list = list_save_dir(SAVE_CURRENT, &count);
+        for (i = j = 0; i < count; i++) {
+            if (save_job_has_file(job, list[i]))
+                Z_Free(list[i]);
+            else
+                list[j++] = list[i];
+        }
+        if (list)
+            list[j] = NULL;
+        job->copy = list;
+        job->numcopy = j;
+    }
+
+    job->message = message;
+    job->snapshot = Sys_Milliseconds() - job->start;
+
+    create_job_paths(job);
+
+    save_handle = Com_QueueAsyncWork(&work);
+
+    if (!sv_async_saves->integer)
+        SV_WaitSavegame();
+}
+
+/*
+==================
+SV_WaitSavegame
+
+Blocks until savegame being written in background is finished.
+==================
+*/
+void SV_WaitSavegame(void)
+{
+    if (save_handle)
+        Com_WaitAsyncWork(save_handle);
+}
+
 static bool file_exists(const char* name)
 {
     FILE* fp = fopen(name, "rb");
@@ -309,6 +612,8 @@ char *SV_GetSaveInfo(const char *dir)
     time_t      t;
     struct tm   *tm;
 
+    SV_WaitSavegame();
+
     if (Q_snprintf(name, MAX_OSPATH, "%s/%s/%s/server.ssv", fs_gamedir, sv_savedir->string, dir) >= MAX_OSPATH)
         return NULL;
 
@@ -508,6 +813,8 @@ void SV_AutoSaveBegin(const mapcmd_t *cmd)
     edict_t     *ent;
     int         i;
 
+    SV_WaitSavegame();
+
     // check for clearing the current savegame
     if (cmd->endofunit) {
         wipe_save_dir(SAVE_CURRENT);
@@ -534,8 +841,13 @@ void SV_AutoSaveBegin(const mapcmd_t *cmd)
     }
 
     // save the map just exited
-    if (write_level_file())
+    begin_save_job();
+    if (write_level_file()) {
         Com_EPrintf("Couldn't write level file.\n");
+        abort_save_job();
+    } else {
+        queue_save_job(NULL, NULL);
+    }
 
     // we must restore these for clients to transfer over correctly
     for (i = 0; i < sv_maxclients->integer; i++) {
@@ -552,30 +864,27 @@ void SV_AutoSaveEnd(void)
 	if (SV_NoSaveGames())
 		return;
 
+    SV_WaitSavegame();
+    begin_save_job();
+
 	// save the map just entered to include the player position (client edict shell)
 	if (write_level_file())
 	{
 		Com_EPrintf("Couldn't write level file.\n");
+		abort_save_job();
 		return;
 	}
 
     // save server state
     if (write_server_file(true)) {
         Com_EPrintf("Couldn't write server file.\n");
+        abort_save_job();
         return;
     }
 
-    // clear whatever savegames are there
-    if (wipe_save_dir(SAVE_AUTO)) {
-        Com_EPrintf("Couldn't wipe '%s' directory.\n", SAVE_AUTO);
-        return;
-    }
-
-    // copy off the level to the autosave slot
-    if (copy_save_dir(SAVE_CURRENT, SAVE_AUTO)) {
-        Com_EPrintf("Couldn't write '%s' directory.\n", SAVE_AUTO);
-        return;
-    }
+    // clear whatever savegames are there and copy off the level
+    // to the autosave slot in background
+    queue_save_job(SAVE_AUTO, NULL);
 }
 
 void SV_CheckForSavegame(const mapcmd_t *cmd)
@@ -585,6 +894,8 @@ void SV_CheckForSavegame(const mapcmd_t *cmd)
     if (sv_noreload->integer)
         return;
 
+    SV_WaitSavegame();
+
     if (read_level_file()) {
         // only warn when loading a regular savegame. autosave without level
         // file is ok and simply starts the map from the beginning.
@@ -670,6 +981,8 @@ static void SV_Loadgame_f(void)
         return;
     }
 
+    SV_WaitSavegame();
+
     // make sure the server files exist
     if (!file_exists(va("%s/%s/%s/server.ssv", fs_gamedir, sv_savedir->string, dir)) ||
         !file_exists(va("%s/%s/%s/game.ssv", fs_gamedir, sv_savedir->string, dir))) {
@@ -732,33 +1045,27 @@ static void SV_Savegame_f(void)
         return;
     }
 
+    SV_WaitSavegame();
+    begin_save_job();
+
     // archive current level, including all client edicts.
     // when the level is reloaded, they will be shells awaiting
     // a connecting client
     if (write_level_file()) {
         Com_Printf("Couldn't write level file.\n");
+        abort_save_job();
         return;
     }
 
     // save server state
     if (write_server_file(false)) {
         Com_Printf("Couldn't write server file.\n");
+        abort_save_job();
         return;
     }
 
-    // clear whatever savegames are there
-    if (wipe_save_dir(dir)) {
-        Com_Printf("Couldn't wipe '%s' directory.\n", dir);
-        return;
-    }
-
-    // copy it off
-    if (copy_save_dir(SAVE_CURRENT, dir)) {
-        Com_Printf("Couldn't write '%s' directory.\n", dir);
-        return;
-    }
-
-    Com_Printf("Game saved.\n");
+    // clear whatever savegames are there and copy it off in background
+    queue_save_job(dir, "Game saved");
 }
 
 static const cmdreg_t c_savegames[] = {
@@ -770,6 +1077,7 @@ static const cmdreg_t c_savegames[] = {
 void SV_RegisterSavegames(void)
 {
     sv_noreload = Cvar_Get("sv_noreload", "0", 0);
+    sv_async_saves = Cvar_Get("sv_async_saves", "1", 0);
 
     Cmd_Register(c_savegames);
 	sv_savedir = Cvar_Get("sv_savedir", "save", 0);
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // sv_send.c
 
 #include "server.h"
+#include "system/pthread.h"
 
 /*
 =============================================================================
@@ -714,6 +715,17 @@ static void repack_unreliables(client_t *client, size_t maxsize)
     }
 }
 
+// set when frame was already encoded into msg_write by a worker thread
+static bool frame_prebuilt;
+
+static void write_frame(client_t *client)
+{
+    if (frame_prebuilt)
+        frame_prebuilt = false;
+    else
+        client->WriteFrame(client);
+}
+
 static void write_datagram_old(client_t *client)
 {
     message_packet_t *msg;
@@ -736,7 +748,7 @@ static void write_datagram_old(client_t *client)
 
     // send over all the relevant entity_state_t
     // and the player_state_t
-    client->WriteFrame(client);
+    write_frame(client);
     if (msg_write.cursize > maxsize) {
         size_t size = msg_write.cursize;
         int len = 0;
@@ -820,7 +832,7 @@ static void write_datagram_new(client_t *client)
 
     // send over all the relevant entity_state_t
     // and the player_state_t
-    client->WriteFrame(client);
+    write_frame(client);
 
     if (msg_write.overflowed) {
         // should never really happen
@@ -894,6 +906,276 @@ static void check_key_sync(client_t *client)
 }
 #endif
 
+/*
+===============================================================================
+
+PARALLEL FRAME BUILDING
+
+When sv_threads is non-zero, client frames are built and encoded by a pool of
+worker threads, each writing into its own thread local msg_write buffer.
+Main thread picks up encoded frames in client order and does the rest of
+datagram processing (unreliables, compression, netchan) serially.
+
+Workers can't print or longjmp out with Com_Error. Diagnostics are buffered
+per worker and printed by main thread along with the frame, and worker
+msg_write is allowed to overflow so that main thread can drop the frame.
+
+===============================================================================
+*/
+
+#define MAX_SEND_THREADS    16
+#define MAX_SEND_LOG        2048
+
+typedef struct {
+    pthread_t       thread;
+    byte            *buffer;
+    deltacache_t    *delta_cache;
+    bool            waiting;    // frame is ready, waiting for main thread to pick it up
+    size_t          loglen;
+    char            log[MAX_SEND_LOG];  // print type byte followed by message, repeated
+} send_worker_t;
+
+typedef struct {
+    client_t        *client;
+    unsigned        first_entity;
+    send_worker_t   *worker;
+    const sizebuf_t *msg;
+} send_job_t;
+
+static send_worker_t    send_workers[MAX_SEND_THREADS];
+static int              num_send_workers;
+static bool             send_terminate;
+static pthread_mutex_t  send_lock;
+static pthread_cond_t   send_work_cond;
+static pthread_cond_t   send_done_cond;
+
+static send_job_t       send_jobs[MAX_CLIENTS];
+static int              num_queued_jobs;
+static int              num_send_jobs;
+static int              next_send_job;
+
+static q_thread_local send_worker_t *send_worker;   // NULL on main thread
+
+void SV_FramePrintf(print_type_t type, const char *fmt, ...)
+{
+    send_worker_t *w = send_worker;
+    char msg[MAXPRINTMSG];
+    va_list argptr;
+    size_t len;
+
+    va_start(argptr, fmt);
+    len = Q_vscnprintf(msg, sizeof(msg), fmt, argptr);
+    va_end(argptr);
+
+    if (!w) {
+        Com_LPrintf(type, "%s", msg);
+        return;
+    }
+
+    // messages that don't fit are lost
+    if (len + 2 > sizeof(w->log) - w->loglen)
+        return;
+
+    w->log[w->loglen++] = type;
+    memcpy(w->log + w->loglen, msg, len + 1);
+    w->loglen += len + 1;
+}
+
+static void flush_worker_log(send_worker_t *w)
+{
+    size_t i, len;
+
+    for (i = 0; i < w->loglen; i += len + 2) {
+        len = strlen(w->log + i + 1);
+        Com_LPrintf(w->log[i], "%s", w->log + i + 1);
+    }
+
+    w->loglen = 0;
+}
+
+static void *send_worker_func(void *arg)
+{
+    send_worker_t *w = arg;
+    send_job_t *job;
+
+    SZ_TagInit(&msg_write, w->buffer, MAX_MSGLEN, "msg_write");
+    msg_write.allowoverflow = true;
+    SV_SetDeltaCache(w->delta_cache);
+    send_worker = w;
+
+    pthread_mutex_lock(&send_lock);
+    while (1) {
+        while (next_send_job >= num_send_jobs && !send_terminate)
+            pthread_cond_wait(&send_work_cond, &send_lock);
+
+        if (send_terminate)
+            break;
+
+        job = &send_jobs[next_send_job++];
+        pthread_mutex_unlock(&send_lock);
+
+        // build the new frame and write it
+        SV_BuildClientFrame(job->client, job->first_entity);
+        job->client->WriteFrame(job->client);
+
+        pthread_mutex_lock(&send_lock);
+        job->msg = &msg_write;
+        job->worker = w;
+        w->waiting = true;
+        pthread_cond_broadcast(&send_done_cond);
+
+        // hold the buffer until main thread copies it out
+        while (w->waiting && !send_terminate)
+            pthread_cond_wait(&send_done_cond, &send_lock);
+
+        SZ_Clear(&msg_write);
+    }
+    pthread_mutex_unlock(&send_lock);
+
+    return NULL;
+}
+
+/*
+=======================
+SV_ShutdownSendThreads
+=======================
+*/
+void SV_ShutdownSendThreads(void)
+{
+    int i;
+
+    if (!num_send_workers)
+        return;
+
+    pthread_mutex_lock(&send_lock);
+    send_terminate = true;
+    pthread_mutex_unlock(&send_lock);
+
+    pthread_cond_broadcast(&send_work_cond);
+    pthread_cond_broadcast(&send_done_cond);
+
+    for (i = 0; i < num_send_workers; i++) {
+        Q_assert(!pthread_join(send_workers[i].thread, NULL));
+        Z_Free(send_workers[i].buffer);
+        Z_Free(send_workers[i].delta_cache);
+    }
+
+    pthread_mutex_destroy(&send_lock);
+    pthread_cond_destroy(&send_work_cond);
+    pthread_cond_destroy(&send_done_cond);
+
+    memset(send_workers, 0, sizeof(send_workers));
+    num_send_workers = 0;
+    num_queued_jobs = num_send_jobs = next_send_job = 0;
+    send_terminate = false;
+}
+
+static void init_send_threads(int count)
+{
+    send_worker_t *w;
+
+    SV_ShutdownSendThreads();
+
+    if (count <= 0)
+        return;
+
+    pthread_mutex_init(&send_lock, NULL);
+    pthread_cond_init(&send_work_cond, NULL);
+    pthread_cond_init(&send_done_cond, NULL);
+
+    for (w = send_workers; w < send_workers + count; w++) {
+        w->buffer = SV_Malloc(MAX_MSGLEN);
+        w->delta_cache = SV_CreateDeltaCache();
+        if (pthread_create(&w->thread, NULL, send_worker_func, w)) {
+            Com_EPrintf("Couldn't create frame building thread\n");
+            Z_Free(w->buffer);
+            Z_Free(w->delta_cache);
+            w->buffer = NULL;
+            w->delta_cache = NULL;
+            Cvar_SetInteger(sv_threads, num_send_workers, FROM_CODE);
+            break;
+        }
+        num_send_workers++;
+    }
+
+    Com_DPrintf("Started %d frame building threads\n", num_send_workers);
+}
+
+static void queue_frame(client_t *client)
+{
+    send_job_t *job = &send_jobs[num_queued_jobs++];
+
+    // reserve the largest possible range of entity states, this keeps
+    // svs.entities from wrapping within UPDATE_BACKUP frames (reservation
+    // is clamped to per client share of the ring by SV_MaxPacketEntities)
+    job->client = client;
+    job->first_entity = svs.next_entity;
+    job->worker = NULL;
+    job->msg = NULL;
+
+    svs.next_entity += SV_MaxPacketEntities(client);
+}
+
+static void write_queued_frames(void)
+{
+    send_job_t *job;
+    client_t *client;
+    uint64_t prof;
+    int i, count;
+
+    // let the workers go
+    pthread_mutex_lock(&send_lock);
+    count = num_send_jobs = num_queued_jobs;
+    next_send_job = 0;
+    pthread_mutex_unlock(&send_lock);
+
+    pthread_cond_broadcast(&send_work_cond);
+
+    for (i = 0; i < count; i++) {
+        job = &send_jobs[i];
+        client = job->client;
+
+        // wait for the frame to be encoded
+        prof = Prof_Begin();
+        pthread_mutex_lock(&send_lock);
+        while (!job->worker)
+            pthread_cond_wait(&send_done_cond, &send_lock);
+        pthread_mutex_unlock(&send_lock);
+        Prof_End(PROF_SV_WAIT, prof);
+
+        flush_worker_log(job->worker);
+
+        if (job->msg->overflowed) {
+            // should never really happen
+            Com_WPrintf("Frame overflowed for %s\n", client->name);
+        } else {
+            SZ_Write(&msg_write, job->msg->data, job->msg->cursize);
+        }
+
+        // release worker buffer
+        pthread_mutex_lock(&send_lock);
+        job->worker->waiting = false;
+        pthread_mutex_unlock(&send_lock);
+
+        pthread_cond_broadcast(&send_done_cond);
+
+        frame_prebuilt = true;
+        prof = Prof_Begin();
+        client->WriteDatagram(client);
+        Prof_End(PROF_SV_WRITE, prof);
+
+        // advance for next frame
+        client->framenum++;
+
+        // clear all unreliable messages still left
+        finish_frame(client);
+    }
+
+    pthread_mutex_lock(&send_lock);
+    num_queued_jobs = num_send_jobs = next_send_job = 0;
+    pthread_mutex_unlock(&send_lock);
+}
+
 /*
 =======================
 SV_SendClientMessages
@@ -905,7 +1187,20 @@ Clients in earlier connection state are handled in SV_SendAsyncPackets.
 void SV_SendClientMessages(void)
 {
     client_t    *client;
+    const game_export_t *fixed_ge = NULL;
     size_t      cursize;
+    uint64_t    prof;
+    int         threads;
+
+    threads = Q_clip(sv_threads->integer, 0, MAX_SEND_THREADS);
+    if (threads != num_send_workers)
+        init_send_threads(threads);
+
+    // vis masks are shared by clients within one frame only
+    SV_ClearVisCache(num_send_workers > 0);
+
+    // queue datagrams and flush them all at once
+    NET_BeginSendBatch(NS_SERVER);
 
     // send a message to each connected client
     FOR_EACH_CLIENT(client) {
@@ -940,9 +1235,26 @@ void SV_SendClientMessages(void)
             goto advance;
         }
 
+        // frame building must not write to edicts
+        if (client->ge != fixed_ge) {
+            SV_FixEntityNumbers(client->ge);
+            fixed_ge = client->ge;
+        }
+
+        // let worker threads build the frame
+        if (num_send_workers) {
+            queue_frame(client);
+            continue;
+        }
+
         // build the new frame and write it
-        SV_BuildClientFrame(client);
+        prof = Prof_Begin();
+        svs.next_entity += SV_BuildClientFrame(client, svs.next_entity);
+        Prof_End(PROF_SV_BUILD, prof);
+
+        prof = Prof_Begin();
         client->WriteDatagram(client);
+        Prof_End(PROF_SV_WRITE, prof);
 
 advance:
         // advance for next frame
@@ -952,6 +1264,11 @@ finish:
         // clear all unreliable messages still left
         finish_frame(client);
     }
+
+    if (num_queued_jobs)
+        write_queued_frames();
+
+    NET_FlushSendBatch(NS_SERVER);
 }
 
 static void write_pending_download(client_t *client)
@@ -1007,6 +1324,8 @@ void SV_SendAsyncPackets(void)
     netchan_t   *netchan;
     size_t      cursize;
 
+    NET_BeginSendBatch(NS_SERVER);
+
     FOR_EACH_CLIENT(client) {
         // don't overrun bandwidth
         if (svs.realtime - client->send_time < client->send_delta) {
@@ -1051,6 +1370,8 @@ calctime:
             SV_CalcSendTime(client, cursize);
         }
     }
+
+    NET_FlushSendBatch(NS_SERVER);
 }
 
 void SV_InitClientSend(client_t *newcl)
@@ -35,6 +35,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/net/chan.h"
 #include "common/net/net.h"
 #include "common/pmove.h"
+#include "common/prof.h"
 #include "common/prompt.h"
 #include "common/protocol.h"
 #include "common/zone.h"
@@ -104,6 +105,7 @@ typedef struct {
     int         number;
     int         num_entities;
     unsigned    first_entity;
+    unsigned    sv_framenum;    // sv.framenum frame was built on
     player_packed_t ps;
     int         clientNum;
     int         areabytes;
@@ -114,6 +116,8 @@ typedef struct {
 
 typedef struct {
     int         solid32;
+    int         arealeaf;   // area index leaf + 1, may be kept while unlinked
+    int         areatree;
 
 #if USE_FPS
 
@@ -542,6 +546,11 @@ extern cvar_t       *sv_calcpings_method;
 extern cvar_t       *sv_changemapcmd;
 extern cvar_t       *sv_max_download_size;
 extern cvar_t       *sv_max_packet_entities;
+extern cvar_t       *sv_area_index;
+extern cvar_t       *sv_cull_nonvisible_entities;
+extern cvar_t       *sv_pvs_cache;
+extern cvar_t       *sv_delta_cache;
+extern cvar_t       *sv_threads;
 
 extern cvar_t       *sv_strafejump_hack;
 #if USE_PACKETDUP
@@ -582,6 +591,7 @@ extern bool     sv_pending_autosave;
 void SV_DropClient(client_t *drop, const char *reason);
 void SV_RemoveClient(client_t *client);
 void SV_CleanClient(client_t *client);
+void SV_RunFrame(void);
 
 void SV_InitOperatorCommands(void);
 
@@ -638,6 +648,22 @@ void SV_BroadcastCommand(const char *fmt, ...) q_printf(1, 2);
 void SV_ClientAddMessage(client_t *client, int flags);
 void SV_ShutdownClientSend(client_t *client);
 void SV_InitClientSend(client_t *newcl);
+void SV_ShutdownSendThreads(void);
+
+// printing from code that may run on frame building threads, buffered there
+// and printed by main thread when the frame is picked up
+void SV_FramePrintf(print_type_t type, const char *fmt, ...) q_printf(2, 3);
+
+#define SV_FrameWPrintf(...) \
+    SV_FramePrintf(PRINT_WARNING, __VA_ARGS__)
+
+#if USE_DEBUG
+#define SV_FrameDPrintf(...) \
+    if (developer && developer->integer > 0) \
+        SV_FramePrintf(PRINT_DEVELOPER, __VA_ARGS__)
+#else
+#define SV_FrameDPrintf(...) ((void)0)
+#endif
 
 //
 // sv_mvd.c
@@ -757,7 +783,17 @@ void SV_PrintMiscInfo(void);
 #define HAS_EFFECTS(ent) \
     ((ent)->s.modelindex || (ent)->s.effects || (ent)->s.sound || (ent)->s.event)
 
-void SV_BuildClientFrame(client_t *client);
+void SV_ClearVisCache(bool threaded);
+void SV_PvsCacheStats_f(void);
+
+typedef struct deltacache_s deltacache_t;
+
+deltacache_t *SV_CreateDeltaCache(void);
+void SV_SetDeltaCache(deltacache_t *cache);
+void SV_DeltaCacheStats_f(void);
+int SV_MaxPacketEntities(client_t *client);
+void SV_FixEntityNumbers(const game_export_t *ge);
+int SV_BuildClientFrame(client_t *client, unsigned first_entity);
 void SV_WriteFrameToClient_Default(client_t *client);
 void SV_WriteFrameToClient_Enhanced(client_t *client);
 
@@ -769,6 +805,7 @@ extern const game_export_ex_t   *gex;
 
 void SV_InitGameProgs(void);
 void SV_ShutdownGameProgs(void);
+bool SV_SeedGameRandom(uint32_t seed);
 void SV_InitEdict(edict_t *e);
 
 void PF_Pmove(pmove_t *pm);
@@ -782,6 +819,8 @@ void SV_CheckForSavegame(const mapcmd_t *cmd);
 void SV_CheckForEnhancedSavegames(void);
 void SV_RegisterSavegames(void);
 bool SV_NoSaveGames(void);
+void SV_WaitSavegame(void);
+void SV_WriteFileAsync(const char *path, const void *data, size_t len, bool compress);
 
 //============================================================
 
@@ -792,6 +831,10 @@ bool SV_NoSaveGames(void);
 void SV_ClearWorld(void);
 // called after the world model has been loaded, before linking any entities
 
+void SV_ShutdownWorld(void);
+void SV_SetAreaIndex(int num);
+// 0 selects legacy area node tree, 1 selects dynamic AABB tree
+
 void PF_UnlinkEdict(edict_t *ent);
 // call before removing an entity, and before trying to move one,
 // so it doesn't clip against itself
@@ -834,3 +877,6 @@ trace_t q_gameabi SV_Trace(const vec3_t start, const vec3_t mins,
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+void SV_TraceBatch(const tracereq_t *reqs, trace_t *results, int count);
+// same as calling SV_Trace for each request, results are identical
+
@@ -42,10 +42,85 @@ typedef struct areanode_s {
 static areanode_t   sv_areanodes[AREA_NODES];
 static int          sv_numareanodes;
 
-static const vec_t  *area_mins, *area_maxs;
-static edict_t      **area_list;
-static int          area_count, area_maxcount;
-static int          area_type;
+/*
+Dynamic AABB tree. Each solid or trigger edict is a leaf with its bounds
+enlarged by a small margin, so that entities moving a little don't need to
+be reinserted. Inner nodes bound their children and the tree is kept
+balanced by rotations. Nodes are stored in a growable array and referenced
+by index.
+*/
+typedef struct {
+    vec3_t      mins, maxs;
+    int         parent;         // next free node if unused
+    int         children[2];    // -1 for leaves
+    int         height;         // 0 for leaves, -1 for unused nodes
+    edict_t     *ent;           // only set for leaves
+} bvhnode_t;
+
+typedef struct {
+    bvhnode_t   *nodes;
+    int         numnodes;
+    int         maxnodes;
+    int         root;
+    int         freenode;
+    list_t      edicts;         // linked edicts, in no particular order
+} bvhtree_t;
+
+#define BVH_NULL        -1
+#define BVH_MARGIN      8
+#define BVH_MAX_DEPTH   64
+
+static bvhtree_t    sv_bvh[2];  // AREA_SOLID, AREA_TRIGGERS
+
+typedef struct {
+    const vec_t *mins, *maxs;
+    edict_t     **list;
+    int         count, maxcount;
+    int         type;
+} areaquery_t;
+
+typedef struct {
+    void    (*clear)(const vec3_t mins, const vec3_t maxs);
+    void    (*link)(edict_t *ent);
+    void    (*unlink)(edict_t *ent, bool relink);
+    void    (*query)(areaquery_t *q);
+} areaindex_t;
+
+// context for traces made from the main thread
+static cm_trace_t   sv_trace;
+
+// adds edict if it touches query bounds, returns false if full
+static bool SV_AreaEdictsCheck(areaquery_t *q, edict_t *check)
+{
+    if (check->solid == SOLID_NOT)
+        return true;        // deactivated
+    if (check->absmin[0] > q->maxs[0]
+        || check->absmin[1] > q->maxs[1]
+        || check->absmin[2] > q->maxs[2]
+        || check->absmax[0] < q->mins[0]
+        || check->absmax[1] < q->mins[1]
+        || check->absmax[2] < q->mins[2])
+        return true;        // not touching
+
+    if (q->count == q->maxcount) {
+        Com_WPrintf("SV_AreaEdicts: MAXCOUNT\n");
+        return false;
+    }
+
+    q->list[q->count++] = check;
+    return true;
+}
+
+static bool SV_AreaEdictsList(areaquery_t *q, const list_t *start)
+{
+    edict_t     *check;
+
+    LIST_FOR_EACH(edict_t, check, start, area)
+        if (!SV_AreaEdictsCheck(q, check))
+            return false;
+
+    return true;
+}
 
 /*
 ===============
@@ -92,6 +167,426 @@ static areanode_t *SV_CreateAreaNode(int depth, const vec3_t mins, const vec3_t
     return anode;
 }
 
+static void SV_ClearAreaTree(const vec3_t mins, const vec3_t maxs)
+{
+    memset(sv_areanodes, 0, sizeof(sv_areanodes));
+    sv_numareanodes = 0;
+
+    SV_CreateAreaNode(0, mins, maxs);
+}
+
+static void SV_LinkAreaTree(edict_t *ent)
+{
+    areanode_t *node;
+
+// find the first node that the ent's box crosses
+    node = sv_areanodes;
+    while (1) {
+        if (node->axis == -1)
+            break;
+        if (ent->absmin[node->axis] > node->dist)
+            node = node->children[0];
+        else if (ent->absmax[node->axis] < node->dist)
+            node = node->children[1];
+        else
+            break;        // crosses the node
+    }
+
+    // link it in
+    if (ent->solid == SOLID_TRIGGER)
+        List_Append(&node->trigger_edicts, &ent->area);
+    else
+        List_Append(&node->solid_edicts, &ent->area);
+}
+
+static void SV_UnlinkAreaTree(edict_t *ent, bool relink)
+{
+    List_Remove(&ent->area);
+}
+
+/*
+====================
+SV_AreaEdicts_r
+
+====================
+*/
+static void SV_AreaEdicts_r(areaquery_t *q, areanode_t *node)
+{
+    // touch linked edicts
+    if (q->type == AREA_SOLID)
+        SV_AreaEdictsList(q, &node->solid_edicts);
+    else
+        SV_AreaEdictsList(q, &node->trigger_edicts);
+
+    if (node->axis == -1)
+        return;        // terminal node
+
+    // recurse down both sides
+    if (q->maxs[node->axis] > node->dist)
+        SV_AreaEdicts_r(q, node->children[0]);
+    if (q->mins[node->axis] < node->dist)
+        SV_AreaEdicts_r(q, node->children[1]);
+}
+
+static void SV_QueryAreaTree(areaquery_t *q)
+{
+    SV_AreaEdicts_r(q, sv_areanodes);
+}
+
+static const areaindex_t sv_areatree = {
+    .clear = SV_ClearAreaTree,
+    .link = SV_LinkAreaTree,
+    .unlink = SV_UnlinkAreaTree,
+    .query = SV_QueryAreaTree,
+};
+
+static inline float BVH_Area(const vec3_t mins, const vec3_t maxs)
+{
+    float x = maxs[0] - mins[0];
+    float y = maxs[1] - mins[1];
+    float z = maxs[2] - mins[2];
+
+    return x * y + y * z + z * x;
+}
+
+static inline void BVH_Union(vec3_t mins, vec3_t maxs, const bvhnode_t *a, const bvhnode_t *b)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        mins[i] = min(a->mins[i], b->mins[i]);
+        maxs[i] = max(a->maxs[i], b->maxs[i]);
+    }
+}
+
+static inline bool BVH_Contains(const bvhnode_t *n, const vec3_t mins, const vec3_t maxs)
+{
+    return n->mins[0] <= mins[0] && n->mins[1] <= mins[1] && n->mins[2] <= mins[2] &&
+           n->maxs[0] >= maxs[0] && n->maxs[1] >= maxs[1] && n->maxs[2] >= maxs[2];
+}
+
+static int BVH_AllocNode(bvhtree_t *t)
+{
+    bvhnode_t *n;
+    int i;
+
+    if (t->freenode == BVH_NULL) {
+        // array may move, so nodes are never referenced by pointer across this
+        t->maxnodes = max(t->maxnodes * 2, 64);
+        t->nodes = Z_Realloc(t->nodes, sizeof(t->nodes[0]) * t->maxnodes);
+        for (i = t->numnodes; i < t->maxnodes; i++) {
+            t->nodes[i].parent = i + 1 < t->maxnodes ? i + 1 : BVH_NULL;
+            t->nodes[i].height = -1;
+        }
+        t->freenode = t->numnodes;
+    }
+
+    i = t->freenode;
+    n = &t->nodes[i];
+    t->freenode = n->parent;
+    t->numnodes = max(t->numnodes, i + 1);
+
+    n->parent = BVH_NULL;
+    n->children[0] = n->children[1] = BVH_NULL;
+    n->height = 0;
+    n->ent = NULL;
+    return i;
+}
+
+static void BVH_FreeNode(bvhtree_t *t, int i)
+{
+    t->nodes[i].parent = t->freenode;
+    t->nodes[i].height = -1;
+    t->freenode = i;
+}
+
+// performs left or right rotation if node A is imbalanced, returns new subtree root
+static int BVH_Balance(bvhtree_t *t, int iA)
+{
+    bvhnode_t *A = &t->nodes[iA];
+    bvhnode_t *B, *C, *F, *G, *P;
+    int iB, iC, iF, iG, balance, swap;
+
+    if (A->height < 2)
+        return iA;
+
+    iB = A->children[0];
+    iC = A->children[1];
+    B = &t->nodes[iB];
+    C = &t->nodes[iC];
+
+    balance = C->height - B->height;
+    if (balance >= -1 && balance <= 1)
+        return iA;
+
+    // rotate the taller child up, mirrored for both directions
+    if (balance < 0) {
+        swap = iB; iB = iC; iC = swap;
+        B = &t->nodes[iB];
+        C = &t->nodes[iC];
+    }
+
+    iF = C->children[0];
+    iG = C->children[1];
+    F = &t->nodes[iF];
+    G = &t->nodes[iG];
+
+    // swap A and C
+    C->children[0] = iA;
+    C->parent = A->parent;
+    A->parent = iC;
+
+    if (C->parent != BVH_NULL) {
+        P = &t->nodes[C->parent];
+        if (P->children[0] == iA)
+            P->children[0] = iC;
+        else
+            P->children[1] = iC;
+    } else {
+        t->root = iC;
+    }
+
+    // A keeps B and the shorter grandchild, C keeps A and the taller one
+    if (F->height > G->height) {
+        swap = iF; iF = iG; iG = swap;
+        F = &t->nodes[iF];
+        G = &t->nodes[iG];
+    }
+
+    C->children[1] = iG;
+    A->children[balance < 0 ? 0 : 1] = iF;
+    F->parent = iA;
+
+    BVH_Union(A->mins, A->maxs, B, F);
+    BVH_Union(C->mins, C->maxs, A, G);
+
+    A->height = 1 + max(B->height, F->height);
+    C->height = 1 + max(A->height, G->height);
+
+    return iC;
+}
+
+// walks up from the given node, fixing heights and bounds
+static void BVH_Refit(bvhtree_t *t, int i)
+{
+    bvhnode_t *n, *c0, *c1;
+
+    while (i != BVH_NULL) {
+        i = BVH_Balance(t, i);
+
+        n = &t->nodes[i];
+        c0 = &t->nodes[n->children[0]];
+        c1 = &t->nodes[n->children[1]];
+
+        n->height = 1 + max(c0->height, c1->height);
+        BVH_Union(n->mins, n->maxs, c0, c1);
+
+        i = n->parent;
+    }
+}
+
+static void BVH_InsertLeaf(bvhtree_t *t, int leaf)
+{
+    bvhnode_t *l, *n, *c;
+    vec3_t mins, maxs;
+    float area, cost, inherit, costs[2];
+    int i, j, sibling, oldparent, parent;
+
+    if (t->root == BVH_NULL) {
+        t->root = leaf;
+        t->nodes[leaf].parent = BVH_NULL;
+        return;
+    }
+
+    // find the best sibling by surface area heuristic
+    l = &t->nodes[leaf];
+    sibling = t->root;
+    while (t->nodes[sibling].height > 0) {
+        n = &t->nodes[sibling];
+
+        area = BVH_Area(n->mins, n->maxs);
+        BVH_Union(mins, maxs, n, l);
+        cost = 2 * BVH_Area(mins, maxs);
+        inherit = cost - 2 * area;
+
+        for (j = 0; j < 2; j++) {
+            c = &t->nodes[n->children[j]];
+            BVH_Union(mins, maxs, c, l);
+            costs[j] = BVH_Area(mins, maxs) + inherit;
+            if (c->height > 0)
+                costs[j] -= BVH_Area(c->mins, c->maxs);
+        }
+
+        if (cost < costs[0] && cost < costs[1])
+            break;
+
+        sibling = n->children[costs[1] < costs[0]];
+    }
+
+    // create a new parent for sibling and leaf
+    parent = BVH_AllocNode(t);
+    l = &t->nodes[leaf];
+    n = &t->nodes[parent];
+    c = &t->nodes[sibling];
+
+    oldparent = c->parent;
+    n->parent = oldparent;
+    n->children[0] = sibling;
+    n->children[1] = leaf;
+    n->height = c->height + 1;
+    BVH_Union(n->mins, n->maxs, c, l);
+    c->parent = parent;
+    l->parent = parent;
+
+    if (oldparent != BVH_NULL) {
+        i = t->nodes[oldparent].children[0] == sibling ? 0 : 1;
+        t->nodes[oldparent].children[i] = parent;
+    } else {
+        t->root = parent;
+    }
+
+    BVH_Refit(t, oldparent);
+}
+
+static void BVH_RemoveLeaf(bvhtree_t *t, int leaf)
+{
+    int parent, grandparent, sibling, i;
+
+    if (leaf == t->root) {
+        t->root = BVH_NULL;
+        return;
+    }
+
+    parent = t->nodes[leaf].parent;
+    grandparent = t->nodes[parent].parent;
+    i = t->nodes[parent].children[0] == leaf ? 1 : 0;
+    sibling = t->nodes[parent].children[i];
+
+    if (grandparent != BVH_NULL) {
+        i = t->nodes[grandparent].children[0] == parent ? 0 : 1;
+        t->nodes[grandparent].children[i] = sibling;
+        t->nodes[sibling].parent = grandparent;
+        BVH_FreeNode(t, parent);
+        BVH_Refit(t, grandparent);
+    } else {
+        t->root = sibling;
+        t->nodes[sibling].parent = BVH_NULL;
+        BVH_FreeNode(t, parent);
+    }
+}
+
+static void SV_FreeAreaBVH(void)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        Z_Free(sv_bvh[i].nodes);
+        memset(&sv_bvh[i], 0, sizeof(sv_bvh[i]));
+        sv_bvh[i].root = sv_bvh[i].freenode = BVH_NULL;
+        List_Init(&sv_bvh[i].edicts);
+    }
+}
+
+static void SV_ClearAreaBVH(const vec3_t mins, const vec3_t maxs)
+{
+    SV_FreeAreaBVH();
+}
+
+static void SV_RemoveAreaLeaf(server_entity_t *sent)
+{
+    bvhtree_t *t = &sv_bvh[sent->areatree];
+
+    BVH_RemoveLeaf(t, sent->arealeaf - 1);
+    BVH_FreeNode(t, sent->arealeaf - 1);
+    sent->arealeaf = 0;
+}
+
+static void SV_LinkAreaBVH(edict_t *ent)
+{
+    server_entity_t *sent = &sv.entities[NUM_FOR_EDICT(ent)];
+    int type = ent->solid == SOLID_TRIGGER;
+    bvhtree_t *t = &sv_bvh[type];
+    bvhnode_t *n;
+    int i, leaf;
+
+    List_Append(&t->edicts, &ent->area);
+
+    // node kept from previous link may still fit
+    if (sent->arealeaf) {
+        if (sent->areatree == type && BVH_Contains(&t->nodes[sent->arealeaf - 1], ent->absmin, ent->absmax))
+            return;
+        SV_RemoveAreaLeaf(sent);
+    }
+
+    leaf = BVH_AllocNode(t);
+    n = &t->nodes[leaf];
+    n->ent = ent;
+    for (i = 0; i < 3; i++) {
+        n->mins[i] = ent->absmin[i] - BVH_MARGIN;
+        n->maxs[i] = ent->absmax[i] + BVH_MARGIN;
+    }
+    BVH_InsertLeaf(t, leaf);
+
+    sent->arealeaf = leaf + 1;
+    sent->areatree = type;
+}
+
+static void SV_UnlinkAreaBVH(edict_t *ent, bool relink)
+{
+    server_entity_t *sent = &sv.entities[NUM_FOR_EDICT(ent)];
+
+    List_Remove(&ent->area);
+
+    // keep the leaf if entity is about to be linked again
+    if (!relink && sent->arealeaf)
+        SV_RemoveAreaLeaf(sent);
+}
+
+static void SV_QueryAreaBVH(areaquery_t *q)
+{
+    const bvhtree_t *t = &sv_bvh[q->type != AREA_SOLID];
+    const bvhnode_t *n;
+    int stack[BVH_MAX_DEPTH];
+    int depth;
+
+    if (t->root == BVH_NULL)
+        return;
+
+    stack[0] = t->root;
+    depth = 1;
+    while (depth) {
+        n = &t->nodes[stack[--depth]];
+        if (n->mins[0] > q->maxs[0] || n->mins[1] > q->maxs[1] || n->mins[2] > q->maxs[2] ||
+            n->maxs[0] < q->mins[0] || n->maxs[1] < q->mins[1] || n->maxs[2] < q->mins[2])
+            continue;
+
+        if (n->height == 0) {
+            if (!SV_AreaEdictsCheck(q, n->ent))
+                return;
+            continue;
+        }
+
+        // balanced tree of MAX_EDICTS leafs is much shallower than this
+        Q_assert(depth + 2 <= BVH_MAX_DEPTH);
+        stack[depth++] = n->children[1];
+        stack[depth++] = n->children[0];
+    }
+}
+
+static const areaindex_t sv_areabvh = {
+    .clear = SV_ClearAreaBVH,
+    .link = SV_LinkAreaBVH,
+    .unlink = SV_UnlinkAreaBVH,
+    .query = SV_QueryAreaBVH,
+};
+
+static const areaindex_t *sv_areaindex = &sv_areatree;
+
+static const areaindex_t *SV_AreaIndexForNum(int num)
+{
+    return num == 1 ? &sv_areabvh : &sv_areatree;
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -104,21 +599,84 @@ void SV_ClearWorld(void)
     edict_t *ent;
     int i;
 
-    memset(sv_areanodes, 0, sizeof(sv_areanodes));
-    sv_numareanodes = 0;
+    CM_InitTraceContext(&sv_trace);
+
+    SV_FreeAreaBVH();
+    sv_areaindex = SV_AreaIndexForNum(sv_area_index->integer);
 
     if (sv.cm.cache) {
         cm = &sv.cm.cache->models[0];
-        SV_CreateAreaNode(0, cm->mins, cm->maxs);
+        sv_areaindex->clear(cm->mins, cm->maxs);
     }
 
     // make sure all entities are unlinked
     for (i = 0; i < ge->max_edicts; i++) {
         ent = EDICT_NUM(i);
         ent->area.prev = ent->area.next = NULL;
+        sv.entities[i].arealeaf = 0;
     }
 }
 
+/*
+===============
+SV_ShutdownWorld
+
+Frees dynamically allocated area index nodes.
+===============
+*/
+void SV_ShutdownWorld(void)
+{
+    SV_FreeAreaBVH();
+}
+
+/*
+===============
+SV_SetAreaIndex
+
+Switches to another area index implementation, relinking all entities.
+Entities are relinked in number order, so order of edicts within the same
+node may differ from the original one.
+===============
+*/
+void SV_SetAreaIndex(int num)
+{
+    const areaindex_t *index = SV_AreaIndexForNum(num);
+    mmodel_t *cm;
+    edict_t *ent;
+    byte *linked;
+    int i;
+
+    if (index == sv_areaindex)
+        return;
+
+    if (!ge || !sv.cm.cache) {
+        sv_areaindex = index;
+        return;
+    }
+
+    linked = Z_Mallocz(ge->max_edicts);
+    for (i = 0; i < ge->max_edicts; i++) {
+        ent = EDICT_NUM(i);
+        if (ent->area.prev) {
+            sv_areaindex->unlink(ent, false);
+            ent->area.prev = ent->area.next = NULL;
+            linked[i] = true;
+        }
+    }
+
+    SV_FreeAreaBVH();
+
+    sv_areaindex = index;
+    cm = &sv.cm.cache->models[0];
+    sv_areaindex->clear(cm->mins, cm->maxs);
+
+    for (i = 0; i < ge->max_edicts; i++)
+        if (linked[i])
+            sv_areaindex->link(EDICT_NUM(i));
+
+    Z_Free(linked);
+}
+
 /*
 ===============
 SV_LinkEdict
@@ -230,7 +788,7 @@ void PF_UnlinkEdict(edict_t *ent)
         Com_Error(ERR_DROP, "%s: NULL", __func__);
     if (!ent->area.prev)
         return;        // not linked in anywhere
-    List_Remove(&ent->area);
+    sv_areaindex->unlink(ent, false);
     ent->area.prev = ent->area.next = NULL;
 }
 
@@ -266,7 +824,6 @@ static uint32_t SV_PackSolid32(edict_t *ent)
 
 void PF_LinkEdict(edict_t *ent)
 {
-    areanode_t *node;
     server_entity_t *sent;
     int entnum;
 #if USE_FPS
@@ -276,8 +833,13 @@ void PF_LinkEdict(edict_t *ent)
     if (!ent)
         Com_Error(ERR_DROP, "%s: NULL", __func__);
 
-    if (ent->area.prev)
-        PF_UnlinkEdict(ent);     // unlink from old position
+    // unlink from old position, area index may keep its node if entity
+    // is going to be relinked
+    if (ent->area.prev) {
+        sv_areaindex->unlink(ent, ent != ge->edicts && ent->inuse &&
+                             sv.cm.cache && ent->solid != SOLID_NOT);
+        ent->area.prev = ent->area.next = NULL;
+    }
 
     if (ent == ge->edicts)
         return;        // don't add the world
@@ -338,74 +900,10 @@ void PF_LinkEdict(edict_t *ent)
     if (ent->solid == SOLID_NOT)
         return;
 
-// find the first node that the ent's box crosses
-    node = sv_areanodes;
-    while (1) {
-        if (node->axis == -1)
-            break;
-        if (ent->absmin[node->axis] > node->dist)
-            node = node->children[0];
-        else if (ent->absmax[node->axis] < node->dist)
-            node = node->children[1];
-        else
-            break;        // crosses the node
-    }
-
-    // link it in
-    if (ent->solid == SOLID_TRIGGER)
-        List_Append(&node->trigger_edicts, &ent->area);
-    else
-        List_Append(&node->solid_edicts, &ent->area);
+    sv_areaindex->link(ent);
 }
 
 
-/*
-====================
-SV_AreaEdicts_r
-
-====================
-*/
-static void SV_AreaEdicts_r(areanode_t *node)
-{
-    list_t      *start;
-    edict_t     *check;
-
-    // touch linked edicts
-    if (area_type == AREA_SOLID)
-        start = &node->solid_edicts;
-    else
-        start = &node->trigger_edicts;
-
-    LIST_FOR_EACH(edict_t, check, start, area) {
-        if (check->solid == SOLID_NOT)
-            continue;        // deactivated
-        if (check->absmin[0] > area_maxs[0]
-            || check->absmin[1] > area_maxs[1]
-            || check->absmin[2] > area_maxs[2]
-            || check->absmax[0] < area_mins[0]
-            || check->absmax[1] < area_mins[1]
-            || check->absmax[2] < area_mins[2])
-            continue;        // not touching
-
-        if (area_count == area_maxcount) {
-            Com_WPrintf("SV_AreaEdicts: MAXCOUNT\n");
-            return;
-        }
-
-        area_list[area_count] = check;
-        area_count++;
-    }
-
-    if (node->axis == -1)
-        return;        // terminal node
-
-    // recurse down both sides
-    if (area_maxs[node->axis] > node->dist)
-        SV_AreaEdicts_r(node->children[0]);
-    if (area_mins[node->axis] < node->dist)
-        SV_AreaEdicts_r(node->children[1]);
-}
-
 /*
 ================
 SV_AreaEdicts
@@ -414,16 +912,18 @@ SV_AreaEdicts
 int SV_AreaEdicts(const vec3_t mins, const vec3_t maxs,
                   edict_t **list, int maxcount, int areatype)
 {
-    area_mins = mins;
-    area_maxs = maxs;
-    area_list = list;
-    area_count = 0;
-    area_maxcount = maxcount;
-    area_type = areatype;
+    areaquery_t q;
 
-    SV_AreaEdicts_r(sv_areanodes);
+    q.mins = mins;
+    q.maxs = maxs;
+    q.list = list;
+    q.count = 0;
+    q.maxcount = maxcount;
+    q.type = areatype;
 
-    return area_count;
+    sv_areaindex->query(&q);
+
+    return q.count;
 }
 
 
@@ -437,7 +937,7 @@ Returns a headnode that can be used for testing or clipping an
 object of mins/maxs size.
 ================
 */
-static mnode_t *SV_HullForEntity(edict_t *ent)
+static mnode_t *SV_HullForEntity(cm_trace_t *ctx, edict_t *ent)
 {
     if (ent->solid == SOLID_BSP) {
         int i = ent->s.modelindex - 1;
@@ -450,6 +950,8 @@ static mnode_t *SV_HullForEntity(edict_t *ent)
     }
 
     // create a temp hull from bounding box sizes
+    if (ctx)
+        return CM_HeadnodeForBoxEx(ctx, ent->mins, ent->maxs);
     return CM_HeadnodeForBox(ent->mins, ent->maxs);
 }
 
@@ -478,7 +980,7 @@ int SV_PointContents(const vec3_t p)
         hit = touch[i];
 
         // might intersect, so do an exact clip
-        contents |= CM_TransformedPointContents(p, SV_HullForEntity(hit),
+        contents |= CM_TransformedPointContents(p, SV_HullForEntity(NULL, hit),
                                                 hit->s.origin, hit->s.angles);
     }
 
@@ -487,20 +989,17 @@ int SV_PointContents(const vec3_t p)
 
 /*
 ====================
-SV_ClipMoveToEntities
+SV_MoveBounds
 
+Creates the bounding box of the entire move
 ====================
 */
-static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
-                                  const vec3_t maxs, const vec3_t end,
-                                  edict_t *passedict, int contentmask, trace_t *tr)
+static void SV_MoveBounds(const vec3_t start, const vec3_t mins,
+                          const vec3_t maxs, const vec3_t end,
+                          vec3_t boxmins, vec3_t boxmaxs)
 {
-    vec3_t      boxmins, boxmaxs;
-    int         i, num;
-    edict_t     *touchlist[MAX_EDICTS], *touch;
-    trace_t     trace;
+    int i;
 
-    // create the bounding box of the entire move
     for (i = 0; i < 3; i++) {
         if (end[i] > start[i]) {
             boxmins[i] = start[i] + mins[i] - 1;
@@ -510,8 +1009,26 @@ static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
             boxmaxs[i] = start[i] + maxs[i] + 1;
         }
     }
+}
 
-    num = SV_AreaEdicts(boxmins, boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+/*
+====================
+SV_ClipMoveToList
+
+Clips the move against each entity from touchlist. If boxmins/boxmaxs
+are given, entities not touching the move bounds are skipped, which
+allows touchlist to be a superset shared by several moves.
+====================
+*/
+static void SV_ClipMoveToList(cm_trace_t *ctx, edict_t **touchlist, int num,
+                              const vec3_t boxmins, const vec3_t boxmaxs,
+                              const vec3_t start, const vec3_t mins,
+                              const vec3_t maxs, const vec3_t end,
+                              edict_t *passedict, int contentmask, trace_t *tr)
+{
+    int         i;
+    edict_t     *touch;
+    trace_t     trace;
 
     // be careful, it is possible to have an entity in this
     // list removed before we get to it (killtriggered)
@@ -534,15 +1051,45 @@ static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
             && (touch->svflags & SVF_DEADMONSTER))
             continue;
 
+        if (boxmins && (touch->absmin[0] > boxmaxs[0]
+                        || touch->absmin[1] > boxmaxs[1]
+                        || touch->absmin[2] > boxmaxs[2]
+                        || touch->absmax[0] < boxmins[0]
+                        || touch->absmax[1] < boxmins[1]
+                        || touch->absmax[2] < boxmins[2]))
+            continue;        // not touching this move
+
         // might intersect, so do an exact clip
-        CM_TransformedBoxTrace(&trace, start, end, mins, maxs,
-                               SV_HullForEntity(touch), contentmask,
-                               touch->s.origin, touch->s.angles);
+        CM_TransformedBoxTraceEx(ctx, &trace, start, end, mins, maxs,
+                                 SV_HullForEntity(ctx, touch), contentmask,
+                                 touch->s.origin, touch->s.angles);
 
         CM_ClipEntity(tr, &trace, touch);
     }
 }
 
+/*
+====================
+SV_ClipMoveToEntities
+
+====================
+*/
+static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
+                                  const vec3_t maxs, const vec3_t end,
+                                  edict_t *passedict, int contentmask, trace_t *tr)
+{
+    vec3_t      boxmins, boxmaxs;
+    int         num;
+    edict_t     *touchlist[MAX_EDICTS];
+
+    SV_MoveBounds(start, mins, maxs, end, boxmins, boxmaxs);
+
+    num = SV_AreaEdicts(boxmins, boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+
+    SV_ClipMoveToList(&sv_trace, touchlist, num, NULL, NULL, start, mins, maxs,
+                      end, passedict, contentmask, tr);
+}
+
 /*
 ==================
 SV_Trace
@@ -567,7 +1114,7 @@ trace_t q_gameabi SV_Trace(const vec3_t start, const vec3_t mins,
         maxs = vec3_origin;
 
     // clip to world
-    CM_BoxTrace(&trace, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
+    CM_BoxTraceEx(&sv_trace, &trace, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
     trace.ent = ge->edicts;
     if (trace.fraction == 0) {
         return trace;   // blocked by the world
@@ -578,3 +1125,99 @@ trace_t q_gameabi SV_Trace(const vec3_t start, const vec3_t mins,
     return trace;
 }
 
+// don't let a group of batched traces grow without bound
+#define MAX_TRACE_GROUP     64
+
+static inline bool BoundsIntersect(const vec3_t mins1, const vec3_t maxs1,
+                                   const vec3_t mins2, const vec3_t maxs2)
+{
+    return mins1[0] <= maxs2[0] && mins1[1] <= maxs2[1] && mins1[2] <= maxs2[2] &&
+           maxs1[0] >= mins2[0] && maxs1[1] >= mins2[1] && maxs1[2] >= mins2[2];
+}
+
+static inline float BoundsVolume(const vec3_t mins, const vec3_t maxs)
+{
+    return (maxs[0] - mins[0]) * (maxs[1] - mins[1]) * (maxs[2] - mins[2]);
+}
+
+/*
+==================
+SV_TraceBatch
+
+Traces consecutive requests with overlapping move bounds as a group,
+making a single area query for the union of their bounds. Entities from
+the shared list are filtered by each move's own bounds, which yields the
+same set and order of entities as a separate query would.
+==================
+*/
+void SV_TraceBatch(const tracereq_t *reqs, trace_t *results, int count)
+{
+    vec3_t      groupmins, groupmaxs, boxmins, boxmaxs, unionmins, unionmaxs;
+    vec3_t      (*bounds)[2];
+    edict_t     *touchlist[MAX_EDICTS];
+    int         i, j, first, num;
+    bool        need_ents;
+
+    if (!sv.cm.cache) {
+        Com_Error(ERR_DROP, "%s: no map loaded", __func__);
+    }
+
+    if (count <= 0) {
+        return;
+    }
+
+    bounds = Z_Malloc(sizeof(bounds[0]) * count);
+    for (i = 0; i < count; i++) {
+        SV_MoveBounds(reqs[i].start, reqs[i].mins, reqs[i].maxs, reqs[i].end,
+                      bounds[i][0], bounds[i][1]);
+    }
+
+    for (first = 0; first < count; first = i) {
+        // find out how many requests can share area query
+        VectorCopy(bounds[first][0], groupmins);
+        VectorCopy(bounds[first][1], groupmaxs);
+        for (i = first + 1; i < count && i - first < MAX_TRACE_GROUP; i++) {
+            VectorCopy(bounds[i][0], boxmins);
+            VectorCopy(bounds[i][1], boxmaxs);
+            if (!BoundsIntersect(groupmins, groupmaxs, boxmins, boxmaxs))
+                break;
+            VectorCopy(groupmins, unionmins);
+            VectorCopy(groupmaxs, unionmaxs);
+            AddPointToBounds(boxmins, unionmins, unionmaxs);
+            AddPointToBounds(boxmaxs, unionmins, unionmaxs);
+            // stop when the query would cover mostly empty space
+            if (BoundsVolume(unionmins, unionmaxs) > 1.5f * max(BoundsVolume(groupmins, groupmaxs),
+                                                                BoundsVolume(boxmins, boxmaxs)))
+                break;
+            VectorCopy(unionmins, groupmins);
+            VectorCopy(unionmaxs, groupmaxs);
+        }
+
+        // clip to world
+        need_ents = false;
+        for (j = first; j < i; j++) {
+            const tracereq_t *r = &reqs[j];
+            CM_BoxTraceEx(&sv_trace, &results[j], r->start, r->end, r->mins, r->maxs,
+                          sv.cm.cache->nodes, r->contentmask);
+            results[j].ent = ge->edicts;
+            if (results[j].fraction != 0)
+                need_ents = true;
+        }
+
+        if (!need_ents)
+            continue;   // all blocked by the world
+
+        // clip to other solid entities
+        num = SV_AreaEdicts(groupmins, groupmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+        for (j = first; j < i; j++) {
+            const tracereq_t *r = &reqs[j];
+            if (results[j].fraction == 0)
+                continue;
+            SV_ClipMoveToList(&sv_trace, touchlist, num, bounds[j][0], bounds[j][1],
+                              r->start, r->mins, r->maxs, r->end,
+                              r->passent, r->contentmask, &results[j]);
+        }
+    }
+
+    Z_Free(bounds);
+}